@@ -0,0 +1,439 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include "bignum.h"
+#include "flonum.h"
+
+// Integers beyond the range of long. Arithmetic on fixnums checks for
+// overflow and only then comes here; every result that fits a long is
+// handed back as an ordinary number, so a bignum is never equal to a
+// fixnum. Magnitudes are kept in base 10^9 limbs, which makes reading and
+// printing decimal linear in the number of digits.
+#define BIG_BASE 1000000000U
+#define BIG_DIGITS 9
+#define KARATSUBA_MIN 32 // operands with fewer limbs multiply schoolbook
+
+struct Lbig {
+    int refs;
+    int sign;           // 1 or -1
+    int count;
+    uint32_t limbs[];   // least significant first, top limb nonzero
+};
+
+// A NUM or BIGNUM operand seen as sign and magnitude
+typedef struct {
+    int sign;
+    int count;
+    const uint32_t *limbs;
+    uint32_t small[3];
+} Bview;
+
+Lbig *lbig_retain(Lbig *b) {
+    __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+    return b;
+}
+
+void lbig_release(Lbig *b) {
+    if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    free(b);
+}
+
+unsigned long lbig_hash(Lbig *b) {
+    unsigned long h = 14695981039346656037UL ^ (unsigned long)b->sign;
+    for (int i = 0; i < b->count; i++) {
+        h = (h ^ b->limbs[i]) * 1099511628211UL;
+    }
+    return h;
+}
+
+int lbig_eq(Lbig *x, Lbig *y) {
+    return x->sign == y->sign && x->count == y->count &&
+           memcmp(x->limbs, y->limbs, sizeof(uint32_t) * x->count) == 0;
+}
+
+char *lbig_to_string(Lbig *b) {
+    char *out = malloc(b->count * BIG_DIGITS + 2);
+    char *p = out;
+    if (b->sign < 0) *p++ = '-';
+    p += sprintf(p, "%u", b->limbs[b->count - 1]);
+    for (int i = b->count - 2; i >= 0; i--) {
+        p += sprintf(p, "%09u", b->limbs[i]);
+    }
+    return out;
+}
+
+// Correctly rounded, by way of the decimal form
+double lbig_to_double(Lbig *b) {
+    char *digits = lbig_to_string(b);
+    double d = strtod(digits, NULL);
+    free(digits);
+    return d;
+}
+
+static int trim(const uint32_t *x, int n) {
+    while (n > 0 && x[n - 1] == 0) n--;
+    return n;
+}
+
+// Boxes a magnitude, as a fixnum whenever it fits
+static Lval *make_number(int sign, const uint32_t *limbs, int count) {
+    count = trim(limbs, count);
+    
+    unsigned long m = 0;
+    int fits = count <= 3;
+    for (int i = count - 1; fits && i >= 0; i--) {
+        fits = !__builtin_mul_overflow(m, BIG_BASE, &m) && !__builtin_add_overflow(m, limbs[i], &m);
+    }
+    if (fits && m <= (unsigned long)LONG_MAX) return lval_num(sign < 0 ? -(long)m : (long)m);
+    if (fits && sign < 0 && m == (unsigned long)LONG_MAX + 1) return lval_num(LONG_MIN);
+    
+    Lbig *b = malloc(sizeof(Lbig) + sizeof(uint32_t) * count);
+    b->refs = 1;
+    b->sign = sign;
+    b->count = count;
+    memcpy(b->limbs, limbs, sizeof(uint32_t) * count);
+    
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_BIGNUM;
+    v->big = b;
+    return v;
+}
+
+// Reads an optionally signed run of decimal digits nine at a time from
+// the least significant end
+Lval *lval_bignum(const char *digits) {
+    int sign = 1;
+    if (*digits == '-' || *digits == '+') {
+        if (*digits++ == '-') sign = -1;
+    }
+    
+    int len = strlen(digits);
+    int count = (len + BIG_DIGITS - 1) / BIG_DIGITS;
+    uint32_t *limbs = malloc(sizeof(uint32_t) * (count > 0 ? count : 1));
+    for (int i = 0; i < count; i++) {
+        int end = len - i * BIG_DIGITS;
+        int start = end > BIG_DIGITS ? end - BIG_DIGITS : 0;
+        uint32_t limb = 0;
+        for (int j = start; j < end; j++) {
+            limb = limb * 10 + (digits[j] - '0');
+        }
+        limbs[i] = limb;
+    }
+    
+    Lval *v = make_number(sign, limbs, count);
+    free(limbs);
+    return v;
+}
+
+int lval_is_number(Lval *v) {
+    return v->type == LVAL_NUM || v->type == LVAL_BIGNUM || v->type == LVAL_FLOAT;
+}
+
+static void view(Lval *v, Bview *b) {
+    if (v->type == LVAL_BIGNUM) {
+        b->sign = v->big->sign;
+        b->count = v->big->count;
+        b->limbs = v->big->limbs;
+        return;
+    }
+    
+    b->sign = v->num < 0 ? -1 : 1;
+    unsigned long m = v->num < 0 ? -(unsigned long)v->num : (unsigned long)v->num;
+    b->count = 0;
+    while (m > 0) {
+        b->small[b->count++] = m % BIG_BASE;
+        m /= BIG_BASE;
+    }
+    b->limbs = b->small;
+}
+
+static int mag_cmp(const uint32_t *a, int na, const uint32_t *b, int nb) {
+    if (na != nb) return na < nb ? -1 : 1;
+    for (int i = na - 1; i >= 0; i--) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// out has room for one limb more than the longer input
+static int mag_add(const uint32_t *a, int na, const uint32_t *b, int nb, uint32_t *out) {
+    if (na < nb) {
+        const uint32_t *t = a;
+        a = b;
+        b = t;
+        int n = na;
+        na = nb;
+        nb = n;
+    }
+    
+    uint32_t carry = 0;
+    for (int i = 0; i < na; i++) {
+        uint32_t s = a[i] + (i < nb ? b[i] : 0) + carry;
+        carry = s >= BIG_BASE;
+        out[i] = carry ? s - BIG_BASE : s;
+    }
+    out[na] = carry;
+    return trim(out, na + 1);
+}
+
+// a - b for a >= b; out may be a
+static int mag_sub(const uint32_t *a, int na, const uint32_t *b, int nb, uint32_t *out) {
+    uint32_t borrow = 0;
+    for (int i = 0; i < na; i++) {
+        uint32_t d = (i < nb ? b[i] : 0) + borrow;
+        borrow = a[i] < d;
+        out[i] = borrow ? a[i] + BIG_BASE - d : a[i] - d;
+    }
+    return trim(out, na);
+}
+
+// Adds x into r from limb off on; the sum must fit in rn limbs
+static void mag_add_at(uint32_t *r, int rn, int off, const uint32_t *x, int xn) {
+    uint32_t carry = 0;
+    for (int i = 0; i < xn || carry; i++) {
+        uint32_t s = r[off + i] + (i < xn ? x[i] : 0) + carry;
+        carry = s >= BIG_BASE;
+        r[off + i] = carry ? s - BIG_BASE : s;
+        if (off + i + 1 >= rn) break;
+    }
+}
+
+static void mul_schoolbook(const uint32_t *a, int na, const uint32_t *b, int nb, uint32_t *r) {
+    for (int i = 0; i < na; i++) {
+        if (a[i] == 0) continue;
+        uint64_t carry = 0;
+        for (int j = 0; j < nb; j++) {
+            uint64_t t = (uint64_t)a[i] * b[j] + r[i + j] + carry;
+            r[i + j] = t % BIG_BASE;
+            carry = t / BIG_BASE;
+        }
+        r[i + nb] = carry;
+    }
+}
+
+// r, zeroed and na + nb limbs long, receives a * b. Balanced operands
+// above the threshold split in half and take three half-size products,
+// (a1 b1, a0 b0 and (a0 + a1)(b0 + b1)) instead of four; a much longer
+// a is multiplied by b a b-sized slice at a time.
+static void mag_mul(const uint32_t *a, int na, const uint32_t *b, int nb, uint32_t *r) {
+    if (na < nb) {
+        const uint32_t *t = a;
+        a = b;
+        b = t;
+        int n = na;
+        na = nb;
+        nb = n;
+    }
+    
+    if (nb < KARATSUBA_MIN) {
+        mul_schoolbook(a, na, b, nb, r);
+        return;
+    }
+    
+    if (2 * nb <= na) {
+        uint32_t *t = malloc(sizeof(uint32_t) * 2 * nb);
+        for (int i = 0; i < na; i += nb) {
+            int len = na - i < nb ? na - i : nb;
+            memset(t, 0, sizeof(uint32_t) * (len + nb));
+            mag_mul(a + i, len, b, nb, t);
+            mag_add_at(r, na + nb, i, t, trim(t, len + nb));
+        }
+        free(t);
+        return;
+    }
+    
+    int m = na / 2;
+    mag_mul(a, m, b, m, r);
+    mag_mul(a + m, na - m, b + m, nb - m, r + 2 * m);
+    
+    int ns = na - m + 1;
+    uint32_t *buf = calloc(4 * ns, sizeof(uint32_t));
+    uint32_t *sa = buf;
+    uint32_t *sb = buf + ns;
+    uint32_t *z1 = buf + 2 * ns;
+    int nsa = mag_add(a, m, a + m, na - m, sa);
+    int nsb = mag_add(b, m, b + m, nb - m, sb);
+    mag_mul(sa, nsa, sb, nsb, z1);
+    
+    int n = trim(z1, nsa + nsb);
+    n = mag_sub(z1, n, r, trim(r, 2 * m), z1);
+    n = mag_sub(z1, n, r + 2 * m, trim(r + 2 * m, na + nb - 2 * m), z1);
+    mag_add_at(r, na + nb, m, z1, n);
+    free(buf);
+}
+
+// a = q b + r with na >= nb, b normalized; q has na - nb + 1 limbs and r
+// has nb. Long division as in Knuth's algorithm D: both operands are
+// scaled so the divisor's top limb is at least half the base, which keeps
+// each estimated quotient limb at most two too large.
+static void mag_divmod(const uint32_t *a, int na, const uint32_t *b, int nb, uint32_t *q, uint32_t *r) {
+    if (nb == 1) {
+        uint64_t rem = 0;
+        for (int i = na - 1; i >= 0; i--) {
+            uint64_t cur = rem * BIG_BASE + a[i];
+            q[i] = cur / b[0];
+            rem = cur % b[0];
+        }
+        r[0] = rem;
+        return;
+    }
+    
+    uint32_t d = BIG_BASE / (b[nb - 1] + 1);
+    uint32_t *u = calloc(na + 1, sizeof(uint32_t));
+    uint32_t *v = calloc(nb + 1, sizeof(uint32_t));
+    mul_schoolbook(a, na, &d, 1, u);
+    mul_schoolbook(b, nb, &d, 1, v);
+    
+    for (int j = na - nb; j >= 0; j--) {
+        uint64_t num = (uint64_t)u[j + nb] * BIG_BASE + u[j + nb - 1];
+        uint64_t qhat = num / v[nb - 1];
+        uint64_t rhat = num % v[nb - 1];
+        while (qhat >= BIG_BASE || qhat * v[nb - 2] > rhat * BIG_BASE + u[j + nb - 2]) {
+            qhat--;
+            rhat += v[nb - 1];
+            if (rhat >= BIG_BASE) break;
+        }
+        
+        uint64_t carry = 0;
+        int64_t borrow = 0;
+        for (int i = 0; i < nb; i++) {
+            uint64_t p = qhat * v[i] + carry;
+            carry = p / BIG_BASE;
+            int64_t t = (int64_t)u[i + j] - (int64_t)(p % BIG_BASE) - borrow;
+            borrow = t < 0;
+            u[i + j] = borrow ? t + BIG_BASE : t;
+        }
+        int64_t t = (int64_t)u[j + nb] - (int64_t)carry - borrow;
+        borrow = t < 0;
+        u[j + nb] = borrow ? t + BIG_BASE : t;
+        
+        // The estimate was one too large: add the divisor back
+        if (borrow) {
+            qhat--;
+            uint32_t c = 0;
+            for (int i = 0; i < nb; i++) {
+                uint32_t s = u[i + j] + v[i] + c;
+                c = s >= BIG_BASE;
+                u[i + j] = c ? s - BIG_BASE : s;
+            }
+            u[j + nb] = (u[j + nb] + c) % BIG_BASE;
+        }
+        q[j] = qhat;
+    }
+    
+    uint64_t rem = 0;
+    for (int i = nb - 1; i >= 0; i--) {
+        uint64_t cur = rem * BIG_BASE + u[i];
+        r[i] = cur / d;
+        rem = cur % d;
+    }
+    free(u);
+    free(v);
+}
+
+// Fixnum arithmetic for +, -, *, / and %; returns 0 when the result does
+// not fit a long. y is nonzero for / and %.
+int lnum_op(char *op, long x, long y, long *out) {
+    switch (op[0]) {
+        case '+': return !__builtin_add_overflow(x, y, out);
+        case '-': return !__builtin_sub_overflow(x, y, out);
+        case '*': return !__builtin_mul_overflow(x, y, out);
+        case '/':
+            if (x == LONG_MIN && y == -1) return 0;
+            *out = x / y;
+            return 1;
+        case '%':
+            *out = y == -1 ? 0 : x % y;
+            return 1;
+    }
+    return 0;
+}
+
+static Lval *add_signed(Bview *x, int ysign, Bview *y) {
+    uint32_t *out = malloc(sizeof(uint32_t) * ((x->count > y->count ? x->count : y->count) + 1));
+    Lval *v;
+    if (x->sign == ysign) {
+        int n = mag_add(x->limbs, x->count, y->limbs, y->count, out);
+        v = make_number(x->sign, out, n);
+    } else if (mag_cmp(x->limbs, x->count, y->limbs, y->count) >= 0) {
+        int n = mag_sub(x->limbs, x->count, y->limbs, y->count, out);
+        v = make_number(x->sign, out, n);
+    } else {
+        int n = mag_sub(y->limbs, y->count, x->limbs, x->count, out);
+        v = make_number(ysign, out, n);
+    }
+    free(out);
+    return v;
+}
+
+// x op y for numbers of any kind: exact for integers, truncating
+// division as C does, and a float when either is a float; y is nonzero
+// for / and %
+Lval *lval_num_op(char *op, Lval *x, Lval *y) {
+    long n;
+    if (x->type == LVAL_NUM && y->type == LVAL_NUM && lnum_op(op, x->num, y->num, &n)) {
+        return lval_num(n);
+    }
+    if (x->type == LVAL_FLOAT || y->type == LVAL_FLOAT) {
+        return lval_float(lfloat_op(op, lval_to_double(x), lval_to_double(y)));
+    }
+    
+    Bview bx;
+    Bview by;
+    view(x, &bx);
+    view(y, &by);
+    
+    if (op[0] == '+') return add_signed(&bx, by.sign, &by);
+    if (op[0] == '-') return add_signed(&bx, -by.sign, &by);
+    
+    if (op[0] == '*') {
+        uint32_t *out = calloc(bx.count + by.count + 1, sizeof(uint32_t));
+        mag_mul(bx.limbs, bx.count, by.limbs, by.count, out);
+        Lval *v = make_number(bx.sign * by.sign, out, bx.count + by.count);
+        free(out);
+        return v;
+    }
+    
+    if (mag_cmp(bx.limbs, bx.count, by.limbs, by.count) < 0) {
+        return op[0] == '/' ? lval_num(0) : lval_copy(x);
+    }
+    
+    uint32_t *q = calloc(bx.count - by.count + 1, sizeof(uint32_t));
+    uint32_t *r = calloc(by.count, sizeof(uint32_t));
+    mag_divmod(bx.limbs, bx.count, by.limbs, by.count, q, r);
+    Lval *v = op[0] == '/' ? make_number(bx.sign * by.sign, q, bx.count - by.count + 1)
+                           : make_number(bx.sign, r, by.count);
+    free(q);
+    free(r);
+    return v;
+}
+
+// -1, 0 or 1 as x is below, equal to or above y, or NUM_UNORDERED when
+// either is a NaN
+int lval_num_cmp(Lval *x, Lval *y) {
+    if (x->type == LVAL_NUM && y->type == LVAL_NUM) return (x->num > y->num) - (x->num < y->num);
+    if (x->type == LVAL_FLOAT || y->type == LVAL_FLOAT) {
+        return lfloat_cmp(lval_to_double(x), lval_to_double(y));
+    }
+    
+    Bview bx;
+    Bview by;
+    view(x, &bx);
+    view(y, &by);
+    if (bx.count == 0) bx.sign = 0;
+    if (by.count == 0) by.sign = 0;
+    if (bx.sign != by.sign) return bx.sign < by.sign ? -1 : 1;
+    return bx.sign * mag_cmp(bx.limbs, bx.count, by.limbs, by.count);
+}
+
+// A total order for sorting and sorted keys: as lval_num_cmp, except that
+// NaNs come after every other number and are all equal to each other
+int lval_num_order(Lval *x, Lval *y) {
+    int c = lval_num_cmp(x, y);
+    if (c != NUM_UNORDERED) return c;
+    return (x->type == LVAL_FLOAT && isnan(x->fnum)) - (y->type == LVAL_FLOAT && isnan(y->fnum));
+}
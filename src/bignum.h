@@ -0,0 +1,20 @@
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include "lval.h"
+
+Lbig *lbig_retain(Lbig *b);
+void lbig_release(Lbig *b);
+unsigned long lbig_hash(Lbig *b);
+int lbig_eq(Lbig *x, Lbig *y);
+char *lbig_to_string(Lbig *b);
+double lbig_to_double(Lbig *b);
+
+Lval *lval_bignum(const char *digits);
+int lval_is_number(Lval *v);
+int lnum_op(char *op, long x, long y, long *out);
+Lval *lval_num_op(char *op, Lval *x, Lval *y);
+int lval_num_cmp(Lval *x, Lval *y);
+int lval_num_order(Lval *x, Lval *y);
+
+#endif
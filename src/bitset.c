@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "bitset.h"
+#include "typed.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BITSET_X86 1
+#endif
+
+// A bitset holds non-negative fixnums as bits in 64-bit words, trimmed
+// so the last word is never zero and equal sets have equal words. It is
+// shared by reference count; bitset-set and bitset-clear change a set in
+// place only when the caller holds the one reference, and copy it
+// otherwise. union, intersect and difference combine whole words, and
+// popcount counts with the popcnt instruction, AVX2 running both four
+// words at a time. The level follows the typed array kernels, so
+// typed_set_simd_level caps it here too.
+#define BITSET_MAX (1L << 30) // largest member plus one
+
+struct Lbitset {
+    int refs;
+    int words;
+    int cap;
+    uint64_t *bits;
+};
+
+typedef struct {
+    void (*combine)(char op, const uint64_t *x, const uint64_t *y, uint64_t *out, int n);
+    long (*count)(const uint64_t *x, int n);
+} Bkernels;
+
+// out = x | y, x & y, or x & ~y for op '|', '&' or '-'
+static void combine_scalar(char op, const uint64_t *x, const uint64_t *y, uint64_t *out, int n) {
+    for (int i = 0; i < n; i++) {
+        out[i] = op == '|' ? x[i] | y[i] : op == '&' ? x[i] & y[i] : x[i] & ~y[i];
+    }
+}
+
+static long count_scalar(const uint64_t *x, int n) {
+    long total = 0;
+    for (int i = 0; i < n; i++) {
+        total += __builtin_popcountll(x[i]);
+    }
+    return total;
+}
+
+static const Bkernels scalar_kernels = {combine_scalar, count_scalar};
+
+#ifdef BITSET_X86
+
+__attribute__((target("sse2")))
+static void combine_sse2(char op, const uint64_t *x, const uint64_t *y, uint64_t *out, int n) {
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(x + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(y + i));
+        __m128i r = op == '|' ? _mm_or_si128(a, b) : op == '&' ? _mm_and_si128(a, b) : _mm_andnot_si128(b, a);
+        _mm_storeu_si128((__m128i *)(out + i), r);
+    }
+    combine_scalar(op, x + i, y + i, out + i, n - i);
+}
+
+__attribute__((target("popcnt")))
+static long count_popcnt(const uint64_t *x, int n) {
+    long total = 0;
+    for (int i = 0; i < n; i++) {
+        total += _mm_popcnt_u64(x[i]);
+    }
+    return total;
+}
+
+__attribute__((target("avx2")))
+static void combine_avx2(char op, const uint64_t *x, const uint64_t *y, uint64_t *out, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(x + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(y + i));
+        __m256i r = op == '|' ? _mm256_or_si256(a, b) : op == '&' ? _mm256_and_si256(a, b) :
+                    _mm256_andnot_si256(b, a);
+        _mm256_storeu_si256((__m256i *)(out + i), r);
+    }
+    combine_scalar(op, x + i, y + i, out + i, n - i);
+}
+
+// Looks up the count of each nibble with a byte shuffle and sums the
+// bytes of each word with a sum of absolute differences against zero
+__attribute__((target("avx2,popcnt")))
+static long count_avx2(const uint64_t *x, int n) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+        __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low));
+        __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+    }
+    
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    return (long)(lanes[0] + lanes[1] + lanes[2] + lanes[3]) + count_popcnt(x + i, n - i);
+}
+
+static const Bkernels sse2_kernels = {combine_sse2, count_scalar};
+static const Bkernels popcnt_kernels = {combine_sse2, count_popcnt};
+static const Bkernels avx2_kernels = {combine_avx2, count_avx2};
+
+#endif
+
+static pthread_once_t detect_once = PTHREAD_ONCE_INIT;
+static int has_popcnt = 0;
+
+static void detect_popcnt(void) {
+#ifdef BITSET_X86
+    __builtin_cpu_init();
+    has_popcnt = __builtin_cpu_supports("popcnt");
+#endif
+}
+
+static const Bkernels *kernels(void) {
+    pthread_once(&detect_once, detect_popcnt);
+#ifdef BITSET_X86
+    switch (typed_kernel_level()) {
+        case TYPED_AVX2: return has_popcnt ? &avx2_kernels : &sse2_kernels;
+        case TYPED_SSE2: return has_popcnt ? &popcnt_kernels : &sse2_kernels;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+static Lbitset *lbitset_new(int words) {
+    Lbitset *s = malloc(sizeof(Lbitset));
+    s->refs = 1;
+    s->words = words;
+    s->cap = words > 0 ? words : 1;
+    s->bits = calloc(s->cap, sizeof(uint64_t));
+    return s;
+}
+
+static Lbitset *lbitset_dup(Lbitset *s) {
+    Lbitset *d = lbitset_new(s->words);
+    memcpy(d->bits, s->bits, sizeof(uint64_t) * s->words);
+    return d;
+}
+
+Lbitset *lbitset_retain(Lbitset *s) {
+    __atomic_add_fetch(&s->refs, 1, __ATOMIC_RELAXED);
+    return s;
+}
+
+void lbitset_release(Lbitset *s) {
+    if (__atomic_sub_fetch(&s->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    free(s->bits);
+    free(s);
+}
+
+// Drops trailing zero words
+static void trim(Lbitset *s) {
+    while (s->words > 0 && s->bits[s->words - 1] == 0) s->words--;
+}
+
+// Makes room for words words, zeroing the new ones
+static void grow(Lbitset *s, int words) {
+    if (words <= s->words) return;
+    if (words > s->cap) {
+        s->cap = words > s->cap * 2 ? words : s->cap * 2;
+        s->bits = realloc(s->bits, sizeof(uint64_t) * s->cap);
+    }
+    memset(s->bits + s->words, 0, sizeof(uint64_t) * (words - s->words));
+    s->words = words;
+}
+
+unsigned long lbitset_hash(Lbitset *s) {
+    unsigned long h = (unsigned long)s->words;
+    for (int i = 0; i < s->words; i++) {
+        h = h * 1099511628211UL ^ s->bits[i];
+    }
+    return h;
+}
+
+int lbitset_eq(Lbitset *x, Lbitset *y) {
+    return x->words == y->words && memcmp(x->bits, y->bits, sizeof(uint64_t) * x->words) == 0;
+}
+
+void lbitset_print(Lbitset *s, char *out, int size) {
+    int n = snprintf(out, size, "#bits(");
+    int first = 1;
+    for (int i = 0; i < s->words && n < size; i++) {
+        for (uint64_t w = s->bits[i]; w != 0 && n < size; w &= w - 1) {
+            n += snprintf(out + n, size - n, first ? "%ld" : " %ld", (long)i * 64 + __builtin_ctzll(w));
+            first = 0;
+        }
+    }
+    if (n < size) snprintf(out + n, size - n, ")");
+}
+
+static Lval *lval_bitset(Lbitset *s) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_BITSET;
+    v->bits = s;
+    return v;
+}
+
+int bitset_handles(char *name, Lval *a) {
+    char *names[] = {"bitset", "bitset-set", "bitset-clear", "bitset-test", "union", "intersect",
+                     "difference", "popcount"};
+    for (int i = 0; i < 8; i++) {
+        if (strcmp(name, names[i]) == 0) return 1;
+    }
+    if (strcmp(name, "len") == 0 || strcmp(name, "to-list") == 0) {
+        return a->sexpr.count > 0 && a->sexpr.cell[0]->type == LVAL_BITSET;
+    }
+    return 0;
+}
+
+static Lval *bitset_err(Lval *a, char *name, char *what) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Function '%s' passed %s!", name, what);
+    lval_free(a);
+    return lval_err(msg);
+}
+
+// Reads a member: a fixnum in [0, BITSET_MAX)
+static int member_arg(Lval *x, long *out) {
+    if (x->type != LVAL_NUM || x->num < 0 || x->num >= BITSET_MAX) return 0;
+    *out = x->num;
+    return 1;
+}
+
+// (bitset x ...) or (bitset xs) of non-negative fixnums
+static Lval *bitset_build(Lval *a, char *name) {
+    Lval **items = a->sexpr.cell;
+    int n = a->sexpr.count;
+    if (n == 1 && items[0]->type == LVAL_SEXPR) {
+        n = items[0]->sexpr.count;
+        items = items[0]->sexpr.cell;
+    }
+    
+    Lbitset *s = lbitset_new(0);
+    for (int i = 0; i < n; i++) {
+        long x;
+        if (!member_arg(items[i], &x)) {
+            lbitset_release(s);
+            return bitset_err(a, name, "a value that is not a small non-negative fixnum");
+        }
+        grow(s, (int)(x / 64) + 1);
+        s->bits[x / 64] |= (uint64_t)1 << (x % 64);
+    }
+    trim(s);
+    lval_free(a);
+    return lval_bitset(s);
+}
+
+// (bitset-set s x) and (bitset-clear s x); s itself changes when the
+// call holds its only reference
+static Lval *bitset_update(Lval *a, char *name) {
+    Lval *v = a->sexpr.cell[0];
+    long x;
+    if (v->type != LVAL_BITSET) return bitset_err(a, name, "incorrect type");
+    if (!member_arg(a->sexpr.cell[1], &x)) return bitset_err(a, name, "an index out of range");
+    
+    int set = strcmp(name, "bitset-set") == 0;
+    Lbitset *s = v->bits;
+    if (!set && x / 64 >= s->words) {
+        return lval_take(a, 0);
+    }
+    if (__atomic_load_n(&s->refs, __ATOMIC_ACQUIRE) > 1) {
+        s = lbitset_dup(s);
+        lbitset_release(v->bits);
+        v->bits = s;
+    }
+    
+    if (set) {
+        grow(s, (int)(x / 64) + 1);
+        s->bits[x / 64] |= (uint64_t)1 << (x % 64);
+    } else {
+        s->bits[x / 64] &= ~((uint64_t)1 << (x % 64));
+        trim(s);
+    }
+    return lval_take(a, 0);
+}
+
+// (union s ...), (intersect s ...) and (difference s ...) fold their
+// sets from the left
+static Lval *bitset_combine(Lval *a, char *name) {
+    char op = strcmp(name, "union") == 0 ? '|' : strcmp(name, "intersect") == 0 ? '&' : '-';
+    if (a->sexpr.count == 0) return bitset_err(a, name, "incorrect number of arguments");
+    for (int i = 0; i < a->sexpr.count; i++) {
+        if (a->sexpr.cell[i]->type != LVAL_BITSET) return bitset_err(a, name, "incorrect type");
+    }
+    
+    const Bkernels *kern = kernels();
+    Lbitset *acc = lbitset_retain(a->sexpr.cell[0]->bits);
+    for (int i = 1; i < a->sexpr.count; i++) {
+        Lbitset *y = a->sexpr.cell[i]->bits;
+        int shared = acc->words < y->words ? acc->words : y->words;
+        int words = op == '|' ? (acc->words > y->words ? acc->words : y->words) :
+                    op == '&' ? shared : acc->words;
+        Lbitset *r = lbitset_new(words);
+        kern->combine(op, acc->bits, y->bits, r->bits, shared);
+        
+        // Past the shorter set, union copies the longer and difference
+        // keeps the left; intersect has nothing left
+        Lbitset *rest = acc->words > y->words ? acc : y;
+        if (op == '|' || (op == '-' && rest == acc)) {
+            memcpy(r->bits + shared, rest->bits + shared, sizeof(uint64_t) * (words - shared));
+        }
+        trim(r);
+        lbitset_release(acc);
+        acc = r;
+    }
+    lval_free(a);
+    return lval_bitset(acc);
+}
+
+Lval *builtin_bitset(Lval *a, char *name) {
+    if (strcmp(name, "bitset") == 0) return bitset_build(a, name);
+    if (strcmp(name, "union") == 0 || strcmp(name, "intersect") == 0 || strcmp(name, "difference") == 0) {
+        return bitset_combine(a, name);
+    }
+    
+    int binary = strcmp(name, "bitset-set") == 0 || strcmp(name, "bitset-clear") == 0 ||
+                 strcmp(name, "bitset-test") == 0;
+    if (a->sexpr.count != 1 + binary) return bitset_err(a, name, "incorrect number of arguments");
+    if (strcmp(name, "bitset-set") == 0 || strcmp(name, "bitset-clear") == 0) return bitset_update(a, name);
+    if (a->sexpr.cell[0]->type != LVAL_BITSET) return bitset_err(a, name, "incorrect type");
+    
+    Lbitset *s = a->sexpr.cell[0]->bits;
+    Lval *result;
+    if (strcmp(name, "bitset-test") == 0) {
+        // Any fixnum past the last word is simply absent
+        Lval *x = a->sexpr.cell[1];
+        if (x->type != LVAL_NUM || x->num < 0) return bitset_err(a, name, "an index out of range");
+        result = lval_num(x->num / 64 < s->words && (s->bits[x->num / 64] >> (x->num % 64) & 1));
+    } else if (strcmp(name, "to-list") == 0) {
+        result = lval_sexpr();
+        for (int i = 0; i < s->words; i++) {
+            for (uint64_t w = s->bits[i]; w != 0; w &= w - 1) {
+                lval_add(result, lval_num((long)i * 64 + __builtin_ctzll(w)));
+            }
+        }
+    } else {
+        // popcount, or len
+        result = lval_num(kernels()->count(s->bits, s->words));
+    }
+    lval_free(a);
+    return result;
+}
@@ -0,0 +1,16 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include "lval.h"
+#include "env.h"
+
+Lbitset *lbitset_retain(Lbitset *s);
+void lbitset_release(Lbitset *s);
+unsigned long lbitset_hash(Lbitset *s);
+int lbitset_eq(Lbitset *x, Lbitset *y);
+void lbitset_print(Lbitset *s, char *out, int size);
+
+int bitset_handles(char *name, Lval *a);
+Lval *builtin_bitset(Lval *a, char *name);
+
+#endif
@@ -0,0 +1,333 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cell.h"
+#include "eval.h"
+
+// A top-level env with reactive cells keeps a graph with one node per
+// name that matters to them: each cell, and each plain binding some cell
+// read. A cell remembers the nodes its last evaluation read through
+// lenv_get; every node remembers the cells that read it. Rebinding a
+// name marks its readers stale, transitively, without evaluating
+// anything. A stale cell is brought up to date the next time it is read,
+// and only re-evaluated if something it read actually changed value, so
+// an edit that leaves an intermediate cell's value alone stops there.
+//
+// Purity analysis treats cells as impure, so they are never read from
+// worker threads and the graph needs no lock.
+struct Lcell {
+    char *name;
+    Lval *expr;        // formula, or NULL for a plain binding
+    Lval *value;       // last result of expr, or NULL before the first read
+    int stale;         // something it read may have changed
+    int computing;     // being evaluated, for cycle detection
+    long changed_at;   // revision its value last changed at
+    long computed_at;  // revision expr was last evaluated at
+    Lcell **reads;     // nodes the last evaluation read, in first-read order
+    int read_count;
+    int read_cap;
+    Lcell **readers;   // cells whose last evaluation read this node
+    int reader_count;
+    int reader_cap;
+    Lcell *next;       // bucket chain
+};
+
+struct Lcells {
+    long revision;     // bumped on every rebinding of a node
+    int count;
+    int bucket_count;
+    Lcell **buckets;
+};
+
+// The cell being evaluated on this thread, which reads are charged to
+static __thread Lcell *cell_reading = NULL;
+static __thread Lcells *cell_graph = NULL;
+static long cells_computed = 0;
+
+static unsigned long name_hash(char *s) {
+    unsigned long h = 5381;
+    while (*s) h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+static Lcells *lcells_new(void) {
+    Lcells *g = malloc(sizeof(Lcells));
+    g->revision = 0;
+    g->count = 0;
+    g->bucket_count = 16;
+    g->buckets = calloc(g->bucket_count, sizeof(Lcell*));
+    return g;
+}
+
+void lcells_free(Lcells *g) {
+    if (g == NULL) return;
+    
+    for (int i = 0; i < g->bucket_count; i++) {
+        Lcell *c = g->buckets[i];
+        while (c) {
+            Lcell *next = c->next;
+            free(c->name);
+            if (c->expr) lval_free(c->expr);
+            if (c->value) lval_free(c->value);
+            free(c->reads);
+            free(c->readers);
+            free(c);
+            c = next;
+        }
+    }
+    free(g->buckets);
+    free(g);
+}
+
+static Lcell *lcells_find(Lcells *g, char *name) {
+    Lcell *c = g->buckets[name_hash(name) & (g->bucket_count - 1)];
+    while (c && strcmp(c->name, name) != 0) c = c->next;
+    return c;
+}
+
+static Lcell *lcells_intern(Lcells *g, char *name) {
+    Lcell *c = lcells_find(g, name);
+    if (c) return c;
+    
+    // Keep the load factor at or below one
+    if (g->count == g->bucket_count) {
+        int bucket_count = g->bucket_count * 2;
+        Lcell **buckets = calloc(bucket_count, sizeof(Lcell*));
+        for (int i = 0; i < g->bucket_count; i++) {
+            Lcell *x = g->buckets[i];
+            while (x) {
+                Lcell *next = x->next;
+                Lcell **b = &buckets[name_hash(x->name) & (bucket_count - 1)];
+                x->next = *b;
+                *b = x;
+                x = next;
+            }
+        }
+        free(g->buckets);
+        g->buckets = buckets;
+        g->bucket_count = bucket_count;
+    }
+    
+    c = calloc(1, sizeof(Lcell));
+    c->name = strdup(name);
+    Lcell **b = &g->buckets[name_hash(name) & (g->bucket_count - 1)];
+    c->next = *b;
+    *b = c;
+    g->count++;
+    return c;
+}
+
+static void push_node(Lcell ***xs, int *count, int *cap, Lcell *c) {
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 4;
+        *xs = realloc(*xs, sizeof(Lcell*) * *cap);
+    }
+    (*xs)[(*count)++] = c;
+}
+
+static void note_read(Lcell *reader, Lcell *c) {
+    for (int i = 0; i < reader->read_count; i++) {
+        if (reader->reads[i] == c) return;
+    }
+    push_node(&reader->reads, &reader->read_count, &reader->read_cap, c);
+    push_node(&c->readers, &c->reader_count, &c->reader_cap, reader);
+}
+
+// Forget what c read, ahead of re-evaluating it or dropping its formula
+static void forget_reads(Lcell *c) {
+    for (int i = 0; i < c->read_count; i++) {
+        Lcell *d = c->reads[i];
+        for (int j = 0; j < d->reader_count; j++) {
+            if (d->readers[j] == c) {
+                d->readers[j] = d->readers[--d->reader_count];
+                break;
+            }
+        }
+    }
+    c->read_count = 0;
+}
+
+static void lcell_refresh(Lenv *e, Lcells *g, Lcell *c) {
+    // Nothing to redo unless a read binding changed after the last
+    // evaluation; stale cells it read are refreshed first to find out
+    int changed = c->value == NULL;
+    for (int i = 0; i < c->read_count && !changed; i++) {
+        Lcell *d = c->reads[i];
+        if (d->computing) changed = 1;
+        else if (d->expr && d->stale) lcell_refresh(e, g, d);
+        if (d->changed_at > c->computed_at) changed = 1;
+    }
+    c->stale = 0;
+    if (!changed) return;
+    
+    forget_reads(c);
+    Lcell *outer = cell_reading;
+    Lcells *outer_graph = cell_graph;
+    cell_reading = c;
+    cell_graph = g;
+    c->computing = 1;
+    
+    Lval *v = eval_owned(e, lval_copy(c->expr));
+    
+    c->computing = 0;
+    cell_reading = outer;
+    cell_graph = outer_graph;
+    __atomic_add_fetch(&cells_computed, 1, __ATOMIC_RELAXED);
+    
+    if (c->value == NULL || !lval_eq(c->value, v)) {
+        c->changed_at = g->revision;
+    }
+    if (c->value) lval_free(c->value);
+    c->value = v;
+    c->computed_at = g->revision;
+}
+
+// Whether this thread is evaluating a cell, so its reads must all go
+// through lenv_get on this thread to be recorded
+int lcells_reading(void) {
+    return cell_reading != NULL;
+}
+
+// Called by lenv_get for every lookup that ends in e, with the bound
+// value or NULL when the name is unbound. Unbound reads are recorded
+// too, so defining the name later wakes the cells that wanted it.
+Lval *lcells_get(Lenv *e, char *sym, Lval *v) {
+    Lcells *g = e->cells;
+    Lcell *c = NULL;
+    
+    if (v && v->type == LVAL_CELL) {
+        c = v->cell;
+    }
+    if (cell_reading && cell_graph == g) {
+        note_read(cell_reading, c ? c : lcells_intern(g, sym));
+    }
+    
+    if (v == NULL) return lval_err("Unbound symbol!");
+    if (c == NULL) return lval_copy(v);
+    
+    if (c->computing) return lval_err("Cyclic cell dependency!");
+    if (c->stale) lcell_refresh(e, g, c);
+    return lval_copy(c->value);
+}
+
+// Called by lenv_put after sym is rebound to v in e
+void lcells_changed(Lenv *e, char *sym, Lval *v) {
+    Lcells *g = e->cells;
+    Lcell *c = lcells_find(g, sym);
+    if (c == NULL) return;
+    
+    // A plain def over a cell turns it back into a plain binding
+    if (c->expr && !(v->type == LVAL_CELL && v->cell == c)) {
+        forget_reads(c);
+        lval_free(c->expr);
+        c->expr = NULL;
+        if (c->value) lval_free(c->value);
+        c->value = NULL;
+        c->stale = 0;
+    }
+    
+    g->revision++;
+    c->changed_at = g->revision;
+    
+    // Mark every transitive reader stale. A reader that already is has
+    // had its own readers marked, so the walk stops there.
+    Lcell **work = NULL;
+    int count = 0;
+    int cap = 0;
+    push_node(&work, &count, &cap, c);
+    while (count > 0) {
+        Lcell *x = work[--count];
+        for (int i = 0; i < x->reader_count; i++) {
+            Lcell *r = x->readers[i];
+            if (!r->stale) {
+                r->stale = 1;
+                push_node(&work, &count, &cap, r);
+            }
+        }
+    }
+    free(work);
+}
+
+// Whether sym names a cell as seen from e, without reading it
+int lcells_bound(Lenv *e, char *sym) {
+    Lenv *root = e;
+    while (root->parent) root = root->parent;
+    if (root->cells == NULL) return 0;
+    
+    for (; e; e = e->parent) {
+        for (int i = 0; i < e->count; i++) {
+            if (strcmp(e->syms[i], sym) == 0) return e->vals[i]->type == LVAL_CELL;
+        }
+    }
+    return 0;
+}
+
+long lcells_computed(void) {
+    return __atomic_load_n(&cells_computed, __ATOMIC_RELAXED);
+}
+
+// (defcell name expr) binds name to expr, evaluated on first read and
+// again only after something it read is rebound
+Lval *builtin_defcell(Lenv *e, Lval *a) {
+    if (a->sexpr.count != 3) {
+        lval_free(a);
+        return lval_err("Function 'defcell' passed incorrect number of arguments!");
+    }
+    if (a->sexpr.cell[1]->type != LVAL_SYM) {
+        lval_free(a);
+        return lval_err("Function 'defcell' passed incorrect type!");
+    }
+    if (e->parent) {
+        lval_free(a);
+        return lval_err("Cells can only be defined at top level!");
+    }
+    
+    if (e->cells == NULL) e->cells = lcells_new();
+    Lval *sym = lval_pop(a, 1);
+    Lcell *c = lcells_intern(e->cells, sym->sym);
+    
+    forget_reads(c);
+    if (c->expr) lval_free(c->expr);
+    if (c->value) lval_free(c->value);
+    c->expr = lval_take(a, 1);
+    c->value = NULL;
+    c->stale = 1;
+    
+    Lval cell;
+    cell.type = LVAL_CELL;
+    cell.cell = c;
+    lenv_put(e, sym, &cell);
+    return sym;
+}
+
+// (cell-deps 'name) lists what name's last evaluation read and
+// (cell-dependents 'name) the cells that read name
+Lval *builtin_cell_graph(Lenv *e, Lval *a, char *name) {
+    char msg[96];
+    if (a->sexpr.count != 1) {
+        lval_free(a);
+        snprintf(msg, sizeof(msg), "Function '%s' passed incorrect number of arguments!", name);
+        return lval_err(msg);
+    }
+    if (a->sexpr.cell[0]->type != LVAL_SYM) {
+        lval_free(a);
+        snprintf(msg, sizeof(msg), "Function '%s' passed incorrect type!", name);
+        return lval_err(msg);
+    }
+    
+    while (e->parent) e = e->parent;
+    Lcell *c = e->cells ? lcells_find(e->cells, a->sexpr.cell[0]->sym) : NULL;
+    lval_free(a);
+    
+    Lval *result = lval_sexpr();
+    if (c == NULL) return result;
+    
+    int deps = strcmp(name, "cell-deps") == 0;
+    Lcell **xs = deps ? c->reads : c->readers;
+    int count = deps ? c->read_count : c->reader_count;
+    for (int i = 0; i < count; i++) {
+        lval_add(result, lval_sym(xs[i]->name));
+    }
+    return result;
+}
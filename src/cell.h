@@ -0,0 +1,17 @@
+#ifndef CELL_H
+#define CELL_H
+
+#include "lval.h"
+#include "env.h"
+
+void lcells_free(Lcells *g);
+Lval *lcells_get(Lenv *e, char *sym, Lval *v);
+void lcells_changed(Lenv *e, char *sym, Lval *v);
+int lcells_bound(Lenv *e, char *sym);
+int lcells_reading(void);
+long lcells_computed(void);
+
+Lval *builtin_defcell(Lenv *e, Lval *a);
+Lval *builtin_cell_graph(Lenv *e, Lval *a, char *name);
+
+#endif
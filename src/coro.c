@@ -0,0 +1,237 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "coro.h"
+#include "eval.h"
+
+// A coroutine runs a function on a small stack of its own, so the function
+// can stop in the middle of an ordinary recursive eval and be resumed
+// later. On x86-64 ELF targets a switch saves the callee-saved registers
+// and swaps stack pointers in a few instructions; elsewhere, and under the
+// sanitizers (which must see every stack switch), ucontext is used.
+#if defined(__x86_64__) && defined(__ELF__) && \
+    !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define CORO_ASM 1
+#else
+#include <ucontext.h>
+#endif
+
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/asan_interface.h>
+#endif
+#ifdef __SANITIZE_THREAD__
+#include <sanitizer/tsan_interface.h>
+#endif
+
+struct Lcoro {
+    char *stack;         // mmap'd, with a guard page at the low end
+#ifdef CORO_ASM
+    void *sp;            // saved stack pointer of the coroutine
+    void *caller_sp;     // saved stack pointer of whoever resumed it
+#else
+    ucontext_t ctx;
+    ucontext_t caller;
+#endif
+#ifdef __SANITIZE_THREAD__
+    void *fiber;         // ThreadSanitizer's view of the coroutine stack
+    void *caller_fiber;
+#endif
+    Lenv *env;
+    Lval *f;
+    Lval *args;
+    Lval *yielded;       // handed over by yield, taken by resume
+    Lval *error;         // kept once the function returned an error
+    int started;
+    int done;
+    int closing;         // being dropped: eval fails so the call unwinds
+    struct Lcoro *prev;  // coroutine that resumed this one, if any
+};
+
+static __thread Lcoro *coro_current = NULL;
+int lcoro_closing = 0;
+
+// Whether the coroutine running on this thread is being unwound
+int lcoro_unwinding(void) {
+    return coro_current != NULL && coro_current->closing;
+}
+
+#ifdef CORO_ASM
+// void coro_switch(void **save_sp, void *load_sp)
+__asm__(
+    ".text\n"
+    ".type lcoro_switch_asm, @function\n"
+    "lcoro_switch_asm:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size lcoro_switch_asm, .-lcoro_switch_asm\n"
+);
+void lcoro_switch_asm(void **save_sp, void *load_sp) __asm__("lcoro_switch_asm");
+#endif
+
+static void coro_to_caller(Lcoro *co) {
+#ifdef __SANITIZE_THREAD__
+    __tsan_switch_to_fiber(co->caller_fiber, 0);
+#endif
+#ifdef CORO_ASM
+    lcoro_switch_asm(&co->sp, co->caller_sp);
+#else
+    swapcontext(&co->ctx, &co->caller);
+#endif
+}
+
+static void coro_boot(void) {
+    Lcoro *co = coro_current;
+    
+    Lval *args = co->args;
+    co->args = NULL;
+    Lval *result = lval_call(co->env, co->f, args);
+    if (result->type == LVAL_ERR) {
+        co->error = result;
+    } else {
+        lval_free(result);
+    }
+    co->done = 1;
+    
+    coro_to_caller(co);
+    abort(); // A finished coroutine is never resumed
+}
+
+// e is only used to dispatch builtins, so the root env is kept rather
+// than a call frame that may be gone by the time the coroutine runs
+Lcoro *lcoro_new(Lenv *e, Lval *f, Lval *args) {
+    while (e->parent) e = e->parent;
+    
+    Lcoro *co = calloc(1, sizeof(Lcoro));
+    co->env = e;
+    co->f = f;
+    co->args = args;
+    return co;
+}
+
+static int coro_start(Lcoro *co) {
+    size_t page = 4096;
+    co->stack = mmap(NULL, CORO_STACK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (co->stack == MAP_FAILED) {
+        co->stack = NULL;
+        return 0;
+    }
+    mprotect(co->stack, page, PROT_NONE);
+
+#ifdef CORO_ASM
+    // Six saved registers, then coro_boot as the return address. The top
+    // is 16-byte aligned, so the stack is aligned as the ABI expects when
+    // coro_boot starts.
+    void **sp = (void**)(co->stack + CORO_STACK_SIZE) - 8;
+    memset(sp, 0, sizeof(void*) * 8);
+    sp[6] = (void*)coro_boot;
+    co->sp = sp;
+#else
+    getcontext(&co->ctx);
+    co->ctx.uc_stack.ss_sp = co->stack + page;
+    co->ctx.uc_stack.ss_size = CORO_STACK_SIZE - page;
+    co->ctx.uc_link = NULL;
+    makecontext(&co->ctx, coro_boot, 0);
+#endif
+#ifdef __SANITIZE_THREAD__
+    co->fiber = __tsan_create_fiber(0);
+#endif
+    co->started = 1;
+    return 1;
+}
+
+static void coro_release_stack(Lcoro *co) {
+#ifdef __SANITIZE_ADDRESS__
+    // Frames left on a stack that is never unwound stay poisoned, and the
+    // next mmap may hand out the same addresses
+    if (co->stack) __asan_unpoison_memory_region(co->stack, CORO_STACK_SIZE);
+#endif
+    if (co->stack) munmap(co->stack, CORO_STACK_SIZE);
+    co->stack = NULL;
+#ifdef __SANITIZE_THREAD__
+    if (co->fiber) __tsan_destroy_fiber(co->fiber);
+    co->fiber = NULL;
+#endif
+}
+
+// Runs co until it yields or returns. Gives back the yielded value, the
+// error the function returned, or NULL once it has finished.
+Lval *lcoro_resume(Lcoro *co) {
+    if (co->done) return co->error ? lval_copy(co->error) : NULL;
+    if (!co->started && !coro_start(co)) {
+        return lval_err("Could not allocate a generator stack!");
+    }
+    
+    co->prev = coro_current;
+    coro_current = co;
+    lenv_frames_block();
+#ifdef __SANITIZE_THREAD__
+    co->caller_fiber = __tsan_get_current_fiber();
+    __tsan_switch_to_fiber(co->fiber, 0);
+#endif
+#ifdef CORO_ASM
+    lcoro_switch_asm(&co->caller_sp, co->sp);
+#else
+    swapcontext(&co->caller, &co->ctx);
+#endif
+    lenv_frames_unblock();
+    coro_current = co->prev;
+    
+    if (co->done) {
+        coro_release_stack(co);
+        return co->error ? lval_copy(co->error) : NULL;
+    }
+    Lval *x = co->yielded;
+    co->yielded = NULL;
+    return x;
+}
+
+// A coroutine dropped while suspended is resumed once more with yield
+// and eval failing, so its call returns through the error path and every
+// frame on its stack frees what it holds before the stack goes
+void lcoro_free(Lcoro *co) {
+    if (co == NULL) return;
+    if (co->started && !co->done) {
+        co->closing = 1;
+        __atomic_add_fetch(&lcoro_closing, 1, __ATOMIC_RELAXED);
+        lval_free(lcoro_resume(co));
+        __atomic_sub_fetch(&lcoro_closing, 1, __ATOMIC_RELAXED);
+    }
+    coro_release_stack(co);
+    lval_free(co->f);
+    lval_free(co->args);
+    lval_free(co->error);
+    free(co);
+}
+
+Lval *builtin_yield(Lval *a) {
+    Lcoro *co = coro_current;
+    if (co == NULL) {
+        lval_free(a);
+        return lval_err("yield called outside a generator!");
+    }
+    if (a->sexpr.count != 1) {
+        lval_free(a);
+        return lval_err("Function 'yield' passed incorrect number of arguments!");
+    }
+    
+    co->yielded = lval_take(a, 0);
+    coro_to_caller(co);
+    if (co->closing) return lval_err("Generator was dropped!");
+    return lval_sexpr();
+}
@@ -0,0 +1,21 @@
+#ifndef CORO_H
+#define CORO_H
+
+#include "lval.h"
+#include "env.h"
+
+#define CORO_STACK_SIZE (8 * 1024 * 1024)
+
+typedef struct Lcoro Lcoro;
+
+Lcoro *lcoro_new(Lenv *e, Lval *f, Lval *args);
+Lval *lcoro_resume(Lcoro *co);
+void lcoro_free(Lcoro *co);
+Lval *builtin_yield(Lval *a);
+
+// Count of coroutines being unwound on any thread, so eval only asks
+// lcoro_unwinding while one is
+extern int lcoro_closing;
+int lcoro_unwinding(void);
+
+#endif
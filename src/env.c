@@ -4,6 +4,9 @@
 #include <string.h>
 #include "env.h"
 #include "lval.h"
+#include "eval.h"
+#include "cell.h"
+#include "reload.h"
 
 Lenv *lenv_new(void) {
     Lenv *e = malloc(sizeof(Lenv));
@@ -11,9 +14,26 @@ Lenv *lenv_new(void) {
     e->syms = NULL;
     e->vals = NULL;
     e->parent = NULL;
+    e->on_stack = 0;
+    e->borrowed = 0;
+    e->spilled = 0;
+    e->refs = 1;
+    e->fixnums = NULL;
+    e->safety = 1;
+    e->cells = NULL;
+    e->sources = NULL;
     return e;
 }
 
+// A heap env for a call or binding form, holding a reference to parent
+Lenv *lenv_child(Lenv *parent) {
+    Lenv *e = lenv_new();
+    e->parent = lenv_retain(parent);
+    return e;
+}
+
+// Frees e whatever its count; the top-level env is freed this way by its
+// owner, every other heap env through lenv_release
 void lenv_free(Lenv *e) {
     if (e == NULL) return;
     
@@ -23,14 +43,114 @@ void lenv_free(Lenv *e) {
     }
     free(e->syms);
     free(e->vals);
-    // Don't free parent - it's managed separately
+    lcells_free(e->cells);
+    lsources_free(e->sources);
+    lenv_release(e->parent);
     free(e);
 }
 
+// Stack frames are never captured and go away with lenv_pop_frame, so
+// they are not counted
+Lenv *lenv_retain(Lenv *e) {
+    if (e && !e->on_stack) __atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED);
+    return e;
+}
+
+void lenv_release(Lenv *e) {
+    if (e == NULL || e->on_stack) return;
+    if (__atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    lenv_free(e);
+}
+
+// Call frames for lambdas whose bodies cannot capture them are carved LIFO
+// from these fixed arrays instead of being malloc'd per call. When either
+// array is exhausted lenv_push_frame returns NULL and the caller falls back
+// to a heap frame. Each thread gets its own stack, so worker threads
+// evaluating arguments in parallel never contend for frames.
+#define LENV_FRAME_MAX 1024
+#define LENV_SLOT_MAX 8192
+
+static __thread Lenv frame_envs[LENV_FRAME_MAX];
+static __thread char *frame_syms[LENV_SLOT_MAX];
+static __thread Lval *frame_vals[LENV_SLOT_MAX];
+static __thread int frame_top = 0;
+static __thread int slot_top = 0;
+
+// Code running on a coroutine stack could be suspended with frames on top
+// of the caller's, breaking LIFO order, so it only gets heap frames
+static __thread int frames_blocked = 0;
+
+void lenv_frames_block(void) {
+    frames_blocked++;
+}
+
+void lenv_frames_unblock(void) {
+    frames_blocked--;
+}
+
+Lenv *lenv_push_frame(Lenv *parent, int count) {
+    if (frames_blocked || frame_top == LENV_FRAME_MAX || slot_top + count > LENV_SLOT_MAX) {
+        return NULL;
+    }
+    
+    Lenv *e = &frame_envs[frame_top++];
+    e->count = 0;
+    e->syms = &frame_syms[slot_top];
+    e->vals = &frame_vals[slot_top];
+    e->parent = parent;
+    e->on_stack = 1;
+    e->borrowed = count;
+    e->spilled = 0;
+    e->refs = 1;
+    e->cells = NULL;
+    e->sources = NULL;
+    slot_top += count;
+    return e;
+}
+
+void lenv_pop_frame(Lenv *e) {
+    // Frames are strictly LIFO, so only the top frame can be popped
+    frame_top--;
+    slot_top -= e->borrowed;
+    
+    for (int i = 0; i < e->count; i++) {
+        if (i >= e->borrowed) free(e->syms[i]);
+        lval_free(e->vals[i]);
+    }
+    if (e->spilled) {
+        free(e->syms);
+        free(e->vals);
+    }
+}
+
+// Closures must never point into the frame stack, so a lambda created
+// inside a stack frame (e.g. from a macro expansion) captures a heap copy.
+Lenv *lenv_snapshot(Lenv *e) {
+    Lenv *x = lenv_child(e->parent);
+    for (int i = 0; i < e->count; i++) {
+        Lval k;
+        k.type = LVAL_SYM;
+        k.sym = e->syms[i];
+        lenv_put(x, &k, e->vals[i]);
+    }
+    return x;
+}
+
+// A reference for a closure or promise to keep, so its defining env
+// outlives the call that made it
+Lenv *lenv_capture(Lenv *e) {
+    if (e->on_stack) {
+        return lenv_snapshot(e);
+    }
+    return lenv_retain(e);
+}
+
 Lval *lenv_get(Lenv *e, Lval *k) {
     // Search in current environment
     for (int i = 0; i < e->count; i++) {
         if (strcmp(e->syms[i], k->sym) == 0) {
+            // Reads of top-level bindings are recorded while a cell computes
+            if (e->cells) return lcells_get(e, k->sym, e->vals[i]);
             Lval *result = lval_copy(e->vals[i]);
             return result;
         }
@@ -41,20 +161,52 @@ Lval *lenv_get(Lenv *e, Lval *k) {
         return lenv_get(e->parent, k);
     }
     
+    if (e->cells) return lcells_get(e, k->sym, NULL);
     return lval_err("Unbound symbol!");
 }
 
+// Like lenv_get, but borrows the bound value rather than copying it and
+// records no cell read. For analyses that only look at what a symbol
+// names; NULL when it is unbound.
+Lval *lenv_peek(Lenv *e, char *sym) {
+    for (; e; e = e->parent) {
+        for (int i = 0; i < e->count; i++) {
+            if (strcmp(e->syms[i], sym) == 0) return e->vals[i];
+        }
+    }
+    return NULL;
+}
+
 void lenv_put(Lenv *e, Lval *k, Lval *v) {
     
     // Check if variable already exists
     for (int i = 0; i < e->count; i++) {
         if (strcmp(e->syms[i], k->sym) == 0) {
+            // Lambdas judged pure may have been calling the old function
+            if (lval_is_fun(e->vals[i]) || lval_is_fun(v)) lambda_purity_stale();
             lval_free(e->vals[i]);
             e->vals[i] = lval_copy(v);
+            if (e->cells) lcells_changed(e, k->sym, v);
             return;
         }
     }
     
+    // A stack frame only owns exactly its formals' slots, so move them to
+    // the heap before growing
+    if (e->on_stack && !e->spilled) {
+        char **syms = malloc(sizeof(char*) * e->count);
+        Lval **vals = malloc(sizeof(Lval*) * e->count);
+        memcpy(syms, e->syms, sizeof(char*) * e->count);
+        memcpy(vals, e->vals, sizeof(Lval*) * e->count);
+        e->syms = syms;
+        e->vals = vals;
+        e->spilled = 1;
+    }
+    
+    // A function bound where closures or child frames can see it may
+    // shadow one their lambdas were judged against
+    if (e->refs > 1 && lval_is_fun(v)) lambda_purity_stale();
+    
     // If not found, add new variable
     int new_count = e->count + 1;
     e->syms = realloc(e->syms, sizeof(char*) * new_count);
@@ -63,7 +215,8 @@ void lenv_put(Lenv *e, Lval *k, Lval *v) {
     strcpy(e->syms[e->count], k->sym);
     e->vals[e->count] = lval_copy(v);
     e->count = new_count;
-    
+    if (e->cells) lcells_changed(e, k->sym, v);
+
 }
 
 void lenv_add_builtins(Lenv *e) {
@@ -96,4 +249,144 @@ void lenv_add_builtins(Lenv *e) {
         lval_free(sym);
         lval_free(func);
     }
+    
+    // Typed array functions
+    char *typed_funcs[] = {"f64vector", "i64vector", "vadd", "vmul", "vdot", "vsum", "vmin", "vmax", "vmap"};
+    for (int i = 0; i < 9; i++) {
+        Lval *sym = lval_sym(typed_funcs[i]);
+        Lval *func = lval_fun(typed_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Matrix functions
+    char *matrix_funcs[] = {"matrix", "make-matrix", "matmul", "transpose", "row", "col", "submatrix",
+                            "shape", "mref"};
+    for (int i = 0; i < 9; i++) {
+        Lval *sym = lval_sym(matrix_funcs[i]);
+        Lval *func = lval_fun(matrix_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Bitset functions
+    char *bitset_funcs[] = {"bitset", "bitset-set", "bitset-clear", "bitset-test", "union", "intersect",
+                            "difference", "popcount"};
+    for (int i = 0; i < 8; i++) {
+        Lval *sym = lval_sym(bitset_funcs[i]);
+        Lval *func = lval_fun(bitset_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Math functions
+    char *math_funcs[] = {"sqrt", "exp", "log", "floor"};
+    for (int i = 0; i < 4; i++) {
+        Lval *sym = lval_sym(math_funcs[i]);
+        Lval *func = lval_fun(math_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Sorting functions
+    char *sort_funcs[] = {"sort", "sort-by"};
+    for (int i = 0; i < 2; i++) {
+        Lval *sym = lval_sym(sort_funcs[i]);
+        Lval *func = lval_fun(sort_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Vector functions
+    char *vec_funcs[] = {"vector", "make-vector", "nth", "len", "slice", "vector-set!", "vector-push!"};
+    for (int i = 0; i < 7; i++) {
+        Lval *sym = lval_sym(vec_funcs[i]);
+        Lval *func = lval_fun(vec_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Persistent vector functions
+    char *pvec_funcs[] = {"pvec", "to-pvec", "to-list"};
+    for (int i = 0; i < 3; i++) {
+        Lval *sym = lval_sym(pvec_funcs[i]);
+        Lval *func = lval_fun(pvec_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Map functions
+    char *map_funcs[] = {"hash-map", "get", "assoc", "dissoc", "contains?", "keys", "vals"};
+    for (int i = 0; i < 7; i++) {
+        Lval *sym = lval_sym(map_funcs[i]);
+        Lval *func = lval_fun(map_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Sorted map functions
+    char *sorted_funcs[] = {"sorted-map", "put", "subrange", "first", "last"};
+    for (int i = 0; i < 5; i++) {
+        Lval *sym = lval_sym(sorted_funcs[i]);
+        Lval *func = lval_fun(sorted_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Transient functions
+    char *transient_funcs[] = {"transient", "push!", "assoc!", "persistent!"};
+    for (int i = 0; i < 4; i++) {
+        Lval *sym = lval_sym(transient_funcs[i]);
+        Lval *func = lval_fun(transient_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Sequence functions
+    char *seq_funcs[] = {"map", "filter", "fold", "take", "range", "range-from",
+                         "lazy-map", "lazy-filter", "force", "generator"};
+    for (int i = 0; i < 10; i++) {
+        Lval *sym = lval_sym(seq_funcs[i]);
+        Lval *func = lval_fun(seq_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Function utilities
+    char *fun_funcs[] = {"memoize", "parallel", "values", "yield"};
+    for (int i = 0; i < 4; i++) {
+        Lval *sym = lval_sym(fun_funcs[i]);
+        Lval *func = lval_fun(fun_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
+    
+    // Source files
+    Lval *reload_sym = lval_sym("reload");
+    Lval *reload_func = lval_fun("reload");
+    lenv_put(e, reload_sym, reload_func);
+    lval_free(reload_sym);
+    lval_free(reload_func);
+    
+    // Reactive cell inspection
+    char *cell_funcs[] = {"cell-deps", "cell-dependents"};
+    for (int i = 0; i < 2; i++) {
+        Lval *sym = lval_sym(cell_funcs[i]);
+        Lval *func = lval_fun(cell_funcs[i]);
+        lenv_put(e, sym, func);
+        lval_free(sym);
+        lval_free(func);
+    }
 }
\ No newline at end of file
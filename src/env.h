@@ -3,16 +3,38 @@
 
 #include "lval.h"
 
+typedef struct Lcells Lcells;
+typedef struct Lsource Lsource;
+
 typedef struct Lenv {
     int count;
     char **syms;
     Lval **vals;
     struct Lenv *parent;
+    int on_stack;  // carved from the frame stack, released by lenv_pop_frame
+    int borrowed;  // leading syms owned by the callee's formals (stack frames)
+    int spilled;   // stack frame grew its syms/vals onto the heap
+    int refs;      // heap envs: the creator's reference plus one per closure,
+                   // promise or child env holding it
+    Lval *fixnums; // formals the running lambda declared fixnum (borrowed)
+    int safety;    // safety level of the running lambda
+    Lcells *cells; // reactive cells defined here (top level only), or NULL
+    Lsource *sources; // files loaded here with reload (top level only)
 } Lenv;
 
 Lenv *lenv_new(void);
+Lenv *lenv_child(Lenv *parent);
 void lenv_free(Lenv *e);
+Lenv *lenv_retain(Lenv *e);
+void lenv_release(Lenv *e);
+Lenv *lenv_push_frame(Lenv *parent, int count);
+void lenv_pop_frame(Lenv *e);
+void lenv_frames_block(void);
+void lenv_frames_unblock(void);
+Lenv *lenv_snapshot(Lenv *e);
+Lenv *lenv_capture(Lenv *e);
 Lval *lenv_get(Lenv *e, Lval *k);
+Lval *lenv_peek(Lenv *e, char *sym);
 void lenv_put(Lenv *e, Lval *k, Lval *v);
 void lenv_add_builtins(Lenv *e);
 
@@ -2,13 +2,43 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include "eval.h"
 #include "lval.h"
 #include "env.h"
+#include "memo.h"
+#include "pool.h"
+#include "match.h"
+#include "quote.h"
+#include "values.h"
+#include "pipeline.h"
+#include "lazy.h"
+#include "coro.h"
+#include "cell.h"
+#include "reload.h"
+#include "generic.h"
+#include "record.h"
+#include "vector.h"
+#include "pvec.h"
+#include "map.h"
+#include "transient.h"
+#include "sorted.h"
+#include "sort.h"
+#include "bignum.h"
+#include "flonum.h"
+#include "typed.h"
+#include "matrix.h"
+#include "bitset.h"
 
 Lval *eval_sexpr(Lenv *e, Lval *v);
 
 Lval *eval(Lenv *e, Lval *v) {
+    // A generator being dropped runs nothing more while it unwinds
+    if (__atomic_load_n(&lcoro_closing, __ATOMIC_RELAXED) && lcoro_unwinding() &&
+        (v->type == LVAL_SYM || v->type == LVAL_SEXPR)) {
+        if (v->type == LVAL_SEXPR) lval_free(v);
+        return lval_err("Generator was dropped!");
+    }
     if (v->type == LVAL_SYM) {
         return lenv_get(e, v);
     }
@@ -18,6 +48,17 @@ Lval *eval(Lenv *e, Lval *v) {
     return v;
 }
 
+// eval leaves a symbol with its caller; this consumes whatever it is
+// given, for callers that own the form they evaluate
+Lval *eval_owned(Lenv *e, Lval *v) {
+    if (v->type == LVAL_SYM) {
+        Lval *x = lenv_get(e, v);
+        lval_free(v);
+        return x;
+    }
+    return eval(e, v);
+}
+
 Lval *builtin_op(Lenv *e, Lval *a, char *op) {
     (void)e; // Suppress unused parameter warning
     
@@ -32,7 +73,7 @@ Lval *builtin_op(Lenv *e, Lval *a, char *op) {
     
     // Ensure all arguments are numbers
     for (int i = 0; i < a->sexpr.count; i++) {
-        if (a->sexpr.cell[i]->type != LVAL_NUM) {
+        if (!lval_is_number(a->sexpr.cell[i])) {
             lval_free(a);
             return lval_err("Cannot operate on non-number!");
         }
@@ -40,9 +81,20 @@ Lval *builtin_op(Lenv *e, Lval *a, char *op) {
     
     Lval *x = lval_pop(a, 0);
     
-    // Handle unary minus
+    // Handle unary minus, which takes -LONG_MIN out of the fixnum range
     if ((strcmp(op, "-") == 0) && a->sexpr.count == 0) {
-        x->num = -x->num;
+        long n;
+        if (x->type == LVAL_FLOAT) {
+            x->fnum = -x->fnum;
+        } else if (x->type == LVAL_NUM && lnum_op("-", 0, x->num, &n)) {
+            x->num = n;
+        } else {
+            Lval *zero = lval_num(0);
+            Lval *r = lval_num_op("-", zero, x);
+            lval_free(zero);
+            lval_free(x);
+            x = r;
+        }
     }
     
     // While there are still elements remaining
@@ -53,22 +105,26 @@ Lval *builtin_op(Lenv *e, Lval *a, char *op) {
         int result = 1; // Start with true
         
         for (int i = 0; i < a->sexpr.count; i++) {
-            Lval *y = a->sexpr.cell[i];
+            int c = lval_num_cmp(x, a->sexpr.cell[i]);
+            if (c == NUM_UNORDERED) {
+                result = 0;
+                continue;
+            }
             
             if (strcmp(op, "=") == 0) { 
-                if (x->num != y->num) result = 0;
+                if (c != 0) result = 0;
             }
             if (strcmp(op, ">") == 0) { 
-                if (x->num <= y->num) result = 0;
+                if (c <= 0) result = 0;
             }
             if (strcmp(op, "<") == 0) { 
-                if (x->num >= y->num) result = 0;
+                if (c >= 0) result = 0;
             }
             if (strcmp(op, ">=") == 0) { 
-                if (x->num < y->num) result = 0;
+                if (c < 0) result = 0;
             }
             if (strcmp(op, "<=") == 0) { 
-                if (x->num > y->num) result = 0;
+                if (c > 0) result = 0;
             }
         }
         
@@ -77,30 +133,37 @@ Lval *builtin_op(Lenv *e, Lval *a, char *op) {
         return lval_num(result);
     }
     
-    // Handle mathematical operators
+    // Handle mathematical operators; a step that overflows a fixnum, or
+    // has a bignum operand, is computed exactly and demoted if it fits.
+    // Floats accumulate in place like fixnums, with no new box per step.
     while (a->sexpr.count > 0) {
         Lval *y = lval_pop(a, 0);
+        int zero = y->type == LVAL_NUM && y->num == 0;
         
-        if (strcmp(op, "+") == 0) { x->num += y->num; }
-        if (strcmp(op, "-") == 0) { x->num -= y->num; }
-        if (strcmp(op, "*") == 0) { x->num *= y->num; }
-        if (strcmp(op, "/") == 0) { 
-            if (y->num == 0) {
-                lval_free(x);
-                lval_free(y);
-                x = lval_err("Division by zero!");
-                break;
-            }
-            x->num /= y->num; 
-        }
-        if (strcmp(op, "%") == 0) { 
-            if (y->num == 0) {
-                lval_free(x);
-                lval_free(y);
-                x = lval_err("Modulo by zero!");
-                break;
-            }
-            x->num %= y->num; 
+        if (strcmp(op, "/") == 0 && zero) {
+            lval_free(x);
+            lval_free(y);
+            x = lval_err("Division by zero!");
+            break;
+        }
+        if (strcmp(op, "%") == 0 && zero) {
+            lval_free(x);
+            lval_free(y);
+            x = lval_err("Modulo by zero!");
+            break;
+        }
+        
+        long n;
+        if (x->type == LVAL_NUM && y->type == LVAL_NUM && lnum_op(op, x->num, y->num, &n)) {
+            x->num = n;
+        } else if ((x->type == LVAL_FLOAT || y->type == LVAL_FLOAT) && x->type != LVAL_BIGNUM) {
+            double d = lfloat_op(op, lval_to_double(x), lval_to_double(y));
+            x->type = LVAL_FLOAT;
+            x->fnum = d;
+        } else {
+            Lval *r = lval_num_op(op, x, y);
+            lval_free(x);
+            x = r;
         }
         
         lval_free(y);
@@ -219,7 +282,8 @@ Lval *builtin_if(Lenv *e, Lval *a) {
     }
     
     // Evaluate condition
-    Lval *cond = eval(e, lval_pop(a, 0));
+    Lval *cond = eval_owned(e, lval_pop(a, 0));
+    values_drop();
     if (cond->type == LVAL_ERR) {
         lval_free(a);
         return cond;
@@ -240,13 +304,13 @@ Lval *builtin_if(Lenv *e, Lval *a) {
     
     if (truthy) {
         // Return then branch
-        result = eval(e, lval_pop(a, 0));
+        result = eval_owned(e, lval_pop(a, 0));
         lval_free(a);
     } else {
         // Return else branch if it exists, otherwise empty list
         if (a->sexpr.count > 1) {
             lval_free(lval_pop(a, 0)); // Remove then branch
-            result = eval(e, lval_pop(a, 0));
+            result = eval_owned(e, lval_pop(a, 0));
             lval_free(a);
         } else {
             lval_free(a);
@@ -257,23 +321,425 @@ Lval *builtin_if(Lenv *e, Lval *a) {
     return result;
 }
 
+static int lval_sym_in(Lval *list, char *sym) {
+    for (int i = 0; i < list->sexpr.count; i++) {
+        if (strcmp(list->sexpr.cell[i]->sym, sym) == 0) return 1;
+    }
+    return 0;
+}
+
+// Builtins whose result depends only on their arguments
+static int is_pure_builtin(char *name) {
+    char *pure[] = {"+", "-", "*", "/", "%", "=", ">", "<", ">=", "<=",
+                    "head", "tail", "list", "cons", "join", "values", "take",
+                    "range", "range-from", "pvec", "to-pvec", "to-list", "hash-map",
+                    "get", "assoc", "dissoc", "contains?", "keys", "vals", "sorted-map",
+                    "put", "subrange", "first", "last", "sort", "sqrt", "exp", "log", "floor",
+                    "f64vector", "i64vector", "vadd", "vmul", "vdot", "vsum", "vmin", "vmax",
+                    "matrix", "make-matrix", "matmul", "transpose", "row", "col", "submatrix",
+                    "shape", "mref", "bitset", "bitset-set", "bitset-clear", "bitset-test",
+                    "union", "intersect", "difference", "popcount"};
+    for (int i = 0; i < (int)(sizeof(pure) / sizeof(pure[0])); i++) {
+        if (strcmp(name, pure[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// A lambda's purity is judged against what its free symbols are bound to,
+// so rebinding a function moves the epoch on and every judgment made
+// before it is redone, transitively, the next time it is asked for.
+static unsigned long purity_epoch = 1;
+static int judge_depth = 0;
+static int judge_low = INT_MAX; // shallowest judgment a cycle fell back on
+
+void lambda_purity_stale(void) {
+    __atomic_add_fetch(&purity_epoch, 1, __ATOMIC_RELAXED);
+}
+
+static int lambda_judge(Lval *f) {
+    Lclosure *c = f->lambda.closure;
+    unsigned long epoch = __atomic_load_n(&purity_epoch, __ATOMIC_RELAXED);
+    
+    if (c->declared || __atomic_load_n(&c->judged, __ATOMIC_ACQUIRE) == epoch) return c->pure;
+    
+    // Only the evaluating thread judges; a worker asking about a stale
+    // lambda gets the safe answer instead
+    if (pool_in_worker()) return 0;
+    
+    // A cycle back to a lambda being judged assumes it pure; the answer
+    // holds only if that judgment agrees, so it is not kept until then
+    if (c->judging) {
+        if (c->judging < judge_low) judge_low = c->judging;
+        return 1;
+    }
+    
+    int outer_low = judge_low;
+    judge_low = INT_MAX;
+    c->judging = ++judge_depth;
+    int pure = lambda_is_pure(f, NULL);
+    judge_depth--;
+    
+    if (!pure || judge_low >= c->judging) {
+        // Cached results may have gone through the old definitions
+        if (c->memo && c->judged) lmemo_clear(c->memo);
+        c->pure = pure;
+        __atomic_store_n(&c->judged, epoch, __ATOMIC_RELEASE);
+        judge_low = outer_low;
+    } else if (outer_low < judge_low) {
+        judge_low = outer_low;
+    }
+    c->judging = 0;
+    return pure;
+}
+
+int lval_is_pure_fun(Lval *f) {
+    return (f->type == LVAL_FUN && is_pure_builtin(f->fun)) ||
+           (f->type == LVAL_LAMBDA && lambda_judge(f)) ||
+           f->type == LVAL_RECFN;
+}
+
+// Whether v can be applied to arguments like a function
+int lval_is_fun(Lval *v) {
+    return v->type == LVAL_FUN || v->type == LVAL_LAMBDA || v->type == LVAL_GENERIC ||
+           v->type == LVAL_RECFN;
+}
+
+// An expression is pure when every call in it goes to a pure builtin, a
+// lambda already known to be pure, or the function being defined (self),
+// and every free symbol names a function rather than mutable global data.
+// With no formals the check is made at run time against the values in e,
+// where reading a bound value is safe unless it forces deferred code.
+static int match_is_pure(Lenv *e, Lval *formals, char *self, Lval *x);
+static int quasi_is_pure(Lenv *e, Lval *formals, char *self, Lval *x, int depth);
+
+static int expr_is_pure(Lenv *e, Lval *formals, char *self, Lval *x, int head) {
+    if (x->type == LVAL_NUM) return 1;
+    
+    if (x->type == LVAL_SEXPR) {
+        if (x->sexpr.count > 0 && x->sexpr.cell[0]->type == LVAL_SEXPR) {
+            return 0; // Calls a computed function
+        }
+        if (x->sexpr.count > 1 && x->sexpr.cell[0]->type == LVAL_SYM &&
+            strcmp(x->sexpr.cell[0]->sym, "match") == 0) {
+            return match_is_pure(e, formals, self, x);
+        }
+        if (x->sexpr.count > 2 && x->sexpr.cell[0]->type == LVAL_SYM &&
+            (strcmp(x->sexpr.cell[0]->sym, "map") == 0 || strcmp(x->sexpr.cell[0]->sym, "filter") == 0 ||
+             strcmp(x->sexpr.cell[0]->sym, "fold") == 0 || strcmp(x->sexpr.cell[0]->sym, "lazy-map") == 0 ||
+             strcmp(x->sexpr.cell[0]->sym, "lazy-filter") == 0)) {
+            // As pure as the function they call
+            if (!expr_is_pure(e, formals, self, x->sexpr.cell[1], 1)) return 0;
+            for (int i = 2; i < x->sexpr.count; i++) {
+                if (!expr_is_pure(e, formals, self, x->sexpr.cell[i], 0)) return 0;
+            }
+            return 1;
+        }
+        if (x->sexpr.count == 2 && x->sexpr.cell[0]->type == LVAL_SYM &&
+            strcmp(x->sexpr.cell[0]->sym, "quote") == 0) {
+            return 1;
+        }
+        if (x->sexpr.count == 2 && x->sexpr.cell[0]->type == LVAL_SYM &&
+            strcmp(x->sexpr.cell[0]->sym, "quasiquote") == 0) {
+            return quasi_is_pure(e, formals, self, x->sexpr.cell[1], 1);
+        }
+        for (int i = 0; i < x->sexpr.count; i++) {
+            if (!expr_is_pure(e, formals, self, x->sexpr.cell[i], i == 0)) return 0;
+        }
+        return 1;
+    }
+    
+    if (x->type != LVAL_SYM) return 0;
+    
+    // Calling an argument could run anything
+    if (formals && lval_sym_in(formals, x->sym)) return !head;
+    if (self && strcmp(x->sym, self) == 0) return 1;
+    if (strcmp(x->sym, "if") == 0) return head;
+    // A cell's value changes when its inputs are rebound
+    if (lcells_bound(e, x->sym)) return 0;
+    
+    // Evaluating an unbound symbol only raises an error
+    Lval *v = lenv_peek(e, x->sym);
+    if (v == NULL) return !formals && !head;
+    return !formals && !head ? !lazy_runs_code(v) : lval_is_pure_fun(v);
+}
+
+// A match is pure when its scrutinee is and each clause body is, with the
+// pattern's variables treated like extra formals
+static int match_is_pure(Lenv *e, Lval *formals, char *self, Lval *x) {
+    if (!expr_is_pure(e, formals, self, x->sexpr.cell[1], 0)) return 0;
+    
+    for (int i = 2; i < x->sexpr.count; i++) {
+        Lval *clause = x->sexpr.cell[i];
+        if (clause->type != LVAL_SEXPR || clause->sexpr.count != 2) return 0;
+        
+        Lval *vars = formals ? lval_copy(formals) : NULL;
+        if (vars) match_pattern_vars(clause->sexpr.cell[0], vars);
+        int pure = expr_is_pure(e, vars, self, clause->sexpr.cell[1], 0);
+        lval_free(vars);
+        if (!pure) return 0;
+    }
+    return 1;
+}
+
+// A quasiquote template is pure when everything it unquotes is; unquotes
+// inside a nested quasiquote are only data until depth comes back to 1
+static int quasi_is_pure(Lenv *e, Lval *formals, char *self, Lval *x, int depth) {
+    if (x->type != LVAL_SEXPR) return 1;
+    
+    if (x->sexpr.count == 2 && x->sexpr.cell[0]->type == LVAL_SYM) {
+        char *head = x->sexpr.cell[0]->sym;
+        if (strcmp(head, "unquote") == 0 || strcmp(head, "unquote-splicing") == 0) {
+            if (depth == 1) return expr_is_pure(e, formals, self, x->sexpr.cell[1], 0);
+            return quasi_is_pure(e, formals, self, x->sexpr.cell[1], depth - 1);
+        }
+        if (strcmp(head, "quasiquote") == 0) {
+            return quasi_is_pure(e, formals, self, x->sexpr.cell[1], depth + 1);
+        }
+    }
+    
+    for (int i = 0; i < x->sexpr.count; i++) {
+        if (!quasi_is_pure(e, formals, self, x->sexpr.cell[i], depth)) return 0;
+    }
+    return 1;
+}
+
+int lambda_is_pure(Lval *f, char *self) {
+    return expr_is_pure(f->lambda.closure->env, f->lambda.formals, self, f->lambda.body, 0);
+}
+
+// Work estimate for an argument: one unit per form, plus what each call
+// into a lambda is estimated to cost. A lambda that recurses, directly or
+// not, or calls a function it was passed, does an amount of work nothing
+// here can bound, so calls into it are charged enough to cross any sane
+// threshold; one that only calls builtins is charged its body's size.
+#define PARALLEL_UNBOUNDED (1L << 20)
+
+static long parallel_threshold = 256;
+
+static long body_cost(Lenv *e, Lval *formals, Lval *x);
+
+// Cached on f's closure until a rebinding moves the purity epoch on
+static long lambda_cost(Lval *f) {
+    Lclosure *c = f->lambda.closure;
+    unsigned long epoch = __atomic_load_n(&purity_epoch, __ATOMIC_RELAXED);
+    if (c->costed == epoch) return c->cost;
+    if (c->costing) return PARALLEL_UNBOUNDED; // Reached itself again
+    
+    c->costing = 1;
+    long cost = body_cost(c->env, f->lambda.formals, f->lambda.body);
+    c->costing = 0;
+    c->cost = cost;
+    c->costed = epoch;
+    return cost;
+}
+
+// Formals are the lambda's own when costing its body, NULL for an argument
+static long body_cost(Lenv *e, Lval *formals, Lval *x) {
+    if (x->type != LVAL_SEXPR) return 0;
+    
+    long cost = 1;
+    for (int i = 0; i < x->sexpr.count && cost < PARALLEL_UNBOUNDED; i++) {
+        Lval *y = x->sexpr.cell[i];
+        if (y->type != LVAL_SYM) {
+            cost += body_cost(e, formals, y);
+        } else if (i == 0 && formals && lval_sym_in(formals, y->sym)) {
+            cost = PARALLEL_UNBOUNDED;
+        } else if (!(formals && lval_sym_in(formals, y->sym))) {
+            Lval *f = lenv_peek(e, y->sym);
+            if (f && f->type == LVAL_LAMBDA) cost += lambda_cost(f);
+        }
+    }
+    return cost < PARALLEL_UNBOUNDED ? cost : PARALLEL_UNBOUNDED;
+}
+
+void eval_set_parallel(int threads, long threshold) {
+    pool_start(threads);
+    parallel_threshold = threshold;
+}
+
+// Arguments that are forms rather than atoms, the only ones worth forking
+static int forms_in(Lval *v) {
+    int forms = 0;
+    for (int i = 1; i < v->sexpr.count; i++) {
+        if (v->sexpr.cell[i]->type == LVAL_SEXPR) forms++;
+    }
+    return forms;
+}
+
+// Evaluates the children of a call to a pure function, forking the
+// expensive arguments onto the worker pool when every argument is pure.
+// Each result lands in its own slot and the caller still scans for errors
+// afterwards, so ordering and first-error-by-position match the
+// sequential path.
+static void eval_args_parallel(Lenv *e, Lval *v) {
+    int *fork = calloc(v->sexpr.count, sizeof(int));
+    int heavy = 0;
+    
+    // Only forms are worth a task. Costing is the cheaper walk, so purity
+    // is checked only once two arguments are known to be worth forking.
+    for (int i = 1; i < v->sexpr.count; i++) {
+        if (v->sexpr.cell[i]->type == LVAL_SEXPR &&
+            body_cost(e, NULL, v->sexpr.cell[i]) >= parallel_threshold) {
+            fork[i] = 1;
+            heavy++;
+        }
+    }
+    for (int i = 1; i < v->sexpr.count && heavy >= 2; i++) {
+        if (!expr_is_pure(e, NULL, NULL, v->sexpr.cell[i], 0)) heavy = 0;
+    }
+    
+    // The caller evaluates the first heavy argument itself
+    Lbatch *b = NULL;
+    int first_heavy = -1;
+    if (heavy >= 2) {
+        b = pool_batch_new();
+        for (int i = 1; i < v->sexpr.count; i++) {
+            if (!fork[i]) continue;
+            if (first_heavy < 0) {
+                first_heavy = i;
+            } else {
+                pool_submit(b, e, &v->sexpr.cell[i]);
+            }
+        }
+    }
+    
+    for (int i = 0; i < v->sexpr.count; i++) {
+        if (!b || !fork[i] || i == first_heavy) {
+            v->sexpr.cell[i] = eval_owned(e, v->sexpr.cell[i]);
+        }
+    }
+    
+    if (b) pool_wait(b);
+    free(fork);
+}
+
+Lval *builtin_parallel(Lval *a) {
+    if (a->sexpr.count != 1 && a->sexpr.count != 2) {
+        lval_free(a);
+        return lval_err("Function 'parallel' passed incorrect number of arguments!");
+    }
+    
+    for (int i = 0; i < a->sexpr.count; i++) {
+        if (a->sexpr.cell[i]->type != LVAL_NUM || a->sexpr.cell[i]->num < 0) {
+            lval_free(a);
+            return lval_err("Function 'parallel' passed incorrect type!");
+        }
+    }
+    
+    // Resizing the pool from inside a worker would join the caller itself
+    if (pool_in_worker()) {
+        lval_free(a);
+        return lval_err("Function 'parallel' called from a worker thread!");
+    }
+    
+    long threads = a->sexpr.cell[0]->num;
+    long threshold = a->sexpr.count == 2 ? a->sexpr.cell[1]->num : parallel_threshold;
+    eval_set_parallel((int)threads, threshold);
+    
+    lval_free(a);
+    return lval_num(threads);
+}
+
+Lval *builtin_memoize(Lval *a) {
+    if (a->sexpr.count != 1 && a->sexpr.count != 2) {
+        lval_free(a);
+        return lval_err("Function 'memoize' passed incorrect number of arguments!");
+    }
+    
+    Lval *f = a->sexpr.cell[0];
+    if (f->type != LVAL_LAMBDA) {
+        lval_free(a);
+        return lval_err("Function 'memoize' passed incorrect type!");
+    }
+    if (!lval_is_pure_fun(f)) {
+        lval_free(a);
+        return lval_err("Cannot memoize impure function!");
+    }
+    
+    int capacity = MEMO_DEFAULT_SIZE;
+    if (a->sexpr.count == 2) {
+        if (a->sexpr.cell[1]->type != LVAL_NUM || a->sexpr.cell[1]->num <= 0) {
+            lval_free(a);
+            return lval_err("Memo size must be a positive number!");
+        }
+        capacity = (int)a->sexpr.cell[1]->num;
+    }
+    
+    // A fresh cache, so memoizing twice never shares stale entries
+    f = lval_pop(a, 0);
+    Lclosure *c = lval_closure_own(f);
+    lmemo_release(c->memo);
+    c->memo = lmemo_new(capacity);
+    lval_free(a);
+    return f;
+}
+
+// Applies (declare (fixnum x y ...) (safety n) (pure)) to a new lambda. Returns
+// NULL on success or an error describing the malformed declaration.
+static Lval *lambda_declare(Lval *f, Lval *decl) {
+    if (decl->type != LVAL_SEXPR || decl->sexpr.count == 0 ||
+        decl->sexpr.cell[0]->type != LVAL_SYM ||
+        strcmp(decl->sexpr.cell[0]->sym, "declare") != 0) {
+        return lval_err("Lambda declaration must be a declare form!");
+    }
+    
+    Lclosure *c = lval_closure_own(f);
+    for (int i = 1; i < decl->sexpr.count; i++) {
+        Lval *spec = decl->sexpr.cell[i];
+        if (spec->type != LVAL_SEXPR || spec->sexpr.count == 0 ||
+            spec->sexpr.cell[0]->type != LVAL_SYM) {
+            return lval_err("Invalid declaration specifier!");
+        }
+        
+        if (strcmp(spec->sexpr.cell[0]->sym, "fixnum") == 0) {
+            if (c->fixnums == NULL) {
+                c->fixnums = lval_sexpr();
+            }
+            for (int j = 1; j < spec->sexpr.count; j++) {
+                Lval *sym = spec->sexpr.cell[j];
+                if (sym->type != LVAL_SYM || !lval_sym_in(f->lambda.formals, sym->sym)) {
+                    return lval_err("Declared fixnum is not a lambda formal!");
+                }
+                lval_add(c->fixnums, lval_copy(sym));
+            }
+        } else if (strcmp(spec->sexpr.cell[0]->sym, "pure") == 0) {
+            // Trusted: lets callers memoize or parallelize what analysis cannot prove
+            c->pure = 1;
+            c->declared = 1;
+        } else if (strcmp(spec->sexpr.cell[0]->sym, "safety") == 0) {
+            if (spec->sexpr.count != 2 || spec->sexpr.cell[1]->type != LVAL_NUM ||
+                spec->sexpr.cell[1]->num < 0) {
+                return lval_err("Safety level must be a non-negative number!");
+            }
+            c->safety = spec->sexpr.cell[1]->num > 0;
+        } else {
+            return lval_err("Unknown declaration specifier!");
+        }
+    }
+    
+    return NULL;
+}
+
 Lval *builtin_lambda(Lenv *e, Lval *a) {
     // Remove the 'lambda' symbol
     Lval *lambda_sym = lval_pop(a, 0);
     lval_free(lambda_sym);
     
-    if (a->sexpr.count != 2) {
+    // An optional (declare ...) form may sit between formals and body
+    if (a->sexpr.count != 2 && a->sexpr.count != 3) {
         lval_free(a);
         return lval_err("Function 'lambda' passed incorrect number of arguments!");
     }
     
     Lval *formals = lval_pop(a, 0);
+    Lval *decl = a->sexpr.count == 2 ? lval_pop(a, 0) : NULL;
     Lval *body = lval_pop(a, 0);
     
     // Check if formals is a list of symbols
     for (int i = 0; i < formals->sexpr.count; i++) {
         if (formals->sexpr.cell[i]->type != LVAL_SYM) {
             lval_free(formals);
+            lval_free(decl);
             lval_free(body);
             lval_free(a);
             return lval_err("Lambda formals must be symbols!");
@@ -281,9 +747,22 @@ Lval *builtin_lambda(Lenv *e, Lval *a) {
     }
     
     // Create lambda with current environment
-    Lval *result = lval_lambda(formals, body, e);
+    Lenv *env = lenv_capture(e);
+    Lval *result = lval_lambda(formals, body, env);
+    lenv_release(env);
+    result->lambda.closure->pure = lambda_is_pure(result, NULL);
+    result->lambda.closure->judged = __atomic_load_n(&purity_epoch, __ATOMIC_RELAXED);
     lval_free(a);
     
+    if (decl) {
+        Lval *err = lambda_declare(result, decl);
+        lval_free(decl);
+        if (err) {
+            lval_free(result);
+            return err;
+        }
+    }
+    
     return result;
 }
 
@@ -311,14 +790,36 @@ Lval *builtin_macro(Lenv *e, Lval *a) {
     }
     
     // Create macro with current environment
-    Lval *result = lval_macro(formals, body, e);
+    Lenv *env = lenv_capture(e);
+    Lval *result = lval_macro(formals, body, env);
+    lenv_release(env);
     lval_free(a);
     
     return result;
 }
 
+static Lval *macro_expand(Lval *body, Lval *formals, Lval *args) {
+    if (body->type == LVAL_SYM) {
+        for (int i = 0; i < formals->sexpr.count; i++) {
+            if (strcmp(formals->sexpr.cell[i]->sym, body->sym) == 0) {
+                return lval_copy(args->sexpr.cell[i]);
+            }
+        }
+    }
+    
+    if (body->type == LVAL_SEXPR) {
+        Lval *x = lval_sexpr();
+        for (int i = 0; i < body->sexpr.count; i++) {
+            lval_add(x, macro_expand(body->sexpr.cell[i], formals, args));
+        }
+        return x;
+    }
+    
+    return lval_copy(body);
+}
+
 Lval *lval_call(Lenv *e, Lval *f, Lval *a) {
-      
+    
     // If it's a macro, perform macro expansion
     if (f->type == LVAL_MACRO) {
         // Check number of arguments
@@ -327,33 +828,37 @@ Lval *lval_call(Lenv *e, Lval *f, Lval *a) {
             return lval_err("Macro passed wrong number of arguments!");
         }
         
-        // Create new environment with parent set to macro's environment (or current if NULL)
-        Lenv *new_env = lenv_new();
-        new_env->parent = f->macro.env ? f->macro.env : e;
-        
-        // Bind arguments (unevaluated) to formal parameters
-        for (int i = 0; i < f->macro.formals->sexpr.count; i++) {
-            Lval *sym = f->macro.formals->sexpr.cell[i];
-            Lval *val = lval_copy(a->sexpr.cell[i]); // Make a copy of the unevaluated argument
-            lenv_put(new_env, sym, val);
-            lval_free(val); // lenv_put makes its own copy
+        if (quote_is_template(f->macro.body)) {
+            return quote_expand_macro(e, f, a);
         }
         
-        // Evaluate the macro body in the new environment to get expanded code
-        Lval *expanded = eval(new_env, f->macro.body);
-        
-        // Clean up
-        lenv_free(new_env);
+        // Expand by substituting the unevaluated arguments for the formals
+        Lval *expanded = macro_expand(f->macro.body, f->macro.formals, a);
         
-        // Always evaluate the expanded code for code-generation macros
+        // Always evaluate the expanded code for code-generation macros.
+        // eval consumes S-expressions and hands other atoms straight back,
+        // so only a symbol lookup leaves the expansion for us to free.
+        int expanded_is_sym = (expanded->type == LVAL_SYM);
         Lval *result = eval(e, expanded);
-        lval_free(expanded);
+        if (expanded_is_sym) {
+            lval_free(expanded);
+        }
         
         lval_free(a);
         
         return result;
     }
     
+    // Generic functions pick a method by the types of the arguments
+    if (f->type == LVAL_GENERIC) {
+        return lgeneric_call(e, f->generic, a);
+    }
+    
+    // Record constructors, predicates, accessors and setters
+    if (f->type == LVAL_RECFN) {
+        return lrecord_call(f, a);
+    }
+    
     // If it's a lambda function
     if (f->type == LVAL_LAMBDA) {
         // Check number of arguments
@@ -362,29 +867,120 @@ Lval *lval_call(Lenv *e, Lval *f, Lval *a) {
             return lval_err("Function passed wrong number of arguments!");
         }
         
-        // Create new environment with parent set to lambda's environment
-        Lenv *new_env = lenv_new();
-        new_env->parent = f->lambda.env;
+        // Declared fixnums are validated once here so the body can use them
+        // unboxed; safety 0 trusts the caller and skips even this check
+        if (f->lambda.closure->fixnums && f->lambda.closure->safety > 0) {
+            for (int i = 0; i < a->sexpr.count; i++) {
+                if (a->sexpr.cell[i]->type != LVAL_NUM &&
+                    lval_sym_in(f->lambda.closure->fixnums, f->lambda.formals->sexpr.cell[i]->sym)) {
+                    lval_free(a);
+                    return lval_err("Function passed non-number for declared fixnum!");
+                }
+            }
+        }
         
-        // Bind arguments to formal parameters
-        for (int i = 0; i < f->lambda.formals->sexpr.count; i++) {
-            Lval *sym = f->lambda.formals->sexpr.cell[i];
-            Lval *val = a->sexpr.cell[i]; // Use the value directly
-            lenv_put(new_env, sym, val);
+        // Memoized pure lambdas answer repeated argument lists from the cache,
+        // unless a callee has since been redefined into something impure. A
+        // cell being computed skips the lookup, since a hit would hide the
+        // reads the call makes from its dependencies.
+        Lval *memo_args = NULL;
+        if (f->lambda.closure->memo && lval_is_pure_fun(f)) {
+            Lval *hit = lcells_reading() ? NULL : lmemo_get(f->lambda.closure->memo, a);
+            if (hit) {
+                lval_free(a);
+                return hit;
+            }
+            memo_args = lval_copy(a);
         }
         
-        // Evaluate the body in the new environment
-        Lval *result = eval(new_env, f->lambda.body);
+        // Bodies that cannot capture their frame get one from the frame
+        // stack: formals are borrowed and arguments are moved in, not copied
+        Lenv *new_env = NULL;
+        if (!f->lambda.closure->escapes) {
+            new_env = lenv_push_frame(f->lambda.closure->env, a->sexpr.count);
+        }
         
-        // Clean up
+        if (new_env) {
+            for (int i = 0; i < a->sexpr.count; i++) {
+                new_env->syms[i] = f->lambda.formals->sexpr.cell[i]->sym;
+                new_env->vals[i] = a->sexpr.cell[i];
+                a->sexpr.cell[i] = NULL;
+            }
+            new_env->count = a->sexpr.count;
+        } else {
+            // Create new environment with parent set to lambda's environment
+            new_env = lenv_child(f->lambda.closure->env);
+            
+            // Bind arguments to formal parameters
+            for (int i = 0; i < f->lambda.formals->sexpr.count; i++) {
+                Lval *sym = f->lambda.formals->sexpr.cell[i];
+                Lval *val = a->sexpr.cell[i]; // Use the value directly
+                lenv_put(new_env, sym, val);
+            }
+        }
+        
+        new_env->fixnums = f->lambda.closure->fixnums;
+        new_env->safety = f->lambda.closure->safety;
+        
+        // Evaluate the body in the new environment. eval would leave a
+        // symbol with us to free, so a symbol body is just looked up.
+        Lval *body = f->lambda.body;
+        Lval *result = body->type == LVAL_SYM ? lenv_get(new_env, body) : eval(new_env, lval_copy(body));
+        
+        // Clean up; a captured frame outlives f and its declarations
+        new_env->fixnums = NULL;
         lval_free(a);
-        lenv_free(new_env);
+        if (new_env->on_stack) {
+            lenv_pop_frame(new_env);
+        } else {
+            lenv_release(new_env);
+        }
+        
+        if (memo_args) {
+            // Only the first of several values would be cached
+            if (result->type != LVAL_ERR && values_count(result) == 1) {
+                lmemo_put(f->lambda.closure->memo, memo_args, result);
+            }
+            lval_free(memo_args);
+        }
         
         return result;
     }
     
     // If it's a builtin function, handle as before
     if (f->type == LVAL_FUN) {
+        // Sequence builtins, and head, tail and cons given a sequence
+        if (lazy_handles(f->fun, a)) {
+            return builtin_lazy(e, a, f->fun);
+        }
+        // Bitset builtins, and len and to-list given a bitset
+        if (bitset_handles(f->fun, a)) {
+            return builtin_bitset(a, f->fun);
+        }
+        // Matrix builtins, and vadd, vmul, len and to-list given a matrix
+        if (matrix_handles(f->fun, a)) {
+            return builtin_matrix(a, f->fun);
+        }
+        // Typed array builtins, and nth, len and to-list given one
+        if (typed_handles(f->fun, a)) {
+            return builtin_typed(e, a, f->fun);
+        }
+        // Sorted map builtins, and the map functions given a sorted map
+        if (sorted_handles(f->fun, a)) {
+            return builtin_sorted(a, f->fun);
+        }
+        // Map builtins, and len given a map
+        if (map_handles(f->fun, a)) {
+            return builtin_map(a, f->fun);
+        }
+        // Persistent vector builtins, and list functions given one
+        if (pvec_handles(f->fun, a)) {
+            return builtin_pvec(a, f->fun);
+        }
+        // Vector builtins, and head and tail given a vector
+        if (vector_handles(f->fun, a)) {
+            return builtin_vector(a, f->fun);
+        }
         if (strcmp(f->fun, "head") == 0) {
             return builtin_head(a);
         } else if (strcmp(f->fun, "tail") == 0) {
@@ -395,6 +991,29 @@ Lval *lval_call(Lenv *e, Lval *f, Lval *a) {
             return builtin_cons(a);
         } else if (strcmp(f->fun, "join") == 0) {
             return builtin_join(a);
+        } else if (strcmp(f->fun, "memoize") == 0) {
+            return builtin_memoize(a);
+        } else if (strcmp(f->fun, "parallel") == 0) {
+            return builtin_parallel(a);
+        } else if (strcmp(f->fun, "values") == 0) {
+            return builtin_values(a);
+        } else if (strcmp(f->fun, "yield") == 0) {
+            return builtin_yield(a);
+        } else if (strcmp(f->fun, "cell-deps") == 0 || strcmp(f->fun, "cell-dependents") == 0) {
+            return builtin_cell_graph(e, a, f->fun);
+        } else if (strcmp(f->fun, "transient") == 0 || strcmp(f->fun, "push!") == 0 ||
+                   strcmp(f->fun, "assoc!") == 0 || strcmp(f->fun, "persistent!") == 0) {
+            return builtin_transient(a, f->fun);
+        } else if (strcmp(f->fun, "sort") == 0 || strcmp(f->fun, "sort-by") == 0) {
+            return builtin_sort(e, a, f->fun);
+        } else if (strcmp(f->fun, "sqrt") == 0 || strcmp(f->fun, "exp") == 0 ||
+                   strcmp(f->fun, "log") == 0 || strcmp(f->fun, "floor") == 0) {
+            return builtin_math(a, f->fun);
+        } else if (strcmp(f->fun, "reload") == 0) {
+            return builtin_reload(e, a);
+        } else if (strcmp(f->fun, "map") == 0 || strcmp(f->fun, "filter") == 0 ||
+                   strcmp(f->fun, "fold") == 0 || strcmp(f->fun, "take") == 0) {
+            return builtin_pipeline(e, a, f->fun);
         } else {
             return builtin_op(e, a, f->fun);
         }
@@ -422,16 +1041,203 @@ Lval *builtin_def(Lenv *e, Lval *a) {
         return lval_err("Function 'def' passed incorrect type!");
     }
     
-    Lval *val = eval(e, lval_pop(a, 0));
+    Lval *val = eval_owned(e, lval_pop(a, 0));
     lval_free(a);
     
+    // Checked code must not break a fixnum declaration by rebinding it
+    if (e->fixnums && e->safety > 0 && val->type != LVAL_NUM &&
+        lval_sym_in(e->fixnums, sym->sym)) {
+        lval_free(sym);
+        lval_free(val);
+        return lval_err("Cannot redefine declared fixnum with non-number!");
+    }
+    
     lenv_put(e, sym, val);
     lval_free(sym);
     
+    // Now that the name is bound, a self-recursive lambda can be judged pure
+    if (val->type == LVAL_LAMBDA) lval_is_pure_fun(val);
+    
+    return val;
+}
+
+// (def-memo name expr) binds name to (memoize expr), with expr free to
+// recurse through name so that every subcall goes through the cache
+Lval *builtin_def_memo(Lenv *e, Lval *a) {
+    lval_free(lval_pop(a, 0));
+    
+    if (a->sexpr.count != 2) {
+        lval_free(a);
+        return lval_err("Function 'def-memo' passed incorrect number of arguments!");
+    }
+    
+    Lval *sym = lval_pop(a, 0);
+    if (sym->type != LVAL_SYM) {
+        lval_free(sym);
+        lval_free(a);
+        return lval_err("Function 'def-memo' passed incorrect type!");
+    }
+    
+    Lval *val = eval_owned(e, lval_pop(a, 0));
+    lval_free(a);
+    
+    // Judged as if already bound, since memoize needs the answer first
+    if (val->type == LVAL_LAMBDA && !val->lambda.closure->declared) {
+        Lclosure *c = lval_closure_own(val);
+        c->pure = lambda_is_pure(val, sym->sym);
+        c->judged = __atomic_load_n(&purity_epoch, __ATOMIC_RELAXED);
+    }
+    
+    Lval *args = lval_sexpr();
+    lval_add(args, val);
+    val = builtin_memoize(args);
+    
+    if (val->type != LVAL_ERR) {
+        lenv_put(e, sym, val);
+    }
+    lval_free(sym);
+    
     return val;
 }
 
+static int is_fixnum_form(Lval *v) {
+    if (v->sexpr.count < 2 || v->sexpr.cell[0]->type != LVAL_SYM) return 0;
+    
+    char *ops[] = {"+", "-", "*", "/", "%", "=", ">", "<", ">=", "<="};
+    for (int i = 0; i < 10; i++) {
+        if (strcmp(v->sexpr.cell[0]->sym, ops[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static Lval *fixnum_apply(Lenv *e, Lval *v, long *out);
+
+// Reads one operand as a raw long. Literals, declared formals and nested
+// arithmetic never allocate or type-check; anything else is evaluated
+// generically and checked. Returns NULL on success, or else an error or
+// the boxed value of an operand that is not a fixnum after all.
+static Lval *fixnum_operand(Lenv *e, Lval *x, long *out) {
+    if (x->type == LVAL_NUM) {
+        *out = x->num;
+        return NULL;
+    }
+    if (x->type == LVAL_BIGNUM || x->type == LVAL_FLOAT) {
+        return lval_copy(x);
+    }
+    
+    if (x->type == LVAL_SEXPR && is_fixnum_form(x)) {
+        return fixnum_apply(e, x, out);
+    }
+    
+    if (x->type == LVAL_SYM && lval_sym_in(e->fixnums, x->sym)) {
+        for (int i = 0; i < e->count; i++) {
+            if (strcmp(e->syms[i], x->sym) == 0) {
+                *out = e->vals[i]->num;
+                return NULL;
+            }
+        }
+    }
+    
+    Lval *r;
+    if (x->type == LVAL_SYM) {
+        r = lenv_get(e, x);
+    } else if (x->type == LVAL_SEXPR) {
+        r = eval(e, lval_copy(x));
+    } else {
+        return lval_err("Cannot operate on non-number!");
+    }
+    
+    if (r->type == LVAL_ERR || r->type == LVAL_BIGNUM || r->type == LVAL_FLOAT) return r;
+    if (r->type != LVAL_NUM) {
+        lval_free(r);
+        return lval_err("Cannot operate on non-number!");
+    }
+    *out = r->num;
+    lval_free(r);
+    return NULL;
+}
+
+// Once a value leaves the fixnum range the rest of the form goes through
+// builtin_op boxed: args holds the operands so far, and the comparison
+// result so far is folded into the final one
+static Lval *fixnum_spill(Lenv *e, Lval *v, int next, Lval *args, int result) {
+    for (int i = next; i < v->sexpr.count; i++) {
+        Lval *y = eval_owned(e, lval_copy(v->sexpr.cell[i]));
+        if (y->type == LVAL_ERR) {
+            lval_free(args);
+            return y;
+        }
+        lval_add(args, y);
+    }
+    
+    Lval *r = builtin_op(e, args, v->sexpr.cell[0]->sym);
+    if (!result && r->type == LVAL_NUM) r->num = 0;
+    return r;
+}
+
+// Same semantics as builtin_op, computed without boxing any operand while
+// every value stays a fixnum. Returns NULL with the result in out, or else
+// an error or a boxed result.
+static Lval *fixnum_apply(Lenv *e, Lval *v, long *out) {
+    char *op = v->sexpr.cell[0]->sym;
+    long x, y;
+    
+    Lval *err = fixnum_operand(e, v->sexpr.cell[1], &x);
+    if (err) {
+        if (err->type == LVAL_ERR) return err;
+        return fixnum_spill(e, v, 2, lval_add(lval_sexpr(), err), 1);
+    }
+    
+    if (strcmp(op, "-") == 0 && v->sexpr.count == 2) {
+        if (x == LONG_MIN) return fixnum_spill(e, v, 2, lval_add(lval_sexpr(), lval_num(x)), 1);
+        *out = -x;
+        return NULL;
+    }
+    
+    int compare = strcmp(op, "=") == 0 || strcmp(op, ">") == 0 || strcmp(op, "<") == 0 ||
+                  strcmp(op, ">=") == 0 || strcmp(op, "<=") == 0;
+    int result = 1;
+    
+    for (int i = 2; i < v->sexpr.count; i++) {
+        err = fixnum_operand(e, v->sexpr.cell[i], &y);
+        if (err && err->type == LVAL_ERR) return err;
+        if (err) {
+            Lval *args = lval_add(lval_sexpr(), lval_num(x));
+            return fixnum_spill(e, v, i + 1, lval_add(args, err), result);
+        }
+        
+        if (compare) {
+            if (strcmp(op, "=") == 0 && x != y) result = 0;
+            if (strcmp(op, ">") == 0 && x <= y) result = 0;
+            if (strcmp(op, "<") == 0 && x >= y) result = 0;
+            if (strcmp(op, ">=") == 0 && x < y) result = 0;
+            if (strcmp(op, "<=") == 0 && x > y) result = 0;
+            continue;
+        }
+        
+        if (y == 0 && strcmp(op, "/") == 0) return lval_err("Division by zero!");
+        if (y == 0 && strcmp(op, "%") == 0) return lval_err("Modulo by zero!");
+        long n;
+        if (!lnum_op(op, x, y, &n)) {
+            Lval *args = lval_add(lval_sexpr(), lval_num(x));
+            return fixnum_spill(e, v, i + 1, lval_add(args, lval_num(y)), 1);
+        }
+        x = n;
+    }
+    
+    *out = compare ? result : x;
+    return NULL;
+}
+
 Lval *eval_sexpr(Lenv *e, Lval *v) {
+    // Arithmetic inside a lambda with fixnum declarations stays unboxed
+    if (e->fixnums && is_fixnum_form(v)) {
+        long x;
+        Lval *boxed = fixnum_apply(e, v, &x);
+        lval_free(v);
+        return boxed ? boxed : lval_num(x);
+    }
+    
     // Check for special forms before evaluating children
     if (v->sexpr.count > 0) {
         Lval *first = v->sexpr.cell[0];
@@ -439,6 +1245,39 @@ Lval *eval_sexpr(Lenv *e, Lval *v) {
             if (strcmp(first->sym, "def") == 0) {
                 return builtin_def(e, v);
             }
+            if (strcmp(first->sym, "def-memo") == 0) {
+                return builtin_def_memo(e, v);
+            }
+            if (strcmp(first->sym, "defcell") == 0) {
+                return builtin_defcell(e, v);
+            }
+            if (strcmp(first->sym, "defgeneric") == 0) {
+                return builtin_defgeneric(e, v);
+            }
+            if (strcmp(first->sym, "defmethod") == 0) {
+                return builtin_defmethod(e, v);
+            }
+            if (strcmp(first->sym, "defstruct") == 0) {
+                return builtin_defstruct(e, v);
+            }
+            if (strcmp(first->sym, "match") == 0) {
+                return builtin_match(e, v);
+            }
+            if (strcmp(first->sym, "quote") == 0) {
+                return builtin_quote(e, v);
+            }
+            if (strcmp(first->sym, "quasiquote") == 0) {
+                return builtin_quasiquote(e, v);
+            }
+            if (strcmp(first->sym, "delay") == 0) {
+                return builtin_delay(e, v);
+            }
+            if (strcmp(first->sym, "lazy-seq") == 0) {
+                return builtin_lazy_seq(e, v);
+            }
+            if (strcmp(first->sym, "let-values") == 0) {
+                return builtin_let_values(e, v);
+            }
             if (strcmp(first->sym, "if") == 0) {
                 return builtin_if(e, v);
             }
@@ -451,21 +1290,33 @@ Lval *eval_sexpr(Lenv *e, Lval *v) {
         }
     }
     
+    // Nested map/filter/fold/take calls run as one pass over the source
+    if (pipeline_fusable(e, v)) {
+        return pipeline_eval(e, v);
+    }
+    
     // Check if this is a macro call before evaluating arguments
     int is_macro_call = 0;
+    int is_pure_call = 0;
     if (v->sexpr.count > 0 && v->sexpr.cell[0]->type == LVAL_SYM) {
-        Lval *first = lenv_get(e, v->sexpr.cell[0]);
-        if (first->type == LVAL_MACRO) {
+        Lval *first = lenv_peek(e, v->sexpr.cell[0]->sym);
+        if (first && first->type == LVAL_MACRO) {
             is_macro_call = 1;
         }
-        lval_free(first);
+        is_pure_call = first && v->sexpr.count > 2 && pool_size() > 0 && !pool_in_worker() &&
+                       !pool_saturated() && !lcells_reading() && forms_in(v) >= 2 && lval_is_pure_fun(first);
     }
     
     // Evaluate Children (except for macro calls)
     if (!is_macro_call) {
-        for (int i = 0; i < v->sexpr.count; i++) {
-            v->sexpr.cell[i] = eval(e, v->sexpr.cell[i]);
+        if (is_pure_call) {
+            eval_args_parallel(e, v);
+        } else {
+            for (int i = 0; i < v->sexpr.count; i++) {
+                v->sexpr.cell[i] = eval_owned(e, v->sexpr.cell[i]);
+            }
         }
+        values_drop();
     }
     
     // Error Checking
@@ -487,7 +1338,7 @@ Lval *eval_sexpr(Lenv *e, Lval *v) {
     
     // Ensure First Element is Function or Symbol
     Lval *f = lval_pop(v, 0);
-    if (f->type != LVAL_FUN && f->type != LVAL_SYM && f->type != LVAL_LAMBDA && f->type != LVAL_MACRO) {
+    if (!lval_is_fun(f) && f->type != LVAL_SYM && f->type != LVAL_MACRO) {
         lval_free(f);
         lval_free(v);
         return lval_err("S-expression Does not start with function!");
@@ -498,7 +1349,7 @@ Lval *eval_sexpr(Lenv *e, Lval *v) {
         Lval *func = lenv_get(e, f);
         lval_free(f);
         f = func;
-        if (f->type != LVAL_FUN && f->type != LVAL_LAMBDA && f->type != LVAL_MACRO) {
+        if (!lval_is_fun(f) && f->type != LVAL_MACRO) {
             lval_free(f);
             lval_free(v);
             return lval_err("Symbol does not evaluate to function!");
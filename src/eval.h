@@ -5,6 +5,12 @@
 #include "env.h"
 
 Lval *eval(Lenv *e, Lval *v);
+Lval *eval_owned(Lenv *e, Lval *v);
+Lval *lval_call(Lenv *e, Lval *f, Lval *a);
+int lval_is_pure_fun(Lval *f);
+int lval_is_fun(Lval *v);
+int lambda_is_pure(Lval *f, char *self);
+void lambda_purity_stale(void);
 Lval *builtin_op(Lenv *e, Lval *a, char *op);
 Lval *builtin_head(Lval *a);
 Lval *builtin_tail(Lval *a);
@@ -12,6 +18,10 @@ Lval *builtin_list(Lval *a);
 Lval *builtin_cons(Lval *a);
 Lval *builtin_join(Lval *a);
 Lval *builtin_def(Lenv *e, Lval *a);
+Lval *builtin_def_memo(Lenv *e, Lval *a);
+Lval *builtin_memoize(Lval *a);
+Lval *builtin_parallel(Lval *a);
+void eval_set_parallel(int threads, long threshold);
 Lval *builtin_if(Lenv *e, Lval *a);
 
 #endif
\ No newline at end of file
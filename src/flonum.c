@@ -0,0 +1,110 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include "flonum.h"
+#include "bignum.h"
+
+// Double-precision floats. An operation with a float operand promotes
+// the other operand to a double and gives a float, and float division
+// follows IEEE 754, so only an exact zero divisor is an error.
+
+double lval_to_double(Lval *v) {
+    if (v->type == LVAL_FLOAT) return v->fnum;
+    if (v->type == LVAL_BIGNUM) return lbig_to_double(v->big);
+    return (double)v->num;
+}
+
+double lfloat_op(char *op, double x, double y) {
+    switch (op[0]) {
+        case '+': return x + y;
+        case '-': return x - y;
+        case '*': return x * y;
+        case '/': return x / y;
+        case '%': return fmod(x, y);
+    }
+    return NAN;
+}
+
+int lfloat_cmp(double x, double y) {
+    if (isnan(x) || isnan(y)) return NUM_UNORDERED;
+    return (x > y) - (x < y);
+}
+
+// Equal floats hash equally, so 0.0 and -0.0 share a hash
+unsigned long lfloat_hash(double x) {
+    if (x == 0) x = 0;
+    unsigned long bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+// The shortest form that reads back as the same double, always with a
+// point or an exponent so it reads back as a float
+void lfloat_print(double x, char *out, int size) {
+    if (isnan(x)) {
+        snprintf(out, size, "nan");
+        return;
+    }
+    if (isinf(x)) {
+        snprintf(out, size, x < 0 ? "-inf" : "inf");
+        return;
+    }
+    
+    for (int precision = 15; precision <= 17; precision++) {
+        snprintf(out, size, "%.*g", precision, x);
+        if (strtod(out, NULL) == x) break;
+    }
+    if (strspn(out, "-0123456789") == strlen(out)) {
+        strncat(out, ".0", size - strlen(out) - 1);
+    }
+}
+
+// The integer nearest below x, as a bignum when it leaves the fixnum range
+static Lval *float_floor(double x) {
+    x = floor(x);
+    if (x >= -(double)LONG_MIN || x < (double)LONG_MIN) {
+        char digits[400];
+        snprintf(digits, sizeof(digits), "%.0f", x);
+        return lval_bignum(digits);
+    }
+    return lval_num((long)x);
+}
+
+// (sqrt x), (exp x) and (log x) give floats; (floor x) gives an integer
+Lval *builtin_math(Lval *a, char *name) {
+    char msg[96];
+    if (a->sexpr.count != 1) {
+        snprintf(msg, sizeof(msg), "Function '%s' passed incorrect number of arguments!", name);
+        lval_free(a);
+        return lval_err(msg);
+    }
+    
+    Lval *x = a->sexpr.cell[0];
+    if (!lval_is_number(x)) {
+        snprintf(msg, sizeof(msg), "Function '%s' passed incorrect type!", name);
+        lval_free(a);
+        return lval_err(msg);
+    }
+    
+    Lval *result;
+    if (strcmp(name, "floor") == 0) {
+        if (x->type != LVAL_FLOAT) return lval_take(a, 0);
+        if (!isfinite(x->fnum)) {
+            lval_free(a);
+            return lval_err("Function 'floor' passed a value that is not finite!");
+        }
+        result = float_floor(x->fnum);
+    } else if (strcmp(name, "sqrt") == 0) {
+        result = lval_float(sqrt(lval_to_double(x)));
+    } else if (strcmp(name, "exp") == 0) {
+        result = lval_float(exp(lval_to_double(x)));
+    } else {
+        result = lval_float(log(lval_to_double(x)));
+    }
+    
+    lval_free(a);
+    return result;
+}
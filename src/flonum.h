@@ -0,0 +1,16 @@
+#ifndef FLONUM_H
+#define FLONUM_H
+
+#include "lval.h"
+
+#define NUM_UNORDERED 2 // lval_num_cmp against a NaN
+
+double lval_to_double(Lval *v);
+double lfloat_op(char *op, double x, double y);
+int lfloat_cmp(double x, double y);
+unsigned long lfloat_hash(double x);
+void lfloat_print(double x, char *out, int size);
+
+Lval *builtin_math(Lval *a, char *name);
+
+#endif
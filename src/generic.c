@@ -0,0 +1,364 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "generic.h"
+#include "eval.h"
+#include "record.h"
+
+// A generic function holds methods, each a lambda with a type (or
+// GENERIC_ANY) per parameter. A call looks up the tuple of its arguments'
+// types in a cache of earlier selections, so in the steady state dispatch
+// is one hash probe followed by a direct call to the method. A miss ranks
+// the applicable methods, most specific first parameter first, and fills
+// the cache; adding a method empties it.
+//
+// Generics are never pure, and neither is reading a promise or sequence
+// whose forcing could call one (see lazy_runs_code), so they only run on
+// the evaluating thread and the cache needs no lock.
+typedef struct Lmethod {
+    int count;
+    long *types;
+    Lval *lambda;
+} Lmethod;
+
+typedef struct Ldispatch {
+    unsigned long hash;
+    int count;
+    long *types;
+    Lmethod *method;
+    struct Ldispatch *next;
+} Ldispatch;
+
+struct Lgeneric {
+    int refs;
+    char *name;
+    Lmethod **methods;
+    int method_count;
+    int running;        // calls in progress
+    Lval **retired;     // lambdas of methods replaced while running
+    int retired_count;
+    Ldispatch **cache;
+    int cache_buckets;
+    long cache_count;
+};
+
+#define GENERIC_CACHE_BUCKETS 16
+
+static Lgeneric *lgeneric_new(char *name) {
+    Lgeneric *g = calloc(1, sizeof(Lgeneric));
+    g->refs = 1;
+    g->name = strdup(name);
+    g->cache_buckets = GENERIC_CACHE_BUCKETS;
+    g->cache = calloc(g->cache_buckets, sizeof(Ldispatch*));
+    return g;
+}
+
+static Lval *lval_generic(Lgeneric *g) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_GENERIC;
+    v->generic = g;
+    return v;
+}
+
+static void retired_free(Lgeneric *g) {
+    for (int i = 0; i < g->retired_count; i++) {
+        lval_free(g->retired[i]);
+    }
+    free(g->retired);
+    g->retired = NULL;
+    g->retired_count = 0;
+}
+
+Lgeneric *lgeneric_retain(Lgeneric *g) {
+    if (g) __atomic_add_fetch(&g->refs, 1, __ATOMIC_RELAXED);
+    return g;
+}
+
+static void cache_clear(Lgeneric *g) {
+    for (int i = 0; i < g->cache_buckets; i++) {
+        Ldispatch *d = g->cache[i];
+        while (d) {
+            Ldispatch *next = d->next;
+            free(d->types);
+            free(d);
+            d = next;
+        }
+        g->cache[i] = NULL;
+    }
+    g->cache_count = 0;
+}
+
+void lgeneric_release(Lgeneric *g) {
+    if (g == NULL || __atomic_sub_fetch(&g->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    
+    cache_clear(g);
+    free(g->cache);
+    for (int i = 0; i < g->method_count; i++) {
+        free(g->methods[i]->types);
+        lval_free(g->methods[i]->lambda);
+        free(g->methods[i]);
+    }
+    free(g->methods);
+    retired_free(g);
+    free(g->name);
+    free(g);
+}
+
+char *lgeneric_name(Lgeneric *g) {
+    return g->name;
+}
+
+long lgeneric_cache_size(Lgeneric *g) {
+    return g->cache_count;
+}
+
+// Every kind of function is just a function to a method, and every
+// integer a num (a float is a float, which num parameters also accept);
+// a record's type is its struct
+long lgeneric_type_of(Lval *v) {
+    if (v->type == LVAL_BIGNUM) return LVAL_NUM;
+    if (v->type == LVAL_RECORD) return lrtype_id(lrecord_type(v->record));
+    if (lval_is_fun(v)) return LVAL_FUN;
+    return v->type;
+}
+
+// A builtin type name, or the name a defstruct bound to its type
+static long type_named(Lenv *e, Lval *sym) {
+    char *names[] = {"num", "sym", "list", "fun", "macro", "promise", "seq", "vector", "pvec", "map",
+                     "sorted-map", "float", "typed-vector", "matrix", "bitset"};
+    long types[] = {LVAL_NUM, LVAL_SYM, LVAL_SEXPR, LVAL_FUN, LVAL_MACRO, LVAL_PROMISE, LVAL_SEQ,
+                    LVAL_VECTOR, LVAL_PVEC, LVAL_MAP, LVAL_SORTED, LVAL_FLOAT, LVAL_TYPED, LVAL_MATRIX, LVAL_BITSET};
+    for (int i = 0; i < 15; i++) {
+        if (strcmp(sym->sym, names[i]) == 0) return types[i];
+    }
+    
+    long type = GENERIC_ANY - 1;
+    Lval *v = lenv_get(e, sym);
+    if (v->type == LVAL_RECFN && v->recfn.op == RECORD_MAKE) type = lrtype_id(v->recfn.type);
+    lval_free(v);
+    return type;
+}
+
+static unsigned long types_hash(long *types, int count) {
+    unsigned long h = 1469598103934665603UL ^ (unsigned long)count;
+    for (int i = 0; i < count; i++) {
+        h = (h ^ (unsigned long)types[i]) * 1099511628211UL;
+    }
+    return h;
+}
+
+// Whether a parameter declared as type accepts an argument of type t. A
+// num parameter takes any number, so floats as well as integers.
+static int type_accepts(long type, long t) {
+    return type == GENERIC_ANY || type == t || (type == LVAL_NUM && t == LVAL_FLOAT);
+}
+
+// Whether a is more specific than b: at the first parameter where they
+// differ, a names a type b also accepts, such as float where b takes num
+// or anything
+static int more_specific(Lmethod *a, Lmethod *b) {
+    for (int i = 0; i < a->count; i++) {
+        if (a->types[i] == b->types[i]) continue;
+        return type_accepts(b->types[i], a->types[i]);
+    }
+    return 0;
+}
+
+static Lmethod *select_method(Lgeneric *g, long *types, int count) {
+    Lmethod *best = NULL;
+    for (int i = 0; i < g->method_count; i++) {
+        Lmethod *m = g->methods[i];
+        if (m->count != count) continue;
+        
+        int applies = 1;
+        for (int j = 0; j < count && applies; j++) {
+            applies = type_accepts(m->types[j], types[j]);
+        }
+        if (applies && (best == NULL || more_specific(m, best))) best = m;
+    }
+    return best;
+}
+
+static void cache_grow(Lgeneric *g) {
+    int buckets = g->cache_buckets * 2;
+    Ldispatch **cache = calloc(buckets, sizeof(Ldispatch*));
+    for (int i = 0; i < g->cache_buckets; i++) {
+        Ldispatch *d = g->cache[i];
+        while (d) {
+            Ldispatch *next = d->next;
+            d->next = cache[d->hash & (buckets - 1)];
+            cache[d->hash & (buckets - 1)] = d;
+            d = next;
+        }
+    }
+    free(g->cache);
+    g->cache = cache;
+    g->cache_buckets = buckets;
+}
+
+Lval *lgeneric_call(Lenv *e, Lgeneric *g, Lval *a) {
+    int count = a->sexpr.count;
+    long small[8];
+    long *types = count <= 8 ? small : malloc(sizeof(long) * count);
+    for (int i = 0; i < count; i++) {
+        types[i] = lgeneric_type_of(a->sexpr.cell[i]);
+    }
+    
+    unsigned long h = types_hash(types, count);
+    Lmethod *m = NULL;
+    for (Ldispatch *d = g->cache[h & (g->cache_buckets - 1)]; d; d = d->next) {
+        if (d->hash == h && d->count == count &&
+            memcmp(d->types, types, sizeof(long) * count) == 0) {
+            m = d->method;
+            break;
+        }
+    }
+    
+    if (m == NULL) {
+        m = select_method(g, types, count);
+        if (m == NULL) {
+            if (types != small) free(types);
+            lval_free(a);
+            return lval_err("No applicable method for generic function!");
+        }
+        
+        // Keep the load factor at or below one
+        if (g->cache_count == g->cache_buckets) cache_grow(g);
+        
+        Ldispatch *d = malloc(sizeof(Ldispatch));
+        d->hash = h;
+        d->count = count;
+        d->types = malloc(sizeof(long) * (count ? count : 1));
+        memcpy(d->types, types, sizeof(long) * count);
+        d->method = m;
+        d->next = g->cache[h & (g->cache_buckets - 1)];
+        g->cache[h & (g->cache_buckets - 1)] = d;
+        g->cache_count++;
+    }
+    
+    if (types != small) free(types);
+    
+    g->running++;
+    Lval *result = lval_call(e, m->lambda, a);
+    if (--g->running == 0 && g->retired) retired_free(g);
+    return result;
+}
+
+// (defgeneric name) binds name to a generic function with no methods. An
+// existing generic is kept with its methods, so reloading a file that
+// declares one does not lose them.
+Lval *builtin_defgeneric(Lenv *e, Lval *a) {
+    if (a->sexpr.count != 2) {
+        lval_free(a);
+        return lval_err("Function 'defgeneric' passed incorrect number of arguments!");
+    }
+    if (a->sexpr.cell[1]->type != LVAL_SYM) {
+        lval_free(a);
+        return lval_err("Function 'defgeneric' passed incorrect type!");
+    }
+    
+    Lval *sym = a->sexpr.cell[1];
+    Lval *v = lenv_get(e, sym);
+    if (v->type == LVAL_GENERIC) {
+        lval_free(a);
+        return v;
+    }
+    lval_free(v);
+    
+    v = lval_generic(lgeneric_new(sym->sym));
+    lenv_put(e, sym, v);
+    lval_free(a);
+    return v;
+}
+
+// (defmethod name (params...) body) adds a method to the generic bound to
+// name. Each parameter is a symbol, accepting any type, or (symbol type)
+// with type one of num (any number), float, sym, list, fun, macro, promise,
+// seq, vector, pvec, map, sorted-map, typed-vector, matrix, bitset or a
+// struct name. A method with the same parameter types replaces the old one.
+Lval *builtin_defmethod(Lenv *e, Lval *a) {
+    if (a->sexpr.count != 4) {
+        lval_free(a);
+        return lval_err("Function 'defmethod' passed incorrect number of arguments!");
+    }
+    if (a->sexpr.cell[1]->type != LVAL_SYM || a->sexpr.cell[2]->type != LVAL_SEXPR) {
+        lval_free(a);
+        return lval_err("Function 'defmethod' passed incorrect type!");
+    }
+    
+    Lval *params = a->sexpr.cell[2];
+    int count = params->sexpr.count;
+    long *types = malloc(sizeof(long) * (count ? count : 1));
+    Lval *formals = lval_sexpr();
+    for (int i = 0; i < count; i++) {
+        Lval *p = params->sexpr.cell[i];
+        if (p->type == LVAL_SYM) {
+            types[i] = GENERIC_ANY;
+            lval_add(formals, lval_sym(p->sym));
+            continue;
+        }
+        
+        long type = GENERIC_ANY - 1;
+        if (p->type == LVAL_SEXPR && p->sexpr.count == 2 &&
+            p->sexpr.cell[0]->type == LVAL_SYM && p->sexpr.cell[1]->type == LVAL_SYM) {
+            type = type_named(e, p->sexpr.cell[1]);
+        }
+        if (type == GENERIC_ANY - 1) {
+            free(types);
+            lval_free(formals);
+            lval_free(a);
+            return lval_err("Method parameter must be a symbol or (symbol type)!");
+        }
+        types[i] = type;
+        lval_add(formals, lval_sym(p->sexpr.cell[0]->sym));
+    }
+    
+    Lval *v = lenv_get(e, a->sexpr.cell[1]);
+    if (v->type != LVAL_GENERIC) {
+        lval_free(v);
+        free(types);
+        lval_free(formals);
+        lval_free(a);
+        return lval_err("Function 'defmethod' expects a generic function!");
+    }
+    Lgeneric *g = v->generic;
+    
+    // The method body is an ordinary lambda, so it gets the same purity
+    // and escape analysis
+    Lval *lambda = lval_sexpr();
+    lval_add(lambda, lval_sym("\\"));
+    lval_add(lambda, formals);
+    lval_add(lambda, lval_pop(a, 3));
+    lval_free(a);
+    lambda = eval(e, lambda);
+    if (lambda->type == LVAL_ERR) {
+        free(types);
+        lval_free(v);
+        return lambda;
+    }
+    
+    Lmethod *m = NULL;
+    for (int i = 0; i < g->method_count && m == NULL; i++) {
+        Lmethod *x = g->methods[i];
+        if (x->count == count && memcmp(x->types, types, sizeof(long) * count) == 0) m = x;
+    }
+    if (m && g->running) {
+        free(types);
+        g->retired = realloc(g->retired, sizeof(Lval*) * (g->retired_count + 1));
+        g->retired[g->retired_count++] = m->lambda;
+    } else if (m) {
+        free(types);
+        lval_free(m->lambda);
+    } else {
+        m = malloc(sizeof(Lmethod));
+        m->count = count;
+        m->types = types;
+        g->methods = realloc(g->methods, sizeof(Lmethod*) * (g->method_count + 1));
+        g->methods[g->method_count++] = m;
+    }
+    m->lambda = lambda;
+    cache_clear(g);
+    
+    return v;
+}
@@ -0,0 +1,19 @@
+#ifndef GENERIC_H
+#define GENERIC_H
+
+#include "lval.h"
+#include "env.h"
+
+#define GENERIC_ANY -1
+
+Lgeneric *lgeneric_retain(Lgeneric *g);
+void lgeneric_release(Lgeneric *g);
+char *lgeneric_name(Lgeneric *g);
+long lgeneric_type_of(Lval *v);
+Lval *lgeneric_call(Lenv *e, Lgeneric *g, Lval *a);
+long lgeneric_cache_size(Lgeneric *g);
+
+Lval *builtin_defgeneric(Lenv *e, Lval *a);
+Lval *builtin_defmethod(Lenv *e, Lval *a);
+
+#endif
@@ -0,0 +1,562 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "lazy.h"
+#include "eval.h"
+#include "coro.h"
+
+// A promise holds an unevaluated expression and the env it was written in.
+// The first force evaluates it and keeps the value; later forces copy the
+// kept value. Promises are shared by every copy of the Lval that holds
+// them, so they are reference counted like memo tables.
+struct Lpromise {
+    int refs;
+    pthread_mutex_t lock;
+    int forced;
+    Lval *expr;   // until forced
+    Lenv *env;
+    Lval *value;  // once forced
+    Lcoro *co;    // generator step instead of an expression
+};
+
+// A lazy sequence is a small description of how to produce its items,
+// never the items themselves. Consumers walk it with an iterator, so a
+// range or a chain of lazy-map and lazy-filter over it runs in constant
+// memory however long it is.
+typedef enum { SEQ_RANGE, SEQ_MAP, SEQ_FILTER, SEQ_DROP, SEQ_CONS, SEQ_THUNK } SeqKind;
+
+struct Lseq {
+    int refs;
+    SeqKind kind;
+    long start;        // range
+    long end;
+    long step;
+    int bounded;
+    Lval *f;           // map and filter
+    Lval *head;        // cons
+    struct Lseq *src;  // map, filter and drop source; cons tail
+    long drop;         // drop
+    Lpromise *thunk;   // lazy-seq body, a list or another sequence
+};
+
+static Lpromise *lpromise_new(Lval *expr, Lenv *env) {
+    Lpromise *p = malloc(sizeof(Lpromise));
+    p->refs = 1;
+    pthread_mutex_init(&p->lock, NULL);
+    p->forced = 0;
+    p->expr = expr;
+    p->env = env;
+    p->value = NULL;
+    p->co = NULL;
+    return p;
+}
+
+Lpromise *lpromise_retain(Lpromise *p) {
+    if (p) __atomic_add_fetch(&p->refs, 1, __ATOMIC_RELAXED);
+    return p;
+}
+
+// Frees p once unreferenced. A forced lazy-seq body that produced another
+// sequence hands that sequence back, so long realized chains can be
+// released in a loop instead of by deep recursion.
+static Lseq *lpromise_drop(Lpromise *p) {
+    if (p == NULL || __atomic_sub_fetch(&p->refs, 1, __ATOMIC_ACQ_REL) > 0) return NULL;
+    
+    Lseq *tail = NULL;
+    if (p->value && p->value->type == LVAL_SEQ) {
+        tail = p->value->seq;
+        free(p->value);
+    } else {
+        lval_free(p->value);
+    }
+    lval_free(p->expr);
+    lenv_release(p->env);
+    lcoro_free(p->co);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+    return tail;
+}
+
+void lpromise_release(Lpromise *p) {
+    lseq_release(lpromise_drop(p));
+}
+
+// Evaluates p if that has not happened yet. Returns NULL once p->value is
+// set, or the error the expression raised; errors are not kept, so a later
+// force tries again. Two threads may race to evaluate the same promise,
+// in which case the first value stored wins.
+static Lval *lpromise_step(Lpromise *p);
+
+static Lval *lpromise_run(Lpromise *p) {
+    pthread_mutex_lock(&p->lock);
+    if (p->forced) {
+        pthread_mutex_unlock(&p->lock);
+        return NULL;
+    }
+    if (p->co) {
+        Lval *err = lpromise_step(p);
+        pthread_mutex_unlock(&p->lock);
+        return err;
+    }
+    Lval *expr = lval_copy(p->expr);
+    pthread_mutex_unlock(&p->lock);
+    
+    int is_sym = (expr->type == LVAL_SYM);
+    Lval *v = eval(p->env, expr);
+    if (is_sym) lval_free(expr);
+    if (v->type == LVAL_ERR) return v;
+    
+    pthread_mutex_lock(&p->lock);
+    if (p->forced) {
+        lval_free(v);
+    } else {
+        p->value = v;
+        lval_free(p->expr);
+        p->expr = NULL;
+        p->forced = 1;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static Lval *lval_promise(Lpromise *p) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_PROMISE;
+    v->promise = p;
+    return v;
+}
+
+static Lseq *lseq_new(SeqKind kind) {
+    Lseq *s = calloc(1, sizeof(Lseq));
+    s->refs = 1;
+    s->kind = kind;
+    return s;
+}
+
+static Lval *lval_seq(Lseq *s) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_SEQ;
+    v->seq = s;
+    return v;
+}
+
+// A generator is a lazy-seq whose body resumes a coroutine: each yield
+// becomes one cons cell, and the coroutine moves on to the promise for the
+// rest. Runs with p locked, so one generator is never resumed twice at once.
+static Lval *lpromise_step(Lpromise *p) {
+    Lval *x = lcoro_resume(p->co);
+    if (x && x->type == LVAL_ERR) return x;
+    
+    if (x == NULL) {
+        lcoro_free(p->co);
+        p->value = lval_sexpr();
+    } else {
+        Lseq *rest = lseq_new(SEQ_THUNK);
+        rest->thunk = lpromise_new(NULL, NULL);
+        rest->thunk->co = p->co;
+        
+        Lseq *cell = lseq_new(SEQ_CONS);
+        cell->head = x;
+        cell->src = rest;
+        p->value = lval_seq(cell);
+    }
+    p->co = NULL;
+    p->forced = 1;
+    return NULL;
+}
+
+Lseq *lseq_retain(Lseq *s) {
+    if (s) __atomic_add_fetch(&s->refs, 1, __ATOMIC_RELAXED);
+    return s;
+}
+
+void lseq_release(Lseq *s) {
+    // Walk down cons tails and lazy-seq bodies in a loop, since realized
+    // recursive sequences can be millions of nodes long
+    while (s && __atomic_sub_fetch(&s->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        Lseq *next = NULL;
+        lval_free(s->f);
+        lval_free(s->head);
+        if (s->kind == SEQ_CONS) {
+            next = s->src;
+        } else {
+            lseq_release(s->src);
+        }
+        if (s->thunk) next = lpromise_drop(s->thunk);
+        free(s);
+        s = next;
+    }
+}
+
+// A list used where a sequence is expected becomes an already forced
+// lazy-seq body, so iterating it copies items out of the list in place
+static Lseq *lseq_of(Lval *x) {
+    if (x->type == LVAL_SEQ) return lseq_retain(x->seq);
+    
+    Lseq *s = lseq_new(SEQ_THUNK);
+    s->thunk = lpromise_new(NULL, NULL);
+    s->thunk->value = lval_copy(x);
+    s->thunk->forced = 1;
+    return s;
+}
+
+// p's value if it has been forced, or NULL
+static Lval *lpromise_peek(Lpromise *p) {
+    pthread_mutex_lock(&p->lock);
+    Lval *value = p->forced ? p->value : NULL;
+    pthread_mutex_unlock(&p->lock);
+    return value;
+}
+
+// Whether reading v can run code that is not known to be pure: an unforced
+// promise or lazy-seq body, a generator step, or an impure lazy-map or
+// lazy-filter function. Forcing runs that code on whichever thread reads
+// v, so the evaluator keeps expressions over such values off the worker
+// pool. Only lists are looked into; other collections that could hold a
+// sequence count as running code.
+int lazy_runs_code(Lval *v) {
+    switch (v->type) {
+        case LVAL_PROMISE: {
+            Lval *value = lpromise_peek(v->promise);
+            return value == NULL || lazy_runs_code(value);
+        }
+        case LVAL_SEQ: {
+            // Forced bodies are followed in a loop, like lseq_release
+            Lseq *s = v->seq;
+            while (s) {
+                if (s->f && !lval_is_pure_fun(s->f)) return 1;
+                if (s->head && lazy_runs_code(s->head)) return 1;
+                if (s->thunk == NULL) {
+                    s = s->src;
+                    continue;
+                }
+                Lval *body = lpromise_peek(s->thunk);
+                if (body == NULL) return 1;
+                if (body->type != LVAL_SEQ) return lazy_runs_code(body);
+                s = body->seq;
+            }
+            return 0;
+        }
+        case LVAL_SEXPR:
+            for (int i = 0; i < v->sexpr.count; i++) {
+                if (lazy_runs_code(v->sexpr.cell[i])) return 1;
+            }
+            return 0;
+        case LVAL_VECTOR:
+        case LVAL_PVEC:
+        case LVAL_MAP:
+        case LVAL_TRANSIENT:
+        case LVAL_SORTED:
+        case LVAL_RECORD:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+struct Lseq_iter {
+    Lseq *node;              // retained
+    long next;               // range: next item; drop: items left to skip
+    int started;             // cons: head already produced
+    Lval *list;              // forced lazy-seq body being walked (borrowed)
+    int pos;
+    struct Lseq_iter *src;   // map, filter and drop
+};
+
+static void iter_init(Lseq_iter *it, Lseq *s) {
+    it->node = lseq_retain(s);
+    it->next = s->kind == SEQ_RANGE ? s->start : s->drop;
+    it->started = 0;
+    it->list = NULL;
+    it->pos = 0;
+    it->src = (s->kind == SEQ_MAP || s->kind == SEQ_FILTER || s->kind == SEQ_DROP) ?
+              lseq_iter_new(s->src) : NULL;
+}
+
+Lseq_iter *lseq_iter_new(Lseq *s) {
+    Lseq_iter *it = malloc(sizeof(Lseq_iter));
+    iter_init(it, s);
+    return it;
+}
+
+void lseq_iter_free(Lseq_iter *it) {
+    if (it == NULL) return;
+    lseq_iter_free(it->src);
+    lseq_release(it->node);
+    free(it);
+}
+
+// Moves the iterator on to s. The old node is released after s is
+// retained, so a chain nobody else holds is freed as it is walked.
+static void iter_become(Lseq_iter *it, Lseq *s) {
+    Lseq *old = it->node;
+    lseq_iter_free(it->src);
+    iter_init(it, s);
+    lseq_release(old);
+}
+
+static Lval *lazy_apply(Lenv *e, Lval *f, Lval *x) {
+    Lval *args = lval_sexpr();
+    lval_add(args, x);
+    return lval_call(e, f, args);
+}
+
+static int lazy_truthy(Lval *v) {
+    if (v->type == LVAL_NUM) return v->num != 0;
+    if (v->type == LVAL_SEXPR) return v->sexpr.count > 0;
+    return 1;
+}
+
+// Returns the next item, an error, or NULL once the sequence has ended
+Lval *lseq_iter_next(Lenv *e, Lseq_iter *it) {
+    for (;;) {
+        Lseq *s = it->node;
+        
+        switch (s->kind) {
+            case SEQ_RANGE: {
+                if (s->bounded && (s->step > 0 ? it->next >= s->end : it->next <= s->end)) {
+                    return NULL;
+                }
+                long x = it->next;
+                it->next += s->step;
+                return lval_num(x);
+            }
+            case SEQ_MAP: {
+                Lval *x = lseq_iter_next(e, it->src);
+                if (x == NULL || x->type == LVAL_ERR) return x;
+                return lazy_apply(e, s->f, x);
+            }
+            case SEQ_FILTER:
+                for (;;) {
+                    Lval *x = lseq_iter_next(e, it->src);
+                    if (x == NULL || x->type == LVAL_ERR) return x;
+                    
+                    Lval *keep = lazy_apply(e, s->f, lval_copy(x));
+                    if (keep->type == LVAL_ERR) {
+                        lval_free(x);
+                        return keep;
+                    }
+                    int pass = lazy_truthy(keep);
+                    lval_free(keep);
+                    if (pass) return x;
+                    lval_free(x);
+                }
+            case SEQ_DROP:
+                while (it->next > 0) {
+                    Lval *x = lseq_iter_next(e, it->src);
+                    it->next--;
+                    if (x == NULL || x->type == LVAL_ERR) return x;
+                    lval_free(x);
+                }
+                return lseq_iter_next(e, it->src);
+            case SEQ_CONS:
+                if (!it->started) {
+                    it->started = 1;
+                    return lval_copy(s->head);
+                }
+                iter_become(it, s->src);
+                continue;
+            case SEQ_THUNK:
+                if (it->list == NULL) {
+                    Lval *err = lpromise_run(s->thunk);
+                    if (err) return err;
+                    
+                    Lval *v = s->thunk->value;
+                    if (v->type == LVAL_SEQ) {
+                        iter_become(it, v->seq);
+                        continue;
+                    }
+                    if (v->type != LVAL_SEXPR) {
+                        return lval_err("lazy-seq must produce a list or sequence!");
+                    }
+                    it->list = v;
+                }
+                if (it->pos == it->list->sexpr.count) return NULL;
+                return lval_copy(it->list->sexpr.cell[it->pos++]);
+        }
+    }
+}
+
+// (delay expr) and (lazy-seq expr) keep expr unevaluated along with the
+// env it refers to
+Lval *builtin_delay(Lenv *e, Lval *a) {
+    if (a->sexpr.count != 2) {
+        lval_free(a);
+        return lval_err("Function 'delay' passed incorrect number of arguments!");
+    }
+    return lval_promise(lpromise_new(lval_take(a, 1), lenv_capture(e)));
+}
+
+Lval *builtin_lazy_seq(Lenv *e, Lval *a) {
+    if (a->sexpr.count != 2) {
+        lval_free(a);
+        return lval_err("Function 'lazy-seq' passed incorrect number of arguments!");
+    }
+    Lseq *s = lseq_new(SEQ_THUNK);
+    s->thunk = lpromise_new(lval_take(a, 1), lenv_capture(e));
+    return lval_seq(s);
+}
+
+// Builtins over sequences; head, tail and cons only come here when given one
+int lazy_handles(char *name, Lval *a) {
+    if (strcmp(name, "force") == 0 || strcmp(name, "range") == 0 || strcmp(name, "range-from") == 0 ||
+        strcmp(name, "generator") == 0 ||
+        strcmp(name, "lazy-map") == 0 || strcmp(name, "lazy-filter") == 0) {
+        return 1;
+    }
+    if (strcmp(name, "head") == 0 || strcmp(name, "tail") == 0) {
+        return a->sexpr.count == 1 && a->sexpr.cell[0]->type == LVAL_SEQ;
+    }
+    if (strcmp(name, "cons") == 0) {
+        return a->sexpr.count == 2 && a->sexpr.cell[1]->type == LVAL_SEQ;
+    }
+    return 0;
+}
+
+static Lval *lazy_force(Lval *a) {
+    if (a->sexpr.count != 1) {
+        lval_free(a);
+        return lval_err("Function 'force' passed incorrect number of arguments!");
+    }
+    
+    Lval *x = lval_take(a, 0);
+    if (x->type != LVAL_PROMISE) return x;
+    
+    Lval *err = lpromise_run(x->promise);
+    Lval *result = err ? err : lval_copy(x->promise->value);
+    lval_free(x);
+    return result;
+}
+
+// (range end), (range start end) or (range start end step), and the
+// unbounded (range-from start) or (range-from start step). A call with no
+// arguments evaluates to the function itself, so an unbounded range needs
+// a name of its own.
+static Lval *lazy_range(Lval *a, char *name) {
+    int bounded = strcmp(name, "range") == 0;
+    if (a->sexpr.count < 1 || a->sexpr.count > (bounded ? 3 : 2)) {
+        lval_free(a);
+        char msg[80];
+        snprintf(msg, sizeof(msg), "Function '%s' passed incorrect number of arguments!", name);
+        return lval_err(msg);
+    }
+    for (int i = 0; i < a->sexpr.count; i++) {
+        if (a->sexpr.cell[i]->type != LVAL_NUM) {
+            lval_free(a);
+            char msg[64];
+            snprintf(msg, sizeof(msg), "Function '%s' passed incorrect type!", name);
+            return lval_err(msg);
+        }
+    }
+    
+    Lseq *s = lseq_new(SEQ_RANGE);
+    s->step = 1;
+    s->bounded = bounded;
+    if (!bounded) {
+        s->start = a->sexpr.cell[0]->num;
+        if (a->sexpr.count == 2) s->step = a->sexpr.cell[1]->num;
+    } else if (a->sexpr.count == 1) {
+        s->end = a->sexpr.cell[0]->num;
+    } else {
+        s->start = a->sexpr.cell[0]->num;
+        s->end = a->sexpr.cell[1]->num;
+        if (a->sexpr.count == 3) s->step = a->sexpr.cell[2]->num;
+    }
+    lval_free(a);
+    
+    if (s->step == 0) {
+        lseq_release(s);
+        return lval_err("Range passed a zero step!");
+    }
+    return lval_seq(s);
+}
+
+static Lval *lazy_stage(Lval *a, char *name, SeqKind kind) {
+    Lval *f = a->sexpr.count == 2 ? a->sexpr.cell[0] : NULL;
+    Lval *xs = a->sexpr.count == 2 ? a->sexpr.cell[1] : NULL;
+    if (f == NULL || !lval_is_fun(f) ||
+        (xs->type != LVAL_SEQ && xs->type != LVAL_SEXPR)) {
+        lval_free(a);
+        char msg[80];
+        snprintf(msg, sizeof(msg), "Function '%s' passed incorrect arguments!", name);
+        return lval_err(msg);
+    }
+    
+    Lseq *s = lseq_new(kind);
+    s->src = lseq_of(xs);
+    s->f = lval_pop(a, 0);
+    lval_free(a);
+    return lval_seq(s);
+}
+
+// (generator f args...) calls f with args on a coroutine; every value it
+// passes to yield becomes the next item of the sequence
+static Lval *lazy_generator(Lenv *e, Lval *a) {
+    if (a->sexpr.count < 1 ||
+        !lval_is_fun(a->sexpr.cell[0])) {
+        lval_free(a);
+        return lval_err("Function 'generator' passed incorrect type!");
+    }
+    
+    Lval *f = lval_pop(a, 0);
+    Lseq *s = lseq_new(SEQ_THUNK);
+    s->thunk = lpromise_new(NULL, NULL);
+    s->thunk->co = lcoro_new(e, f, a);
+    return lval_seq(s);
+}
+
+static Lval *lazy_head(Lenv *e, Lval *a) {
+    Lseq_iter *it = lseq_iter_new(a->sexpr.cell[0]->seq);
+    Lval *x = lseq_iter_next(e, it);
+    lseq_iter_free(it);
+    lval_free(a);
+    return x ? x : lval_err("Function 'head' passed empty list!");
+}
+
+// The tail of a range or cons is known without touching any item;
+// anything else drops its first item lazily
+static Lval *lazy_tail(Lval *a) {
+    Lseq *s = a->sexpr.cell[0]->seq;
+    Lseq *t;
+    
+    if (s->kind == SEQ_CONS) {
+        t = lseq_retain(s->src);
+    } else if (s->kind == SEQ_RANGE) {
+        t = lseq_new(SEQ_RANGE);
+        t->start = s->start + s->step;
+        t->end = s->end;
+        t->step = s->step;
+        t->bounded = s->bounded;
+    } else if (s->kind == SEQ_DROP) {
+        t = lseq_new(SEQ_DROP);
+        t->src = lseq_retain(s->src);
+        t->drop = s->drop + 1;
+    } else {
+        t = lseq_new(SEQ_DROP);
+        t->src = lseq_retain(s);
+        t->drop = 1;
+    }
+    lval_free(a);
+    return lval_seq(t);
+}
+
+static Lval *lazy_cons(Lval *a) {
+    Lseq *s = lseq_new(SEQ_CONS);
+    s->head = lval_pop(a, 0);
+    s->src = lseq_retain(a->sexpr.cell[0]->seq);
+    lval_free(a);
+    return lval_seq(s);
+}
+
+Lval *builtin_lazy(Lenv *e, Lval *a, char *name) {
+    if (strcmp(name, "force") == 0) return lazy_force(a);
+    if (strcmp(name, "range") == 0 || strcmp(name, "range-from") == 0) return lazy_range(a, name);
+    if (strcmp(name, "lazy-map") == 0) return lazy_stage(a, name, SEQ_MAP);
+    if (strcmp(name, "lazy-filter") == 0) return lazy_stage(a, name, SEQ_FILTER);
+    if (strcmp(name, "generator") == 0) return lazy_generator(e, a);
+    if (strcmp(name, "head") == 0) return lazy_head(e, a);
+    if (strcmp(name, "tail") == 0) return lazy_tail(a);
+    return lazy_cons(a);
+}
@@ -0,0 +1,24 @@
+#ifndef LAZY_H
+#define LAZY_H
+
+#include "lval.h"
+#include "env.h"
+
+typedef struct Lseq_iter Lseq_iter;
+
+Lpromise *lpromise_retain(Lpromise *p);
+void lpromise_release(Lpromise *p);
+Lseq *lseq_retain(Lseq *s);
+void lseq_release(Lseq *s);
+int lazy_runs_code(Lval *v);
+
+Lseq_iter *lseq_iter_new(Lseq *s);
+Lval *lseq_iter_next(Lenv *e, Lseq_iter *it);
+void lseq_iter_free(Lseq_iter *it);
+
+Lval *builtin_delay(Lenv *e, Lval *a);
+Lval *builtin_lazy_seq(Lenv *e, Lval *a);
+int lazy_handles(char *name, Lval *a);
+Lval *builtin_lazy(Lenv *e, Lval *a, char *name);
+
+#endif
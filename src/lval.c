@@ -3,6 +3,23 @@
 #include <stdlib.h>
 #include <string.h>
 #include "lval.h"
+#include "env.h"
+#include "memo.h"
+#include "lazy.h"
+#include "generic.h"
+#include "record.h"
+#include "vector.h"
+#include "pvec.h"
+#include "map.h"
+#include "transient.h"
+#include "sorted.h"
+#include "bignum.h"
+#include "flonum.h"
+#include "typed.h"
+#include "matrix.h"
+#include "bitset.h"
+#include "match.h"
+#include "values.h"
 
 Lval *lval_num(long x) {
     Lval *v = malloc(sizeof(Lval));
@@ -11,6 +28,13 @@ Lval *lval_num(long x) {
     return v;
 }
 
+Lval *lval_float(double x) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_FLOAT;
+    v->fnum = x;
+    return v;
+}
+
 Lval *lval_sym(char *s) {
     Lval *v = malloc(sizeof(Lval));
     v->type = LVAL_SYM;
@@ -32,21 +56,72 @@ Lval *lval_fun(char *f) {
     return v;
 }
 
+// A body can only capture its call frame by creating a closure over it,
+// so any lambda or macro form anywhere inside the body counts as an escape.
+static int lval_captures_frame(Lval *v) {
+    if (v->type == LVAL_SYM) {
+        return strcmp(v->sym, "\\") == 0 || strcmp(v->sym, "macro") == 0;
+    }
+    if (v->type == LVAL_SEXPR) {
+        for (int i = 0; i < v->sexpr.count; i++) {
+            if (lval_captures_frame(v->sexpr.cell[i])) return 1;
+        }
+    }
+    return 0;
+}
+
 Lval *lval_lambda(Lval *formals, Lval *body, Lenv *env) {
     Lval *v = malloc(sizeof(Lval));
     v->type = LVAL_LAMBDA;
     v->lambda.formals = formals;
     v->lambda.body = body;
-    v->lambda.env = env; // Reference the environment, don't copy it
+    v->lambda.closure = malloc(sizeof(Lclosure));
+    v->lambda.closure->refs = 1;
+    v->lambda.closure->env = lenv_retain(env); // Reference the environment, don't copy it
+    v->lambda.closure->escapes = lval_captures_frame(body);
+    v->lambda.closure->fixnums = NULL;
+    v->lambda.closure->safety = 1;
+    v->lambda.closure->pure = 0;
+    v->lambda.closure->declared = 0;
+    v->lambda.closure->judged = 0;
+    v->lambda.closure->judging = 0;
+    v->lambda.closure->cost = 0;
+    v->lambda.closure->costed = 0;
+    v->lambda.closure->costing = 0;
+    v->lambda.closure->memo = NULL;
     return v;
 }
 
+static void lclosure_release(Lclosure *c) {
+    if (__atomic_sub_fetch(&c->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    lval_free(c->fixnums);
+    lmemo_release(c->memo);
+    lenv_release(c->env);
+    free(c);
+}
+
+// Gives f a closure record no other copy sees, so that it can be changed
+Lclosure *lval_closure_own(Lval *f) {
+    Lclosure *c = f->lambda.closure;
+    if (__atomic_load_n(&c->refs, __ATOMIC_ACQUIRE) == 1) return c;
+    
+    Lclosure *own = malloc(sizeof(Lclosure));
+    *own = *c;
+    own->refs = 1;
+    lenv_retain(own->env);
+    own->fixnums = c->fixnums ? lval_copy(c->fixnums) : NULL;
+    lmemo_retain(own->memo); // Share the cache, as copies always have
+    lclosure_release(c);
+    f->lambda.closure = own;
+    return own;
+}
+
 Lval *lval_macro(Lval *formals, Lval *body, Lenv *env) {
     Lval *v = malloc(sizeof(Lval));
     v->type = LVAL_MACRO;
     v->macro.formals = formals;
     v->macro.body = body;
-    v->macro.env = env; // Reference the environment, don't copy it
+    v->macro.env = lenv_retain(env); // Reference the environment, don't copy it
     return v;
 }
 
@@ -55,12 +130,19 @@ Lval *lval_sexpr(void) {
     v->type = LVAL_SEXPR;
     v->sexpr.count = 0;
     v->sexpr.cell = NULL;
+    v->sexpr.match = NULL;
     return v;
 }
 
-void lval_free(Lval *v) {
-    if (v == NULL) return;
-    
+// Drops the match tree v shares with its copies, before its cells change
+void lval_sexpr_own(Lval *v) {
+    if (v->sexpr.match == NULL) return;
+    lmatch_release(v->sexpr.match);
+    v->sexpr.match = NULL;
+}
+
+// Frees what v owns but not v itself, for values stored inline
+void lval_clear(Lval *v) {
     switch (v->type) {
         case LVAL_SYM: free(v->sym); break;
         case LVAL_ERR: free(v->err); break;
@@ -68,25 +150,48 @@ void lval_free(Lval *v) {
         case LVAL_LAMBDA:
             lval_free(v->lambda.formals);
             lval_free(v->lambda.body);
-            // Don't free env here as it's managed separately
+            lclosure_release(v->lambda.closure);
             break;
         case LVAL_MACRO:
             lval_free(v->macro.formals);
             lval_free(v->macro.body);
-            // Don't free env here as it's managed separately
+            lenv_release(v->macro.env);
             break;
         case LVAL_SEXPR:
             for (int i = 0; i < v->sexpr.count; i++) {
                 lval_free(v->sexpr.cell[i]);
             }
             free(v->sexpr.cell);
+            lmatch_release(v->sexpr.match);
             break;
+        case LVAL_PROMISE: lpromise_release(v->promise); break;
+        case LVAL_SEQ: lseq_release(v->seq); break;
+        case LVAL_GENERIC: lgeneric_release(v->generic); break;
+        case LVAL_RECORD: lrecord_release(v->record); break;
+        case LVAL_RECFN: lrtype_release(v->recfn.type); break;
+        case LVAL_VECTOR: lvstore_release(v->vec.store); break;
+        case LVAL_PVEC: lpvec_release(v->pvec); break;
+        case LVAL_MAP: lmnode_release(v->map.root); break;
+        case LVAL_TRANSIENT: ltransient_release(v->transient); break;
+        case LVAL_SORTED: lsnode_release(v->sorted.root); break;
+        case LVAL_BIGNUM: lbig_release(v->big); break;
+        case LVAL_TYPED: ltyped_release(v->typed); break;
+        case LVAL_MATRIX: lmatrix_release(v->mat); break;
+        case LVAL_BITSET: lbitset_release(v->bits); break;
         default: break;
     }
+}
+
+void lval_free(Lval *v) {
+    if (v == NULL) return;
+    
+    values_forget(v);
+    lval_clear(v);
     free(v);
 }
 
 Lval *lval_add(Lval *v, Lval *x) {
+    lval_sexpr_own(v);
     v->sexpr.count++;
     v->sexpr.cell = realloc(v->sexpr.cell, sizeof(Lval*) * v->sexpr.count);
     v->sexpr.cell[v->sexpr.count - 1] = x;
@@ -94,6 +199,7 @@ Lval *lval_add(Lval *v, Lval *x) {
 }
 
 Lval *lval_add_front(Lval *v, Lval *x) {
+    lval_sexpr_own(v);
     v->sexpr.count++;
     v->sexpr.cell = realloc(v->sexpr.cell, sizeof(Lval*) * v->sexpr.count);
     memmove(&v->sexpr.cell[1], &v->sexpr.cell[0], sizeof(Lval*) * (v->sexpr.count - 1));
@@ -102,6 +208,7 @@ Lval *lval_add_front(Lval *v, Lval *x) {
 }
 
 Lval *lval_pop(Lval *v, int i) {
+    lval_sexpr_own(v);
     Lval *x = v->sexpr.cell[i];
     
     // Shift memory after the item at "i" over the top
@@ -126,6 +233,9 @@ Lval *lval_copy(Lval *v) {
         case LVAL_NUM:
             x->num = v->num;
             break;
+        case LVAL_FLOAT:
+            x->fnum = v->fnum;
+            break;
         case LVAL_SYM:
             x->sym = malloc(strlen(v->sym) + 1);
             strcpy(x->sym, v->sym);
@@ -141,12 +251,13 @@ Lval *lval_copy(Lval *v) {
         case LVAL_LAMBDA:
             x->lambda.formals = lval_copy(v->lambda.formals);
             x->lambda.body = lval_copy(v->lambda.body);
-            x->lambda.env = v->lambda.env; // Share the environment
+            x->lambda.closure = v->lambda.closure; // Share the environment and cache
+            __atomic_add_fetch(&x->lambda.closure->refs, 1, __ATOMIC_RELAXED);
             break;
         case LVAL_MACRO:
             x->macro.formals = lval_copy(v->macro.formals);
             x->macro.body = lval_copy(v->macro.body);
-            x->macro.env = v->macro.env; // Share the environment like lambda
+            x->macro.env = lenv_retain(v->macro.env); // Share the environment like lambda
             break;
         case LVAL_SEXPR:
             x->sexpr.count = v->sexpr.count;
@@ -154,6 +265,58 @@ Lval *lval_copy(Lval *v) {
             for (int i = 0; i < x->sexpr.count; i++) {
                 x->sexpr.cell[i] = lval_copy(v->sexpr.cell[i]);
             }
+            x->sexpr.match = lmatch_retain(v->sexpr.match);
+            break;
+        case LVAL_PROMISE:
+            x->promise = lpromise_retain(v->promise);
+            break;
+        case LVAL_SEQ:
+            x->seq = lseq_retain(v->seq);
+            break;
+        case LVAL_CELL:
+            x->cell = v->cell;
+            break;
+        case LVAL_GENERIC:
+            x->generic = lgeneric_retain(v->generic);
+            break;
+        case LVAL_RECORD:
+            x->record = lrecord_retain(v->record);
+            break;
+        case LVAL_RECFN:
+            x->recfn.type = lrtype_retain(v->recfn.type);
+            x->recfn.op = v->recfn.op;
+            x->recfn.slot = v->recfn.slot;
+            break;
+        case LVAL_VECTOR:
+            x->vec.store = lvstore_retain(v->vec.store);
+            x->vec.start = v->vec.start;
+            x->vec.count = v->vec.count;
+            break;
+        case LVAL_PVEC:
+            x->pvec = lpvec_retain(v->pvec);
+            break;
+        case LVAL_MAP:
+            x->map.root = lmnode_retain(v->map.root);
+            x->map.count = v->map.count;
+            break;
+        case LVAL_TRANSIENT:
+            x->transient = ltransient_retain(v->transient);
+            break;
+        case LVAL_SORTED:
+            x->sorted.root = lsnode_retain(v->sorted.root);
+            x->sorted.count = v->sorted.count;
+            break;
+        case LVAL_BIGNUM:
+            x->big = lbig_retain(v->big);
+            break;
+        case LVAL_TYPED:
+            x->typed = ltyped_retain(v->typed);
+            break;
+        case LVAL_MATRIX:
+            x->mat = lmatrix_retain(v->mat);
+            break;
+        case LVAL_BITSET:
+            x->bits = lbitset_retain(v->bits);
             break;
     }
     
@@ -168,6 +331,9 @@ char *lval_to_string(Lval *v) {
         case LVAL_NUM:
             snprintf(result, 1024, "%ld", v->num);
             break;
+        case LVAL_FLOAT:
+            lfloat_print(v->fnum, result, 1024);
+            break;
         case LVAL_SYM:
             strncpy(result, v->sym, 1023);
             result[1023] = '\0';
@@ -184,21 +350,184 @@ char *lval_to_string(Lval *v) {
         case LVAL_MACRO:
             snprintf(result, 1024, "<macro>");
             break;
-        case LVAL_SEXPR:
-            strcpy(result, "(");
-            for (int i = 0; i < v->sexpr.count; i++) {
-                char *child_str = lval_to_string(v->sexpr.cell[i]);
-                strcat(result, child_str);
-                free(child_str);
-                if (i != v->sexpr.count - 1) {
-                    strcat(result, " ");
-                }
+        case LVAL_PROMISE:
+            snprintf(result, 1024, "<promise>");
+            break;
+        case LVAL_SEQ:
+            snprintf(result, 1024, "<seq>");
+            break;
+        case LVAL_CELL:
+            snprintf(result, 1024, "<cell>");
+            break;
+        case LVAL_GENERIC:
+            snprintf(result, 1024, "<generic %s>", lgeneric_name(v->generic));
+            break;
+        case LVAL_RECORD:
+            lrecord_print(v->record, result, 1024);
+            break;
+        case LVAL_RECFN:
+            snprintf(result, 1024, "<struct %s>", lrtype_name(v->recfn.type));
+            break;
+        case LVAL_VECTOR:
+            lvector_print(v, result, 1024);
+            break;
+        case LVAL_PVEC:
+            lpvec_print(v->pvec, result, 1024);
+            break;
+        case LVAL_MAP:
+            lmap_print(v, result, 1024);
+            break;
+        case LVAL_TRANSIENT:
+            ltransient_print(v->transient, result, 1024);
+            break;
+        case LVAL_SORTED:
+            lsorted_print(v, result, 1024);
+            break;
+        case LVAL_BIGNUM:
+            free(result);
+            result = lbig_to_string(v->big);
+            break;
+        case LVAL_TYPED:
+            ltyped_print(v->typed, result, 1024);
+            break;
+        case LVAL_MATRIX:
+            lmatrix_print(v->mat, result, 1024);
+            break;
+        case LVAL_BITSET:
+            lbitset_print(v->bits, result, 1024);
+            break;
+        case LVAL_SEXPR: {
+            // Items such as bignums print at any length, so the list is
+            // sized from its items' strings
+            int n = v->sexpr.count;
+            char **items = malloc(sizeof(char*) * (n > 0 ? n : 1));
+            size_t size = 3;
+            for (int i = 0; i < n; i++) {
+                items[i] = lval_to_string(v->sexpr.cell[i]);
+                size += strlen(items[i]) + 1;
+            }
+            if (size > 1024) result = realloc(result, size);
+            
+            char *out = result;
+            *out++ = '(';
+            for (int i = 0; i < n; i++) {
+                size_t len = strlen(items[i]);
+                memcpy(out, items[i], len);
+                out += len;
+                if (i != n - 1) *out++ = ' ';
+                free(items[i]);
             }
-            strcat(result, ")");
+            *out++ = ')';
+            *out = '\0';
+            free(items);
             break;
+        }
         default:
             strcpy(result, "Unknown type");
     }
     
     return result;
-}
\ No newline at end of file
+}
+
+// FNV-1a over the structure of a value, so equal values hash equally
+static unsigned long hash_mix(unsigned long h, unsigned long x) {
+    for (int i = 0; i < (int)sizeof(x); i++) {
+        h ^= (x >> (i * 8)) & 0xff;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+static unsigned long hash_str(unsigned long h, char *s) {
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+unsigned long lval_hash(Lval *v) {
+    unsigned long h = hash_mix(14695981039346656037UL, v->type);
+    
+    switch (v->type) {
+        case LVAL_NUM: return hash_mix(h, (unsigned long)v->num);
+        case LVAL_SYM: return hash_str(h, v->sym);
+        case LVAL_ERR: return hash_str(h, v->err);
+        case LVAL_FUN: return hash_str(h, v->fun);
+        case LVAL_LAMBDA:
+            h = hash_mix(h, lval_hash(v->lambda.formals));
+            return hash_mix(h, lval_hash(v->lambda.body));
+        case LVAL_MACRO:
+            h = hash_mix(h, lval_hash(v->macro.formals));
+            return hash_mix(h, lval_hash(v->macro.body));
+        case LVAL_SEXPR:
+            h = hash_mix(h, v->sexpr.count);
+            for (int i = 0; i < v->sexpr.count; i++) {
+                h = hash_mix(h, lval_hash(v->sexpr.cell[i]));
+            }
+            return h;
+        case LVAL_PROMISE: return hash_mix(h, (unsigned long)v->promise);
+        case LVAL_SEQ: return hash_mix(h, (unsigned long)v->seq);
+        case LVAL_CELL: return hash_mix(h, (unsigned long)v->cell);
+        case LVAL_GENERIC: return hash_mix(h, (unsigned long)v->generic);
+        case LVAL_RECORD: return hash_mix(h, lrecord_hash(v->record));
+        case LVAL_RECFN:
+            h = hash_mix(h, (unsigned long)v->recfn.type);
+            return hash_mix(h, v->recfn.op * 65536 + v->recfn.slot);
+        case LVAL_VECTOR: return hash_mix(h, lvector_hash(v));
+        case LVAL_PVEC: return hash_mix(h, lpvec_hash(v->pvec));
+        case LVAL_MAP: return hash_mix(h, lmap_hash(v));
+        case LVAL_TRANSIENT: return hash_mix(h, (unsigned long)v->transient);
+        case LVAL_SORTED: return hash_mix(h, lsorted_hash(v));
+        case LVAL_BIGNUM: return hash_mix(h, lbig_hash(v->big));
+        case LVAL_FLOAT: return hash_mix(h, lfloat_hash(v->fnum));
+        case LVAL_TYPED: return hash_mix(h, ltyped_hash(v->typed));
+        case LVAL_MATRIX: return hash_mix(h, lmatrix_hash(v->mat));
+        case LVAL_BITSET: return hash_mix(h, lbitset_hash(v->bits));
+    }
+    return h;
+}
+
+int lval_eq(Lval *x, Lval *y) {
+    if (x->type != y->type) return 0;
+    
+    switch (x->type) {
+        case LVAL_NUM: return x->num == y->num;
+        case LVAL_SYM: return strcmp(x->sym, y->sym) == 0;
+        case LVAL_ERR: return strcmp(x->err, y->err) == 0;
+        case LVAL_FUN: return strcmp(x->fun, y->fun) == 0;
+        case LVAL_LAMBDA:
+            return x->lambda.closure->env == y->lambda.closure->env &&
+                   lval_eq(x->lambda.formals, y->lambda.formals) &&
+                   lval_eq(x->lambda.body, y->lambda.body);
+        case LVAL_MACRO:
+            return x->macro.env == y->macro.env &&
+                   lval_eq(x->macro.formals, y->macro.formals) &&
+                   lval_eq(x->macro.body, y->macro.body);
+        case LVAL_SEXPR:
+            if (x->sexpr.count != y->sexpr.count) return 0;
+            for (int i = 0; i < x->sexpr.count; i++) {
+                if (!lval_eq(x->sexpr.cell[i], y->sexpr.cell[i])) return 0;
+            }
+            return 1;
+        case LVAL_PROMISE: return x->promise == y->promise;
+        case LVAL_SEQ: return x->seq == y->seq;
+        case LVAL_CELL: return x->cell == y->cell;
+        case LVAL_GENERIC: return x->generic == y->generic;
+        case LVAL_RECORD: return lrecord_eq(x->record, y->record);
+        case LVAL_RECFN:
+            return x->recfn.type == y->recfn.type && x->recfn.op == y->recfn.op &&
+                   x->recfn.slot == y->recfn.slot;
+        case LVAL_VECTOR: return lvector_eq(x, y);
+        case LVAL_PVEC: return lpvec_eq(x->pvec, y->pvec);
+        case LVAL_MAP: return lmap_eq(x, y);
+        case LVAL_TRANSIENT: return x->transient == y->transient;
+        case LVAL_SORTED: return lsorted_eq(x, y);
+        case LVAL_BIGNUM: return lbig_eq(x->big, y->big);
+        case LVAL_FLOAT: return x->fnum == y->fnum;
+        case LVAL_TYPED: return ltyped_eq(x->typed, y->typed);
+        case LVAL_MATRIX: return lmatrix_eq(x->mat, y->mat);
+        case LVAL_BITSET: return lbitset_eq(x->bits, y->bits);
+    }
+    return 0;
+}
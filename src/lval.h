@@ -8,26 +8,91 @@ typedef enum {
     LVAL_ERR,
     LVAL_FUN,
     LVAL_LAMBDA,
-    LVAL_MACRO
+    LVAL_MACRO,
+    LVAL_PROMISE,
+    LVAL_SEQ,
+    LVAL_CELL,
+    LVAL_GENERIC,
+    LVAL_RECORD,
+    LVAL_RECFN,
+    LVAL_VECTOR,
+    LVAL_PVEC,
+    LVAL_MAP,
+    LVAL_TRANSIENT,
+    LVAL_SORTED,
+    LVAL_BIGNUM,
+    LVAL_FLOAT,
+    LVAL_TYPED,
+    LVAL_MATRIX,
+    LVAL_BITSET
 } LvalType;
 
 typedef struct Lenv Lenv;
+typedef struct Lmemo Lmemo;
+typedef struct Lclosure Lclosure;
+typedef struct Lpromise Lpromise;
+typedef struct Lseq Lseq;
+typedef struct Lcell Lcell;
+typedef struct Lgeneric Lgeneric;
+typedef struct Lrtype Lrtype;
+typedef struct Lrecord Lrecord;
+typedef struct Lvstore Lvstore;
+typedef struct Lpvec Lpvec;
+typedef struct Lmnode Lmnode;
+typedef struct Ltransient Ltransient;
+typedef struct Lsnode Lsnode;
+typedef struct Lbig Lbig;
+typedef struct Ltyped Ltyped;
+typedef struct Lmatrix Lmatrix;
+typedef struct Lbitset Lbitset;
+typedef struct Lmatch Lmatch;
 
 typedef struct Lval {
     LvalType type;
     union {
         long num;
+        double fnum;       // inline, like num, so float results need no box of their own
+        Lbig *big;         // shared between copies, never changed; beyond a long
         char *sym;
         char *err;
         char *fun;
+        Lpromise *promise; // shared between copies
+        Lseq *seq;         // shared between copies
+        Lcell *cell;       // owned by the env's cell graph
+        Lgeneric *generic; // shared between copies
+        Lrecord *record;   // shared between copies, never changed once shared
+        Lpvec *pvec;       // shared between copies, never changed; NULL when empty
+        Ltransient *transient; // shared between copies
+        Ltyped *typed;     // shared between copies, never changed
+        Lmatrix *mat;      // shared between copies, never changed
+        Lbitset *bits;     // shared between copies, changed only by a sole holder
+        struct {
+            Lrtype *type;
+            int op;        // constructor, predicate, accessor or setter
+            int slot;
+        } recfn;
+        struct {
+            Lvstore *store; // shared between views
+            int start;
+            int count;      // -1 for a whole vector, which ends with the store
+        } vec;
+        struct {
+            Lmnode *root;   // shared between copies, never changed once shared
+            int count;
+        } map;
+        struct {
+            Lsnode *root;   // shared between copies, never changed once shared
+            int count;
+        } sorted;
         struct {
             struct Lval **cell;
             int count;
+            Lmatch *match; // tree of a (match ...) form, shared between copies; or NULL
         } sexpr;
         struct {
             struct Lval *formals;
             struct Lval *body;
-            Lenv *env;
+            Lclosure *closure; // shared between copies
         } lambda;
         struct {
             struct Lval *formals;
@@ -37,19 +102,43 @@ typedef struct Lval {
     };
 } Lval;
 
+// What copies of a lambda share, kept out of line so Lval stays four words.
+// Copies that are about to change it take their own with lval_closure_own.
+struct Lclosure {
+    int refs;
+    Lenv *env;
+    int escapes; // body may capture its call frame in a closure
+    Lval *fixnums; // formals declared fixnum, or NULL
+    int safety;  // 0 trusts the declarations, 1 checks them at entry
+    int pure;    // body only calls pure builtins and pure lambdas
+    int declared; // (declare (pure)) given, so pure is trusted, never judged
+    unsigned long judged; // purity epoch pure was judged in; stale once it moves on
+    int judging; // depth of the judgment in progress over this lambda, or 0
+    long cost;   // work a call is estimated to take, for forking arguments
+    unsigned long costed; // purity epoch cost was estimated in
+    int costing; // cost estimate in progress over this lambda
+    Lmemo *memo; // shared result cache, or NULL when not memoized
+};
+
 Lval *lval_num(long x);
+Lval *lval_float(double x);
 Lval *lval_sym(char *s);
 Lval *lval_err(char *m);
 Lval *lval_fun(char *f);
 Lval *lval_lambda(Lval *formals, Lval *body, Lenv *env);
+Lclosure *lval_closure_own(Lval *f);
 Lval *lval_macro(Lval *formals, Lval *body, Lenv *env);
 Lval *lval_sexpr(void);
+void lval_sexpr_own(Lval *v);
 Lval *lval_add(Lval *v, Lval *x);
 Lval *lval_add_front(Lval *v, Lval *x);
 Lval *lval_pop(Lval *v, int i);
 Lval *lval_take(Lval *v, int i);
 Lval *lval_copy(Lval *v);
 void lval_free(Lval *v);
+void lval_clear(Lval *v);
 char *lval_to_string(Lval *v);
+unsigned long lval_hash(Lval *v);
+int lval_eq(Lval *x, Lval *y);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,490 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map.h"
+
+// A map is a persistent hash array mapped trie. Each node covers five
+// bits of a key's structural hash and has 32 slots; two bitmaps say which
+// slots hold an entry directly and which hold a subtree, and only the
+// occupied slots are stored, entries first, so finding a slot is a
+// popcount. Keys whose hashes agree on every bit end up together in a
+// collision node that is scanned linearly. Updates copy the nodes on the
+// path to the changed slot and share everything else, including the
+// entries themselves, which are reference counted and never changed.
+// Removing a key pulls a subtree left with one entry back up into its
+// parent, so equal maps always have the same shape.
+#define MAP_BITS 5
+#define MAP_HASH_BITS ((int)sizeof(unsigned long) * 8)
+
+typedef struct Lmentry {
+    int refs;
+    unsigned long hash;
+    Lval key;
+    Lval val;
+} Lmentry;
+
+typedef union {
+    Lmentry *entry;
+    Lmnode *node;
+} Lmslot;
+
+struct Lmnode {
+    int refs;
+    unsigned datamap;  // slots holding an entry; 0 with nodemap for a collision node
+    unsigned nodemap;  // slots holding a subtree
+    int count;         // entries held directly
+    Lmslot slots[];    // entries in slot order, then subtrees in slot order
+};
+
+// Moves the contents of a heap Lval into an entry
+static void slot_move(Lval *slot, Lval *v) {
+    *slot = *v;
+    free(v);
+}
+
+static Lmentry *entry_new(unsigned long hash, Lval *key, Lval *val) {
+    Lmentry *x = malloc(sizeof(Lmentry));
+    x->refs = 1;
+    x->hash = hash;
+    slot_move(&x->key, key);
+    slot_move(&x->val, val);
+    return x;
+}
+
+static Lmentry *entry_retain(Lmentry *x) {
+    __atomic_add_fetch(&x->refs, 1, __ATOMIC_RELAXED);
+    return x;
+}
+
+static void entry_release(Lmentry *x) {
+    if (__atomic_sub_fetch(&x->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    
+    lval_clear(&x->key);
+    lval_clear(&x->val);
+    free(x);
+}
+
+static Lmnode *node_alloc(unsigned datamap, unsigned nodemap, int entries, int nodes) {
+    Lmnode *n = malloc(sizeof(Lmnode) + sizeof(Lmslot) * (entries + nodes));
+    n->refs = 1;
+    n->datamap = datamap;
+    n->nodemap = nodemap;
+    n->count = entries;
+    return n;
+}
+
+Lmnode *lmnode_retain(Lmnode *n) {
+    if (n) __atomic_add_fetch(&n->refs, 1, __ATOMIC_RELAXED);
+    return n;
+}
+
+void lmnode_release(Lmnode *n) {
+    if (n == NULL || __atomic_sub_fetch(&n->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    
+    for (int i = 0; i < n->count; i++) {
+        entry_release(n->slots[i].entry);
+    }
+    int nodes = __builtin_popcount(n->nodemap);
+    for (int i = 0; i < nodes; i++) {
+        lmnode_release(n->slots[n->count + i].node);
+    }
+    free(n);
+}
+
+static int is_collision(Lmnode *n) {
+    return n->datamap == 0 && n->nodemap == 0;
+}
+
+static unsigned slot_bit(unsigned long hash, int shift) {
+    return 1u << ((hash >> shift) & ((1 << MAP_BITS) - 1));
+}
+
+static Lmentry *entry_at(Lmnode *n, unsigned bit) {
+    return n->slots[__builtin_popcount(n->datamap & (bit - 1))].entry;
+}
+
+static Lmnode *node_at(Lmnode *n, unsigned bit) {
+    return n->slots[n->count + __builtin_popcount(n->nodemap & (bit - 1))].node;
+}
+
+static int entry_is(Lmentry *x, unsigned long hash, Lval *key) {
+    return x->hash == hash && lval_eq(&x->key, key);
+}
+
+// Rebuilds n with new bitmaps, taking ownership of the entry for ebit and
+// the subtree for nbit; every other slot is carried over. A copy shares
+// the carried slots with n. When own is set nothing else holds n, so it
+// is rearranged in place instead, releasing the slots it drops.
+static Lmnode *node_with(Lmnode *n, unsigned datamap, unsigned nodemap,
+                         unsigned ebit, Lmentry *entry, unsigned nbit, Lmnode *child, int own) {
+    Lmslot slots[1 << MAP_BITS];
+    int size = 0;
+    for (unsigned b = datamap; b; b &= b - 1) {
+        unsigned bit = b & -b;
+        Lmentry *x = bit == ebit ? entry : entry_at(n, bit);
+        slots[size++].entry = bit == ebit || own ? x : entry_retain(x);
+    }
+    for (unsigned b = nodemap; b; b &= b - 1) {
+        unsigned bit = b & -b;
+        Lmnode *x = bit == nbit ? child : node_at(n, bit);
+        slots[size++].node = bit == nbit || own ? x : lmnode_retain(x);
+    }
+    
+    if (own) {
+        for (unsigned b = n->datamap; b; b &= b - 1) {
+            unsigned bit = b & -b;
+            if (!(datamap & bit) || bit == ebit) entry_release(entry_at(n, bit));
+        }
+        for (unsigned b = n->nodemap; b; b &= b - 1) {
+            unsigned bit = b & -b;
+            if (!(nodemap & bit) || bit == nbit) lmnode_release(node_at(n, bit));
+        }
+        if (size != n->count + __builtin_popcount(n->nodemap)) {
+            n = realloc(n, sizeof(Lmnode) + sizeof(Lmslot) * size);
+        }
+        n->datamap = datamap;
+        n->nodemap = nodemap;
+        n->count = __builtin_popcount(datamap);
+    } else {
+        n = node_alloc(datamap, nodemap, __builtin_popcount(datamap), size - __builtin_popcount(datamap));
+    }
+    memcpy(n->slots, slots, sizeof(Lmslot) * size);
+    return n;
+}
+
+// Copies a collision node, replacing entry i, or appending when i is count
+// and dropping it when entry is NULL
+static Lmnode *collision_with(Lmnode *n, int i, Lmentry *entry) {
+    int count = n->count + (i == n->count) - (entry == NULL);
+    Lmnode *m = node_alloc(0, 0, count, 0);
+    
+    int k = 0;
+    for (int j = 0; j < n->count; j++) {
+        if (j != i) m->slots[k++].entry = entry_retain(n->slots[j].entry);
+        else if (entry) m->slots[k++].entry = entry;
+    }
+    if (i == n->count) m->slots[k].entry = entry;
+    return m;
+}
+
+// The smallest subtree holding two entries with different keys
+static Lmnode *node_pair(Lmentry *a, Lmentry *b, int shift) {
+    if (shift >= MAP_HASH_BITS) {
+        Lmnode *n = node_alloc(0, 0, 2, 0);
+        n->slots[0].entry = a;
+        n->slots[1].entry = b;
+        return n;
+    }
+    
+    unsigned abit = slot_bit(a->hash, shift);
+    unsigned bbit = slot_bit(b->hash, shift);
+    if (abit == bbit) {
+        Lmnode *n = node_alloc(0, abit, 0, 1);
+        n->slots[0].node = node_pair(a, b, shift + MAP_BITS);
+        return n;
+    }
+    
+    Lmnode *n = node_alloc(abit | bbit, 0, 2, 0);
+    n->slots[abit < bbit ? 0 : 1].entry = a;
+    n->slots[abit < bbit ? 1 : 0].entry = b;
+    return n;
+}
+
+// Borrows n and takes the entry; *added is set when the key is new. With
+// edit set the caller holds the only path to n, so n is changed in place
+// whenever nothing else holds it either.
+static Lmnode *node_assoc(Lmnode *n, int shift, Lmentry *x, int *added, int edit) {
+    if (n == NULL) {
+        n = node_alloc(slot_bit(x->hash, shift), 0, 1, 0);
+        n->slots[0].entry = x;
+        *added = 1;
+        return n;
+    }
+    
+    int own = edit && __atomic_load_n(&n->refs, __ATOMIC_ACQUIRE) == 1;
+    
+    if (is_collision(n)) {
+        int i = 0;
+        while (i < n->count && !entry_is(n->slots[i].entry, x->hash, &x->key)) i++;
+        *added = i == n->count;
+        if (!own) return collision_with(n, i, x);
+        if (i < n->count) {
+            entry_release(n->slots[i].entry);
+        } else {
+            n = realloc(n, sizeof(Lmnode) + sizeof(Lmslot) * ++n->count);
+        }
+        n->slots[i].entry = x;
+        return n;
+    }
+    
+    unsigned bit = slot_bit(x->hash, shift);
+    if (n->datamap & bit) {
+        Lmentry *old = entry_at(n, bit);
+        if (entry_is(old, x->hash, &x->key)) {
+            return node_with(n, n->datamap, n->nodemap, bit, x, 0, NULL, own);
+        }
+        *added = 1;
+        Lmnode *child = node_pair(entry_retain(old), x, shift + MAP_BITS);
+        return node_with(n, n->datamap & ~bit, n->nodemap | bit, 0, NULL, bit, child, own);
+    }
+    if (n->nodemap & bit) {
+        Lmnode *old = node_at(n, bit);
+        int mine = own && __atomic_load_n(&old->refs, __ATOMIC_ACQUIRE) == 1;
+        Lmnode *child = node_assoc(old, shift + MAP_BITS, x, added, mine);
+        if (!mine) return node_with(n, n->datamap, n->nodemap, 0, NULL, bit, child, own);
+        
+        // The subtree was changed in place, though it may have moved
+        n->slots[n->count + __builtin_popcount(n->nodemap & (bit - 1))].node = child;
+        return n;
+    }
+    *added = 1;
+    return node_with(n, n->datamap | bit, n->nodemap, bit, x, 0, NULL, own);
+}
+
+// Borrows n; returns n itself, retained, when the key is absent, and NULL
+// when the last entry goes
+static Lmnode *node_dissoc(Lmnode *n, int shift, Lval *key, unsigned long hash, int *removed) {
+    if (is_collision(n)) {
+        for (int i = 0; i < n->count; i++) {
+            if (entry_is(n->slots[i].entry, hash, key)) {
+                *removed = 1;
+                return collision_with(n, i, NULL);
+            }
+        }
+        return lmnode_retain(n);
+    }
+    
+    unsigned bit = slot_bit(hash, shift);
+    if (n->datamap & bit) {
+        if (!entry_is(entry_at(n, bit), hash, key)) return lmnode_retain(n);
+        *removed = 1;
+        if (n->count == 1 && n->nodemap == 0) return NULL;
+        return node_with(n, n->datamap & ~bit, n->nodemap, 0, NULL, 0, NULL, 0);
+    }
+    if (n->nodemap & bit) {
+        Lmnode *child = node_dissoc(node_at(n, bit), shift + MAP_BITS, key, hash, removed);
+        if (!*removed) {
+            lmnode_release(child);
+            return lmnode_retain(n);
+        }
+        
+        // A subtree always holds two or more entries; one left over moves up
+        if (child->nodemap == 0 && child->count == 1) {
+            Lmentry *x = entry_retain(child->slots[0].entry);
+            lmnode_release(child);
+            return node_with(n, n->datamap | bit, n->nodemap & ~bit, bit, x, 0, NULL, 0);
+        }
+        return node_with(n, n->datamap, n->nodemap, 0, NULL, bit, child, 0);
+    }
+    return lmnode_retain(n);
+}
+
+static Lmentry *node_find(Lmnode *n, Lval *key, unsigned long hash) {
+    for (int shift = 0; n; shift += MAP_BITS) {
+        if (is_collision(n)) {
+            for (int i = 0; i < n->count; i++) {
+                if (entry_is(n->slots[i].entry, hash, key)) return n->slots[i].entry;
+            }
+            return NULL;
+        }
+        
+        unsigned bit = slot_bit(hash, shift);
+        if (n->datamap & bit) {
+            Lmentry *x = entry_at(n, bit);
+            return entry_is(x, hash, key) ? x : NULL;
+        }
+        n = n->nodemap & bit ? node_at(n, bit) : NULL;
+    }
+    return NULL;
+}
+
+// Calls f on every entry, in hash order
+static void node_walk(Lmnode *n, void (*f)(Lmentry *x, void *ctx), void *ctx) {
+    if (n == NULL) return;
+    
+    for (int i = 0; i < n->count; i++) {
+        f(n->slots[i].entry, ctx);
+    }
+    int nodes = __builtin_popcount(n->nodemap);
+    for (int i = 0; i < nodes; i++) {
+        node_walk(n->slots[n->count + i].node, f, ctx);
+    }
+}
+
+static void hash_entry(Lmentry *x, void *ctx) {
+    // Summed, so the order entries are met in does not matter
+    *(unsigned long *)ctx += x->hash * 1099511628211UL ^ lval_hash(&x->val);
+}
+
+unsigned long lmap_hash(Lval *m) {
+    unsigned long h = (unsigned long)m->map.count;
+    node_walk(m->map.root, hash_entry, &h);
+    return h;
+}
+
+typedef struct {
+    Lmnode *other;
+    int same;
+} MapEq;
+
+static void eq_entry(Lmentry *x, void *ctx) {
+    MapEq *eq = ctx;
+    if (!eq->same) return;
+    Lmentry *y = node_find(eq->other, &x->key, x->hash);
+    eq->same = y && lval_eq(&x->val, &y->val);
+}
+
+int lmap_eq(Lval *x, Lval *y) {
+    if (x->map.root == y->map.root) return 1;
+    if (x->map.count != y->map.count) return 0;
+    
+    MapEq eq = {y->map.root, 1};
+    node_walk(x->map.root, eq_entry, &eq);
+    return eq.same;
+}
+
+typedef struct {
+    char *out;
+    int size;
+    int n;
+} MapPrint;
+
+static void print_entry(Lmentry *x, void *ctx) {
+    MapPrint *p = ctx;
+    if (p->n >= p->size) return;
+    char *key = lval_to_string(&x->key);
+    char *val = lval_to_string(&x->val);
+    p->n += snprintf(p->out + p->n, p->size - p->n, p->n > 1 ? " %s %s" : "%s %s", key, val);
+    free(key);
+    free(val);
+}
+
+void lmap_print(Lval *m, char *out, int size) {
+    MapPrint p = {out, size, snprintf(out, size, "{")};
+    node_walk(m->map.root, print_entry, &p);
+    if (p.n < size) snprintf(out + p.n, size - p.n, "}");
+}
+
+static void add_key(Lmentry *x, void *ctx) {
+    lval_add(ctx, lval_copy(&x->key));
+}
+
+static void add_val(Lmentry *x, void *ctx) {
+    lval_add(ctx, lval_copy(&x->val));
+}
+
+static Lval *lval_map(Lmnode *root, int count) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_MAP;
+    v->map.root = root;
+    v->map.count = count;
+    return v;
+}
+
+// Takes ownership of the key and value. Nodes that m alone holds are
+// updated in place; the rest are copied along the path.
+void lmap_put(Lval *m, Lval *key, Lval *val) {
+    Lmnode *old = m->map.root;
+    int own = old && __atomic_load_n(&old->refs, __ATOMIC_ACQUIRE) == 1;
+    
+    int added = 0;
+    Lmentry *x = entry_new(lval_hash(key), key, val);
+    m->map.root = node_assoc(old, 0, x, &added, 1);
+    if (!own) lmnode_release(old);
+    m->map.count += added;
+}
+
+static void map_remove(Lval *m, Lval *key) {
+    if (m->map.root == NULL) return;
+    
+    int removed = 0;
+    Lmnode *root = node_dissoc(m->map.root, 0, key, lval_hash(key), &removed);
+    lmnode_release(m->map.root);
+    m->map.root = root;
+    m->map.count -= removed;
+}
+
+int map_handles(char *name, Lval *a) {
+    if (strcmp(name, "hash-map") == 0 || strcmp(name, "get") == 0 || strcmp(name, "assoc") == 0 ||
+        strcmp(name, "dissoc") == 0 || strcmp(name, "contains?") == 0 ||
+        strcmp(name, "keys") == 0 || strcmp(name, "vals") == 0) {
+        return 1;
+    }
+    if (strcmp(name, "len") == 0) {
+        return a->sexpr.count == 1 && a->sexpr.cell[0]->type == LVAL_MAP;
+    }
+    return 0;
+}
+
+static Lval *map_err(Lval *a, char *name, char *what) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Function '%s' passed %s!", name, what);
+    lval_free(a);
+    return lval_err(msg);
+}
+
+Lval *builtin_map(Lval *a, char *name) {
+    // (hash-map k v ...) and (assoc m k v ...) take keys and values in pairs
+    if (strcmp(name, "hash-map") == 0 || strcmp(name, "assoc") == 0) {
+        int first = strcmp(name, "assoc") == 0;
+        if (a->sexpr.count < first || (a->sexpr.count - first) % 2 != 0) {
+            return map_err(a, name, "incorrect number of arguments");
+        }
+        if (first && a->sexpr.cell[0]->type != LVAL_MAP) return map_err(a, name, "incorrect type");
+        
+        Lval *m = first ? lval_pop(a, 0) : lval_map(NULL, 0);
+        while (a->sexpr.count > 0) {
+            Lval *key = lval_pop(a, 0);
+            lmap_put(m, key, lval_pop(a, 0));
+        }
+        lval_free(a);
+        return m;
+    }
+    
+    if (a->sexpr.count < 1) return map_err(a, name, "incorrect number of arguments");
+    if (a->sexpr.cell[0]->type != LVAL_MAP) return map_err(a, name, "incorrect type");
+    Lval *m = a->sexpr.cell[0];
+    
+    if (strcmp(name, "dissoc") == 0) {
+        m = lval_pop(a, 0);
+        for (int i = 0; i < a->sexpr.count; i++) {
+            map_remove(m, a->sexpr.cell[i]);
+        }
+        lval_free(a);
+        return m;
+    }
+    
+    if (strcmp(name, "len") == 0 || strcmp(name, "keys") == 0 || strcmp(name, "vals") == 0) {
+        if (a->sexpr.count != 1) return map_err(a, name, "incorrect number of arguments");
+        Lval *v = NULL;
+        if (strcmp(name, "len") == 0) {
+            v = lval_num(m->map.count);
+        } else {
+            v = lval_sexpr();
+            node_walk(m->map.root, strcmp(name, "keys") == 0 ? add_key : add_val, v);
+        }
+        lval_free(a);
+        return v;
+    }
+    
+    // (get m k) fails on a missing key; (get m k default) returns the default
+    int want = strcmp(name, "get") == 0 ? 3 : 2;
+    if (a->sexpr.count != 2 && a->sexpr.count != want) {
+        return map_err(a, name, "incorrect number of arguments");
+    }
+    Lval *key = a->sexpr.cell[1];
+    Lmentry *x = node_find(m->map.root, key, lval_hash(key));
+    
+    if (strcmp(name, "contains?") == 0) {
+        lval_free(a);
+        return lval_num(x != NULL);
+    }
+    if (x == NULL) {
+        if (a->sexpr.count == 3) return lval_take(a, 2);
+        return map_err(a, name, "a missing key");
+    }
+    Lval *v = lval_copy(&x->val);
+    lval_free(a);
+    return v;
+}
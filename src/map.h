@@ -0,0 +1,16 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include "lval.h"
+
+Lmnode *lmnode_retain(Lmnode *n);
+void lmnode_release(Lmnode *n);
+unsigned long lmap_hash(Lval *m);
+int lmap_eq(Lval *x, Lval *y);
+void lmap_print(Lval *m, char *out, int size);
+void lmap_put(Lval *m, Lval *key, Lval *val);
+
+int map_handles(char *name, Lval *a);
+Lval *builtin_map(Lval *a, char *name);
+
+#endif
@@ -0,0 +1,564 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "match.h"
+#include "eval.h"
+#include "bignum.h"
+
+// (match expr (pattern body) ...) tries each clause in order. Patterns are
+// `_` (anything), a symbol (binds the value), a number (equal to the value
+// as by =) or a quoted datum such as 'a (equal to the value), or a list of
+// patterns, optionally ending in `& rest` to bind the remaining items.
+//
+// All clauses of a match form are compiled once into a decision tree: each
+// inner node tests one position of the value (reached by a path of cell
+// indices) and every leaf names the clause to run and where its variables
+// live. Matching then walks the value in place, and bound items are moved
+// into the clause's frame rather than copied.
+
+typedef enum { TEST_EXACT, TEST_ATLEAST, TEST_LIT, TEST_LEAF } TestKind;
+
+// One test on a value: a list length, or equality with a literal
+typedef struct {
+    TestKind kind;
+    long arg;     // list length
+    Lval *lit;    // literal, borrowed from the compiled clauses
+} Test;
+
+typedef struct {
+    char *name;   // borrowed from the compiled clauses
+    int *path;
+    int depth;
+    int rest;     // -1, or the index the rest of the list starts at
+} Binding;
+
+typedef struct Lmatch_node {
+    TestKind kind;
+    int *path;
+    int depth;
+    long arg;     // list length
+    Lval *lit;    // literal to compare with
+    struct Lmatch_node *yes;
+    struct Lmatch_node *no;
+    int clause;   // leaves only; -1 when nothing matched
+    Binding *binds;
+    int nbinds;
+} Lmatch_node;
+
+// A pending test of one clause: the pattern that must hold at path
+typedef struct {
+    int *path;
+    int depth;
+    Lval *pat;
+} Constraint;
+
+typedef struct {
+    int clause;
+    Constraint *cons;
+    int ncons;
+    Binding *binds;
+    int nbinds;
+} Row;
+
+static int *path_copy(int *path, int depth) {
+    int *p = malloc(sizeof(int) * (depth + 1));
+    if (depth > 0) memcpy(p, path, sizeof(int) * depth);
+    return p;
+}
+
+static int *path_extend(int *path, int depth, int i) {
+    int *p = path_copy(path, depth);
+    p[depth] = i;
+    return p;
+}
+
+static int path_eq(int *a, int da, int *b, int db) {
+    return da == db && (da == 0 || memcmp(a, b, sizeof(int) * da) == 0);
+}
+
+static int is_sym(Lval *x, char *s) {
+    return x->type == LVAL_SYM && strcmp(x->sym, s) == 0;
+}
+
+// (quote x), which the reader makes of 'x
+static int is_quoted(Lval *p) {
+    return p->type == LVAL_SEXPR && p->sexpr.count == 2 && is_sym(p->sexpr.cell[0], "quote");
+}
+
+// Validates a pattern; returns NULL or an error
+static Lval *pattern_check(Lval *p) {
+    if (lval_is_number(p) || is_quoted(p)) return NULL;
+    if (p->type == LVAL_SYM) {
+        return is_sym(p, "&") ? lval_err("Misplaced '&' in match pattern!") : NULL;
+    }
+    if (p->type != LVAL_SEXPR) return lval_err("Invalid match pattern!");
+    
+    for (int i = 0; i < p->sexpr.count; i++) {
+        if (is_sym(p->sexpr.cell[i], "&")) {
+            if (i != p->sexpr.count - 2 || p->sexpr.cell[i + 1]->type != LVAL_SYM ||
+                is_sym(p->sexpr.cell[i + 1], "&")) {
+                return lval_err("'&' must be followed by exactly one symbol!");
+            }
+            return NULL;
+        }
+        Lval *err = pattern_check(p->sexpr.cell[i]);
+        if (err) return err;
+    }
+    return NULL;
+}
+
+// Adds the symbols a pattern binds to vars
+void match_pattern_vars(Lval *p, Lval *vars) {
+    if (p->type == LVAL_SYM && !is_sym(p, "_") && !is_sym(p, "&")) {
+        lval_add(vars, lval_copy(p));
+    }
+    if (p->type == LVAL_SEXPR && !is_quoted(p)) {
+        for (int i = 0; i < p->sexpr.count; i++) {
+            match_pattern_vars(p->sexpr.cell[i], vars);
+        }
+    }
+}
+
+// Number of fixed items in a list pattern, and whether it has a rest part
+static int list_fixed(Lval *p, int *has_rest) {
+    *has_rest = p->sexpr.count >= 2 && is_sym(p->sexpr.cell[p->sexpr.count - 2], "&");
+    return *has_rest ? p->sexpr.count - 2 : p->sexpr.count;
+}
+
+static Test pattern_test(Lval *p) {
+    Test t = { TEST_LIT, 0, NULL };
+    if (lval_is_number(p)) {
+        t.lit = p;
+    } else if (is_quoted(p)) {
+        t.lit = p->sexpr.cell[1];
+    } else {
+        int has_rest;
+        t.arg = list_fixed(p, &has_rest);
+        t.kind = has_rest ? TEST_ATLEAST : TEST_EXACT;
+    }
+    return t;
+}
+
+// Numbers compare as by =, whatever their representation
+static int lit_eq(Lval *x, Lval *lit) {
+    if (lval_is_number(x) && lval_is_number(lit)) return lval_num_cmp(x, lit) == 0;
+    return lval_eq(x, lit);
+}
+
+// Whether a value known to be the literal lit passes test t
+static int lit_passes(Lval *lit, Test t) {
+    switch (t.kind) {
+        case TEST_LIT: return lit_eq(lit, t.lit);
+        case TEST_EXACT: return lit->type == LVAL_SEXPR && lit->sexpr.count == t.arg;
+        case TEST_ATLEAST: return lit->type == LVAL_SEXPR && lit->sexpr.count >= t.arg;
+        default: return 0;
+    }
+}
+
+static void row_bind(Row *r, char *name, int *path, int depth, int rest) {
+    r->binds = realloc(r->binds, sizeof(Binding) * (r->nbinds + 1));
+    r->binds[r->nbinds].name = name;
+    r->binds[r->nbinds].path = path_copy(path, depth);
+    r->binds[r->nbinds].depth = depth;
+    r->binds[r->nbinds].rest = rest;
+    r->nbinds++;
+}
+
+// Appends the constraint for pattern p at path to the list, turning
+// variables into bindings and dropping wildcards
+static void row_add(Row *r, Constraint *out, int *n, int *path, int depth, Lval *p) {
+    if (p->type == LVAL_SYM) {
+        if (!is_sym(p, "_")) row_bind(r, p->sym, path, depth, -1);
+        return;
+    }
+    out[*n].path = path_copy(path, depth);
+    out[*n].depth = depth;
+    out[*n].pat = p;
+    (*n)++;
+}
+
+static Row row_copy(Row *r) {
+    Row x;
+    x.clause = r->clause;
+    x.ncons = r->ncons;
+    x.cons = malloc(sizeof(Constraint) * (r->ncons + 1));
+    for (int i = 0; i < r->ncons; i++) {
+        x.cons[i] = r->cons[i];
+        x.cons[i].path = path_copy(r->cons[i].path, r->cons[i].depth);
+    }
+    x.nbinds = 0;
+    x.binds = NULL;
+    for (int i = 0; i < r->nbinds; i++) {
+        row_bind(&x, r->binds[i].name, r->binds[i].path, r->binds[i].depth, r->binds[i].rest);
+    }
+    return x;
+}
+
+static void row_free(Row *r) {
+    for (int i = 0; i < r->ncons; i++) free(r->cons[i].path);
+    for (int i = 0; i < r->nbinds; i++) free(r->binds[i].path);
+    free(r->cons);
+    free(r->binds);
+}
+
+// Constraint k of r is known to hold: replace it with its sub-patterns
+static void row_satisfy(Row *r, int k) {
+    Constraint c = r->cons[k];
+    int list = c.pat->type == LVAL_SEXPR && !is_quoted(c.pat);
+    Constraint *out = malloc(sizeof(Constraint) * (r->ncons + (list ? c.pat->sexpr.count : 0)));
+    int n = 0;
+    
+    for (int i = 0; i < k; i++) out[n++] = r->cons[i];
+    if (list) {
+        int has_rest;
+        int fixed = list_fixed(c.pat, &has_rest);
+        for (int i = 0; i < fixed; i++) {
+            int *child = path_extend(c.path, c.depth, i);
+            row_add(r, out, &n, child, c.depth + 1, c.pat->sexpr.cell[i]);
+            free(child);
+        }
+        Lval *rest = has_rest ? c.pat->sexpr.cell[fixed + 1] : NULL;
+        if (rest && !is_sym(rest, "_")) {
+            row_bind(r, rest->sym, c.path, c.depth, fixed);
+        }
+    }
+    for (int i = k + 1; i < r->ncons; i++) out[n++] = r->cons[i];
+    
+    free(c.path);
+    free(r->cons);
+    r->cons = out;
+    r->ncons = n;
+}
+
+// What knowing test t is `outcome` at a path says about test o at the
+// same path: 1 holds, 0 fails, -1 unknown
+static int implies(Test t, int outcome, Test o) {
+    if (t.kind == TEST_LIT) {
+        if (outcome) return lit_passes(t.lit, o);
+        return o.kind == TEST_LIT && lit_eq(t.lit, o.lit) ? 0 : -1;
+    }
+    if (o.kind == TEST_LIT) {
+        // A list test says nothing about a literal of the right shape
+        if (outcome) return lit_passes(o.lit, t) ? -1 : 0;
+        return lit_passes(o.lit, t) ? 0 : -1;
+    }
+    if (outcome) {
+        if (t.kind == TEST_EXACT) return o.kind == TEST_EXACT ? o.arg == t.arg : t.arg >= o.arg;
+        if (o.kind == TEST_EXACT) return o.arg < t.arg ? 0 : -1;
+        return o.arg <= t.arg ? 1 : -1;
+    }
+    if (t.kind == TEST_EXACT) return o.kind == TEST_EXACT && o.arg == t.arg ? 0 : -1;
+    return o.arg >= t.arg ? 0 : -1;
+}
+
+static Lmatch_node *node_new(TestKind kind) {
+    Lmatch_node *n = calloc(1, sizeof(Lmatch_node));
+    n->kind = kind;
+    n->clause = -1;
+    return n;
+}
+
+// Builds the tree for rows (consuming them). The first row decides: if it
+// has nothing left to test it wins, otherwise its first test splits every
+// row into the ones still possible when that test passes and when it fails.
+static Lmatch_node *compile_rows(Row *rows, int nrows) {
+    if (nrows == 0) {
+        free(rows);
+        return node_new(TEST_LEAF);
+    }
+    
+    if (rows[0].ncons == 0) {
+        Lmatch_node *leaf = node_new(TEST_LEAF);
+        leaf->clause = rows[0].clause;
+        leaf->binds = rows[0].binds;
+        leaf->nbinds = rows[0].nbinds;
+        rows[0].binds = NULL;
+        rows[0].nbinds = 0;
+        for (int i = 0; i < nrows; i++) row_free(&rows[i]);
+        free(rows);
+        return leaf;
+    }
+    
+    Constraint c = rows[0].cons[0];
+    Test t = pattern_test(c.pat);
+    
+    Lmatch_node *node = node_new(t.kind);
+    node->arg = t.arg;
+    node->lit = t.lit;
+    node->depth = c.depth;
+    node->path = path_copy(c.path, c.depth);
+    
+    Row *yes = malloc(sizeof(Row) * nrows);
+    Row *no = malloc(sizeof(Row) * nrows);
+    int nyes = 0, nno = 0;
+    
+    for (int i = 0; i < nrows; i++) {
+        int k = -1;
+        for (int j = 0; j < rows[i].ncons; j++) {
+            if (path_eq(rows[i].cons[j].path, rows[i].cons[j].depth, node->path, node->depth)) {
+                k = j;
+                break;
+            }
+        }
+        
+        if (k < 0) {
+            yes[nyes++] = row_copy(&rows[i]);
+            no[nno++] = rows[i];
+            continue;
+        }
+        
+        Test other = pattern_test(rows[i].cons[k].pat);
+        int on_yes = implies(t, 1, other);
+        int on_no = implies(t, 0, other);
+        
+        if (on_yes != 0) {
+            Row r = row_copy(&rows[i]);
+            if (on_yes == 1) row_satisfy(&r, k);
+            yes[nyes++] = r;
+        }
+        if (on_no != 0) {
+            no[nno++] = rows[i];
+        } else {
+            row_free(&rows[i]);
+        }
+    }
+    free(rows);
+    
+    node->yes = compile_rows(yes, nyes);
+    node->no = compile_rows(no, nno);
+    return node;
+}
+
+static Lmatch_node *match_compile(Lval *clauses) {
+    Row *rows = malloc(sizeof(Row) * clauses->sexpr.count);
+    for (int i = 0; i < clauses->sexpr.count; i++) {
+        rows[i].clause = i;
+        rows[i].cons = malloc(sizeof(Constraint));
+        rows[i].ncons = 0;
+        rows[i].binds = NULL;
+        rows[i].nbinds = 0;
+        row_add(&rows[i], rows[i].cons, &rows[i].ncons, NULL, 0, clauses->sexpr.cell[i]->sexpr.cell[0]);
+    }
+    return compile_rows(rows, clauses->sexpr.count);
+}
+
+static void node_free(Lmatch_node *n) {
+    if (n == NULL) return;
+    node_free(n->yes);
+    node_free(n->no);
+    for (int i = 0; i < n->nbinds; i++) free(n->binds[i].path);
+    free(n->binds);
+    free(n->path);
+    free(n);
+}
+
+// A compiled form: its clauses and the tree that picks one of them
+typedef struct {
+    Lval *clauses;
+    Lmatch_node *tree;
+} Lmatch_entry;
+
+static void entry_free(Lmatch_entry *x) {
+    node_free(x->tree);
+    lval_free(x->clauses);
+    free(x);
+}
+
+// Where a (match ...) form keeps its tree. The reader gives one to each
+// match form it reads, and every copy of the form made as its enclosing
+// body runs shares it, so the clauses compile once per call site.
+struct Lmatch {
+    int refs;
+    Lmatch_entry *compiled; // NULL until the form first runs
+};
+
+Lmatch *lmatch_new(void) {
+    Lmatch *m = malloc(sizeof(Lmatch));
+    m->refs = 1;
+    m->compiled = NULL;
+    return m;
+}
+
+Lmatch *lmatch_retain(Lmatch *m) {
+    if (m) __atomic_add_fetch(&m->refs, 1, __ATOMIC_RELAXED);
+    return m;
+}
+
+void lmatch_release(Lmatch *m) {
+    if (m == NULL || __atomic_sub_fetch(&m->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    if (m->compiled) entry_free(m->compiled);
+    free(m);
+}
+
+// Returns an error when a pattern binds the same name twice
+static Lval *pattern_check_vars(Lval *p) {
+    Lval *vars = lval_sexpr();
+    match_pattern_vars(p, vars);
+    Lval *err = NULL;
+    for (int i = 0; i < vars->sexpr.count && !err; i++) {
+        for (int j = 0; j < i; j++) {
+            if (strcmp(vars->sexpr.cell[i]->sym, vars->sexpr.cell[j]->sym) == 0) {
+                char msg[96];
+                snprintf(msg, sizeof(msg), "Match pattern binds '%.48s' more than once!", vars->sexpr.cell[i]->sym);
+                err = lval_err(msg);
+                break;
+            }
+        }
+    }
+    lval_free(vars);
+    return err;
+}
+
+// Compiles the clauses of a (match expr clause...) form.
+// Returns NULL and sets *err when a clause is malformed.
+static Lmatch_entry *match_build(Lval *a, Lval **err) {
+    Lval *clauses = lval_sexpr();
+    for (int i = 2; i < a->sexpr.count; i++) {
+        Lval *c = a->sexpr.cell[i];
+        *err = c->type == LVAL_SEXPR && c->sexpr.count == 2
+             ? pattern_check(c->sexpr.cell[0])
+             : lval_err("Match clause must be (pattern body)!");
+        if (*err == NULL) *err = pattern_check_vars(c->sexpr.cell[0]);
+        if (*err) {
+            lval_free(clauses);
+            return NULL;
+        }
+        lval_add(clauses, lval_copy(c));
+    }
+    
+    Lmatch_entry *x = malloc(sizeof(Lmatch_entry));
+    x->clauses = clauses;
+    x->tree = match_compile(clauses);
+    return x;
+}
+
+// The compiled form for a, from its call site when it has one. Forms built
+// at run time have none, so theirs is compiled here and left to the caller
+// to free. Returns NULL and sets *err when a clause is malformed.
+static Lmatch_entry *match_lookup(Lmatch *site, Lval *a, Lval **err) {
+    Lmatch_entry *x = site ? __atomic_load_n(&site->compiled, __ATOMIC_ACQUIRE) : NULL;
+    if (x) return x;
+    
+    x = match_build(a, err);
+    if (x == NULL || site == NULL) return x;
+    
+    // Another thread running the same form may have got there first
+    Lmatch_entry *expected = NULL;
+    if (!__atomic_compare_exchange_n(&site->compiled, &expected, x, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        entry_free(x);
+        return expected;
+    }
+    return x;
+}
+
+static Lval *match_at(Lval *x, int *path, int depth) {
+    for (int i = 0; i < depth; i++) x = x->sexpr.cell[path[i]];
+    return x;
+}
+
+// Moves the value a binding names out of the matched value
+static Lval *match_take(Lval **x, Binding *b) {
+    if (b->rest >= 0) {
+        Lval *list = match_at(*x, b->path, b->depth);
+        Lval *rest = lval_sexpr();
+        rest->sexpr.count = list->sexpr.count - b->rest;
+        rest->sexpr.cell = malloc(sizeof(Lval*) * rest->sexpr.count);
+        for (int i = 0; i < rest->sexpr.count; i++) {
+            rest->sexpr.cell[i] = list->sexpr.cell[b->rest + i];
+            list->sexpr.cell[b->rest + i] = NULL;
+        }
+        return rest;
+    }
+    
+    if (b->depth == 0) {
+        Lval *v = *x;
+        *x = NULL;
+        return v;
+    }
+    
+    Lval *parent = match_at(*x, b->path, b->depth - 1);
+    Lval *v = parent->sexpr.cell[b->path[b->depth - 1]];
+    parent->sexpr.cell[b->path[b->depth - 1]] = NULL;
+    return v;
+}
+
+// Runs the clause of entry that x matches, consuming x
+static Lval *match_run(Lenv *e, Lmatch_entry *entry, Lval *x) {
+    Lmatch_node *n = entry->tree;
+    while (n->kind != TEST_LEAF) {
+        Lval *y = match_at(x, n->path, n->depth);
+        int pass;
+        if (n->kind == TEST_LIT) {
+            pass = lit_eq(y, n->lit);
+        } else if (n->kind == TEST_EXACT) {
+            pass = y->type == LVAL_SEXPR && y->sexpr.count == n->arg;
+        } else {
+            pass = y->type == LVAL_SEXPR && y->sexpr.count >= n->arg;
+        }
+        n = pass ? n->yes : n->no;
+    }
+    
+    if (n->clause < 0) {
+        lval_free(x);
+        return lval_err("No match clause matched!");
+    }
+    
+    // Bindings get a frame of their own, like a lambda call
+    Lenv *frame = lenv_push_frame(e, n->nbinds);
+    if (frame) {
+        for (int i = 0; i < n->nbinds; i++) {
+            frame->syms[i] = n->binds[i].name;
+            frame->vals[i] = match_take(&x, &n->binds[i]);
+        }
+        frame->count = n->nbinds;
+    } else {
+        frame = lenv_child(e);
+        for (int i = 0; i < n->nbinds; i++) {
+            Lval k;
+            k.type = LVAL_SYM;
+            k.sym = n->binds[i].name;
+            Lval *v = match_take(&x, &n->binds[i]);
+            lenv_put(frame, &k, v);
+            lval_free(v);
+        }
+    }
+    lval_free(x);
+    
+    Lval *body = entry->clauses->sexpr.cell[n->clause]->sexpr.cell[1];
+    Lval *result = eval_owned(frame, lval_copy(body));
+    
+    if (frame->on_stack) {
+        lenv_pop_frame(frame);
+    } else {
+        lenv_release(frame);
+    }
+    return result;
+}
+
+Lval *builtin_match(Lenv *e, Lval *a) {
+    if (a->sexpr.count < 3) {
+        lval_free(a);
+        return lval_err("Function 'match' passed incorrect number of arguments!");
+    }
+    
+    // Hold the site, since a itself is about to be taken apart
+    Lmatch *site = a->sexpr.match;
+    a->sexpr.match = NULL;
+    
+    Lval *err = NULL;
+    Lmatch_entry *entry = match_lookup(site, a, &err);
+    if (entry == NULL) {
+        lmatch_release(site);
+        lval_free(a);
+        return err;
+    }
+    
+    Lval *x = eval_owned(e, lval_pop(a, 1));
+    lval_free(a);
+    Lval *result = x->type == LVAL_ERR ? x : match_run(e, entry, x);
+    
+    if (site == NULL) entry_free(entry);
+    lmatch_release(site);
+    return result;
+}
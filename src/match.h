@@ -0,0 +1,13 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+#include "lval.h"
+#include "env.h"
+
+Lmatch *lmatch_new(void);
+Lmatch *lmatch_retain(Lmatch *m);
+void lmatch_release(Lmatch *m);
+Lval *builtin_match(Lenv *e, Lval *a);
+void match_pattern_vars(Lval *p, Lval *vars);
+
+#endif
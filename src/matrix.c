@@ -0,0 +1,531 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix.h"
+#include "typed.h"
+#include "pool.h"
+#include "bignum.h"
+#include "flonum.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MATRIX_X86 1
+#endif
+
+// A matrix is rows x cols doubles in one row-major buffer, shared by
+// reference count and never changed once built, like an f64vector.
+// matmul walks C = A B a block at a time: MAT_KC of the inner dimension
+// and MAT_NC columns of B, small enough that the block of B stays in
+// cache while every band of four rows of A streams past it through a
+// micro-kernel holding a tile of C in registers. Every element of C adds
+// its products in ascending order with no fused multiply-add, so each
+// SIMD level, and a product split into bands of rows on the pool, give
+// bit-identical results.
+#define MAT_KC 128                  // inner dimension per block
+#define MAT_NC 128                  // columns of B per block
+#define MAT_MR 4                    // rows of A per micro-kernel call
+#define MAT_PARALLEL_MIN (1L << 21) // multiply-adds before the pool joins in
+#define MAT_TILE 32                 // edge of a transpose tile
+#define MAT_MAX (1L << 30)          // most elements in one matrix
+
+struct Lmatrix {
+    int refs;
+    int rows;
+    int cols;
+    double *data;
+};
+
+// Adds the product of an mr x kc block of A and a kc x nc block of B into
+// the mr x nc block of C, each given by its first element and the row
+// stride of its matrix
+typedef void (*Mkernel)(const double *a, int lda, const double *b, int ldb,
+                        double *c, int ldc, int mr, int kc, int nc);
+
+static void panel_scalar(const double *a, int lda, const double *b, int ldb,
+                         double *c, int ldc, int mr, int kc, int nc) {
+    for (int r = 0; r < mr; r++) {
+        for (int k = 0; k < kc; k++) {
+            double x = a[r * lda + k];
+            for (int j = 0; j < nc; j++) {
+                c[r * ldc + j] += x * b[k * ldb + j];
+            }
+        }
+    }
+}
+
+#ifdef MATRIX_X86
+
+// Four rows by four columns in two registers per row
+__attribute__((target("sse2")))
+static void panel_sse2(const double *a, int lda, const double *b, int ldb,
+                       double *c, int ldc, int mr, int kc, int nc) {
+    int j = 0;
+    for (; j + 4 <= nc; j += 4) {
+        __m128d acc[MAT_MR][2];
+        for (int r = 0; r < mr; r++) {
+            acc[r][0] = _mm_loadu_pd(c + r * ldc + j);
+            acc[r][1] = _mm_loadu_pd(c + r * ldc + j + 2);
+        }
+        for (int k = 0; k < kc; k++) {
+            __m128d b0 = _mm_loadu_pd(b + k * ldb + j);
+            __m128d b1 = _mm_loadu_pd(b + k * ldb + j + 2);
+            for (int r = 0; r < mr; r++) {
+                __m128d x = _mm_set1_pd(a[r * lda + k]);
+                acc[r][0] = _mm_add_pd(acc[r][0], _mm_mul_pd(x, b0));
+                acc[r][1] = _mm_add_pd(acc[r][1], _mm_mul_pd(x, b1));
+            }
+        }
+        for (int r = 0; r < mr; r++) {
+            _mm_storeu_pd(c + r * ldc + j, acc[r][0]);
+            _mm_storeu_pd(c + r * ldc + j + 2, acc[r][1]);
+        }
+    }
+    panel_scalar(a, lda, b + j, ldb, c + j, ldc, mr, kc, nc - j);
+}
+
+// Four rows by eight columns in two registers per row
+__attribute__((target("avx2")))
+static void panel_avx2(const double *a, int lda, const double *b, int ldb,
+                       double *c, int ldc, int mr, int kc, int nc) {
+    int j = 0;
+    for (; j + 8 <= nc; j += 8) {
+        __m256d acc[MAT_MR][2];
+        for (int r = 0; r < mr; r++) {
+            acc[r][0] = _mm256_loadu_pd(c + r * ldc + j);
+            acc[r][1] = _mm256_loadu_pd(c + r * ldc + j + 4);
+        }
+        for (int k = 0; k < kc; k++) {
+            __m256d b0 = _mm256_loadu_pd(b + k * ldb + j);
+            __m256d b1 = _mm256_loadu_pd(b + k * ldb + j + 4);
+            for (int r = 0; r < mr; r++) {
+                __m256d x = _mm256_set1_pd(a[r * lda + k]);
+                acc[r][0] = _mm256_add_pd(acc[r][0], _mm256_mul_pd(x, b0));
+                acc[r][1] = _mm256_add_pd(acc[r][1], _mm256_mul_pd(x, b1));
+            }
+        }
+        for (int r = 0; r < mr; r++) {
+            _mm256_storeu_pd(c + r * ldc + j, acc[r][0]);
+            _mm256_storeu_pd(c + r * ldc + j + 4, acc[r][1]);
+        }
+    }
+    panel_sse2(a, lda, b + j, ldb, c + j, ldc, mr, kc, nc - j);
+}
+
+#endif
+
+// The micro-kernel for the typed array kernels' level, so a cap set with
+// typed_set_simd_level applies here too
+static Mkernel pick_kernel(void) {
+#ifdef MATRIX_X86
+    switch (typed_kernel_level()) {
+        case TYPED_AVX2: return panel_avx2;
+        case TYPED_SSE2: return panel_sse2;
+    }
+#endif
+    return panel_scalar;
+}
+
+// Rows from..to of C = A B, for a k-wide A and an n-wide B
+static void matmul_rows(Mkernel kern, const double *a, const double *b, double *c,
+                        int k, int n, int from, int to) {
+    for (int kk = 0; kk < k; kk += MAT_KC) {
+        int kc = k - kk < MAT_KC ? k - kk : MAT_KC;
+        for (int jj = 0; jj < n; jj += MAT_NC) {
+            int nc = n - jj < MAT_NC ? n - jj : MAT_NC;
+            for (int i = from; i < to; i += MAT_MR) {
+                int mr = to - i < MAT_MR ? to - i : MAT_MR;
+                kern(a + (long)i * k + kk, k, b + (long)kk * n + jj, n, c + (long)i * n + jj, n, mr, kc, nc);
+            }
+        }
+    }
+}
+
+typedef struct {
+    Mkernel kern;
+    const double *a;
+    const double *b;
+    double *c;
+    int k;
+    int n;
+    int from;
+    int to;
+} MatJob;
+
+static void matmul_job(void *arg) {
+    MatJob *job = arg;
+    matmul_rows(job->kern, job->a, job->b, job->c, job->k, job->n, job->from, job->to);
+}
+
+// C = A B for an m x k A and a k x n B, into a zeroed C. A large product
+// cuts C into one band of rows per thread, each a whole number of
+// micro-kernel rows
+static void matmul(const double *a, const double *b, double *c, int m, int k, int n) {
+    Mkernel kern = pick_kernel();
+    if ((long)m * k * n < MAT_PARALLEL_MIN || m < 2 * MAT_MR || pool_size() == 0 || pool_in_worker()) {
+        matmul_rows(kern, a, b, c, k, n, 0, m);
+        return;
+    }
+    
+    int bands = pool_size() + 1;
+    int height = ((m + bands - 1) / bands + MAT_MR - 1) / MAT_MR * MAT_MR;
+    MatJob *jobs = malloc(sizeof(MatJob) * bands);
+    Lbatch *batch = pool_batch_new();
+    int count = 0;
+    for (int i = 0; i < m; i += height) {
+        jobs[count] = (MatJob){kern, a, b, c, k, n, i, m - i < height ? m : i + height};
+        pool_submit_fn(batch, matmul_job, &jobs[count++]);
+    }
+    pool_wait(batch);
+    free(jobs);
+}
+
+// Tile by tile, so both the rows read and the columns written stay in cache
+static void transpose(const double *x, double *out, int rows, int cols) {
+    for (int ii = 0; ii < rows; ii += MAT_TILE) {
+        int ie = rows - ii < MAT_TILE ? rows : ii + MAT_TILE;
+        for (int jj = 0; jj < cols; jj += MAT_TILE) {
+            int je = cols - jj < MAT_TILE ? cols : jj + MAT_TILE;
+            for (int i = ii; i < ie; i++) {
+                for (int j = jj; j < je; j++) {
+                    out[(long)j * rows + i] = x[(long)i * cols + j];
+                }
+            }
+        }
+    }
+}
+
+static Lmatrix *lmatrix_new(int rows, int cols) {
+    Lmatrix *m = malloc(sizeof(Lmatrix));
+    m->refs = 1;
+    m->rows = rows;
+    m->cols = cols;
+    
+    long count = (long)rows * cols;
+    void *data = NULL;
+    if (posix_memalign(&data, 32, sizeof(double) * (count > 0 ? count : 1)) != 0) data = NULL;
+    m->data = data;
+    memset(m->data, 0, sizeof(double) * count);
+    return m;
+}
+
+Lmatrix *lmatrix_retain(Lmatrix *m) {
+    __atomic_add_fetch(&m->refs, 1, __ATOMIC_RELAXED);
+    return m;
+}
+
+void lmatrix_release(Lmatrix *m) {
+    if (__atomic_sub_fetch(&m->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    free(m->data);
+    free(m);
+}
+
+unsigned long lmatrix_hash(Lmatrix *m) {
+    unsigned long h = (unsigned long)m->rows * 31 + m->cols;
+    for (long i = 0; i < (long)m->rows * m->cols; i++) {
+        h = h * 1099511628211UL ^ lfloat_hash(m->data[i]);
+    }
+    return h;
+}
+
+int lmatrix_eq(Lmatrix *x, Lmatrix *y) {
+    if (x->rows != y->rows || x->cols != y->cols) return 0;
+    for (long i = 0; i < (long)x->rows * x->cols; i++) {
+        if (x->data[i] != y->data[i]) return 0;
+    }
+    return 1;
+}
+
+void lmatrix_print(Lmatrix *m, char *out, int size) {
+    int n = snprintf(out, size, "#mat(");
+    for (int i = 0; i < m->rows && n < size; i++) {
+        n += snprintf(out + n, size - n, i ? " (" : "(");
+        for (int j = 0; j < m->cols && n < size; j++) {
+            char item[32];
+            lfloat_print(m->data[(long)i * m->cols + j], item, sizeof(item));
+            n += snprintf(out + n, size - n, j ? " %s" : "%s", item);
+        }
+        if (n < size) n += snprintf(out + n, size - n, ")");
+    }
+    if (n < size) snprintf(out + n, size - n, ")");
+}
+
+static Lval *lval_matrix(Lmatrix *m) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_MATRIX;
+    v->mat = m;
+    return v;
+}
+
+int matrix_handles(char *name, Lval *a) {
+    char *names[] = {"matrix", "make-matrix", "matmul", "transpose", "row", "col", "submatrix", "shape", "mref"};
+    for (int i = 0; i < 9; i++) {
+        if (strcmp(name, names[i]) == 0) return 1;
+    }
+    if (strcmp(name, "vadd") == 0 || strcmp(name, "vmul") == 0) {
+        return a->sexpr.count == 2 &&
+               (a->sexpr.cell[0]->type == LVAL_MATRIX || a->sexpr.cell[1]->type == LVAL_MATRIX);
+    }
+    if (strcmp(name, "len") == 0 || strcmp(name, "to-list") == 0) {
+        return a->sexpr.count > 0 && a->sexpr.cell[0]->type == LVAL_MATRIX;
+    }
+    return 0;
+}
+
+static Lval *matrix_err(Lval *a, char *name, char *what) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Function '%s' passed %s!", name, what);
+    lval_free(a);
+    return lval_err(msg);
+}
+
+// Reads a fixnum in [0, limit] into out
+static int bound_arg(Lval *x, long limit, int *out) {
+    if (x->type != LVAL_NUM || x->num < 0 || x->num > limit) return 0;
+    *out = (int)x->num;
+    return 1;
+}
+
+// The length of a matrix row given as a list or an f64vector, or -1
+static int row_length(Lval *x) {
+    int n;
+    if (typed_f64_data(x, &n) != NULL) return n;
+    return x->type == LVAL_SEXPR ? x->sexpr.count : -1;
+}
+
+static int row_read(Lval *x, double *out) {
+    int n;
+    double *data = typed_f64_data(x, &n);
+    if (data != NULL) {
+        memcpy(out, data, sizeof(double) * n);
+        return 1;
+    }
+    for (int j = 0; j < x->sexpr.count; j++) {
+        if (!lval_is_number(x->sexpr.cell[j])) return 0;
+        out[j] = lval_to_double(x->sexpr.cell[j]);
+    }
+    return 1;
+}
+
+// (matrix row ...) or (matrix rows), each row a list of numbers or an
+// f64vector, all the same length
+static Lval *matrix_build(Lval *a, char *name) {
+    Lval **rows = a->sexpr.cell;
+    int n = a->sexpr.count;
+    if (n == 1 && rows[0]->type == LVAL_SEXPR && rows[0]->sexpr.count > 0 &&
+        row_length(rows[0]->sexpr.cell[0]) >= 0) {
+        n = rows[0]->sexpr.count;
+        rows = rows[0]->sexpr.cell;
+    }
+    
+    int cols = n > 0 ? row_length(rows[0]) : 0;
+    for (int i = 0; i < n; i++) {
+        if (row_length(rows[i]) < 0) return matrix_err(a, name, "a row that is not a list or f64vector");
+        if (row_length(rows[i]) != cols) return matrix_err(a, name, "rows of different lengths");
+    }
+    if ((long)n * cols > MAT_MAX) return matrix_err(a, name, "too many elements");
+    
+    Lmatrix *m = lmatrix_new(n, cols);
+    for (int i = 0; i < n; i++) {
+        if (!row_read(rows[i], m->data + (long)i * cols)) {
+            lmatrix_release(m);
+            return matrix_err(a, name, "a value that is not a number");
+        }
+    }
+    lval_free(a);
+    return lval_matrix(m);
+}
+
+// (make-matrix rows cols) of zeros, or (make-matrix rows cols x) of x
+static Lval *matrix_make(Lval *a, char *name) {
+    if (a->sexpr.count != 2 && a->sexpr.count != 3) return matrix_err(a, name, "incorrect number of arguments");
+    int rows;
+    int cols;
+    if (!bound_arg(a->sexpr.cell[0], MAT_MAX, &rows) || !bound_arg(a->sexpr.cell[1], MAT_MAX, &cols) ||
+        (a->sexpr.count == 3 && !lval_is_number(a->sexpr.cell[2]))) {
+        return matrix_err(a, name, "incorrect type");
+    }
+    if ((long)rows * cols > MAT_MAX) return matrix_err(a, name, "too many elements");
+    
+    Lmatrix *m = lmatrix_new(rows, cols);
+    if (a->sexpr.count == 3) {
+        double x = lval_to_double(a->sexpr.cell[2]);
+        for (long i = 0; i < (long)rows * cols; i++) {
+            m->data[i] = x;
+        }
+    }
+    lval_free(a);
+    return lval_matrix(m);
+}
+
+// (matmul a b) of two matrices is a matrix; a matrix times an f64vector,
+// or an f64vector times a matrix, is an f64vector
+static Lval *matrix_matmul(Lval *a, char *name) {
+    if (a->sexpr.count != 2) return matrix_err(a, name, "incorrect number of arguments");
+    Lval *x = a->sexpr.cell[0];
+    Lval *y = a->sexpr.cell[1];
+    int xn;
+    int yn;
+    double *xv = typed_f64_data(x, &xn);
+    double *yv = typed_f64_data(y, &yn);
+    
+    int m;
+    int k;
+    int n;
+    int inner;
+    const double *p;
+    const double *q;
+    if (x->type == LVAL_MATRIX && y->type == LVAL_MATRIX) {
+        m = x->mat->rows;
+        k = x->mat->cols;
+        n = y->mat->cols;
+        inner = y->mat->rows;
+        p = x->mat->data;
+        q = y->mat->data;
+    } else if (x->type == LVAL_MATRIX && yv != NULL) {
+        m = x->mat->rows;
+        k = x->mat->cols;
+        n = 1;
+        inner = yn;
+        p = x->mat->data;
+        q = yv;
+    } else if (xv != NULL && y->type == LVAL_MATRIX) {
+        m = 1;
+        k = xn;
+        n = y->mat->cols;
+        inner = y->mat->rows;
+        p = xv;
+        q = y->mat->data;
+    } else {
+        return matrix_err(a, name, "incorrect type");
+    }
+    if (k != inner) return matrix_err(a, name, "matrices of mismatched shapes");
+    if ((long)m * n > MAT_MAX) return matrix_err(a, name, "matrices whose product is too large");
+    
+    Lval *result;
+    double *out;
+    if (x->type == LVAL_MATRIX && y->type == LVAL_MATRIX) {
+        Lmatrix *r = lmatrix_new(m, n);
+        out = r->data;
+        result = lval_matrix(r);
+    } else {
+        result = typed_f64_new(m * n, &out);
+        memset(out, 0, sizeof(double) * m * n);
+    }
+    matmul(p, q, out, m, k, n);
+    lval_free(a);
+    return result;
+}
+
+// (vadd x y) and (vmul x y) over two matrices of one shape, or a matrix
+// and a number applied to every element
+static Lval *matrix_elementwise(Lval *a, char *name) {
+    char op = strcmp(name, "vadd") == 0 ? '+' : '*';
+    Lval *x = a->sexpr.cell[0];
+    Lval *y = a->sexpr.cell[1];
+    Lmatrix *m = x->type == LVAL_MATRIX ? x->mat : y->mat;
+    Lval *other = x->type == LVAL_MATRIX ? y : x;
+    if (other->type == LVAL_MATRIX && (other->mat->rows != m->rows || other->mat->cols != m->cols)) {
+        return matrix_err(a, name, "matrices of different shapes");
+    }
+    if (other->type != LVAL_MATRIX && !lval_is_number(other)) return matrix_err(a, name, "incorrect type");
+    
+    Lmatrix *r = lmatrix_new(m->rows, m->cols);
+    int count = m->rows * m->cols;
+    if (other->type == LVAL_MATRIX) {
+        typed_f64_op(op, m->data, other->mat->data, 0, r->data, count);
+    } else {
+        typed_f64_op(op, m->data, NULL, lval_to_double(other), r->data, count);
+    }
+    lval_free(a);
+    return lval_matrix(r);
+}
+
+// (submatrix m r0 r1 c0 c1) copies rows r0 up to r1 and columns c0 up to c1
+static Lval *matrix_sub(Lval *a, char *name) {
+    if (a->sexpr.count != 5) return matrix_err(a, name, "incorrect number of arguments");
+    if (a->sexpr.cell[0]->type != LVAL_MATRIX) return matrix_err(a, name, "incorrect type");
+    Lmatrix *m = a->sexpr.cell[0]->mat;
+    int r0;
+    int r1;
+    int c0;
+    int c1;
+    if (!bound_arg(a->sexpr.cell[1], m->rows, &r0) || !bound_arg(a->sexpr.cell[2], m->rows, &r1) ||
+        !bound_arg(a->sexpr.cell[3], m->cols, &c0) || !bound_arg(a->sexpr.cell[4], m->cols, &c1) ||
+        r0 > r1 || c0 > c1) {
+        return matrix_err(a, name, "an index out of range");
+    }
+    
+    Lmatrix *r = lmatrix_new(r1 - r0, c1 - c0);
+    for (int i = r0; i < r1; i++) {
+        memcpy(r->data + (long)(i - r0) * r->cols, m->data + (long)i * m->cols + c0, sizeof(double) * r->cols);
+    }
+    lval_free(a);
+    return lval_matrix(r);
+}
+
+static int arg_count(char *name) {
+    if (strcmp(name, "mref") == 0) return 3;
+    if (strcmp(name, "row") == 0 || strcmp(name, "col") == 0 ||
+        strcmp(name, "vadd") == 0 || strcmp(name, "vmul") == 0) return 2;
+    return 1;
+}
+
+Lval *builtin_matrix(Lval *a, char *name) {
+    if (strcmp(name, "matrix") == 0) return matrix_build(a, name);
+    if (strcmp(name, "make-matrix") == 0) return matrix_make(a, name);
+    if (strcmp(name, "matmul") == 0) return matrix_matmul(a, name);
+    if (strcmp(name, "submatrix") == 0) return matrix_sub(a, name);
+    
+    if (a->sexpr.count != arg_count(name)) return matrix_err(a, name, "incorrect number of arguments");
+    if (strcmp(name, "vadd") == 0 || strcmp(name, "vmul") == 0) return matrix_elementwise(a, name);
+    if (a->sexpr.cell[0]->type != LVAL_MATRIX) return matrix_err(a, name, "incorrect type");
+    
+    Lmatrix *m = a->sexpr.cell[0]->mat;
+    Lval *result;
+    if (strcmp(name, "transpose") == 0) {
+        Lmatrix *t = lmatrix_new(m->cols, m->rows);
+        transpose(m->data, t->data, m->rows, m->cols);
+        result = lval_matrix(t);
+    } else if (strcmp(name, "len") == 0) {
+        result = lval_num(m->rows);
+    } else if (strcmp(name, "shape") == 0) {
+        result = lval_sexpr();
+        lval_add(result, lval_num(m->rows));
+        lval_add(result, lval_num(m->cols));
+    } else if (strcmp(name, "to-list") == 0) {
+        result = lval_sexpr();
+        for (int i = 0; i < m->rows; i++) {
+            Lval *row = lval_sexpr();
+            for (int j = 0; j < m->cols; j++) {
+                lval_add(row, lval_float(m->data[(long)i * m->cols + j]));
+            }
+            lval_add(result, row);
+        }
+    } else if (strcmp(name, "mref") == 0) {
+        int i;
+        int j;
+        if (!bound_arg(a->sexpr.cell[1], m->rows - 1, &i) || !bound_arg(a->sexpr.cell[2], m->cols - 1, &j)) {
+            return matrix_err(a, name, "an index out of range");
+        }
+        result = lval_float(m->data[(long)i * m->cols + j]);
+    } else {
+        // row or col, copied out as an f64vector
+        int is_row = strcmp(name, "row") == 0;
+        int i;
+        if (!bound_arg(a->sexpr.cell[1], (is_row ? m->rows : m->cols) - 1, &i)) {
+            return matrix_err(a, name, "an index out of range");
+        }
+        double *out;
+        result = typed_f64_new(is_row ? m->cols : m->rows, &out);
+        if (is_row) {
+            memcpy(out, m->data + (long)i * m->cols, sizeof(double) * m->cols);
+        } else {
+            for (int r = 0; r < m->rows; r++) {
+                out[r] = m->data[(long)r * m->cols + i];
+            }
+        }
+    }
+    lval_free(a);
+    return result;
+}
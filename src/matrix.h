@@ -0,0 +1,16 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include "lval.h"
+#include "env.h"
+
+Lmatrix *lmatrix_retain(Lmatrix *m);
+void lmatrix_release(Lmatrix *m);
+unsigned long lmatrix_hash(Lmatrix *m);
+int lmatrix_eq(Lmatrix *x, Lmatrix *y);
+void lmatrix_print(Lmatrix *m, char *out, int size);
+
+int matrix_handles(char *name, Lval *a);
+Lval *builtin_matrix(Lval *a, char *name);
+
+#endif
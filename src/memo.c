@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include "memo.h"
+
+// A memo table maps an argument list to the result of a pure call. Lookups
+// hash the arguments structurally into chained buckets; every entry is also
+// on a recency list so the least recently used one is evicted once the
+// table is full. The table is shared between copies of a lambda, which
+// may be running on worker threads, so lookups and updates are locked.
+typedef struct Lmemo_entry {
+    unsigned long hash;
+    Lval *args;
+    Lval *result;
+    struct Lmemo_entry *next;   // bucket chain
+    struct Lmemo_entry *newer;  // recency list
+    struct Lmemo_entry *older;
+} Lmemo_entry;
+
+struct Lmemo {
+    int refs;
+    pthread_mutex_t lock;
+    int count;
+    int capacity;
+    int bucket_count;
+    Lmemo_entry **buckets;
+    Lmemo_entry *newest;
+    Lmemo_entry *oldest;
+};
+
+Lmemo *lmemo_new(int capacity) {
+    Lmemo *m = malloc(sizeof(Lmemo));
+    m->refs = 1;
+    pthread_mutex_init(&m->lock, NULL);
+    m->count = 0;
+    m->capacity = capacity;
+    
+    // Keep the load factor at or below one half
+    m->bucket_count = 1;
+    while (m->bucket_count < capacity * 2) m->bucket_count *= 2;
+    m->buckets = calloc(m->bucket_count, sizeof(Lmemo_entry*));
+    
+    m->newest = NULL;
+    m->oldest = NULL;
+    return m;
+}
+
+Lmemo *lmemo_retain(Lmemo *m) {
+    if (m) __atomic_add_fetch(&m->refs, 1, __ATOMIC_RELAXED);
+    return m;
+}
+
+static void entry_free(Lmemo_entry *x) {
+    lval_free(x->args);
+    lval_free(x->result);
+    free(x);
+}
+
+void lmemo_release(Lmemo *m) {
+    if (m == NULL || __atomic_sub_fetch(&m->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    
+    Lmemo_entry *x = m->newest;
+    while (x) {
+        Lmemo_entry *older = x->older;
+        entry_free(x);
+        x = older;
+    }
+    pthread_mutex_destroy(&m->lock);
+    free(m->buckets);
+    free(m);
+}
+
+static void unlink_recent(Lmemo *m, Lmemo_entry *x) {
+    if (x->newer) x->newer->older = x->older; else m->newest = x->older;
+    if (x->older) x->older->newer = x->newer; else m->oldest = x->newer;
+}
+
+static void link_newest(Lmemo *m, Lmemo_entry *x) {
+    x->newer = NULL;
+    x->older = m->newest;
+    if (m->newest) m->newest->newer = x; else m->oldest = x;
+    m->newest = x;
+}
+
+Lval *lmemo_get(Lmemo *m, Lval *args) {
+    unsigned long h = lval_hash(args);
+    Lval *result = NULL;
+    
+    pthread_mutex_lock(&m->lock);
+    for (Lmemo_entry *x = m->buckets[h & (m->bucket_count - 1)]; x; x = x->next) {
+        if (x->hash == h && lval_eq(x->args, args)) {
+            unlink_recent(m, x);
+            link_newest(m, x);
+            result = lval_copy(x->result);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+    return result;
+}
+
+static void evict_oldest(Lmemo *m) {
+    Lmemo_entry *x = m->oldest;
+    Lmemo_entry **p = &m->buckets[x->hash & (m->bucket_count - 1)];
+    while (*p != x) p = &(*p)->next;
+    *p = x->next;
+    
+    unlink_recent(m, x);
+    entry_free(x);
+    m->count--;
+}
+
+void lmemo_put(Lmemo *m, Lval *args, Lval *result) {
+    if (m->capacity <= 0) return;
+    
+    unsigned long h = lval_hash(args);
+    
+    pthread_mutex_lock(&m->lock);
+    Lmemo_entry **bucket = &m->buckets[h & (m->bucket_count - 1)];
+    
+    // A recursive call may already have filled this entry
+    for (Lmemo_entry *x = *bucket; x; x = x->next) {
+        if (x->hash == h && lval_eq(x->args, args)) {
+            pthread_mutex_unlock(&m->lock);
+            return;
+        }
+    }
+    
+    if (m->count == m->capacity) {
+        evict_oldest(m);
+        bucket = &m->buckets[h & (m->bucket_count - 1)];
+    }
+    
+    Lmemo_entry *x = malloc(sizeof(Lmemo_entry));
+    x->hash = h;
+    x->args = lval_copy(args);
+    x->result = lval_copy(result);
+    x->next = *bucket;
+    *bucket = x;
+    link_newest(m, x);
+    m->count++;
+    pthread_mutex_unlock(&m->lock);
+}
+
+// Drops every entry, for when a function the cached calls went through
+// has been replaced
+void lmemo_clear(Lmemo *m) {
+    pthread_mutex_lock(&m->lock);
+    Lmemo_entry *x = m->newest;
+    while (x) {
+        Lmemo_entry *older = x->older;
+        entry_free(x);
+        x = older;
+    }
+    for (int i = 0; i < m->bucket_count; i++) m->buckets[i] = NULL;
+    m->newest = NULL;
+    m->oldest = NULL;
+    m->count = 0;
+    pthread_mutex_unlock(&m->lock);
+}
+
+int lmemo_count(Lmemo *m) {
+    pthread_mutex_lock(&m->lock);
+    int n = m->count;
+    pthread_mutex_unlock(&m->lock);
+    return n;
+}
@@ -0,0 +1,16 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "lval.h"
+
+#define MEMO_DEFAULT_SIZE 1024
+
+Lmemo *lmemo_new(int capacity);
+Lmemo *lmemo_retain(Lmemo *m);
+void lmemo_release(Lmemo *m);
+Lval *lmemo_get(Lmemo *m, Lval *args);
+void lmemo_put(Lmemo *m, Lval *args, Lval *result);
+void lmemo_clear(Lmemo *m);
+int lmemo_count(Lmemo *m);
+
+#endif
@@ -14,12 +14,30 @@ static AstNode *create_number(long value) {
     return node;
 }
 
-static AstNode *create_symbol(const char *symbol) {
+static AstNode *create_float(double value) {
+    AstNode *node = malloc(sizeof(AstNode));
+    if (node == NULL) return NULL;
+    
+    node->type = AST_FLOAT;
+    node->fnum = value;
+    return node;
+}
+
+static AstNode *create_bignum(const char *digits, int length) {
+    AstNode *node = malloc(sizeof(AstNode));
+    if (node == NULL) return NULL;
+    
+    node->type = AST_BIGNUM;
+    node->digits = strndup(digits, length);
+    return node;
+}
+
+static AstNode *create_symbol(const char *symbol, int length) {
     AstNode *node = malloc(sizeof(AstNode));
     if (node == NULL) return NULL;
     
     node->type = AST_SYMBOL;
-    node->symbol = strdup(symbol);
+    node->symbol = strndup(symbol, length);
     return node;
 }
 
@@ -32,61 +50,96 @@ static AstNode *create_error(const char *message) {
     return node;
 }
 
-static int is_number(const char *str) {
-    if (*str == '-' || *str == '+') str++;
-    if (*str == '\0') return 0;
-    
-    while (*str) {
-        if (!isdigit(*str)) return 0;
-        str++;
-    }
-    return 1;
+static int is_symbol_start(char c) {
+    return isalpha(c) || c == '+' || c == '-' || c == '*' || c == '/' || c == '%' ||
+           c == '=' || c == '>' || c == '<' || c == '_' || c == '&' || c == '\\';
 }
 
-static int is_number_at_position(const char *input, int pos) {
-    if (input[pos] == '-' || input[pos] == '+') {
-        if (!isdigit(input[pos + 1])) return 0;
-        pos++;
-    }
+static int is_quote_start(char c) {
+    return c == '\'' || c == '`' || c == ',';
+}
+
+// Length of the number literal that starts str, or 0 if none does; real
+// is set when the literal has a fraction or an exponent
+static int scan_number(const char *str, int *real) {
+    int i = 0;
+    *real = 0;
     
-    if (!isdigit(input[pos])) return 0;
+    if (str[i] == '-' || str[i] == '+') i++;
+    if (!isdigit(str[i])) return 0;
+    while (isdigit(str[i])) i++;
     
-    while (isdigit(input[pos])) {
-        pos++;
+    if (str[i] == '.' && isdigit(str[i + 1])) {
+        *real = 1;
+        i++;
+        while (isdigit(str[i])) i++;
     }
     
-    return 1;
+    if (str[i] == 'e' || str[i] == 'E') {
+        int j = i + 1;
+        if (str[j] == '-' || str[j] == '+') j++;
+        if (isdigit(str[j])) {
+            *real = 1;
+            i = j;
+            while (isdigit(str[i])) i++;
+        }
+    }
+    return i;
 }
 
+static int is_number(const char *str) {
+    int real;
+    int length = scan_number(str, &real);
+    return length > 0 && str[length] == '\0';
+}
+
+static int is_number_at_position(const char *input, int pos) {
+    int real;
+    return scan_number(input + pos, &real) > 0;
+}
+
+// Accumulates toward the literal's sign so that LONG_MIN reads exactly;
+// a literal that leaves the range of long is kept as its digits
 static AstNode *parse_number(const char *input, int *pos) {
-    char buffer[256];
-    int i = 0;
+    int start = *pos;
+    int real;
+    int length = scan_number(input + start, &real);
+    if (real) {
+        *pos += length;
+        return create_float(strtod(input + start, NULL));
+    }
+    
+    int sign = 1;
+    int overflow = 0;
+    long value = 0;
     
     if (input[*pos] == '-' || input[*pos] == '+') {
-        buffer[i++] = input[(*pos)++];
+        if (input[(*pos)++] == '-') sign = -1;
     }
     
     while (isdigit(input[*pos])) {
-        buffer[i++] = input[(*pos)++];
+        long digit = input[(*pos)++] - '0';
+        overflow = overflow || __builtin_mul_overflow(value, 10, &value) ||
+                   __builtin_add_overflow(value, sign * digit, &value);
     }
     
-    buffer[i] = '\0';
-    long value = atol(buffer);
+    if (overflow) return create_bignum(input + start, *pos - start);
     return create_number(value);
 }
 
+// Symbols are read at whatever length they have, since whole files come
+// through here on reload
 static AstNode *parse_symbol(const char *input, int *pos) {
-    char buffer[256];
-    int i = 0;
-    
-    while (input[*pos] && !isspace(input[*pos]) && input[*pos] != '(' && input[*pos] != ')') {
-        buffer[i++] = input[(*pos)++];
+    int start = *pos;
+    while (input[*pos] && !isspace(input[*pos]) && input[*pos] != '(' && input[*pos] != ')' &&
+           !is_quote_start(input[*pos])) {
+        (*pos)++;
     }
-    
-    buffer[i] = '\0';
-    return create_symbol(buffer);
+    return create_symbol(input + start, *pos - start);
 }
 
+static AstNode *parse_element(const char *input, int *pos);
+
 static AstNode *parse_sexpr(const char *input, int *pos) {
     // Skip opening '('
     (*pos)++;
@@ -108,61 +161,86 @@ static AstNode *parse_sexpr(const char *input, int *pos) {
             return create_error("Unclosed S-expression");
         }
         
-          
-        if (input[*pos] == '(') {
-            AstNode *child = parse_sexpr(input, pos);
-            if (child == NULL) {
-                ast_free(node);
-                return NULL;
-            }
-            if (child->type == AST_ERROR) {
-                ast_free(node);
-                return child;
-            }
-            
-            // Add child to S-expression
-            node->sexpr.count++;
-            node->sexpr.children = realloc(node->sexpr.children, sizeof(AstNode*) * node->sexpr.count);
-            node->sexpr.children[node->sexpr.count - 1] = child;
-        } else if (is_number_at_position(input, *pos)) {
-            AstNode *child = parse_number(input, pos);
-            if (child == NULL) {
-                ast_free(node);
-                return NULL;
-            }
-            
-            // Add child to S-expression
-            node->sexpr.count++;
-            node->sexpr.children = realloc(node->sexpr.children, sizeof(AstNode*) * node->sexpr.count);
-            node->sexpr.children[node->sexpr.count - 1] = child;
-        } else if (isalpha(input[*pos]) || input[*pos] == '+' || input[*pos] == '-' || input[*pos] == '*' || input[*pos] == '/' || input[*pos] == '%' || input[*pos] == '=' || input[*pos] == '>' || input[*pos] == '<') {
-            AstNode *child = parse_symbol(input, pos);
-            if (child == NULL) {
-                ast_free(node);
-                return NULL;
-            }
-            
-            // Add child to S-expression
-            node->sexpr.count++;
-            node->sexpr.children = realloc(node->sexpr.children, sizeof(AstNode*) * node->sexpr.count);
-            node->sexpr.children[node->sexpr.count - 1] = child;
-        } else {
+        AstNode *child = parse_element(input, pos);
+        if (child == NULL) {
             ast_free(node);
-            return create_error("Invalid S-expression content");
+            return NULL;
         }
+        if (child->type == AST_ERROR) {
+            ast_free(node);
+            return child;
+        }
+        
+        // Add child to S-expression
+        node->sexpr.count++;
+        node->sexpr.children = realloc(node->sexpr.children, sizeof(AstNode*) * node->sexpr.count);
+        node->sexpr.children[node->sexpr.count - 1] = child;
         
         // Skip whitespace after element
         while (isspace(input[*pos])) (*pos)++;
     }
     
+    if (input[*pos] != ')') {
+        ast_free(node);
+        return create_error("Unclosed S-expression");
+    }
+    
     // Skip closing ')'
-    if (input[*pos] == ')') {
+    (*pos)++;
+    
+    return node;
+}
+
+// 'x, `x, ,x and ,@x read as (quote x), (quasiquote x), (unquote x) and
+// (unquote-splicing x)
+static AstNode *parse_quoted(const char *input, int *pos) {
+    const char *name = "quote";
+    if (input[*pos] == '`') name = "quasiquote";
+    if (input[*pos] == ',') name = "unquote";
+    (*pos)++;
+    if (strcmp(name, "unquote") == 0 && input[*pos] == '@') {
+        name = "unquote-splicing";
         (*pos)++;
     }
     
+    while (isspace(input[*pos])) (*pos)++;
+    if (input[*pos] == '\0' || input[*pos] == ')') {
+        return create_error("Quote must be followed by an expression");
+    }
+    
+    AstNode *datum = parse_element(input, pos);
+    if (datum == NULL || datum->type == AST_ERROR) return datum;
+    
+    AstNode *node = malloc(sizeof(AstNode));
+    if (node == NULL) {
+        ast_free(datum);
+        return NULL;
+    }
+    
+    node->type = AST_SEXPR;
+    node->sexpr.count = 2;
+    node->sexpr.children = malloc(sizeof(AstNode*) * 2);
+    node->sexpr.children[0] = create_symbol(name, strlen(name));
+    node->sexpr.children[1] = datum;
     return node;
 }
 
+static AstNode *parse_element(const char *input, int *pos) {
+    if (input[*pos] == '(') {
+        return parse_sexpr(input, pos);
+    }
+    if (is_quote_start(input[*pos])) {
+        return parse_quoted(input, pos);
+    }
+    if (is_number_at_position(input, *pos)) {
+        return parse_number(input, pos);
+    }
+    if (is_symbol_start(input[*pos])) {
+        return parse_symbol(input, pos);
+    }
+    return create_error("Invalid S-expression content");
+}
+
 AstNode *parse_string(const char *input) {
     int pos = 0;
     
@@ -176,17 +254,50 @@ AstNode *parse_string(const char *input) {
         return parse_sexpr(input, &pos);
     }
     
+    if (is_quote_start(input[pos])) {
+        return parse_quoted(input, &pos);
+    }
+    
     if (is_number(&input[pos])) {
         return parse_number(input, &pos);
     }
     
-    if (isalpha(input[pos]) || input[pos] == '+' || input[pos] == '-' || input[pos] == '*' || input[pos] == '/' || input[pos] == '%' || input[pos] == '=' || input[pos] == '>' || input[pos] == '<') {
+    if (is_symbol_start(input[pos])) {
         return parse_symbol(input, &pos);
     }
     
     return create_error("Invalid input");
 }
 
+// Reads every top-level form of a source file into one S-expression
+AstNode *parse_program(const char *input) {
+    int pos = 0;
+    
+    AstNode *node = malloc(sizeof(AstNode));
+    if (node == NULL) return NULL;
+    
+    node->type = AST_SEXPR;
+    node->sexpr.count = 0;
+    node->sexpr.children = NULL;
+    
+    while (1) {
+        while (isspace(input[pos])) pos++;
+        if (input[pos] == '\0') break;
+        
+        AstNode *child = parse_element(input, &pos);
+        if (child == NULL || child->type == AST_ERROR) {
+            ast_free(node);
+            return child;
+        }
+        
+        node->sexpr.count++;
+        node->sexpr.children = realloc(node->sexpr.children, sizeof(AstNode*) * node->sexpr.count);
+        node->sexpr.children[node->sexpr.count - 1] = child;
+    }
+    
+    return node;
+}
+
 void ast_free(AstNode *node) {
     if (node == NULL) return;
     
@@ -194,6 +305,9 @@ void ast_free(AstNode *node) {
         case AST_SYMBOL:
             free(node->symbol);
             break;
+        case AST_BIGNUM:
+            free(node->digits);
+            break;
         case AST_SEXPR:
             for (int i = 0; i < node->sexpr.count; i++) {
                 ast_free(node->sexpr.children[i]);
@@ -5,13 +5,17 @@ typedef enum {
     AST_NUMBER,
     AST_SYMBOL,
     AST_SEXPR,
-    AST_ERROR
+    AST_ERROR,
+    AST_BIGNUM,
+    AST_FLOAT
 } AstType;
 
 typedef struct AstNode {
     AstType type;
     union {
         long number;
+        double fnum;
+        char *digits; // a number literal too large for a long, sign included
         char *symbol;
         struct {
             struct AstNode **children;
@@ -22,6 +26,7 @@ typedef struct AstNode {
 } AstNode;
 
 AstNode *parse_string(const char *input);
+AstNode *parse_program(const char *input);
 void ast_free(AstNode *node);
 
 #endif
\ No newline at end of file
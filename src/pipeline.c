@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pipeline.h"
+#include "eval.h"
+#include "lazy.h"
+
+// map, filter, fold and take run as stages of a pipeline. A nested call
+// such as (fold f 0 (map g (filter p xs))) is fused: each element of xs is
+// pushed through filter, map and fold in turn, so no intermediate list is
+// built and elements are moved from stage to stage instead of copied.
+// Fusion reorders the calls, so it is only used when every stage function
+// is pure; otherwise the stages run one after another as written.
+
+#define PIPELINE_MAX 16
+
+typedef enum { STAGE_MAP, STAGE_FILTER, STAGE_FOLD, STAGE_TAKE } StageKind;
+
+typedef struct {
+    StageKind kind;
+    char *name;   // for error messages
+    Lval *f;      // map, filter and fold
+    Lval *acc;    // fold
+    long limit;   // take
+    long taken;
+} Stage;
+
+static int stage_kind(char *name, StageKind *kind) {
+    if (strcmp(name, "map") == 0) { *kind = STAGE_MAP; return 1; }
+    if (strcmp(name, "filter") == 0) { *kind = STAGE_FILTER; return 1; }
+    if (strcmp(name, "fold") == 0) { *kind = STAGE_FOLD; return 1; }
+    if (strcmp(name, "take") == 0) { *kind = STAGE_TAKE; return 1; }
+    return 0;
+}
+
+// Arguments before the list: (map f xs), (filter p xs), (fold f init xs)
+// and (take n xs)
+static int stage_params(StageKind kind) {
+    return kind == STAGE_FOLD ? 2 : 1;
+}
+
+static void stage_free(Stage *s) {
+    lval_free(s->f);
+    lval_free(s->acc);
+}
+
+// Takes the leading arguments of a, leaving only the list behind
+static Lval *stage_init(Stage *s, StageKind kind, char *name, Lval *a) {
+    s->kind = kind;
+    s->name = name;
+    s->f = NULL;
+    s->acc = NULL;
+    s->limit = 0;
+    s->taken = 0;
+    
+    if (kind == STAGE_TAKE) {
+        Lval *n = lval_pop(a, 0);
+        int ok = (n->type == LVAL_NUM);
+        s->limit = ok && n->num > 0 ? n->num : 0;
+        lval_free(n);
+        if (!ok) return lval_err("Function 'take' passed incorrect type!");
+        return NULL;
+    }
+    
+    s->f = lval_pop(a, 0);
+    if (kind == STAGE_FOLD) s->acc = lval_pop(a, 0);
+    if (!lval_is_fun(s->f)) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "Function '%s' passed incorrect type!", name);
+        return lval_err(msg);
+    }
+    return NULL;
+}
+
+static int pipeline_truthy(Lval *v) {
+    if (v->type == LVAL_NUM) return v->num != 0;
+    if (v->type == LVAL_SEXPR) return v->sexpr.count > 0;
+    return 1;
+}
+
+static Lval *pipeline_apply(Lenv *e, Lval *f, Lval *x, Lval *y) {
+    Lval *args = lval_sexpr();
+    lval_add(args, x);
+    if (y) lval_add(args, y);
+    return lval_call(e, f, args);
+}
+
+// Pushes x through stages [0, count). Returns the element that came out
+// of the last stage, NULL when a stage dropped or folded it, or an error
+// with *at set to the stage that raised it.
+static Lval *pipeline_push(Lenv *e, Stage *stages, int count, Lval *x, int *at) {
+    for (int i = 0; i < count; i++) {
+        Stage *s = &stages[i];
+        *at = i;
+        
+        switch (s->kind) {
+            case STAGE_FILTER: {
+                Lval *keep = pipeline_apply(e, s->f, lval_copy(x), NULL);
+                if (keep->type == LVAL_ERR) {
+                    lval_free(x);
+                    return keep;
+                }
+                int pass = pipeline_truthy(keep);
+                lval_free(keep);
+                if (!pass) {
+                    lval_free(x);
+                    return NULL;
+                }
+                break;
+            }
+            case STAGE_MAP:
+                x = pipeline_apply(e, s->f, x, NULL);
+                if (x->type == LVAL_ERR) return x;
+                break;
+            case STAGE_TAKE:
+                if (s->taken == s->limit) {
+                    lval_free(x);
+                    return NULL;
+                }
+                s->taken++;
+                break;
+            case STAGE_FOLD:
+                s->acc = pipeline_apply(e, s->f, s->acc, x);
+                if (s->acc->type == LVAL_ERR) {
+                    Lval *err = s->acc;
+                    s->acc = NULL;
+                    return err;
+                }
+                return NULL;
+        }
+    }
+    return x;
+}
+
+// Runs xs through the stages in one pass, consuming xs. Run separately,
+// the stages would report the error of the earliest failing stage, so
+// after an error the remaining elements still go through the stages
+// before it, and only an error from an earlier stage replaces it.
+// A lazy sequence source is pulled one item at a time, and an error
+// while producing an item comes before anything later stages would do.
+static Lval *pipeline_run(Lenv *e, Stage *stages, int count, Lval *xs) {
+    // The iterator holds its own reference, and dropping ours lets the
+    // items of a recursive lazy-seq be freed as soon as they are passed
+    Lseq_iter *it = NULL;
+    if (xs->type == LVAL_SEQ) {
+        it = lseq_iter_new(xs->seq);
+        lval_free(xs);
+        xs = NULL;
+    }
+    int n = it ? 0 : xs->sexpr.count;
+    int capacity = it ? 16 : n;
+    Lval **out = malloc(sizeof(Lval*) * (capacity > 0 ? capacity : 1));
+    int emitted = 0;
+    Lval *err = NULL;
+    int limit = count;
+    
+    for (int i = 0; it || i < n; i++) {
+        // Nothing gets past a full take at the front of the pipeline
+        if (stages[0].kind == STAGE_TAKE && stages[0].taken == stages[0].limit) break;
+        
+        Lval *x;
+        if (it) {
+            x = lseq_iter_next(e, it);
+            if (x == NULL) break;
+            if (x->type == LVAL_ERR) {
+                lval_free(err);
+                err = x;
+                break;
+            }
+        } else {
+            x = xs->sexpr.cell[i];
+            xs->sexpr.cell[i] = NULL;
+        }
+        
+        int at = 0;
+        Lval *r = pipeline_push(e, stages, limit, x, &at);
+        if (r == NULL) continue;
+        
+        if (r->type == LVAL_ERR) {
+            lval_free(err);
+            err = r;
+            limit = at;
+            if (limit == 0) break;
+        } else if (err) {
+            lval_free(r);
+        } else {
+            if (emitted == capacity) {
+                capacity *= 2;
+                out = realloc(out, sizeof(Lval*) * capacity);
+            }
+            out[emitted++] = r;
+        }
+    }
+    lseq_iter_free(it);
+    lval_free(xs);
+    
+    if (err) {
+        for (int i = 0; i < emitted; i++) lval_free(out[i]);
+        free(out);
+        return err;
+    }
+    
+    if (stages[count - 1].kind == STAGE_FOLD) {
+        free(out);
+        Lval *acc = stages[count - 1].acc;
+        stages[count - 1].acc = NULL;
+        return acc;
+    }
+    
+    Lval *result = lval_sexpr();
+    result->sexpr.cell = realloc(out, sizeof(Lval*) * (emitted > 0 ? emitted : 1));
+    result->sexpr.count = emitted;
+    return result;
+}
+
+static Lval *pipeline_check_list(Stage *s, Lval *xs) {
+    if (xs->type == LVAL_SEXPR || xs->type == LVAL_SEQ) return NULL;
+    
+    char msg[64];
+    snprintf(msg, sizeof(msg), "Function '%s' passed incorrect type!", s->name);
+    return lval_err(msg);
+}
+
+// Runs a single stage called as an ordinary builtin
+Lval *builtin_pipeline(Lenv *e, Lval *a, char *name) {
+    StageKind kind;
+    stage_kind(name, &kind);
+    
+    if (a->sexpr.count != stage_params(kind) + 1) {
+        lval_free(a);
+        char msg[80];
+        snprintf(msg, sizeof(msg), "Function '%s' passed incorrect number of arguments!", name);
+        return lval_err(msg);
+    }
+    
+    Stage s;
+    Lval *err = stage_init(&s, kind, name, a);
+    Lval *xs = lval_take(a, 0);
+    if (!err) err = pipeline_check_list(&s, xs);
+    if (err) {
+        stage_free(&s);
+        lval_free(xs);
+        return err;
+    }
+    
+    Lval *result = pipeline_run(e, &s, 1, xs);
+    stage_free(&s);
+    return result;
+}
+
+// A stage call whose head really names the builtin, with the right arity
+static int pipeline_is_stage(Lenv *e, Lval *x, StageKind *kind) {
+    if (x->type != LVAL_SEXPR || x->sexpr.count < 3 || x->sexpr.cell[0]->type != LVAL_SYM) return 0;
+    if (!stage_kind(x->sexpr.cell[0]->sym, kind)) return 0;
+    if (x->sexpr.count != stage_params(*kind) + 2) return 0;
+    
+    Lval *f = lenv_get(e, x->sexpr.cell[0]);
+    int builtin = (f->type == LVAL_FUN && strcmp(f->fun, x->sexpr.cell[0]->sym) == 0);
+    lval_free(f);
+    return builtin;
+}
+
+// True when v is a stage applied to another stage that produces a list
+int pipeline_fusable(Lenv *e, Lval *v) {
+    StageKind kind;
+    if (!pipeline_is_stage(e, v, &kind)) return 0;
+    
+    Lval *inner = v->sexpr.cell[v->sexpr.count - 1];
+    return pipeline_is_stage(e, inner, &kind) && kind != STAGE_FOLD;
+}
+
+// eval hands back a copy for a symbol and leaves the symbol to us
+static Lval *pipeline_eval_arg(Lenv *e, Lval *x) {
+    int is_sym = (x->type == LVAL_SYM);
+    Lval *result = eval(e, x);
+    if (is_sym) lval_free(x);
+    return result;
+}
+
+// Evaluates a fusable pipeline. Arguments are evaluated in the same order
+// as the nested calls would evaluate them: outer stage first, left to
+// right, ending with the source list.
+Lval *pipeline_eval(Lenv *e, Lval *v) {
+    Lval *forms[PIPELINE_MAX];
+    int count = 0;
+    
+    Lval *x = v;
+    StageKind kind;
+    while (count < PIPELINE_MAX && pipeline_is_stage(e, x, &kind) && (count == 0 || kind != STAGE_FOLD)) {
+        forms[count++] = x;
+        x = x->sexpr.cell[x->sexpr.count - 1];
+    }
+    
+    // Index 0 is the innermost stage, the first one an element meets
+    Lval *params[PIPELINE_MAX];
+    Lval *err = NULL;
+    int ready = 0;
+    for (int i = 0; i < count && !err; i++) {
+        Lval *form = forms[i];
+        stage_kind(form->sexpr.cell[0]->sym, &kind);
+        
+        Lval *a = lval_sexpr();
+        for (int j = 0; j < stage_params(kind) && !err; j++) {
+            Lval *arg = pipeline_eval_arg(e, lval_pop(form, 1));
+            if (arg->type == LVAL_ERR) {
+                err = arg;
+            } else {
+                lval_add(a, arg);
+            }
+        }
+        params[count - 1 - i] = a;
+        ready++;
+    }
+    
+    Lval *xs = NULL;
+    if (!err) {
+        Lval *inner = forms[count - 1];
+        xs = pipeline_eval_arg(e, lval_pop(inner, inner->sexpr.count - 1));
+        if (xs->type == LVAL_ERR) {
+            err = xs;
+            xs = NULL;
+        }
+    }
+    
+    if (err) {
+        for (int i = 0; i < ready; i++) lval_free(params[count - 1 - i]);
+        lval_free(v);
+        return err;
+    }
+    
+    // Stage names point into v, so it is freed only once the run is over
+    Stage stages[PIPELINE_MAX];
+    Lval *errs[PIPELINE_MAX];
+    int fuse = 1;
+    for (int i = 0; i < count; i++) {
+        char *name = forms[count - 1 - i]->sexpr.cell[0]->sym;
+        stage_kind(name, &kind);
+        errs[i] = stage_init(&stages[i], kind, name, params[i]);
+        lval_free(params[i]);
+        if (errs[i] || (stages[i].f && !lval_is_pure_fun(stages[i].f))) fuse = 0;
+    }
+    
+    Lval *result;
+    if (fuse) {
+        result = pipeline_check_list(&stages[0], xs);
+        if (result) {
+            lval_free(xs);
+        } else {
+            result = pipeline_run(e, stages, count, xs);
+        }
+    } else {
+        // Run the stages one after another, exactly as written
+        result = xs;
+        for (int i = 0; i < count && result->type != LVAL_ERR; i++) {
+            Lval *stage_err = errs[i] ? errs[i] : pipeline_check_list(&stages[i], result);
+            errs[i] = NULL;
+            if (stage_err) {
+                lval_free(result);
+                result = stage_err;
+            } else {
+                result = pipeline_run(e, &stages[i], 1, result);
+            }
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        lval_free(errs[i]);
+        stage_free(&stages[i]);
+    }
+    lval_free(v);
+    return result;
+}
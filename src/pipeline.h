@@ -0,0 +1,11 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "lval.h"
+#include "env.h"
+
+Lval *builtin_pipeline(Lenv *e, Lval *a, char *name);
+int pipeline_fusable(Lenv *e, Lval *v);
+Lval *pipeline_eval(Lenv *e, Lval *v);
+
+#endif
@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include "pool.h"
+#include "eval.h"
+
+// Worker pool for evaluating independent arguments of pure calls. A task
+// evaluates one argument in place (*slot = eval_owned(e, *slot)), or runs a
+// plain C function for builtins that split up their own work; a batch
+// counts the tasks a caller is still waiting on. The caller helps drain the queue
+// while it waits, and workers never fork again, so nothing can deadlock.
+struct Lbatch {
+    int pending;
+    pthread_cond_t done;
+};
+
+typedef struct Ltask {
+    Lenv *e;
+    Lval **slot;
+    void (*fn)(void *arg); // run instead of eval when set
+    void *arg;
+    Lbatch *batch;
+    struct Ltask *next;
+} Ltask;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_ready = PTHREAD_COND_INITIALIZER;
+static pthread_t *workers = NULL;
+static int worker_count = 0;
+static int stopping = 0;
+static long tasks_run = 0;
+static Ltask *queue_head = NULL;
+static Ltask *queue_tail = NULL;
+static int queued = 0; // tasks no thread has taken yet
+static __thread int in_worker = 0;
+
+// Called with pool_lock held; returns with it held again
+static void run_task(Ltask *t) {
+    pthread_mutex_unlock(&pool_lock);
+    if (t->fn) {
+        t->fn(t->arg);
+    } else {
+        *t->slot = eval_owned(t->e, *t->slot);
+    }
+    pthread_mutex_lock(&pool_lock);
+    
+    tasks_run++;
+    if (--t->batch->pending == 0) {
+        pthread_cond_broadcast(&t->batch->done);
+    }
+    free(t);
+}
+
+static Ltask *queue_pop(void) {
+    Ltask *t = queue_head;
+    queue_head = t->next;
+    __atomic_sub_fetch(&queued, 1, __ATOMIC_RELAXED);
+    if (queue_head == NULL) queue_tail = NULL;
+    return t;
+}
+
+static void *worker_main(void *arg) {
+    (void)arg;
+    in_worker = 1;
+    
+    pthread_mutex_lock(&pool_lock);
+    while (1) {
+        while (queue_head == NULL && !stopping) {
+            pthread_cond_wait(&pool_ready, &pool_lock);
+        }
+        if (queue_head == NULL) break;
+        run_task(queue_pop());
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return NULL;
+}
+
+void pool_start(int threads) {
+    pool_stop();
+    if (threads <= 0) return;
+    
+    stopping = 0;
+    workers = malloc(sizeof(pthread_t) * threads);
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, worker_main, NULL);
+    }
+    worker_count = threads;
+}
+
+void pool_stop(void) {
+    if (worker_count == 0) return;
+    
+    pthread_mutex_lock(&pool_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&pool_ready);
+    pthread_mutex_unlock(&pool_lock);
+    
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+}
+
+int pool_size(void) {
+    return worker_count;
+}
+
+int pool_in_worker(void) {
+    return in_worker;
+}
+
+// Whether every worker already has a queued task waiting for it, so that
+// forking more would only add overhead. Read without the lock; a stale
+// answer costs at most one task more or less.
+int pool_saturated(void) {
+    return __atomic_load_n(&queued, __ATOMIC_RELAXED) >= worker_count;
+}
+
+long pool_tasks_run(void) {
+    pthread_mutex_lock(&pool_lock);
+    long n = tasks_run;
+    pthread_mutex_unlock(&pool_lock);
+    return n;
+}
+
+Lbatch *pool_batch_new(void) {
+    Lbatch *b = malloc(sizeof(Lbatch));
+    b->pending = 0;
+    pthread_cond_init(&b->done, NULL);
+    return b;
+}
+
+static void pool_push(Lbatch *b, Ltask *t) {
+    t->batch = b;
+    t->next = NULL;
+    
+    pthread_mutex_lock(&pool_lock);
+    b->pending++;
+    __atomic_add_fetch(&queued, 1, __ATOMIC_RELAXED);
+    if (queue_tail) queue_tail->next = t; else queue_head = t;
+    queue_tail = t;
+    pthread_cond_signal(&pool_ready);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void pool_submit(Lbatch *b, Lenv *e, Lval **slot) {
+    Ltask *t = malloc(sizeof(Ltask));
+    t->e = e;
+    t->slot = slot;
+    t->fn = NULL;
+    t->arg = NULL;
+    pool_push(b, t);
+}
+
+void pool_submit_fn(Lbatch *b, void (*fn)(void *arg), void *arg) {
+    Ltask *t = malloc(sizeof(Ltask));
+    t->e = NULL;
+    t->slot = NULL;
+    t->fn = fn;
+    t->arg = arg;
+    pool_push(b, t);
+}
+
+// Waits for every task in the batch, running queued tasks meanwhile, then
+// frees the batch
+void pool_wait(Lbatch *b) {
+    pthread_mutex_lock(&pool_lock);
+    while (b->pending > 0) {
+        if (queue_head) {
+            run_task(queue_pop());
+        } else {
+            pthread_cond_wait(&b->done, &pool_lock);
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+    
+    pthread_cond_destroy(&b->done);
+    free(b);
+}
@@ -0,0 +1,20 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "lval.h"
+#include "env.h"
+
+typedef struct Lbatch Lbatch;
+
+void pool_start(int threads);
+void pool_stop(void);
+int pool_size(void);
+int pool_in_worker(void);
+int pool_saturated(void);
+long pool_tasks_run(void);
+Lbatch *pool_batch_new(void);
+void pool_submit(Lbatch *b, Lenv *e, Lval **slot);
+void pool_submit_fn(Lbatch *b, void (*fn)(void *arg), void *arg);
+void pool_wait(Lbatch *b);
+
+#endif
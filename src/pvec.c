@@ -0,0 +1,468 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pvec.h"
+#include "vector.h"
+
+// A persistent vector is an immutable, height-balanced binary tree whose
+// leaves each hold a short run of items inline. Every operation builds
+// new nodes only along the paths it touches and shares the rest of the
+// tree with the vector it came from, so old versions stay valid and
+// copying one is just a reference count. Keeping the two subtrees of any
+// node within one level of each other bounds the height by O(log n),
+// which makes indexing, cons, tail, slice and join all O(log n). Joining
+// works down the spine of the taller tree to a subtree of matching height
+// and rotates on the way back up, as in AVL trees.
+#define PVEC_LEAF 32
+
+struct Lpvec {
+    int refs;
+    int height;    // 1 for a leaf
+    int count;     // items in the whole subtree
+    Lpvec *left;   // NULL for a leaf
+    Lpvec *right;
+    Lval items[];  // a leaf's items
+};
+
+static Lpvec *leaf_new(int count) {
+    Lpvec *t = malloc(sizeof(Lpvec) + sizeof(Lval) * count);
+    t->refs = 1;
+    t->height = 1;
+    t->count = count;
+    t->left = NULL;
+    t->right = NULL;
+    return t;
+}
+
+// Takes ownership of both subtrees
+static Lpvec *node_new(Lpvec *l, Lpvec *r) {
+    Lpvec *t = malloc(sizeof(Lpvec));
+    t->refs = 1;
+    t->height = 1 + (l->height > r->height ? l->height : r->height);
+    t->count = l->count + r->count;
+    t->left = l;
+    t->right = r;
+    return t;
+}
+
+Lpvec *lpvec_retain(Lpvec *t) {
+    if (t) __atomic_add_fetch(&t->refs, 1, __ATOMIC_RELAXED);
+    return t;
+}
+
+void lpvec_release(Lpvec *t) {
+    if (t == NULL || __atomic_sub_fetch(&t->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    
+    if (t->left) {
+        lpvec_release(t->left);
+        lpvec_release(t->right);
+    } else {
+        for (int i = 0; i < t->count; i++) {
+            lval_clear(&t->items[i]);
+        }
+    }
+    free(t);
+}
+
+int lpvec_count(Lpvec *t) {
+    return t ? t->count : 0;
+}
+
+// Moves the contents of a heap Lval into a leaf
+static void item_move(Lval *slot, Lval *v) {
+    *slot = *v;
+    free(v);
+}
+
+static void item_copy(Lval *slot, Lval *v) {
+    item_move(slot, lval_copy(v));
+}
+
+// Borrowed; t is never changed, so valid while t is held
+static Lval *item_at(Lpvec *t, int i) {
+    while (t->left) {
+        if (i < t->left->count) {
+            t = t->left;
+        } else {
+            i -= t->left->count;
+            t = t->right;
+        }
+    }
+    return &t->items[i];
+}
+
+// Hands back references to both subtrees of a node in place of the
+// caller's reference to the node
+static void expose(Lpvec *t, Lpvec **l, Lpvec **r) {
+    *l = lpvec_retain(t->left);
+    *r = lpvec_retain(t->right);
+    lpvec_release(t);
+}
+
+// Fills slots from a leaf, giving up the caller's reference to it; the
+// items of a leaf nothing else holds are moved rather than copied
+static void leaf_drain(Lval *slots, Lpvec *t) {
+    if (__atomic_load_n(&t->refs, __ATOMIC_ACQUIRE) == 1) {
+        memcpy(slots, t->items, sizeof(Lval) * t->count);
+        free(t);
+        return;
+    }
+    for (int i = 0; i < t->count; i++) {
+        item_copy(&slots[i], &t->items[i]);
+    }
+    lpvec_release(t);
+}
+
+static Lpvec *leaf_merge(Lpvec *l, Lpvec *r) {
+    int n = l->count;
+    Lpvec *t = leaf_new(n + r->count);
+    leaf_drain(t->items, l);
+    leaf_drain(t->items + n, r);
+    return t;
+}
+
+// Folds a leaf into the first or last leaf of t, copying the path down to
+// it; no height changes, so the tree stays balanced. Borrows t, and takes
+// the leaf only when it fits, returning NULL otherwise.
+static Lpvec *merge_edge(Lpvec *t, Lpvec *leaf, int front) {
+    if (t->left == NULL) {
+        if (t->count + leaf->count > PVEC_LEAF) return NULL;
+        return front ? leaf_merge(leaf, lpvec_retain(t)) : leaf_merge(lpvec_retain(t), leaf);
+    }
+    
+    Lpvec *edge = merge_edge(front ? t->left : t->right, leaf, front);
+    if (edge == NULL) return NULL;
+    return front ? node_new(edge, lpvec_retain(t->right)) : node_new(lpvec_retain(t->left), edge);
+}
+
+static Lpvec *rotate_left(Lpvec *t) {
+    Lpvec *a, *y, *b, *c;
+    expose(t, &a, &y);
+    expose(y, &b, &c);
+    return node_new(node_new(a, b), c);
+}
+
+static Lpvec *rotate_right(Lpvec *t) {
+    Lpvec *y, *c, *a, *b;
+    expose(t, &y, &c);
+    expose(y, &a, &b);
+    return node_new(a, node_new(b, c));
+}
+
+// l is at least two levels taller than r
+static Lpvec *join_right(Lpvec *l, Lpvec *r) {
+    Lpvec *a, *c;
+    expose(l, &a, &c);
+    
+    if (c->height <= r->height + 1) {
+        Lpvec *t = node_new(c, r);
+        if (t->height <= a->height + 1) return node_new(a, t);
+        return rotate_left(node_new(a, rotate_right(t)));
+    }
+    
+    Lpvec *t = join_right(c, r);
+    if (t->height <= a->height + 1) return node_new(a, t);
+    return rotate_left(node_new(a, t));
+}
+
+// r is at least two levels taller than l
+static Lpvec *join_left(Lpvec *l, Lpvec *r) {
+    Lpvec *c, *a;
+    expose(r, &c, &a);
+    
+    if (c->height <= l->height + 1) {
+        Lpvec *t = node_new(l, c);
+        if (t->height <= a->height + 1) return node_new(t, a);
+        return rotate_right(node_new(rotate_left(t), a));
+    }
+    
+    Lpvec *t = join_left(l, c);
+    if (t->height <= a->height + 1) return node_new(t, a);
+    return rotate_right(node_new(t, a));
+}
+
+// Takes ownership of both trees, either of which may be empty
+static Lpvec *concat(Lpvec *l, Lpvec *r) {
+    if (l == NULL) return r;
+    if (r == NULL) return l;
+    
+    // A short leaf on either side joins its neighbour, so repeated
+    // cons and appends fill leaves instead of growing the tree by one
+    Lpvec *t = l->left == NULL ? merge_edge(r, l, 1) : NULL;
+    if (t) {
+        lpvec_release(r);
+        return t;
+    }
+    t = r->left == NULL ? merge_edge(l, r, 0) : NULL;
+    if (t) {
+        lpvec_release(l);
+        return t;
+    }
+    
+    if (l->height > r->height + 1) return join_right(l, r);
+    if (r->height > l->height + 1) return join_left(l, r);
+    return node_new(l, r);
+}
+
+static Lpvec *leaf_slice(Lpvec *t, int start, int end) {
+    Lpvec *s = leaf_new(end - start);
+    for (int i = start; i < end; i++) {
+        item_copy(&s->items[i - start], &t->items[i]);
+    }
+    return s;
+}
+
+// Splits t into its first i items and the rest, taking ownership of t
+static void split(Lpvec *t, int i, Lpvec **l, Lpvec **r) {
+    if (i == 0 || i == t->count) {
+        *l = i ? t : NULL;
+        *r = i ? NULL : t;
+        return;
+    }
+    
+    if (t->left == NULL) {
+        *l = leaf_slice(t, 0, i);
+        *r = leaf_slice(t, i, t->count);
+        lpvec_release(t);
+        return;
+    }
+    
+    Lpvec *a, *b, *m;
+    expose(t, &a, &b);
+    if (i < a->count) {
+        split(a, i, l, &m);
+        *r = concat(m, b);
+    } else {
+        split(b, i - a->count, &m, r);
+        *l = concat(a, m);
+    }
+}
+
+// Builds a tree from n heap Lvals, taking ownership of them
+static Lpvec *pvec_from(Lval **items, int n) {
+    Lpvec *t = NULL;
+    for (int i = 0; i < n; i += PVEC_LEAF) {
+        int k = n - i < PVEC_LEAF ? n - i : PVEC_LEAF;
+        Lpvec *leaf = leaf_new(k);
+        for (int j = 0; j < k; j++) {
+            item_move(&leaf->items[j], items[i + j]);
+        }
+        t = concat(t, leaf);
+    }
+    return t;
+}
+
+static void append_items(Lval *list, Lpvec *t) {
+    if (t == NULL) return;
+    
+    if (t->left) {
+        append_items(list, t->left);
+        append_items(list, t->right);
+        return;
+    }
+    for (int i = 0; i < t->count; i++) {
+        lval_add(list, lval_copy(&t->items[i]));
+    }
+}
+
+unsigned long lpvec_hash(Lpvec *t) {
+    unsigned long h = (unsigned long)lpvec_count(t);
+    for (int i = 0; i < lpvec_count(t); i++) {
+        h = h * 1099511628211UL ^ lval_hash(item_at(t, i));
+    }
+    return h;
+}
+
+int lpvec_eq(Lpvec *x, Lpvec *y) {
+    if (x == y) return 1;
+    
+    int n = lpvec_count(x);
+    if (n != lpvec_count(y)) return 0;
+    for (int i = 0; i < n; i++) {
+        if (!lval_eq(item_at(x, i), item_at(y, i))) return 0;
+    }
+    return 1;
+}
+
+void lpvec_print(Lpvec *t, char *out, int size) {
+    int n = snprintf(out, size, "#[");
+    for (int i = 0; i < lpvec_count(t) && n < size; i++) {
+        char *item = lval_to_string(item_at(t, i));
+        n += snprintf(out + n, size - n, i ? " %s" : "%s", item);
+        free(item);
+    }
+    if (n < size) snprintf(out + n, size - n, "]");
+}
+
+static Lval *lval_pvec(Lpvec *t) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_PVEC;
+    v->pvec = t;
+    return v;
+}
+
+int pvec_handles(char *name, Lval *a) {
+    if (strcmp(name, "pvec") == 0 || strcmp(name, "to-pvec") == 0 || strcmp(name, "to-list") == 0) {
+        return 1;
+    }
+    if (strcmp(name, "cons") == 0) {
+        return a->sexpr.count == 2 && a->sexpr.cell[1]->type == LVAL_PVEC;
+    }
+    if (strcmp(name, "join") == 0) {
+        for (int i = 0; i < a->sexpr.count; i++) {
+            if (a->sexpr.cell[i]->type == LVAL_PVEC) return 1;
+        }
+        return 0;
+    }
+    if (strcmp(name, "head") == 0 || strcmp(name, "tail") == 0 || strcmp(name, "nth") == 0 ||
+        strcmp(name, "len") == 0 || strcmp(name, "slice") == 0) {
+        return a->sexpr.count > 0 && a->sexpr.cell[0]->type == LVAL_PVEC;
+    }
+    return 0;
+}
+
+static Lval *pvec_err(Lval *a, char *name, char *what) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Function '%s' passed %s!", name, what);
+    lval_free(a);
+    return lval_err(msg);
+}
+
+// Reads argument i as an index in [0, limit]
+static int index_arg(Lval *a, int i, int limit, long *out) {
+    Lval *x = a->sexpr.cell[i];
+    if (x->type != LVAL_NUM || x->num < 0 || x->num > limit) return 0;
+    *out = x->num;
+    return 1;
+}
+
+static int arg_count(char *name) {
+    if (strcmp(name, "slice") == 0) return 3;
+    if (strcmp(name, "nth") == 0 || strcmp(name, "cons") == 0) return 2;
+    return 1;
+}
+
+// Takes ownership of a list, vector or persistent vector
+static Lpvec *pvec_of(Lval *x) {
+    Lpvec *t = NULL;
+    if (x->type == LVAL_PVEC) {
+        t = lpvec_retain(x->pvec);
+    } else if (x->type == LVAL_SEXPR) {
+        t = pvec_from(x->sexpr.cell, x->sexpr.count);
+        x->sexpr.count = 0;
+    } else {
+        int n = lvector_count(x);
+        Lval **items = malloc(sizeof(Lval*) * (n > 0 ? n : 1));
+        for (int i = 0; i < n; i++) {
+            items[i] = lval_copy(lvector_item(x, i));
+        }
+        t = pvec_from(items, n);
+        free(items);
+    }
+    lval_free(x);
+    return t;
+}
+
+static int is_sequence(Lval *x) {
+    return x->type == LVAL_PVEC || x->type == LVAL_SEXPR || x->type == LVAL_VECTOR;
+}
+
+Lval *builtin_pvec(Lval *a, char *name) {
+    if (strcmp(name, "pvec") == 0) {
+        Lpvec *t = pvec_from(a->sexpr.cell, a->sexpr.count);
+        a->sexpr.count = 0;
+        lval_free(a);
+        return lval_pvec(t);
+    }
+    
+    // join takes any number of lists and persistent vectors
+    if (strcmp(name, "join") == 0) {
+        for (int i = 0; i < a->sexpr.count; i++) {
+            int type = a->sexpr.cell[i]->type;
+            if (type != LVAL_PVEC && type != LVAL_SEXPR) return pvec_err(a, name, "incorrect type");
+        }
+        Lpvec *t = NULL;
+        while (a->sexpr.count > 0) {
+            t = concat(t, pvec_of(lval_pop(a, 0)));
+        }
+        lval_free(a);
+        return lval_pvec(t);
+    }
+    
+    if (a->sexpr.count != arg_count(name)) return pvec_err(a, name, "incorrect number of arguments");
+    
+    if (strcmp(name, "cons") == 0) {
+        Lpvec *leaf = leaf_new(1);
+        item_move(&leaf->items[0], lval_pop(a, 0));
+        Lpvec *t = concat(leaf, lpvec_retain(a->sexpr.cell[0]->pvec));
+        lval_free(a);
+        return lval_pvec(t);
+    }
+    
+    Lval *x = a->sexpr.cell[0];
+    if (!is_sequence(x)) return pvec_err(a, name, "incorrect type");
+    
+    if (strcmp(name, "to-pvec") == 0) {
+        Lpvec *t = pvec_of(lval_take(a, 0));
+        return lval_pvec(t);
+    }
+    
+    if (strcmp(name, "to-list") == 0) {
+        if (x->type == LVAL_SEXPR) return lval_take(a, 0);
+        Lval *list = lval_sexpr();
+        if (x->type == LVAL_PVEC) {
+            append_items(list, x->pvec);
+        } else {
+            for (int i = 0; i < lvector_count(x); i++) {
+                lval_add(list, lval_copy(lvector_item(x, i)));
+            }
+        }
+        lval_free(a);
+        return list;
+    }
+    
+    // The rest are only routed here for persistent vectors
+    Lpvec *t = x->pvec;
+    int n = lpvec_count(t);
+    
+    if (strcmp(name, "len") == 0) {
+        lval_free(a);
+        return lval_num(n);
+    }
+    
+    if (strcmp(name, "head") == 0 || strcmp(name, "tail") == 0) {
+        if (n == 0) return pvec_err(a, name, "empty vector");
+        if (strcmp(name, "head") == 0) {
+            Lval *v = lval_copy(item_at(t, 0));
+            lval_free(a);
+            return v;
+        }
+        Lpvec *first, *rest;
+        split(lpvec_retain(t), 1, &first, &rest);
+        lpvec_release(first);
+        lval_free(a);
+        return lval_pvec(rest);
+    }
+    
+    if (strcmp(name, "nth") == 0) {
+        long i;
+        if (n == 0 || !index_arg(a, 1, n - 1, &i)) return pvec_err(a, name, "an index out of range");
+        Lval *v = lval_copy(item_at(t, (int)i));
+        lval_free(a);
+        return v;
+    }
+    
+    // slice
+    long start, end;
+    if (!index_arg(a, 1, n, &start) || !index_arg(a, 2, n, &end) || end < start) {
+        return pvec_err(a, name, "a range out of bounds");
+    }
+    Lpvec *front, *back, *skip, *mid;
+    split(lpvec_retain(t), (int)end, &front, &back);
+    lpvec_release(back);
+    split(front, (int)start, &skip, &mid);
+    lpvec_release(skip);
+    lval_free(a);
+    return lval_pvec(mid);
+}
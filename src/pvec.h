@@ -0,0 +1,16 @@
+#ifndef PVEC_H
+#define PVEC_H
+
+#include "lval.h"
+
+Lpvec *lpvec_retain(Lpvec *t);
+void lpvec_release(Lpvec *t);
+int lpvec_count(Lpvec *t);
+unsigned long lpvec_hash(Lpvec *t);
+int lpvec_eq(Lpvec *x, Lpvec *y);
+void lpvec_print(Lpvec *t, char *out, int size);
+
+int pvec_handles(char *name, Lval *a);
+Lval *builtin_pvec(Lval *a, char *name);
+
+#endif
@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "quote.h"
+#include "eval.h"
+
+// The reader turns 'x, `x, ,x and ,@x into (quote x), (quasiquote x),
+// (unquote x) and (unquote-splicing x). eval always consumes a private copy
+// of the code it runs, so neither form copies its datum again: quote moves
+// the datum out of the form, and quasiquote fills the template in place.
+
+static int quote_form_is(Lval *x, char *name) {
+    return x->type == LVAL_SEXPR && x->sexpr.count == 2 &&
+           x->sexpr.cell[0]->type == LVAL_SYM && strcmp(x->sexpr.cell[0]->sym, name) == 0;
+}
+
+// eval hands back a copy for a symbol and leaves the symbol to us
+static Lval *quote_eval(Lenv *e, Lval *x) {
+    int is_sym = (x->type == LVAL_SYM);
+    Lval *result = eval(e, x);
+    if (is_sym) lval_free(x);
+    return result;
+}
+
+Lval *builtin_quote(Lenv *e, Lval *a) {
+    (void)e;
+    
+    if (a->sexpr.count != 2) {
+        lval_free(a);
+        return lval_err("Function 'quote' passed incorrect number of arguments!");
+    }
+    return lval_take(a, 1);
+}
+
+// Fills the template in *slot, in place, at quasiquote nesting depth and
+// returns whether anything in it was unquoted. Only unquotes at depth 1
+// are evaluated; one inside a nested quasiquote stays in the output, with
+// its own contents filled one level further out. A list is rebuilt only
+// when something was spliced into it: the first pass fills every element
+// in its slot and sums the final length, the second moves the pieces into
+// a cell array allocated once at that size. An error replaces the whole
+// template.
+static int quote_fill(Lenv *e, Lval **slot, int depth) {
+    Lval *t = *slot;
+    if (t->type != LVAL_SEXPR) return 0;
+    
+    if (depth == 1 && quote_form_is(t, "unquote")) {
+        *slot = quote_eval(e, lval_take(t, 1));
+        return 1;
+    }
+    if (depth == 1 && quote_form_is(t, "unquote-splicing")) {
+        lval_free(t);
+        *slot = lval_err("',@' must appear inside a list!");
+        return 1;
+    }
+    
+    // Nested forms stay; only the depth their datum is filled at changes
+    if (quote_form_is(t, "quasiquote")) {
+        depth++;
+    } else if (quote_form_is(t, "unquote") || quote_form_is(t, "unquote-splicing")) {
+        depth--;
+    }
+    
+    int n = t->sexpr.count;
+    char *spliced = NULL;
+    int total = 0;
+    int unquoted = 0;
+    
+    for (int i = 0; i < n; i++) {
+        Lval *c = t->sexpr.cell[i];
+        if (depth == 1 && quote_form_is(c, "unquote-splicing")) {
+            c = quote_eval(e, lval_take(c, 1));
+            if (c->type != LVAL_ERR && c->type != LVAL_SEXPR) {
+                lval_free(c);
+                c = lval_err("',@' must splice a list!");
+            }
+            if (spliced == NULL) spliced = calloc(n, 1);
+            spliced[i] = 1;
+            t->sexpr.cell[i] = c;
+        } else if (!quote_fill(e, &t->sexpr.cell[i], depth)) {
+            total++;
+            continue;
+        }
+        
+        unquoted = 1;
+        c = t->sexpr.cell[i];
+        if (c->type == LVAL_ERR) {
+            free(spliced);
+            *slot = lval_take(t, i);
+            return 1;
+        }
+        total += spliced && spliced[i] ? c->sexpr.count : 1;
+    }
+    
+    if (unquoted) lval_sexpr_own(t);
+    if (spliced == NULL) return unquoted;
+    
+    Lval **cells = malloc(sizeof(Lval*) * (total > 0 ? total : 1));
+    int k = 0;
+    for (int i = 0; i < n; i++) {
+        Lval *c = t->sexpr.cell[i];
+        if (spliced[i]) {
+            for (int j = 0; j < c->sexpr.count; j++) {
+                cells[k++] = c->sexpr.cell[j];
+            }
+            c->sexpr.count = 0;
+            lval_free(c);
+        } else {
+            cells[k++] = c;
+        }
+    }
+    
+    free(spliced);
+    free(t->sexpr.cell);
+    t->sexpr.cell = cells;
+    t->sexpr.count = total;
+    return 1;
+}
+
+Lval *builtin_quasiquote(Lenv *e, Lval *a) {
+    if (a->sexpr.count != 2) {
+        lval_free(a);
+        return lval_err("Function 'quasiquote' passed incorrect number of arguments!");
+    }
+    Lval *t = lval_take(a, 1);
+    quote_fill(e, &t, 1);
+    return t;
+}
+
+int quote_is_template(Lval *body) {
+    return quote_form_is(body, "quasiquote");
+}
+
+// A macro whose body is a quasiquote builds its expansion instead of
+// having its formals substituted: the template is filled with the
+// unevaluated arguments bound to the formals, and the code it produces is
+// then evaluated in the caller's environment.
+Lval *quote_expand_macro(Lenv *e, Lval *f, Lval *a) {
+    Lval *formals = f->macro.formals;
+    
+    Lenv *frame = lenv_push_frame(f->macro.env, a->sexpr.count);
+    if (frame) {
+        for (int i = 0; i < a->sexpr.count; i++) {
+            frame->syms[i] = formals->sexpr.cell[i]->sym;
+            frame->vals[i] = a->sexpr.cell[i];
+            a->sexpr.cell[i] = NULL;
+        }
+        frame->count = a->sexpr.count;
+    } else {
+        frame = lenv_child(f->macro.env);
+        for (int i = 0; i < a->sexpr.count; i++) {
+            lenv_put(frame, formals->sexpr.cell[i], a->sexpr.cell[i]);
+        }
+    }
+    lval_free(a);
+    
+    Lval *code = eval_owned(frame, lval_copy(f->macro.body));
+    
+    if (frame->on_stack) {
+        lenv_pop_frame(frame);
+    } else {
+        lenv_release(frame);
+    }
+    
+    if (code->type == LVAL_ERR) return code;
+    return quote_eval(e, code);
+}
@@ -0,0 +1,12 @@
+#ifndef QUOTE_H
+#define QUOTE_H
+
+#include "lval.h"
+#include "env.h"
+
+Lval *builtin_quote(Lenv *e, Lval *a);
+Lval *builtin_quasiquote(Lenv *e, Lval *a);
+int quote_is_template(Lval *body);
+Lval *quote_expand_macro(Lenv *e, Lval *f, Lval *a);
+
+#endif
@@ -0,0 +1,287 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "record.h"
+
+// (defstruct point x y) makes a record type and binds
+//   point, make-point   constructor taking one value per field
+//   point?              type predicate
+//   point-x, point-y    accessors
+//   set-point-x, ...    setters, returning the updated record
+//
+// A record is one allocation: a header and its slots, each an Lval stored
+// inline, so reading a field is a single indexed load. Copies of a record
+// share it by reference count, which makes copying O(1). A shared record
+// is never changed. A setter updates its argument in place when nothing
+// else holds it, and otherwise works on a copy.
+struct Lrtype {
+    int refs;
+    char *name;
+    long id;
+    int count;
+    char **fields;
+};
+
+struct Lrecord {
+    int refs;
+    Lrtype *type;
+    Lval slots[];
+};
+
+static long next_type_id = RECORD_TYPE_BASE;
+
+static Lrtype *lrtype_new(char *name, Lval *fields) {
+    Lrtype *t = malloc(sizeof(Lrtype));
+    t->refs = 1;
+    t->name = strdup(name);
+    t->id = __atomic_fetch_add(&next_type_id, 1, __ATOMIC_RELAXED);
+    t->count = fields->sexpr.count;
+    t->fields = malloc(sizeof(char*) * (t->count ? t->count : 1));
+    for (int i = 0; i < t->count; i++) {
+        t->fields[i] = strdup(fields->sexpr.cell[i]->sym);
+    }
+    return t;
+}
+
+Lrtype *lrtype_retain(Lrtype *t) {
+    if (t) __atomic_add_fetch(&t->refs, 1, __ATOMIC_RELAXED);
+    return t;
+}
+
+void lrtype_release(Lrtype *t) {
+    if (t == NULL || __atomic_sub_fetch(&t->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    
+    for (int i = 0; i < t->count; i++) {
+        free(t->fields[i]);
+    }
+    free(t->fields);
+    free(t->name);
+    free(t);
+}
+
+char *lrtype_name(Lrtype *t) {
+    return t->name;
+}
+
+long lrtype_id(Lrtype *t) {
+    return t->id;
+}
+
+static Lrecord *lrecord_new(Lrtype *t) {
+    Lrecord *r = malloc(sizeof(Lrecord) + sizeof(Lval) * t->count);
+    r->refs = 1;
+    r->type = lrtype_retain(t);
+    return r;
+}
+
+Lrecord *lrecord_retain(Lrecord *r) {
+    if (r) __atomic_add_fetch(&r->refs, 1, __ATOMIC_RELAXED);
+    return r;
+}
+
+void lrecord_release(Lrecord *r) {
+    if (r == NULL || __atomic_sub_fetch(&r->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    
+    for (int i = 0; i < r->type->count; i++) {
+        lval_clear(&r->slots[i]);
+    }
+    lrtype_release(r->type);
+    free(r);
+}
+
+Lrtype *lrecord_type(Lrecord *r) {
+    return r->type;
+}
+
+unsigned long lrecord_hash(Lrecord *r) {
+    unsigned long h = (unsigned long)r->type->id;
+    for (int i = 0; i < r->type->count; i++) {
+        h = h * 1099511628211UL ^ lval_hash(&r->slots[i]);
+    }
+    return h;
+}
+
+int lrecord_eq(Lrecord *x, Lrecord *y) {
+    if (x == y) return 1;
+    if (x->type != y->type) return 0;
+    for (int i = 0; i < x->type->count; i++) {
+        if (!lval_eq(&x->slots[i], &y->slots[i])) return 0;
+    }
+    return 1;
+}
+
+void lrecord_print(Lrecord *r, char *out, int size) {
+    int n = snprintf(out, size, "<%s", r->type->name);
+    for (int i = 0; i < r->type->count && n < size; i++) {
+        char *slot = lval_to_string(&r->slots[i]);
+        n += snprintf(out + n, size - n, " %s", slot);
+        free(slot);
+    }
+    if (n < size) snprintf(out + n, size - n, ">");
+}
+
+static Lval *lval_record(Lrecord *r) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_RECORD;
+    v->record = r;
+    return v;
+}
+
+static Lval *lval_recfn(Lrtype *t, int op, int slot) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_RECFN;
+    v->recfn.type = lrtype_retain(t);
+    v->recfn.op = op;
+    v->recfn.slot = slot;
+    return v;
+}
+
+// Moves the contents of a heap Lval into a slot
+static void slot_move(Lval *slot, Lval *v) {
+    *slot = *v;
+    free(v);
+}
+
+static void slot_copy(Lval *slot, Lval *v) {
+    slot_move(slot, lval_copy(v));
+}
+
+static Lval *record_err(Lval *f, Lval *a, char *what) {
+    Lrtype *t = f->recfn.type;
+    char name[96];
+    switch (f->recfn.op) {
+        case RECORD_MAKE: snprintf(name, sizeof(name), "%s", t->name); break;
+        case RECORD_TEST: snprintf(name, sizeof(name), "%s?", t->name); break;
+        case RECORD_GET: snprintf(name, sizeof(name), "%s-%s", t->name, t->fields[f->recfn.slot]); break;
+        default: snprintf(name, sizeof(name), "set-%s-%s", t->name, t->fields[f->recfn.slot]); break;
+    }
+    
+    char msg[160];
+    snprintf(msg, sizeof(msg), "Function '%s' passed %s!", name, what);
+    lval_free(a);
+    return lval_err(msg);
+}
+
+Lval *lrecord_call(Lval *f, Lval *a) {
+    Lrtype *t = f->recfn.type;
+    
+    if (f->recfn.op == RECORD_MAKE) {
+        if (a->sexpr.count != t->count) return record_err(f, a, "incorrect number of arguments");
+        
+        Lrecord *r = lrecord_new(t);
+        for (int i = 0; i < t->count; i++) {
+            slot_move(&r->slots[i], a->sexpr.cell[i]);
+        }
+        a->sexpr.count = 0;
+        lval_free(a);
+        return lval_record(r);
+    }
+    
+    int want = f->recfn.op == RECORD_SET ? 2 : 1;
+    if (a->sexpr.count != want) return record_err(f, a, "incorrect number of arguments");
+    
+    Lval *x = a->sexpr.cell[0];
+    int is_type = x->type == LVAL_RECORD && x->record->type == t;
+    if (f->recfn.op == RECORD_TEST) {
+        lval_free(a);
+        return lval_num(is_type);
+    }
+    if (!is_type) return record_err(f, a, "incorrect type");
+    
+    Lrecord *r = x->record;
+    int slot = f->recfn.slot;
+    if (f->recfn.op == RECORD_GET) {
+        Lval *v = lval_copy(&r->slots[slot]);
+        lval_free(a);
+        return v;
+    }
+    
+    // Nothing else can see an unshared record, so it is updated in place
+    Lval *v = lval_pop(a, 1);
+    x = lval_take(a, 0);
+    if (__atomic_load_n(&r->refs, __ATOMIC_ACQUIRE) > 1) {
+        Lrecord *c = lrecord_new(t);
+        for (int i = 0; i < t->count; i++) {
+            if (i != slot) slot_copy(&c->slots[i], &r->slots[i]);
+        }
+        lrecord_release(r);
+        x->record = c;
+    } else {
+        lval_clear(&r->slots[slot]);
+    }
+    slot_move(&x->record->slots[slot], v);
+    return x;
+}
+
+static void bind(Lenv *e, char *name, Lval *v) {
+    Lval *sym = lval_sym(name);
+    lenv_put(e, sym, v);
+    lval_free(sym);
+    lval_free(v);
+}
+
+static int same_fields(Lrtype *t, Lval *fields) {
+    if (t->count != fields->sexpr.count) return 0;
+    for (int i = 0; i < t->count; i++) {
+        if (strcmp(t->fields[i], fields->sexpr.cell[i]->sym) != 0) return 0;
+    }
+    return 1;
+}
+
+// (defstruct name field...) returns the new type. Repeating an identical
+// definition keeps the existing type, so records made before a reload
+// still satisfy its predicate.
+Lval *builtin_defstruct(Lenv *e, Lval *a) {
+    lval_free(lval_pop(a, 0));
+    
+    for (int i = 0; i < a->sexpr.count; i++) {
+        if (a->sexpr.cell[i]->type != LVAL_SYM) {
+            lval_free(a);
+            return lval_err("Function 'defstruct' passed incorrect type!");
+        }
+        for (int j = 1; j < i; j++) {
+            if (strcmp(a->sexpr.cell[i]->sym, a->sexpr.cell[j]->sym) == 0) {
+                lval_free(a);
+                return lval_err("Struct fields must be distinct!");
+            }
+        }
+    }
+    if (a->sexpr.count == 0) {
+        lval_free(a);
+        return lval_err("Function 'defstruct' passed incorrect number of arguments!");
+    }
+    
+    Lval *name = lval_pop(a, 0);
+    Lrtype *t = NULL;
+    Lval *old = lenv_get(e, name);
+    if (old->type == LVAL_RECFN && old->recfn.op == RECORD_MAKE &&
+        same_fields(old->recfn.type, a)) {
+        t = lrtype_retain(old->recfn.type);
+    }
+    lval_free(old);
+    if (t == NULL) t = lrtype_new(name->sym, a);
+    
+    size_t len = strlen(name->sym) + 64;
+    for (int i = 0; i < t->count; i++) len += strlen(t->fields[i]);
+    char *buf = malloc(len);
+    
+    bind(e, name->sym, lval_recfn(t, RECORD_MAKE, 0));
+    snprintf(buf, len, "make-%s", name->sym);
+    bind(e, buf, lval_recfn(t, RECORD_MAKE, 0));
+    snprintf(buf, len, "%s?", name->sym);
+    bind(e, buf, lval_recfn(t, RECORD_TEST, 0));
+    for (int i = 0; i < t->count; i++) {
+        snprintf(buf, len, "%s-%s", name->sym, t->fields[i]);
+        bind(e, buf, lval_recfn(t, RECORD_GET, i));
+        snprintf(buf, len, "set-%s-%s", name->sym, t->fields[i]);
+        bind(e, buf, lval_recfn(t, RECORD_SET, i));
+    }
+    
+    free(buf);
+    lval_free(name);
+    lval_free(a);
+    Lval *result = lval_recfn(t, RECORD_MAKE, 0);
+    lrtype_release(t);
+    return result;
+}
@@ -0,0 +1,28 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "lval.h"
+#include "env.h"
+
+// Record type ids start above every LvalType so generic dispatch can
+// mix them with the builtin types
+#define RECORD_TYPE_BASE 1024
+
+typedef enum { RECORD_MAKE, RECORD_TEST, RECORD_GET, RECORD_SET } RecordOp;
+
+Lrtype *lrtype_retain(Lrtype *t);
+void lrtype_release(Lrtype *t);
+char *lrtype_name(Lrtype *t);
+long lrtype_id(Lrtype *t);
+
+Lrecord *lrecord_retain(Lrecord *r);
+void lrecord_release(Lrecord *r);
+Lrtype *lrecord_type(Lrecord *r);
+unsigned long lrecord_hash(Lrecord *r);
+int lrecord_eq(Lrecord *x, Lrecord *y);
+void lrecord_print(Lrecord *r, char *out, int size);
+
+Lval *lrecord_call(Lval *f, Lval *a);
+Lval *builtin_defstruct(Lenv *e, Lval *a);
+
+#endif
@@ -0,0 +1,261 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reload.h"
+#include "eval.h"
+#include "memo.h"
+#include "parser.h"
+#include "repl.h"
+
+// Every file loaded with reload remembers the definitions it made. On the
+// next reload a definition is evaluated again only if its form changed
+// structurally, or it mentions a name that is being redefined; the rest
+// keep the values they already have. Other top-level forms are evaluated
+// every time, since they are run for their effect.
+typedef struct Ldef {
+    char *name;
+    unsigned long hash;
+    Lval *form;   // the whole (def name expr) as last evaluated
+} Ldef;
+
+struct Lsource {
+    char *path;
+    Ldef *defs;
+    int count;
+    struct Lsource *next;
+};
+
+static void ldefs_free(Ldef *defs, int count) {
+    for (int i = 0; i < count; i++) {
+        free(defs[i].name);
+        lval_free(defs[i].form);
+    }
+    free(defs);
+}
+
+void lsources_free(Lsource *s) {
+    while (s) {
+        Lsource *next = s->next;
+        free(s->path);
+        ldefs_free(s->defs, s->count);
+        free(s);
+        s = next;
+    }
+}
+
+static Lsource *lsource_find(Lenv *e, char *path) {
+    for (Lsource *s = e->sources; s; s = s->next) {
+        if (strcmp(s->path, path) == 0) return s;
+    }
+    Lsource *s = calloc(1, sizeof(Lsource));
+    s->path = strdup(path);
+    s->next = e->sources;
+    e->sources = s;
+    return s;
+}
+
+static Ldef *lsource_def(Lsource *s, char *name) {
+    // The last definition wins, as it does in the env
+    for (int i = s->count - 1; i >= 0; i--) {
+        if (strcmp(s->defs[i].name, name) == 0) return &s->defs[i];
+    }
+    return NULL;
+}
+
+// The name a top-level form defines, or NULL
+static char *def_name(Lval *form) {
+    if (form->type != LVAL_SEXPR || form->sexpr.count != 3) return NULL;
+    Lval *head = form->sexpr.cell[0];
+    Lval *name = form->sexpr.cell[1];
+    if (head->type != LVAL_SYM || name->type != LVAL_SYM) return NULL;
+    
+    if (strcmp(head->sym, "def") == 0 || strcmp(head->sym, "def-memo") == 0 ||
+        strcmp(head->sym, "defcell") == 0) {
+        return name->sym;
+    }
+    return NULL;
+}
+
+// Whether x mentions any symbol in names. Shadowing is ignored, which can
+// only cause an extra re-evaluation.
+static int mentions(Lval *x, Lval *names) {
+    if (x->type == LVAL_SYM) {
+        for (int i = 0; i < names->sexpr.count; i++) {
+            if (strcmp(names->sexpr.cell[i]->sym, x->sym) == 0) return 1;
+        }
+        return 0;
+    }
+    if (x->type == LVAL_SEXPR) {
+        for (int i = 0; i < x->sexpr.count; i++) {
+            if (mentions(x->sexpr.cell[i], names)) return 1;
+        }
+    }
+    return 0;
+}
+
+static int lists(Lval *names, char *name) {
+    for (int i = 0; i < names->sexpr.count; i++) {
+        if (strcmp(names->sexpr.cell[i]->sym, name) == 0) return 1;
+    }
+    return 0;
+}
+
+// Lambdas bound outside the file may call what was replaced. Their memo
+// tables hold results computed through the old definitions, and their
+// purity was judged against them, so both are redone; this repeats for
+// lambdas calling those in turn.
+static void refresh_callers(Lenv *e, Lval *replaced) {
+    int grew = 1;
+    while (grew) {
+        grew = 0;
+        for (int i = 0; i < e->count; i++) {
+            Lval *f = e->vals[i];
+            if (f->type != LVAL_LAMBDA || lists(replaced, e->syms[i])) continue;
+            if (!mentions(f->lambda.body, replaced)) continue;
+            
+            Lclosure *c = lval_closure_own(f);
+            c->pure = lambda_is_pure(f, e->syms[i]);
+            if (c->memo && c->pure) {
+                lmemo_clear(c->memo);
+            } else if (c->memo) {
+                lmemo_release(c->memo);
+                c->memo = NULL;
+            }
+            lval_add(replaced, lval_sym(e->syms[i]));
+            grew = 1;
+        }
+    }
+}
+
+static char *read_file(char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+    
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    char *buf = malloc(size + 1);
+    size_t n = fread(buf, 1, size, f);
+    buf[n] = '\0';
+    fclose(f);
+    return buf;
+}
+
+// (reload 'path) evaluates the file's top-level forms, skipping the
+// definitions that are unchanged since the last reload, and returns the
+// names it (re)defined
+Lval *builtin_reload(Lenv *e, Lval *a) {
+    if (a->sexpr.count != 1) {
+        lval_free(a);
+        return lval_err("Function 'reload' passed incorrect number of arguments!");
+    }
+    if (a->sexpr.cell[0]->type != LVAL_SYM) {
+        lval_free(a);
+        return lval_err("Function 'reload' passed incorrect type!");
+    }
+    
+    char *text = read_file(a->sexpr.cell[0]->sym);
+    if (text == NULL) {
+        lval_free(a);
+        return lval_err("Could not open file!");
+    }
+    AstNode *program = parse_program(text);
+    free(text);
+    if (program == NULL || program->type == AST_ERROR) {
+        Lval *err = lval_err(program ? program->error : "Parse error");
+        ast_free(program);
+        lval_free(a);
+        return err;
+    }
+    Lval *forms = ast_to_lval(program);
+    ast_free(program);
+    
+    while (e->parent) e = e->parent;
+    Lsource *src = lsource_find(e, a->sexpr.cell[0]->sym);
+    lval_free(a);
+    
+    // Changed and new definitions, then everything mentioning them
+    int n = forms->sexpr.count;
+    int *dirty = calloc(n, sizeof(int));
+    unsigned long *hashes = calloc(n, sizeof(unsigned long));
+    Lval *replaced = lval_sexpr();
+    for (int i = 0; i < n; i++) {
+        Lval *form = forms->sexpr.cell[i];
+        char *name = def_name(form);
+        if (name == NULL) {
+            dirty[i] = 1;
+            continue;
+        }
+        hashes[i] = lval_hash(form);
+        Ldef *old = lsource_def(src, name);
+        if (old == NULL || old->hash != hashes[i] || !lval_eq(old->form, form)) {
+            dirty[i] = 1;
+            lval_add(replaced, lval_sym(name));
+        }
+    }
+    
+    int grew = 1;
+    while (grew) {
+        grew = 0;
+        for (int i = 0; i < n; i++) {
+            char *name = def_name(forms->sexpr.cell[i]);
+            if (dirty[i] || !mentions(forms->sexpr.cell[i]->sexpr.cell[2], replaced)) continue;
+            dirty[i] = 1;
+            lval_add(replaced, lval_sym(name));
+            grew = 1;
+        }
+    }
+    
+    // Evaluate in file order, stopping at the first error
+    Lval *result = lval_sexpr();
+    int done = 0;
+    for (; done < n; done++) {
+        if (!dirty[done]) continue;
+        
+        Lval *v = eval_owned(e, lval_copy(forms->sexpr.cell[done]));
+        if (v->type == LVAL_ERR) {
+            lval_free(result);
+            result = v;
+            break;
+        }
+        lval_free(v);
+        
+        char *name = def_name(forms->sexpr.cell[done]);
+        if (name) lval_add(result, lval_sym(name));
+    }
+    
+    // Remember what each definition now stands for. Those not reached
+    // because of an error keep their old form, so they are retried.
+    Ldef *defs = malloc(sizeof(Ldef) * (n ? n : 1));
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        char *name = def_name(forms->sexpr.cell[i]);
+        if (name == NULL) continue;
+        
+        Lval *form = forms->sexpr.cell[i];
+        unsigned long hash = hashes[i];
+        if (dirty[i] && i >= done) {
+            Ldef *old = lsource_def(src, name);
+            if (old == NULL) continue;
+            form = old->form;
+            hash = old->hash;
+        }
+        defs[count].name = strdup(name);
+        defs[count].hash = hash;
+        defs[count].form = lval_copy(form);
+        count++;
+    }
+    ldefs_free(src->defs, src->count);
+    src->defs = defs;
+    src->count = count;
+    
+    refresh_callers(e, replaced);
+    
+    lval_free(replaced);
+    free(dirty);
+    free(hashes);
+    lval_free(forms);
+    return result;
+}
@@ -0,0 +1,10 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include "lval.h"
+#include "env.h"
+
+void lsources_free(Lsource *s);
+Lval *builtin_reload(Lenv *e, Lval *a);
+
+#endif
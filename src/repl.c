@@ -6,13 +6,19 @@
 #include "eval.h"
 #include "env.h"
 #include "lval.h"
+#include "bignum.h"
+#include "match.h"
 
-static Lval *ast_to_lval(AstNode *node) {
+Lval *ast_to_lval(AstNode *node) {
     if (node == NULL) return NULL;
     
     switch (node->type) {
         case AST_NUMBER:
             return lval_num(node->number);
+        case AST_BIGNUM:
+            return lval_bignum(node->digits);
+        case AST_FLOAT:
+            return lval_float(node->fnum);
         case AST_SYMBOL:
             return lval_sym(node->symbol);
         case AST_SEXPR: {
@@ -25,6 +31,11 @@ static Lval *ast_to_lval(AstNode *node) {
                 }
                 lval_add(lval, child);
             }
+            // Match forms compile their clauses once, on the first run
+            if (lval->sexpr.count > 0 && lval->sexpr.cell[0]->type == LVAL_SYM &&
+                strcmp(lval->sexpr.cell[0]->sym, "match") == 0) {
+                lval->sexpr.match = lmatch_new();
+            }
             return lval;
         }
         case AST_ERROR:
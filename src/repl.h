@@ -1,6 +1,10 @@
 #ifndef REPL_H
 #define REPL_H
 
+#include "parser.h"
+#include "lval.h"
+
+Lval *ast_to_lval(AstNode *node);
 char *read_input(char *input);
 void start_repl();
 
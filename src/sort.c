@@ -0,0 +1,248 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sort.h"
+#include "eval.h"
+#include "pool.h"
+#include "bignum.h"
+
+// sort and sort-by reorder a list's cell array in place: only pointers
+// move, never the elements. Keys are numbers, ordered as by < with NaNs
+// last (see lval_num_order), or symbols, ordered lexicographically after
+// every number. When every key
+// is a fixnum the pointers go through an LSD radix sort on the keys, a
+// byte per pass, skipping passes where all keys share the byte. Otherwise
+// a stable merge sort runs, and a large input with a worker pool is cut
+// into chunks that are sorted on the pool and then merged pairwise, each
+// round of merges on the pool too.
+#define SORT_RUN 16             // runs this short are insertion sorted
+#define SORT_PARALLEL_MIN 65536 // inputs this long go to the pool
+
+typedef struct {
+    Lval *key;
+    Lval *item;
+} SortItem;
+
+typedef struct {
+    unsigned long key;
+    Lval *item;
+} RadixItem;
+
+static int key_cmp(Lval *a, Lval *b) {
+    if (a->type == LVAL_NUM && b->type == LVAL_NUM) return (a->num > b->num) - (a->num < b->num);
+    if (lval_is_number(a) && lval_is_number(b)) return lval_num_order(a, b);
+    if (lval_is_number(a) || lval_is_number(b)) return lval_is_number(a) ? -1 : 1;
+    return strcmp(a->sym, b->sym);
+}
+
+static void insertion_sort(SortItem *x, int n) {
+    for (int i = 1; i < n; i++) {
+        SortItem v = x[i];
+        int j = i;
+        while (j > 0 && key_cmp(x[j - 1].key, v.key) > 0) {
+            x[j] = x[j - 1];
+            j--;
+        }
+        x[j] = v;
+    }
+}
+
+// Stable: ties take from a first
+static void merge(SortItem *a, int na, SortItem *b, int nb, SortItem *out) {
+    int i = 0;
+    int j = 0;
+    while (i < na && j < nb) {
+        *out++ = key_cmp(b[j].key, a[i].key) < 0 ? b[j++] : a[i++];
+    }
+    memcpy(out, a + i, sizeof(SortItem) * (na - i));
+    memcpy(out + na - i, b + j, sizeof(SortItem) * (nb - j));
+}
+
+static void merge_sort(SortItem *x, SortItem *tmp, int n) {
+    if (n <= SORT_RUN) {
+        insertion_sort(x, n);
+        return;
+    }
+    
+    int mid = n / 2;
+    merge_sort(x, tmp, mid);
+    merge_sort(x + mid, tmp + mid, n - mid);
+    if (key_cmp(x[mid - 1].key, x[mid].key) <= 0) return;
+    merge(x, mid, x + mid, n - mid, tmp);
+    memcpy(x, tmp, sizeof(SortItem) * n);
+}
+
+typedef struct {
+    SortItem *x;
+    SortItem *tmp;
+    int n;     // items in the first run, or the chunk to sort
+    int m;     // items in the second run, or -1 for a sort
+} SortJob;
+
+static void sort_job(void *arg) {
+    SortJob *job = arg;
+    if (job->m < 0) {
+        merge_sort(job->x, job->tmp, job->n);
+    } else {
+        merge(job->x, job->n, job->x + job->n, job->m, job->tmp);
+    }
+}
+
+// Sorts chunk by chunk on the pool, then merges runs of doubling width
+// back and forth between x and tmp until one run is left
+static void parallel_sort(SortItem *x, SortItem *tmp, int n) {
+    int chunks = 1;
+    while (chunks < pool_size() + 1) chunks *= 2;
+    int width = (n + chunks - 1) / chunks;
+    SortJob *jobs = malloc(sizeof(SortJob) * chunks);
+    
+    Lbatch *b = pool_batch_new();
+    int count = 0;
+    for (int i = 0; i < n; i += width) {
+        int len = n - i < width ? n - i : width;
+        jobs[count] = (SortJob){x + i, tmp + i, len, -1};
+        pool_submit_fn(b, sort_job, &jobs[count++]);
+    }
+    pool_wait(b);
+    
+    SortItem *src = x;
+    SortItem *dst = tmp;
+    for (; width < n; width *= 2) {
+        b = pool_batch_new();
+        count = 0;
+        for (int i = 0; i < n; i += 2 * width) {
+            int len = n - i < width ? n - i : width;
+            int rest = n - i - len < width ? n - i - len : width;
+            jobs[count] = (SortJob){src + i, dst + i, len, rest};
+            pool_submit_fn(b, sort_job, &jobs[count++]);
+        }
+        pool_wait(b);
+        SortItem *t = src;
+        src = dst;
+        dst = t;
+    }
+    
+    if (src != x) memcpy(x, src, sizeof(SortItem) * n);
+    free(jobs);
+}
+
+// Returns whichever of x and tmp ends up holding the sorted items
+static RadixItem *radix_sort(RadixItem *x, RadixItem *tmp, int n) {
+    for (int shift = 0; shift < (int)sizeof(unsigned long) * 8; shift += 8) {
+        int count[257] = {0};
+        for (int i = 0; i < n; i++) {
+            count[((x[i].key >> shift) & 255) + 1]++;
+        }
+        if (count[((x[0].key >> shift) & 255) + 1] == n) continue;
+        
+        for (int i = 1; i < 257; i++) {
+            count[i] += count[i - 1];
+        }
+        for (int i = 0; i < n; i++) {
+            tmp[count[(x[i].key >> shift) & 255]++] = x[i];
+        }
+        RadixItem *t = x;
+        x = tmp;
+        tmp = t;
+    }
+    return x;
+}
+
+static void sort_numbers(Lval **cell, Lval **keys, int n) {
+    RadixItem *x = malloc(sizeof(RadixItem) * n);
+    RadixItem *tmp = malloc(sizeof(RadixItem) * n);
+    for (int i = 0; i < n; i++) {
+        // Flipping the sign bit puts negative numbers first as unsigned
+        x[i].key = (unsigned long)keys[i]->num ^ (1UL << (sizeof(unsigned long) * 8 - 1));
+        x[i].item = cell[i];
+    }
+    
+    RadixItem *sorted = radix_sort(x, tmp, n);
+    for (int i = 0; i < n; i++) {
+        cell[i] = sorted[i].item;
+    }
+    free(x);
+    free(tmp);
+}
+
+static void sort_keys(Lval **cell, Lval **keys, int n) {
+    SortItem *x = malloc(sizeof(SortItem) * n);
+    SortItem *tmp = malloc(sizeof(SortItem) * n);
+    for (int i = 0; i < n; i++) {
+        x[i].key = keys[i];
+        x[i].item = cell[i];
+    }
+    
+    if (n >= SORT_PARALLEL_MIN && pool_size() > 0 && !pool_in_worker()) {
+        parallel_sort(x, tmp, n);
+    } else {
+        merge_sort(x, tmp, n);
+    }
+    for (int i = 0; i < n; i++) {
+        cell[i] = x[i].item;
+    }
+    free(x);
+    free(tmp);
+}
+
+static Lval *sort_err(Lval *a, char *name, char *what) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Function '%s' passed %s!", name, what);
+    lval_free(a);
+    return lval_err(msg);
+}
+
+static void free_keys(Lval **keys, int n) {
+    for (int i = 0; i < n; i++) {
+        lval_free(keys[i]);
+    }
+    free(keys);
+}
+
+// (sort xs) sorts by the elements themselves; (sort-by f xs) by (f x),
+// calling f once per element
+Lval *builtin_sort(Lenv *e, Lval *a, char *name) {
+    int by = strcmp(name, "sort-by") == 0;
+    if (a->sexpr.count != 1 + by) return sort_err(a, name, "incorrect number of arguments");
+    if (a->sexpr.cell[by]->type != LVAL_SEXPR || (by && !lval_is_fun(a->sexpr.cell[0]))) {
+        return sort_err(a, name, "incorrect type");
+    }
+    
+    Lval *xs = a->sexpr.cell[by];
+    int n = xs->sexpr.count;
+    Lval **keys = xs->sexpr.cell;
+    if (by) {
+        keys = malloc(sizeof(Lval*) * (n > 0 ? n : 1));
+        for (int i = 0; i < n; i++) {
+            Lval *args = lval_sexpr();
+            lval_add(args, lval_copy(xs->sexpr.cell[i]));
+            keys[i] = lval_call(e, a->sexpr.cell[0], args);
+            if (keys[i]->type == LVAL_ERR) {
+                Lval *err = keys[i];
+                free_keys(keys, i);
+                lval_free(a);
+                return err;
+            }
+        }
+    }
+    
+    int numbers = 1;
+    for (int i = 0; i < n; i++) {
+        if (!lval_is_number(keys[i]) && keys[i]->type != LVAL_SYM) {
+            if (by) free_keys(keys, n);
+            return sort_err(a, name, by ? "a key that is not a number or symbol" :
+                                          "an element that is not a number or symbol");
+        }
+        numbers = numbers && keys[i]->type == LVAL_NUM;
+    }
+    
+    lval_sexpr_own(xs);
+    if (n > 1 && numbers) {
+        sort_numbers(xs->sexpr.cell, keys, n);
+    } else if (n > 1) {
+        sort_keys(xs->sexpr.cell, keys, n);
+    }
+    if (by) free_keys(keys, n);
+    return lval_take(a, by);
+}
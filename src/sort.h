@@ -0,0 +1,9 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include "lval.h"
+#include "env.h"
+
+Lval *builtin_sort(Lenv *e, Lval *a, char *name);
+
+#endif
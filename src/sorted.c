@@ -0,0 +1,427 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sorted.h"
+#include "bignum.h"
+
+// A sorted map is a persistent B-tree keyed on numbers and symbols, with
+// numbers ordered as by < (NaNs last, see lval_num_order) and before every
+// symbol, and symbols ordered lexicographically. Each node keeps its keys
+// in a compact array of their own, a fixnum or a borrowed name per key, so
+// a lookup binary searches a few contiguous cache lines per level and only
+// reaches the entries themselves at the end, or for a float or bignum key. Entries are reference counted and shared between
+// versions. put copies the nodes on its path, unless nothing else holds
+// them, in which case they are updated in place; a full node splits
+// around its middle key on the way back up.
+#define SORTED_MAX 15
+
+typedef struct {
+    long num;
+    const char *sym;  // NULL for a number; the entry's own name otherwise
+    Lval *wide;       // the entry's own key when a float or bignum, else NULL
+} Lskey;
+
+typedef struct Lsentry {
+    int refs;
+    Lval key;
+    Lval val;
+} Lsentry;
+
+struct Lsnode {
+    int refs;
+    int count;
+    int leaf;
+    Lskey keys[SORTED_MAX + 1];  // one spare, filled just before a split
+    Lsentry *entries[SORTED_MAX + 1];
+    Lsnode *kids[SORTED_MAX + 2];
+};
+
+// Moves the contents of a heap Lval into an entry
+static void slot_move(Lval *slot, Lval *v) {
+    *slot = *v;
+    free(v);
+}
+
+static Lsentry *entry_new(Lval *key, Lval *val) {
+    Lsentry *x = malloc(sizeof(Lsentry));
+    x->refs = 1;
+    slot_move(&x->key, key);
+    slot_move(&x->val, val);
+    return x;
+}
+
+static Lsentry *entry_retain(Lsentry *x) {
+    __atomic_add_fetch(&x->refs, 1, __ATOMIC_RELAXED);
+    return x;
+}
+
+static void entry_release(Lsentry *x) {
+    if (__atomic_sub_fetch(&x->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    
+    lval_clear(&x->key);
+    lval_clear(&x->val);
+    free(x);
+}
+
+static Lskey key_of(Lval *k) {
+    Lskey key = {0, NULL, NULL};
+    if (k->type == LVAL_NUM) key.num = k->num;
+    else if (k->type == LVAL_SYM) key.sym = k->sym;
+    else key.wide = k;
+    return key;
+}
+
+static int key_cmp(Lskey a, Lskey b) {
+    if (a.sym == NULL && b.sym == NULL) {
+        if (a.wide == NULL && b.wide == NULL) return (a.num > b.num) - (a.num < b.num);
+        Lval x;
+        Lval y;
+        x.type = LVAL_NUM;
+        x.num = a.num;
+        y.type = LVAL_NUM;
+        y.num = b.num;
+        return lval_num_order(a.wide ? a.wide : &x, b.wide ? b.wide : &y);
+    }
+    if (a.sym == NULL || b.sym == NULL) return a.sym == NULL ? -1 : 1;
+    return strcmp(a.sym, b.sym);
+}
+
+static Lsnode *node_new(int leaf) {
+    Lsnode *n = malloc(sizeof(Lsnode));
+    n->refs = 1;
+    n->count = 0;
+    n->leaf = leaf;
+    return n;
+}
+
+Lsnode *lsnode_retain(Lsnode *n) {
+    if (n) __atomic_add_fetch(&n->refs, 1, __ATOMIC_RELAXED);
+    return n;
+}
+
+void lsnode_release(Lsnode *n) {
+    if (n == NULL || __atomic_sub_fetch(&n->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    
+    for (int i = 0; i < n->count; i++) {
+        entry_release(n->entries[i]);
+    }
+    if (!n->leaf) {
+        for (int i = 0; i <= n->count; i++) {
+            lsnode_release(n->kids[i]);
+        }
+    }
+    free(n);
+}
+
+// A node the caller may change: n itself when nothing else holds it,
+// otherwise a copy sharing its entries and subtrees
+static Lsnode *node_own(Lsnode *n) {
+    if (__atomic_load_n(&n->refs, __ATOMIC_ACQUIRE) == 1) return n;
+    
+    Lsnode *m = node_new(n->leaf);
+    m->count = n->count;
+    memcpy(m->keys, n->keys, sizeof(Lskey) * n->count);
+    for (int i = 0; i < n->count; i++) {
+        m->entries[i] = entry_retain(n->entries[i]);
+    }
+    if (!n->leaf) {
+        for (int i = 0; i <= n->count; i++) {
+            m->kids[i] = lsnode_retain(n->kids[i]);
+        }
+    }
+    lsnode_release(n);
+    return m;
+}
+
+// The first position whose key is not less than key
+static int lower_bound(Lsnode *n, Lskey key) {
+    int lo = 0;
+    int hi = n->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (key_cmp(n->keys[mid], key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void insert_at(Lsnode *n, int i, Lsentry *x, Lsnode *right) {
+    memmove(&n->keys[i + 1], &n->keys[i], sizeof(Lskey) * (n->count - i));
+    memmove(&n->entries[i + 1], &n->entries[i], sizeof(Lsentry*) * (n->count - i));
+    if (!n->leaf) {
+        memmove(&n->kids[i + 2], &n->kids[i + 1], sizeof(Lsnode*) * (n->count - i));
+        n->kids[i + 1] = right;
+    }
+    n->keys[i] = key_of(&x->key);
+    n->entries[i] = x;
+    n->count++;
+}
+
+// Takes the caller's reference to n and the entry, and returns the
+// updated node. A node that overflows keeps its lower half; the middle
+// entry goes to *up and the upper half to *right.
+static Lsnode *node_put(Lsnode *n, Lsentry *x, int *added, Lsentry **up, Lsnode **right) {
+    n = node_own(n);
+    Lskey key = key_of(&x->key);
+    int i = lower_bound(n, key);
+    
+    if (i < n->count && key_cmp(n->keys[i], key) == 0) {
+        entry_release(n->entries[i]);
+        n->keys[i] = key;
+        n->entries[i] = x;
+        return n;
+    }
+    
+    if (n->leaf) {
+        *added = 1;
+        insert_at(n, i, x, NULL);
+    } else {
+        Lsentry *kid_up = NULL;
+        Lsnode *kid_right = NULL;
+        n->kids[i] = node_put(n->kids[i], x, added, &kid_up, &kid_right);
+        if (kid_up == NULL) return n;
+        insert_at(n, i, kid_up, kid_right);
+    }
+    if (n->count <= SORTED_MAX) return n;
+    
+    int mid = n->count / 2;
+    Lsnode *r = node_new(n->leaf);
+    r->count = n->count - mid - 1;
+    memcpy(r->keys, &n->keys[mid + 1], sizeof(Lskey) * r->count);
+    memcpy(r->entries, &n->entries[mid + 1], sizeof(Lsentry*) * r->count);
+    if (!n->leaf) memcpy(r->kids, &n->kids[mid + 1], sizeof(Lsnode*) * (r->count + 1));
+    *up = n->entries[mid];
+    *right = r;
+    n->count = mid;
+    return n;
+}
+
+static Lsentry *node_find(Lsnode *n, Lskey key) {
+    while (n) {
+        int i = lower_bound(n, key);
+        if (i < n->count && key_cmp(n->keys[i], key) == 0) return n->entries[i];
+        n = n->leaf ? NULL : n->kids[i];
+    }
+    return NULL;
+}
+
+// Calls f on each entry with lo <= key < hi in order, where a NULL bound
+// is open, skipping subtrees that lie wholly outside
+static void node_walk(Lsnode *n, Lskey *lo, Lskey *hi, void (*f)(Lsentry *x, void *ctx), void *ctx) {
+    if (n == NULL) return;
+    
+    int i = lo ? lower_bound(n, *lo) : 0;
+    for (; i <= n->count; i++) {
+        if (!n->leaf) node_walk(n->kids[i], lo, hi, f, ctx);
+        if (i == n->count || (hi && key_cmp(n->keys[i], *hi) >= 0)) return;
+        f(n->entries[i], ctx);
+    }
+}
+
+static void add_pair(Lsentry *x, void *ctx) {
+    Lval *pair = lval_sexpr();
+    lval_add(pair, lval_copy(&x->key));
+    lval_add(pair, lval_copy(&x->val));
+    lval_add(ctx, pair);
+}
+
+static void add_key(Lsentry *x, void *ctx) {
+    lval_add(ctx, lval_copy(&x->key));
+}
+
+static void add_val(Lsentry *x, void *ctx) {
+    lval_add(ctx, lval_copy(&x->val));
+}
+
+static void hash_entry(Lsentry *x, void *ctx) {
+    unsigned long *h = ctx;
+    *h = *h * 1099511628211UL ^ lval_hash(&x->key);
+    *h = *h * 1099511628211UL ^ lval_hash(&x->val);
+}
+
+unsigned long lsorted_hash(Lval *m) {
+    unsigned long h = (unsigned long)m->sorted.count;
+    node_walk(m->sorted.root, NULL, NULL, hash_entry, &h);
+    return h;
+}
+
+// Both maps in order, as lists of pairs
+int lsorted_eq(Lval *x, Lval *y) {
+    if (x->sorted.root == y->sorted.root) return 1;
+    if (x->sorted.count != y->sorted.count) return 0;
+    
+    Lval *a = lval_sexpr();
+    Lval *b = lval_sexpr();
+    node_walk(x->sorted.root, NULL, NULL, add_pair, a);
+    node_walk(y->sorted.root, NULL, NULL, add_pair, b);
+    int same = lval_eq(a, b);
+    lval_free(a);
+    lval_free(b);
+    return same;
+}
+
+typedef struct {
+    char *out;
+    int size;
+    int n;
+} SortedPrint;
+
+static void print_entry(Lsentry *x, void *ctx) {
+    SortedPrint *p = ctx;
+    if (p->n >= p->size) return;
+    char *key = lval_to_string(&x->key);
+    char *val = lval_to_string(&x->val);
+    p->n += snprintf(p->out + p->n, p->size - p->n, p->n > 1 ? " %s %s" : "%s %s", key, val);
+    free(key);
+    free(val);
+}
+
+void lsorted_print(Lval *m, char *out, int size) {
+    SortedPrint p = {out, size, snprintf(out, size, "{")};
+    node_walk(m->sorted.root, NULL, NULL, print_entry, &p);
+    if (p.n < size) snprintf(out + p.n, size - p.n, "}");
+}
+
+static Lval *lval_sorted(Lsnode *root, int count) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_SORTED;
+    v->sorted.root = root;
+    v->sorted.count = count;
+    return v;
+}
+
+// Takes ownership of the key and value
+static void sorted_put(Lval *m, Lval *key, Lval *val) {
+    Lsentry *x = entry_new(key, val);
+    if (m->sorted.root == NULL) {
+        Lsnode *n = node_new(1);
+        insert_at(n, 0, x, NULL);
+        m->sorted.root = n;
+        m->sorted.count = 1;
+        return;
+    }
+    
+    int added = 0;
+    Lsentry *up = NULL;
+    Lsnode *right = NULL;
+    Lsnode *root = node_put(m->sorted.root, x, &added, &up, &right);
+    if (up) {
+        Lsnode *n = node_new(0);
+        n->kids[0] = root;
+        insert_at(n, 0, up, right);
+        root = n;
+    }
+    m->sorted.root = root;
+    m->sorted.count += added;
+}
+
+int sorted_handles(char *name, Lval *a) {
+    if (strcmp(name, "sorted-map") == 0 || strcmp(name, "put") == 0 || strcmp(name, "subrange") == 0 ||
+        strcmp(name, "first") == 0 || strcmp(name, "last") == 0) {
+        return 1;
+    }
+    if (strcmp(name, "get") == 0 || strcmp(name, "contains?") == 0 || strcmp(name, "keys") == 0 ||
+        strcmp(name, "vals") == 0 || strcmp(name, "len") == 0) {
+        return a->sexpr.count > 0 && a->sexpr.cell[0]->type == LVAL_SORTED;
+    }
+    return 0;
+}
+
+static Lval *sorted_err(Lval *a, char *name, char *what) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Function '%s' passed %s!", name, what);
+    lval_free(a);
+    return lval_err(msg);
+}
+
+static int is_key(Lval *x) {
+    return lval_is_number(x) || x->type == LVAL_SYM;
+}
+
+// The (key value) pair at one end of the map
+static Lval *end_pair(Lsnode *n, int last) {
+    while (!n->leaf) {
+        n = n->kids[last ? n->count : 0];
+    }
+    Lval *pair = lval_sexpr();
+    add_pair(n->entries[last ? n->count - 1 : 0], pair);
+    return lval_take(pair, 0);
+}
+
+Lval *builtin_sorted(Lval *a, char *name) {
+    // (sorted-map k v ...) and (put m k v ...) take keys and values in pairs
+    if (strcmp(name, "sorted-map") == 0 || strcmp(name, "put") == 0) {
+        int first = strcmp(name, "put") == 0;
+        if (a->sexpr.count < first || (a->sexpr.count - first) % 2 != 0) {
+            return sorted_err(a, name, "incorrect number of arguments");
+        }
+        if (first && a->sexpr.cell[0]->type != LVAL_SORTED) return sorted_err(a, name, "incorrect type");
+        for (int i = first; i < a->sexpr.count; i += 2) {
+            if (!is_key(a->sexpr.cell[i])) return sorted_err(a, name, "a key that is not a number or symbol");
+        }
+        
+        Lval *m = first ? lval_pop(a, 0) : lval_sorted(NULL, 0);
+        while (a->sexpr.count > 0) {
+            Lval *key = lval_pop(a, 0);
+            sorted_put(m, key, lval_pop(a, 0));
+        }
+        lval_free(a);
+        return m;
+    }
+    
+    if (a->sexpr.count < 1) return sorted_err(a, name, "incorrect number of arguments");
+    if (a->sexpr.cell[0]->type != LVAL_SORTED) return sorted_err(a, name, "incorrect type");
+    Lval *m = a->sexpr.cell[0];
+    
+    if (strcmp(name, "subrange") == 0) {
+        if (a->sexpr.count != 3) return sorted_err(a, name, "incorrect number of arguments");
+        if (!is_key(a->sexpr.cell[1]) || !is_key(a->sexpr.cell[2])) {
+            return sorted_err(a, name, "a bound that is not a number or symbol");
+        }
+        Lskey lo = key_of(a->sexpr.cell[1]);
+        Lskey hi = key_of(a->sexpr.cell[2]);
+        Lval *v = lval_sexpr();
+        node_walk(m->sorted.root, &lo, &hi, add_pair, v);
+        lval_free(a);
+        return v;
+    }
+    
+    if (a->sexpr.count == 1) {
+        Lval *v = NULL;
+        if (strcmp(name, "len") == 0) {
+            v = lval_num(m->sorted.count);
+        } else if (strcmp(name, "keys") == 0 || strcmp(name, "vals") == 0) {
+            v = lval_sexpr();
+            node_walk(m->sorted.root, NULL, NULL, strcmp(name, "keys") == 0 ? add_key : add_val, v);
+        } else if (strcmp(name, "first") == 0 || strcmp(name, "last") == 0) {
+            if (m->sorted.root == NULL) return sorted_err(a, name, "an empty map");
+            v = end_pair(m->sorted.root, strcmp(name, "last") == 0);
+        }
+        if (v) {
+            lval_free(a);
+            return v;
+        }
+    }
+    
+    // (get m k) fails on a missing key; (get m k default) returns the default
+    int want = strcmp(name, "get") == 0 ? 3 : 2;
+    if ((a->sexpr.count != 2 && a->sexpr.count != want) ||
+        (strcmp(name, "get") != 0 && strcmp(name, "contains?") != 0)) {
+        return sorted_err(a, name, "incorrect number of arguments");
+    }
+    Lval *key = a->sexpr.cell[1];
+    Lsentry *x = is_key(key) ? node_find(m->sorted.root, key_of(key)) : NULL;
+    
+    if (strcmp(name, "contains?") == 0) {
+        lval_free(a);
+        return lval_num(x != NULL);
+    }
+    if (x == NULL) {
+        if (a->sexpr.count == 3) return lval_take(a, 2);
+        return sorted_err(a, name, "a missing key");
+    }
+    Lval *v = lval_copy(&x->val);
+    lval_free(a);
+    return v;
+}
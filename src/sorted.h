@@ -0,0 +1,15 @@
+#ifndef SORTED_H
+#define SORTED_H
+
+#include "lval.h"
+
+Lsnode *lsnode_retain(Lsnode *n);
+void lsnode_release(Lsnode *n);
+unsigned long lsorted_hash(Lval *m);
+int lsorted_eq(Lval *x, Lval *y);
+void lsorted_print(Lval *m, char *out, int size);
+
+int sorted_handles(char *name, Lval *a);
+Lval *builtin_sorted(Lval *a, char *name);
+
+#endif
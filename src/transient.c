@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "transient.h"
+#include "map.h"
+
+// A transient is a mutable builder for a list or a map. It is a reference
+// type, so binding it or passing it around shares one builder rather than
+// copying what it holds, and push! and assoc! change it in place: a list
+// builder appends into an array that doubles as it fills, and a map
+// builder's trie updates the nodes only it holds without copying them.
+// persistent! hands the contents over as an ordinary list or map in O(1)
+// and retires the builder. A builder belongs to the thread that made it,
+// and every use checks both that and that it has not been retired.
+typedef enum { TRANSIENT_LIST, TRANSIENT_MAP } TransientKind;
+
+struct Ltransient {
+    int refs;
+    pthread_t owner;
+    TransientKind kind;
+    int done;        // persistent! has taken the contents
+    Lval **items;    // list builder
+    int count;
+    int cap;
+    Lval *map;       // map builder
+};
+
+Ltransient *ltransient_retain(Ltransient *t) {
+    if (t) __atomic_add_fetch(&t->refs, 1, __ATOMIC_RELAXED);
+    return t;
+}
+
+void ltransient_release(Ltransient *t) {
+    if (t == NULL || __atomic_sub_fetch(&t->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    
+    if (!t->done) {
+        for (int i = 0; i < t->count; i++) {
+            lval_free(t->items[i]);
+        }
+        lval_free(t->map);
+    }
+    free(t->items);
+    free(t);
+}
+
+void ltransient_print(Ltransient *t, char *out, int size) {
+    if (t->done) {
+        snprintf(out, size, "<transient>");
+    } else if (t->kind == TRANSIENT_LIST) {
+        snprintf(out, size, "<transient list %d>", t->count);
+    } else {
+        snprintf(out, size, "<transient map %d>", t->map->map.count);
+    }
+}
+
+static Lval *lval_transient(Ltransient *t) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_TRANSIENT;
+    v->transient = t;
+    return v;
+}
+
+static Lval *transient_err(Lval *a, char *name, char *what) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Function '%s' passed %s!", name, what);
+    lval_free(a);
+    return lval_err(msg);
+}
+
+// (transient xs) takes over the list's cell array or the map's trie
+static Lval *transient_new(Lval *a) {
+    if (a->sexpr.count != 1) return transient_err(a, "transient", "incorrect number of arguments");
+    
+    Lval *x = a->sexpr.cell[0];
+    if (x->type != LVAL_SEXPR && x->type != LVAL_MAP) return transient_err(a, "transient", "incorrect type");
+    x = lval_take(a, 0);
+    
+    Ltransient *t = calloc(1, sizeof(Ltransient));
+    t->refs = 1;
+    t->owner = pthread_self();
+    if (x->type == LVAL_MAP) {
+        t->kind = TRANSIENT_MAP;
+        t->map = x;
+    } else {
+        t->kind = TRANSIENT_LIST;
+        t->items = x->sexpr.cell;
+        t->count = x->sexpr.count;
+        t->cap = x->sexpr.count;
+        x->sexpr.cell = NULL;
+        x->sexpr.count = 0;
+        lval_free(x);
+    }
+    return lval_transient(t);
+}
+
+Lval *builtin_transient(Lval *a, char *name) {
+    if (strcmp(name, "transient") == 0) return transient_new(a);
+    
+    if (a->sexpr.count < 1) return transient_err(a, name, "incorrect number of arguments");
+    if (a->sexpr.cell[0]->type != LVAL_TRANSIENT) return transient_err(a, name, "incorrect type");
+    
+    Ltransient *t = a->sexpr.cell[0]->transient;
+    if (!pthread_equal(t->owner, pthread_self())) {
+        return transient_err(a, name, "a transient owned by another thread");
+    }
+    if (t->done) return transient_err(a, name, "a transient already made persistent");
+    
+    if (strcmp(name, "persistent!") == 0) {
+        if (a->sexpr.count != 1) return transient_err(a, name, "incorrect number of arguments");
+        t->done = 1;
+        Lval *v = t->map;
+        if (t->kind == TRANSIENT_LIST) {
+            v = lval_sexpr();
+            v->sexpr.cell = t->items;
+            v->sexpr.count = t->count;
+            t->items = NULL;
+        }
+        lval_free(a);
+        return v;
+    }
+    
+    // (push! t x ...) appends to a list; (assoc! t k v ...) puts into a map
+    int is_push = strcmp(name, "push!") == 0;
+    if (t->kind != (is_push ? TRANSIENT_LIST : TRANSIENT_MAP)) return transient_err(a, name, "incorrect type");
+    if (!is_push && a->sexpr.count % 2 == 0) return transient_err(a, name, "incorrect number of arguments");
+    
+    // A builder holding itself could never be freed
+    for (int i = 1; i < a->sexpr.count; i++) {
+        Lval *x = a->sexpr.cell[i];
+        if (x->type == LVAL_TRANSIENT && x->transient == t) return transient_err(a, name, "the transient itself");
+    }
+    
+    Lval *v = lval_pop(a, 0);
+    while (a->sexpr.count > 0) {
+        if (!is_push) {
+            Lval *key = lval_pop(a, 0);
+            lmap_put(t->map, key, lval_pop(a, 0));
+            continue;
+        }
+        if (t->count == t->cap) {
+            t->cap = t->cap ? t->cap * 2 : 8;
+            t->items = realloc(t->items, sizeof(Lval*) * t->cap);
+        }
+        t->items[t->count++] = lval_pop(a, 0);
+    }
+    lval_free(a);
+    return v;
+}
@@ -0,0 +1,12 @@
+#ifndef TRANSIENT_H
+#define TRANSIENT_H
+
+#include "lval.h"
+
+Ltransient *ltransient_retain(Ltransient *t);
+void ltransient_release(Ltransient *t);
+void ltransient_print(Ltransient *t, char *out, int size);
+
+Lval *builtin_transient(Lval *a, char *name);
+
+#endif
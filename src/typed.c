@@ -0,0 +1,929 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include "typed.h"
+#include "eval.h"
+#include "bignum.h"
+#include "flonum.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define TYPED_X86 1
+#endif
+
+// f64vector and i64vector keep doubles or fixnums unboxed in one
+// contiguous buffer, shared by reference count and never changed once
+// built. The bulk builtins run on kernels picked once at startup from
+// what the CPU supports: AVX2, SSE2 or plain C. Floating-point sums and
+// dot products always accumulate in four interleaved lanes combined in a
+// fixed order, so every level gives bit-identical results; integer sums
+// and dot products are exact, promoting to bignums. vmap compiles a
+// lambda that is plain arithmetic on its argument into a short program
+// run over the array a block at a time on the same kernels, and calls
+// anything else element by element.
+#define TYPED_F64 0
+#define TYPED_I64 1
+#define TYPED_BLOCK 256 // elements per block when broadcasting or fusing
+#define VMAP_MAX 32     // most steps or constants in a fused vmap body
+
+struct Ltyped {
+    int refs;
+    int kind;
+    int count;
+    union {
+        double *f64;
+        long *i64;      // fixnums, 64 bits wide on every target with kernels
+    };
+};
+
+typedef struct {
+    void (*f64_op)(char op, const double *x, const double *y, double *out, int n);
+    double (*f64_sum)(const double *x, int n);
+    double (*f64_dot)(const double *x, const double *y, int n);
+    void (*f64_range)(const double *x, int n, double *lo, double *hi);
+    int (*i64_add)(const long *x, const long *y, long *out, int n);
+    __int128 (*i64_sum)(const long *x, int n);
+    void (*i64_range)(const long *x, int n, long *lo, long *hi);
+} Vkernels;
+
+// Plain C kernels, also finishing the tails of the vector ones
+
+static void f64_op_scalar(char op, const double *x, const double *y, double *out, int n) {
+    for (int i = 0; i < n; i++) {
+        out[i] = op == '+' ? x[i] + y[i] : op == '-' ? x[i] - y[i] :
+                 op == '*' ? x[i] * y[i] : x[i] / y[i];
+    }
+}
+
+static double lanes_total(double *acc) {
+    return (acc[0] + acc[2]) + (acc[1] + acc[3]);
+}
+
+static double f64_sum_scalar(const double *x, int n) {
+    double acc[4] = {0, 0, 0, 0};
+    for (int i = 0; i < n; i++) {
+        acc[i & 3] += x[i];
+    }
+    return lanes_total(acc);
+}
+
+static double f64_dot_scalar(const double *x, const double *y, int n) {
+    double acc[4] = {0, 0, 0, 0};
+    for (int i = 0; i < n; i++) {
+        acc[i & 3] += x[i] * y[i];
+    }
+    return lanes_total(acc);
+}
+
+static void f64_range_scalar(const double *x, int n, double *lo, double *hi) {
+    for (int i = 0; i < n; i++) {
+        *lo = x[i] < *lo ? x[i] : *lo;
+        *hi = x[i] > *hi ? x[i] : *hi;
+    }
+}
+
+// Returns nonzero when any sum overflowed
+static int i64_add_scalar(const long *x, const long *y, long *out, int n) {
+    int overflow = 0;
+    for (int i = 0; i < n; i++) {
+        overflow |= __builtin_add_overflow(x[i], y[i], &out[i]);
+    }
+    return overflow;
+}
+
+static __int128 i64_sum_scalar(const long *x, int n) {
+    __int128 acc = 0;
+    for (int i = 0; i < n; i++) {
+        acc += x[i];
+    }
+    return acc;
+}
+
+static void i64_range_scalar(const long *x, int n, long *lo, long *hi) {
+    for (int i = 0; i < n; i++) {
+        *lo = x[i] < *lo ? x[i] : *lo;
+        *hi = x[i] > *hi ? x[i] : *hi;
+    }
+}
+
+static const Vkernels scalar_kernels = {
+    f64_op_scalar, f64_sum_scalar, f64_dot_scalar, f64_range_scalar,
+    i64_add_scalar, i64_sum_scalar, i64_range_scalar
+};
+
+#ifdef TYPED_X86
+
+__attribute__((target("sse2")))
+static void f64_op_sse2(char op, const double *x, const double *y, double *out, int n) {
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d a = _mm_loadu_pd(x + i);
+        __m128d b = _mm_loadu_pd(y + i);
+        __m128d r = op == '+' ? _mm_add_pd(a, b) : op == '-' ? _mm_sub_pd(a, b) :
+                    op == '*' ? _mm_mul_pd(a, b) : _mm_div_pd(a, b);
+        _mm_storeu_pd(out + i, r);
+    }
+    f64_op_scalar(op, x + i, y + i, out + i, n - i);
+}
+
+// Lanes 0 and 1 live in lo, 2 and 3 in hi
+__attribute__((target("sse2")))
+static double f64_sum_sse2(const double *x, int n) {
+    __m128d lo = _mm_setzero_pd();
+    __m128d hi = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        lo = _mm_add_pd(lo, _mm_loadu_pd(x + i));
+        hi = _mm_add_pd(hi, _mm_loadu_pd(x + i + 2));
+    }
+    double acc[4];
+    _mm_storeu_pd(acc, lo);
+    _mm_storeu_pd(acc + 2, hi);
+    for (; i < n; i++) {
+        acc[i & 3] += x[i];
+    }
+    return lanes_total(acc);
+}
+
+__attribute__((target("sse2")))
+static double f64_dot_sse2(const double *x, const double *y, int n) {
+    __m128d lo = _mm_setzero_pd();
+    __m128d hi = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        lo = _mm_add_pd(lo, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+        hi = _mm_add_pd(hi, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+    }
+    double acc[4];
+    _mm_storeu_pd(acc, lo);
+    _mm_storeu_pd(acc + 2, hi);
+    for (; i < n; i++) {
+        acc[i & 3] += x[i] * y[i];
+    }
+    return lanes_total(acc);
+}
+
+__attribute__((target("sse2")))
+static void f64_range_sse2(const double *x, int n, double *lo, double *hi) {
+    __m128d vlo = _mm_set1_pd(*lo);
+    __m128d vhi = _mm_set1_pd(*hi);
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(x + i);
+        vlo = _mm_min_pd(v, vlo);
+        vhi = _mm_max_pd(v, vhi);
+    }
+    double l[2];
+    double h[2];
+    _mm_storeu_pd(l, vlo);
+    _mm_storeu_pd(h, vhi);
+    f64_range_scalar(l, 2, lo, hi);
+    f64_range_scalar(h, 2, lo, hi);
+    f64_range_scalar(x + i, n - i, lo, hi);
+}
+
+static const Vkernels sse2_kernels = {
+    f64_op_sse2, f64_sum_sse2, f64_dot_sse2, f64_range_sse2,
+    i64_add_scalar, i64_sum_scalar, i64_range_scalar
+};
+
+__attribute__((target("avx2")))
+static void f64_op_avx2(char op, const double *x, const double *y, double *out, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d a = _mm256_loadu_pd(x + i);
+        __m256d b = _mm256_loadu_pd(y + i);
+        __m256d r = op == '+' ? _mm256_add_pd(a, b) : op == '-' ? _mm256_sub_pd(a, b) :
+                    op == '*' ? _mm256_mul_pd(a, b) : _mm256_div_pd(a, b);
+        _mm256_storeu_pd(out + i, r);
+    }
+    f64_op_scalar(op, x + i, y + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static double f64_sum_avx2(const double *x, int n) {
+    __m256d v = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        v = _mm256_add_pd(v, _mm256_loadu_pd(x + i));
+    }
+    double acc[4];
+    _mm256_storeu_pd(acc, v);
+    for (; i < n; i++) {
+        acc[i & 3] += x[i];
+    }
+    return lanes_total(acc);
+}
+
+__attribute__((target("avx2")))
+static double f64_dot_avx2(const double *x, const double *y, int n) {
+    __m256d v = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        v = _mm256_add_pd(v, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+    }
+    double acc[4];
+    _mm256_storeu_pd(acc, v);
+    for (; i < n; i++) {
+        acc[i & 3] += x[i] * y[i];
+    }
+    return lanes_total(acc);
+}
+
+__attribute__((target("avx2")))
+static void f64_range_avx2(const double *x, int n, double *lo, double *hi) {
+    __m256d vlo = _mm256_set1_pd(*lo);
+    __m256d vhi = _mm256_set1_pd(*hi);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(x + i);
+        vlo = _mm256_min_pd(v, vlo);
+        vhi = _mm256_max_pd(v, vhi);
+    }
+    double l[4];
+    double h[4];
+    _mm256_storeu_pd(l, vlo);
+    _mm256_storeu_pd(h, vhi);
+    f64_range_scalar(l, 4, lo, hi);
+    f64_range_scalar(h, 4, lo, hi);
+    f64_range_scalar(x + i, n - i, lo, hi);
+}
+
+// A lane overflowed when both inputs differ in sign from the sum
+__attribute__((target("avx2")))
+static int i64_add_avx2(const long *x, const long *y, long *out, int n) {
+    __m256i overflow = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(x + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(y + i));
+        __m256i r = _mm256_add_epi64(a, b);
+        overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(a, r), _mm256_xor_si256(b, r)));
+        _mm256_storeu_si256((__m256i *)(out + i), r);
+    }
+    int lanes = _mm256_movemask_pd(_mm256_castsi256_pd(overflow));
+    return lanes | i64_add_scalar(x + i, y + i, out + i, n - i);
+}
+
+// Each element is split into its low 32 bits, its high 32 bits read as
+// unsigned and a borrow of 2^64 when negative; the three sums cannot
+// overflow a lane for any array length an int can count
+__attribute__((target("avx2")))
+static __int128 i64_sum_avx2(const long *x, int n) {
+    __m256i mask = _mm256_set1_epi64x(0xffffffffL);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i low = zero;
+    __m256i high = zero;
+    __m256i negative = zero;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+        low = _mm256_add_epi64(low, _mm256_and_si256(v, mask));
+        high = _mm256_add_epi64(high, _mm256_srli_epi64(v, 32));
+        negative = _mm256_add_epi64(negative, _mm256_cmpgt_epi64(zero, v));
+    }
+    
+    long l[4];
+    long h[4];
+    long g[4];
+    _mm256_storeu_si256((__m256i *)l, low);
+    _mm256_storeu_si256((__m256i *)h, high);
+    _mm256_storeu_si256((__m256i *)g, negative);
+    __int128 acc = i64_sum_scalar(x + i, n - i);
+    for (int k = 0; k < 4; k++) {
+        acc += ((__int128)h[k] << 32) + l[k] + (__int128)g[k] * ((__int128)1 << 64);
+    }
+    return acc;
+}
+
+__attribute__((target("avx2")))
+static void i64_range_avx2(const long *x, int n, long *lo, long *hi) {
+    __m256i vlo = _mm256_set1_epi64x(*lo);
+    __m256i vhi = _mm256_set1_epi64x(*hi);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+        vlo = _mm256_blendv_epi8(vlo, v, _mm256_cmpgt_epi64(vlo, v));
+        vhi = _mm256_blendv_epi8(vhi, v, _mm256_cmpgt_epi64(v, vhi));
+    }
+    long l[4];
+    long h[4];
+    _mm256_storeu_si256((__m256i *)l, vlo);
+    _mm256_storeu_si256((__m256i *)h, vhi);
+    i64_range_scalar(l, 4, lo, hi);
+    i64_range_scalar(h, 4, lo, hi);
+    i64_range_scalar(x + i, n - i, lo, hi);
+}
+
+static const Vkernels avx2_kernels = {
+    f64_op_avx2, f64_sum_avx2, f64_dot_avx2, f64_range_avx2,
+    i64_add_avx2, i64_sum_avx2, i64_range_avx2
+};
+
+#endif
+
+static pthread_once_t detect_once = PTHREAD_ONCE_INIT;
+static int detected_level = TYPED_SCALAR;
+static int current_level = TYPED_SCALAR;
+
+static void detect_level(void) {
+#ifdef TYPED_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        detected_level = TYPED_AVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        detected_level = TYPED_SSE2;
+    }
+#endif
+    current_level = detected_level;
+}
+
+// The best level this CPU supports
+int typed_simd_level(void) {
+    pthread_once(&detect_once, detect_level);
+    return detected_level;
+}
+
+// Caps the kernels in use at level, for comparing levels against each other
+void typed_set_simd_level(int level) {
+    int best = typed_simd_level();
+    __atomic_store_n(&current_level, level < best ? level : best, __ATOMIC_RELAXED);
+}
+
+static const Vkernels *kernels(void) {
+    pthread_once(&detect_once, detect_level);
+#ifdef TYPED_X86
+    switch (__atomic_load_n(&current_level, __ATOMIC_RELAXED)) {
+        case TYPED_AVX2: return &avx2_kernels;
+        case TYPED_SSE2: return &sse2_kernels;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+// The level of the kernels in use, which typed_set_simd_level may cap
+int typed_kernel_level(void) {
+    pthread_once(&detect_once, detect_level);
+    return __atomic_load_n(&current_level, __ATOMIC_RELAXED);
+}
+
+// out = x op y over n doubles on the kernels in use; with no y, c stands
+// in for every element of it
+void typed_f64_op(char op, const double *x, const double *y, double c, double *out, int n) {
+    if (y != NULL) {
+        kernels()->f64_op(op, x, y, out, n);
+        return;
+    }
+    
+    double block[TYPED_BLOCK];
+    for (int k = 0; k < TYPED_BLOCK; k++) {
+        block[k] = c;
+    }
+    for (int off = 0; off < n; off += TYPED_BLOCK) {
+        int len = n - off < TYPED_BLOCK ? n - off : TYPED_BLOCK;
+        kernels()->f64_op(op, x + off, block, out + off, len);
+    }
+}
+
+static Ltyped *ltyped_new(int kind, int count) {
+    Ltyped *t = malloc(sizeof(Ltyped));
+    t->refs = 1;
+    t->kind = kind;
+    t->count = count;
+    
+    void *data = NULL;
+    if (posix_memalign(&data, 32, sizeof(double) * (count > 0 ? count : 1)) != 0) data = NULL;
+    t->f64 = data;
+    return t;
+}
+
+Ltyped *ltyped_retain(Ltyped *t) {
+    __atomic_add_fetch(&t->refs, 1, __ATOMIC_RELAXED);
+    return t;
+}
+
+void ltyped_release(Ltyped *t) {
+    if (__atomic_sub_fetch(&t->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    free(t->f64);
+    free(t);
+}
+
+unsigned long ltyped_hash(Ltyped *t) {
+    unsigned long h = (unsigned long)t->count * 2 + t->kind;
+    for (int i = 0; i < t->count; i++) {
+        unsigned long x = t->kind == TYPED_F64 ? lfloat_hash(t->f64[i]) : (unsigned long)t->i64[i];
+        h = h * 1099511628211UL ^ x;
+    }
+    return h;
+}
+
+int ltyped_eq(Ltyped *x, Ltyped *y) {
+    if (x->kind != y->kind || x->count != y->count) return 0;
+    for (int i = 0; i < x->count; i++) {
+        if (x->kind == TYPED_F64 ? x->f64[i] != y->f64[i] : x->i64[i] != y->i64[i]) return 0;
+    }
+    return 1;
+}
+
+void ltyped_print(Ltyped *t, char *out, int size) {
+    int n = snprintf(out, size, t->kind == TYPED_F64 ? "#f64(" : "#i64(");
+    for (int i = 0; i < t->count && n < size; i++) {
+        char item[32];
+        if (t->kind == TYPED_F64) {
+            lfloat_print(t->f64[i], item, sizeof(item));
+        } else {
+            snprintf(item, sizeof(item), "%ld", t->i64[i]);
+        }
+        n += snprintf(out + n, size - n, i ? " %s" : "%s", item);
+    }
+    if (n < size) snprintf(out + n, size - n, ")");
+}
+
+static Lval *lval_typed(Ltyped *t) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_TYPED;
+    v->typed = t;
+    return v;
+}
+
+static Lval *lval_i128(__int128 x) {
+    if (x >= LONG_MIN && x <= LONG_MAX) return lval_num((long)x);
+    
+    char digits[48];
+    int i = sizeof(digits) - 1;
+    digits[i] = '\0';
+    unsigned __int128 m = x < 0 ? -(unsigned __int128)x : (unsigned __int128)x;
+    while (m > 0) {
+        digits[--i] = '0' + (int)(m % 10);
+        m /= 10;
+    }
+    if (x < 0) digits[--i] = '-';
+    return lval_bignum(digits + i);
+}
+
+// A new f64 array of count elements for the caller to fill through data
+Lval *typed_f64_new(int count, double **data) {
+    Ltyped *t = ltyped_new(TYPED_F64, count);
+    *data = t->f64;
+    return lval_typed(t);
+}
+
+// The elements of an f64 array, or NULL for anything else
+double *typed_f64_data(Lval *v, int *count) {
+    if (v->type != LVAL_TYPED || v->typed->kind != TYPED_F64) return NULL;
+    *count = v->typed->count;
+    return v->typed->f64;
+}
+
+static Lval *item_at(Ltyped *t, int i) {
+    return t->kind == TYPED_F64 ? lval_float(t->f64[i]) : lval_num(t->i64[i]);
+}
+
+int typed_handles(char *name, Lval *a) {
+    char *names[] = {"f64vector", "i64vector", "vadd", "vmul", "vdot", "vsum", "vmin", "vmax", "vmap"};
+    for (int i = 0; i < 9; i++) {
+        if (strcmp(name, names[i]) == 0) return 1;
+    }
+    if (strcmp(name, "nth") == 0 || strcmp(name, "len") == 0 || strcmp(name, "to-list") == 0) {
+        return a->sexpr.count > 0 && a->sexpr.cell[0]->type == LVAL_TYPED;
+    }
+    return 0;
+}
+
+static Lval *typed_err(Lval *a, char *name, char *what) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Function '%s' passed %s!", name, what);
+    lval_free(a);
+    return lval_err(msg);
+}
+
+// Reads a number as an element of the given kind
+static int element_arg(Lval *x, int kind, double *f, long *i) {
+    if (kind == TYPED_F64 && lval_is_number(x)) {
+        *f = lval_to_double(x);
+        return 1;
+    }
+    if (kind == TYPED_I64 && x->type == LVAL_NUM) {
+        *i = x->num;
+        return 1;
+    }
+    return 0;
+}
+
+// (f64vector x ...) or (i64vector x ...), from numbers or from one list
+static Lval *typed_build(Lval *a, char *name) {
+    int kind = name[0] == 'f' ? TYPED_F64 : TYPED_I64;
+    Lval **items = a->sexpr.cell;
+    int n = a->sexpr.count;
+    if (n == 1 && items[0]->type == LVAL_SEXPR) {
+        n = items[0]->sexpr.count;
+        items = items[0]->sexpr.cell;
+    }
+    
+    Ltyped *t = ltyped_new(kind, n);
+    for (int i = 0; i < n; i++) {
+        if (!element_arg(items[i], kind, &t->f64[i], &t->i64[i])) {
+            ltyped_release(t);
+            return typed_err(a, name, kind == TYPED_F64 ? "a value that is not a number" :
+                                                          "a value that is not a fixnum");
+        }
+    }
+    lval_free(a);
+    return lval_typed(t);
+}
+
+static int i64_step(char op, const long *x, const long *y, long *out, int n);
+
+// (vadd x y) and (vmul x y) over two arrays of one kind and length, or
+// an array and a number applied to every element
+static Lval *typed_elementwise(Lval *a, char *name) {
+    char op = strcmp(name, "vadd") == 0 ? '+' : '*';
+    Lval *x = a->sexpr.cell[0];
+    Lval *y = a->sexpr.cell[1];
+    Ltyped *t = x->type == LVAL_TYPED ? x->typed : y->type == LVAL_TYPED ? y->typed : NULL;
+    if (t == NULL) return typed_err(a, name, "incorrect type");
+    if (x->type == LVAL_TYPED && y->type == LVAL_TYPED &&
+        (x->typed->kind != y->typed->kind || x->typed->count != y->typed->count)) {
+        return typed_err(a, name, "vectors of different kinds or lengths");
+    }
+    
+    // A number operand is broadcast through one constant block
+    double fconst[TYPED_BLOCK];
+    long iconst[TYPED_BLOCK];
+    Lval *scalar = x->type == LVAL_TYPED ? y : x;
+    if (scalar->type != LVAL_TYPED) {
+        double f = 0;
+        long i = 0;
+        if (!element_arg(scalar, t->kind, &f, &i)) return typed_err(a, name, "incorrect type");
+        for (int k = 0; k < TYPED_BLOCK; k++) {
+            fconst[k] = f;
+            iconst[k] = i;
+        }
+    }
+    
+    Ltyped *r = ltyped_new(t->kind, t->count);
+    const Vkernels *kern = kernels();
+    int whole = scalar->type == LVAL_TYPED;
+    for (int off = 0; off < t->count; off += TYPED_BLOCK) {
+        int len = t->count - off < TYPED_BLOCK ? t->count - off : TYPED_BLOCK;
+        if (t->kind == TYPED_F64) {
+            const double *p = x->type == LVAL_TYPED ? x->typed->f64 + off : fconst;
+            const double *q = y->type == LVAL_TYPED ? y->typed->f64 + off : fconst;
+            kern->f64_op(op, p, q, r->f64 + off, whole ? t->count : len);
+        } else {
+            const long *p = x->type == LVAL_TYPED ? x->typed->i64 + off : iconst;
+            const long *q = y->type == LVAL_TYPED ? y->typed->i64 + off : iconst;
+            if (!i64_step(op, p, q, r->i64 + off, whole ? t->count : len)) {
+                ltyped_release(r);
+                return typed_err(a, name, "values whose result overflows an i64");
+            }
+        }
+        if (whole) break;
+    }
+    
+    lval_free(a);
+    return lval_typed(r);
+}
+
+static Lval *typed_dot(Lval *a, char *name) {
+    Lval *x = a->sexpr.cell[0];
+    Lval *y = a->sexpr.cell[1];
+    if (x->type != LVAL_TYPED || y->type != LVAL_TYPED) return typed_err(a, name, "incorrect type");
+    if (x->typed->kind != y->typed->kind || x->typed->count != y->typed->count) {
+        return typed_err(a, name, "vectors of different kinds or lengths");
+    }
+    
+    Lval *result;
+    int n = x->typed->count;
+    if (x->typed->kind == TYPED_F64) {
+        result = lval_float(kernels()->f64_dot(x->typed->f64, y->typed->f64, n));
+    } else {
+        // Each product fits; only the running sum can leave 128 bits
+        __int128 acc = 0;
+        for (int i = 0; i < n; i++) {
+            if (__builtin_add_overflow(acc, (__int128)x->typed->i64[i] * y->typed->i64[i], &acc)) {
+                return typed_err(a, name, "vectors whose dot product overflows");
+            }
+        }
+        result = lval_i128(acc);
+    }
+    lval_free(a);
+    return result;
+}
+
+// A fused vmap body: steps over the argument, constants and earlier
+// steps. A slot is 0 for the argument, k > 0 for step k - 1 and k < 0
+// for constant -k - 1.
+typedef struct {
+    char op;    // + - * / %, or n to negate
+    int x;
+    int y;
+} Vstep;
+
+typedef struct {
+    char *formal;
+    Lenv *env;
+    int kind;
+    int nsteps;
+    Vstep steps[VMAP_MAX];
+    int nconsts;
+    double fconsts[VMAP_MAX];
+    long iconsts[VMAP_MAX];
+    int exact_zero[VMAP_MAX];
+} Vprog;
+
+#define VMAP_FAIL INT_MIN
+
+static int mentions(Lval *x, char *formal) {
+    if (x->type == LVAL_SYM) return strcmp(x->sym, formal) == 0;
+    if (x->type != LVAL_SEXPR) return 0;
+    for (int i = 0; i < x->sexpr.count; i++) {
+        if (mentions(x->sexpr.cell[i], formal)) return 1;
+    }
+    return 0;
+}
+
+// Whether x is plain arithmetic: numbers, symbols bound to numbers or
+// to the formal, and the arithmetic builtins under their own names
+static int plain_arith(Vprog *p, Lval *x) {
+    if (x->type == LVAL_NUM || x->type == LVAL_FLOAT || x->type == LVAL_BIGNUM) return 1;
+    if (x->type == LVAL_SYM) {
+        if (strcmp(x->sym, p->formal) == 0) return 1;
+        Lval *v = lenv_get(p->env, x);
+        int number = lval_is_number(v);
+        lval_free(v);
+        return number;
+    }
+    if (x->type != LVAL_SEXPR || x->sexpr.count < 2 || x->sexpr.cell[0]->type != LVAL_SYM) return 0;
+    
+    char *op = x->sexpr.cell[0]->sym;
+    if (strlen(op) != 1 || strchr("+-*/%", op[0]) == NULL) return 0;
+    Lval *f = lenv_get(p->env, x->sexpr.cell[0]);
+    int builtin = f->type == LVAL_FUN && strcmp(f->fun, op) == 0;
+    lval_free(f);
+    if (!builtin) return 0;
+    
+    for (int i = 1; i < x->sexpr.count; i++) {
+        if (!plain_arith(p, x->sexpr.cell[i])) return 0;
+    }
+    return 1;
+}
+
+// Evaluates an expression without the formal once, the way a call would
+static int add_const(Vprog *p, Lval *x) {
+    Lval *v = eval_owned(p->env, lval_copy(x));
+    double f = 0;
+    long i = 0;
+    int ok = element_arg(v, p->kind, &f, &i) && p->nconsts < VMAP_MAX;
+    int zero = v->type == LVAL_NUM && v->num == 0;
+    lval_free(v);
+    if (!ok) return VMAP_FAIL;
+    
+    p->fconsts[p->nconsts] = f;
+    p->iconsts[p->nconsts] = i;
+    p->exact_zero[p->nconsts] = zero;
+    return -++p->nconsts;
+}
+
+static int add_step(Vprog *p, char op, int x, int y) {
+    if (x == VMAP_FAIL || y == VMAP_FAIL || p->nsteps == VMAP_MAX) return VMAP_FAIL;
+    p->steps[p->nsteps] = (Vstep){op, x, y};
+    return ++p->nsteps;
+}
+
+// Compiles x into p and returns its slot. Operands fold left to right
+// as builtin_op does; the constants before the first use of the formal
+// fold together first, so integer division among them stays exact.
+static int vmap_compile(Vprog *p, Lval *x) {
+    if (!mentions(x, p->formal)) return add_const(p, x);
+    if (x->type == LVAL_SYM) return 0;
+    
+    char op = x->sexpr.cell[0]->sym[0];
+    int count = x->sexpr.count;
+    if (count == 2) {
+        int slot = vmap_compile(p, x->sexpr.cell[1]);
+        return op == '-' ? add_step(p, 'n', slot, slot) : slot;
+    }
+    
+    int first = 1;
+    while (!mentions(x->sexpr.cell[first], p->formal)) first++;
+    
+    int acc;
+    if (first == 1) {
+        acc = vmap_compile(p, x->sexpr.cell[1]);
+    } else {
+        int prefix;
+        if (first == 2) {
+            prefix = add_const(p, x->sexpr.cell[1]);
+        } else {
+            Lval *head = lval_sexpr();
+            for (int i = 0; i < first; i++) {
+                lval_add(head, lval_copy(x->sexpr.cell[i]));
+            }
+            prefix = add_const(p, head);
+            lval_free(head);
+        }
+        acc = add_step(p, op, prefix, vmap_compile(p, x->sexpr.cell[first]));
+    }
+    
+    for (int i = first + 1; i < count; i++) {
+        // An exact zero divisor is an error in a call, not an infinity
+        int slot = vmap_compile(p, x->sexpr.cell[i]);
+        if ((op == '/' || op == '%') && slot < 0 && slot != VMAP_FAIL && p->exact_zero[-slot - 1]) {
+            return VMAP_FAIL;
+        }
+        acc = add_step(p, op, acc, slot);
+    }
+    return acc;
+}
+
+// Returns 0 on overflow or a zero divisor
+static int i64_step(char op, const long *x, const long *y, long *out, int n) {
+    if (op == '+') return !kernels()->i64_add(x, y, out, n);
+    
+    for (int i = 0; i < n; i++) {
+        if (op == 'n') {
+            if (x[i] == LONG_MIN) return 0;
+            out[i] = -x[i];
+            continue;
+        }
+        if ((op == '/' || op == '%') && y[i] == 0) return 0;
+        char name[2] = {op, '\0'};
+        if (!lnum_op(name, x[i], y[i], &out[i])) return 0;
+    }
+    return 1;
+}
+
+static void f64_step(char op, const double *x, const double *y, double *out, int n) {
+    if (op == 'n') {
+        for (int i = 0; i < n; i++) {
+            out[i] = -x[i];
+        }
+    } else if (op == '%') {
+        for (int i = 0; i < n; i++) {
+            out[i] = fmod(x[i], y[i]);
+        }
+    } else {
+        kernels()->f64_op(op, x, y, out, n);
+    }
+}
+
+// Runs the program over src into dst a block at a time, the last step
+// writing straight into dst. Returns 0 when an i64 step fails.
+static int vmap_run(Vprog *p, int result, Ltyped *src, Ltyped *dst) {
+    int width = sizeof(double) * TYPED_BLOCK;
+    char *consts = malloc(width * (p->nconsts + 1));
+    char *regs = malloc(width * (p->nsteps + 1));
+    for (int c = 0; c < p->nconsts; c++) {
+        for (int k = 0; k < TYPED_BLOCK; k++) {
+            if (p->kind == TYPED_F64) {
+                ((double *)(consts + c * width))[k] = p->fconsts[c];
+            } else {
+                ((long *)(consts + c * width))[k] = p->iconsts[c];
+            }
+        }
+    }
+    
+    int ok = 1;
+    for (int off = 0; ok && off < src->count; off += TYPED_BLOCK) {
+        int len = src->count - off < TYPED_BLOCK ? src->count - off : TYPED_BLOCK;
+        char *in = (char *)src->f64 + off * sizeof(double);
+        char *out = (char *)dst->f64 + off * sizeof(double);
+        
+        for (int s = 0; ok && s < p->nsteps; s++) {
+            void *operand[2];
+            int slots[2] = {p->steps[s].x, p->steps[s].y};
+            for (int k = 0; k < 2; k++) {
+                operand[k] = slots[k] == 0 ? in : slots[k] > 0 ? regs + (slots[k] - 1) * width :
+                             consts + (-slots[k] - 1) * width;
+            }
+            void *target = s + 1 == result ? out : regs + s * width;
+            if (p->kind == TYPED_F64) {
+                f64_step(p->steps[s].op, operand[0], operand[1], target, len);
+            } else {
+                ok = i64_step(p->steps[s].op, operand[0], operand[1], target, len);
+            }
+        }
+        
+        if (result <= 0) {
+            memcpy(out, result == 0 ? in : consts + (-result - 1) * width, len * sizeof(double));
+        }
+    }
+    
+    free(consts);
+    free(regs);
+    return ok;
+}
+
+// Calls f on each element in turn
+static Lval *vmap_calls(Lenv *e, Lval *f, Ltyped *src, Ltyped *dst) {
+    for (int i = 0; i < src->count; i++) {
+        Lval *args = lval_sexpr();
+        lval_add(args, item_at(src, i));
+        Lval *r = lval_call(e, f, args);
+        if (r->type == LVAL_ERR) return r;
+        
+        int ok = element_arg(r, dst->kind, &dst->f64[i], &dst->i64[i]);
+        lval_free(r);
+        if (!ok) {
+            return lval_err(dst->kind == TYPED_F64 ? "Function 'vmap' passed a function that returned a non-number!" :
+                                                     "Function 'vmap' passed a function that returned a non-fixnum!");
+        }
+    }
+    return NULL;
+}
+
+// (vmap f v) gives the array of (f x) for each x in v, of v's kind
+static Lval *typed_vmap(Lenv *e, Lval *a, char *name) {
+    Lval *f = a->sexpr.cell[0];
+    Lval *v = a->sexpr.cell[1];
+    if (!lval_is_fun(f) || v->type != LVAL_TYPED) return typed_err(a, name, "incorrect type");
+    
+    Ltyped *src = v->typed;
+    Ltyped *dst = ltyped_new(src->kind, src->count);
+    int fused = 0;
+    char *formal = f->type == LVAL_LAMBDA && f->lambda.formals->sexpr.count == 1 ?
+                   f->lambda.formals->sexpr.cell[0]->sym : NULL;
+    if (formal && strcmp(formal, "&") != 0 && !(strlen(formal) == 1 && strchr("+-*/%", formal[0]))) {
+        Vprog *p = malloc(sizeof(Vprog));
+        p->formal = formal;
+        p->env = f->lambda.closure->env;
+        p->kind = src->kind;
+        p->nsteps = 0;
+        p->nconsts = 0;
+        if (plain_arith(p, f->lambda.body)) {
+            int result = vmap_compile(p, f->lambda.body);
+            fused = result != VMAP_FAIL && vmap_run(p, result, src, dst);
+        }
+        free(p);
+    }
+    
+    // Overflow past an i64 in a fused step may still come back in range
+    // through a bignum, so a failed run is redone call by call
+    if (!fused) {
+        Lval *err = vmap_calls(e, f, src, dst);
+        if (err) {
+            ltyped_release(dst);
+            lval_free(a);
+            return err;
+        }
+    }
+    lval_free(a);
+    return lval_typed(dst);
+}
+
+Lval *builtin_typed(Lenv *e, Lval *a, char *name) {
+    if (strcmp(name, "f64vector") == 0 || strcmp(name, "i64vector") == 0) return typed_build(a, name);
+    
+    int binary = strcmp(name, "vadd") == 0 || strcmp(name, "vmul") == 0 || strcmp(name, "vdot") == 0 ||
+                 strcmp(name, "vmap") == 0 || strcmp(name, "nth") == 0;
+    if (a->sexpr.count != 1 + binary) return typed_err(a, name, "incorrect number of arguments");
+    
+    if (strcmp(name, "vadd") == 0 || strcmp(name, "vmul") == 0) return typed_elementwise(a, name);
+    if (strcmp(name, "vdot") == 0) return typed_dot(a, name);
+    if (strcmp(name, "vmap") == 0) return typed_vmap(e, a, name);
+    
+    if (a->sexpr.cell[0]->type != LVAL_TYPED) return typed_err(a, name, "incorrect type");
+    Ltyped *t = a->sexpr.cell[0]->typed;
+    Lval *result;
+    
+    if (strcmp(name, "len") == 0) {
+        result = lval_num(t->count);
+    } else if (strcmp(name, "nth") == 0) {
+        Lval *i = a->sexpr.cell[1];
+        if (i->type != LVAL_NUM || i->num < 0 || i->num >= t->count) {
+            return typed_err(a, name, "an index out of range");
+        }
+        result = item_at(t, (int)i->num);
+    } else if (strcmp(name, "to-list") == 0) {
+        result = lval_sexpr();
+        for (int i = 0; i < t->count; i++) {
+            lval_add(result, item_at(t, i));
+        }
+    } else if (strcmp(name, "vsum") == 0) {
+        result = t->kind == TYPED_F64 ? lval_float(kernels()->f64_sum(t->f64, t->count)) :
+                                        lval_i128(kernels()->i64_sum(t->i64, t->count));
+    } else {
+        // vmin and vmax
+        if (t->count == 0) return typed_err(a, name, "an empty vector");
+        int max = strcmp(name, "vmax") == 0;
+        if (t->kind == TYPED_F64) {
+            double lo = t->f64[0];
+            double hi = t->f64[0];
+            kernels()->f64_range(t->f64, t->count, &lo, &hi);
+            result = lval_float(max ? hi : lo);
+        } else {
+            long lo = t->i64[0];
+            long hi = t->i64[0];
+            kernels()->i64_range(t->i64, t->count, &lo, &hi);
+            result = lval_num(max ? hi : lo);
+        }
+    }
+    
+    lval_free(a);
+    return result;
+}
@@ -0,0 +1,27 @@
+#ifndef TYPED_H
+#define TYPED_H
+
+#include "lval.h"
+#include "env.h"
+
+#define TYPED_SCALAR 0
+#define TYPED_SSE2 1
+#define TYPED_AVX2 2
+
+Ltyped *ltyped_retain(Ltyped *t);
+void ltyped_release(Ltyped *t);
+unsigned long ltyped_hash(Ltyped *t);
+int ltyped_eq(Ltyped *x, Ltyped *y);
+void ltyped_print(Ltyped *t, char *out, int size);
+
+int typed_simd_level(void);
+void typed_set_simd_level(int level);
+int typed_kernel_level(void);
+void typed_f64_op(char op, const double *x, const double *y, double c, double *out, int n);
+Lval *typed_f64_new(int count, double **data);
+double *typed_f64_data(Lval *v, int *count);
+
+int typed_handles(char *name, Lval *a);
+Lval *builtin_typed(Lenv *e, Lval *a, char *name);
+
+#endif
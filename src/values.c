@@ -0,0 +1,129 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "values.h"
+#include "eval.h"
+
+// (values a b ...) returns a as its ordinary result and parks the rest in
+// a fixed per-thread register area, so returning several results builds no
+// list. A single-value context just uses the first value; let-values
+// checks that the value it got back is the one the last values call
+// returned before reading the registers. Evaluated arguments and if
+// conditions drop the registers, so a values call whose result was
+// consumed cannot leak extra results into a later let-values, and so does
+// freeing the first value, so a new value that reuses its address is not
+// taken for it.
+static __thread Lval *value_regs[VALUES_MAX - 1];
+static __thread int value_extra = 0;
+static __thread Lval *value_first = NULL;
+
+void values_drop(void) {
+    for (int i = 0; i < value_extra; i++) {
+        lval_free(value_regs[i]);
+    }
+    value_extra = 0;
+    value_first = NULL;
+}
+
+// Called as v is freed: once the first value is gone, so are the rest
+void values_forget(Lval *v) {
+    if (v == value_first) values_drop();
+}
+
+int values_count(Lval *v) {
+    return (v == value_first) ? value_extra + 1 : 1;
+}
+
+Lval *builtin_values(Lval *a) {
+    if (a->sexpr.count == 0 || a->sexpr.count > VALUES_MAX) {
+        lval_free(a);
+        return lval_err("Function 'values' passed incorrect number of arguments!");
+    }
+    
+    values_drop();
+    for (int i = 1; i < a->sexpr.count; i++) {
+        value_regs[i - 1] = a->sexpr.cell[i];
+    }
+    value_extra = a->sexpr.count - 1;
+    a->sexpr.count = 1;
+    
+    value_first = lval_take(a, 0);
+    return value_first;
+}
+
+// (let-values ((a b ...) expr) body) binds every value expr returns
+Lval *builtin_let_values(Lenv *e, Lval *a) {
+    lval_free(lval_pop(a, 0));
+    
+    if (a->sexpr.count != 2) {
+        lval_free(a);
+        return lval_err("Function 'let-values' passed incorrect number of arguments!");
+    }
+    
+    Lval *binding = a->sexpr.cell[0];
+    if (binding->type != LVAL_SEXPR || binding->sexpr.count != 2 ||
+        binding->sexpr.cell[0]->type != LVAL_SEXPR) {
+        lval_free(a);
+        return lval_err("let-values binding must be ((names...) expr)!");
+    }
+    
+    Lval *formals = binding->sexpr.cell[0];
+    for (int i = 0; i < formals->sexpr.count; i++) {
+        if (formals->sexpr.cell[i]->type != LVAL_SYM) {
+            lval_free(a);
+            return lval_err("let-values names must be symbols!");
+        }
+    }
+    
+    values_drop();
+    Lval *first = eval_owned(e, lval_pop(binding, 1));
+    if (first->type == LVAL_ERR) {
+        values_drop();
+        lval_free(a);
+        return first;
+    }
+    
+    int n = values_count(first);
+    if (n != formals->sexpr.count) {
+        values_drop();
+        lval_free(first);
+        lval_free(a);
+        return lval_err("let-values got the wrong number of values!");
+    }
+    
+    // The registers are emptied before the body runs, since the body may
+    // call values itself
+    Lval *vals[VALUES_MAX];
+    vals[0] = first;
+    for (int i = 1; i < n; i++) {
+        vals[i] = value_regs[i - 1];
+    }
+    value_extra = 0;
+    value_first = NULL;
+    
+    Lenv *frame = lenv_push_frame(e, n);
+    if (frame) {
+        for (int i = 0; i < n; i++) {
+            frame->syms[i] = formals->sexpr.cell[i]->sym;
+            frame->vals[i] = vals[i];
+        }
+        frame->count = n;
+    } else {
+        frame = lenv_child(e);
+        for (int i = 0; i < n; i++) {
+            lenv_put(frame, formals->sexpr.cell[i], vals[i]);
+            lval_free(vals[i]);
+        }
+    }
+    
+    Lval *result = eval_owned(frame, lval_pop(a, 1));
+    
+    if (frame->on_stack) {
+        lenv_pop_frame(frame);
+    } else {
+        lenv_release(frame);
+    }
+    lval_free(a);
+    return result;
+}
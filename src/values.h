@@ -0,0 +1,15 @@
+#ifndef VALUES_H
+#define VALUES_H
+
+#include "lval.h"
+#include "env.h"
+
+#define VALUES_MAX 8
+
+Lval *builtin_values(Lval *a);
+Lval *builtin_let_values(Lenv *e, Lval *a);
+int values_count(Lval *v);
+void values_drop(void);
+void values_forget(Lval *v);
+
+#endif
@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vector.h"
+
+// A vector is a view onto a store: one contiguous, growable array of
+// Lvals held inline, shared by reference count. Copying a vector, slicing
+// it and taking its tail all make new views of the same store, so they
+// are O(1) and allocate nothing but the view. Vectors are mutable:
+// vector-set! writes through to the store and is seen by every view, and
+// vector-push! appends with amortized doubling. A whole vector always
+// spans to the end of its store; a slice is a fixed window.
+struct Lvstore {
+    int refs;
+    int count;
+    int cap;
+    Lval *items;
+};
+
+static Lvstore *lvstore_new(int cap) {
+    Lvstore *s = malloc(sizeof(Lvstore));
+    s->refs = 1;
+    s->count = 0;
+    s->cap = cap > 0 ? cap : 4;
+    s->items = malloc(sizeof(Lval) * s->cap);
+    return s;
+}
+
+Lvstore *lvstore_retain(Lvstore *s) {
+    if (s) __atomic_add_fetch(&s->refs, 1, __ATOMIC_RELAXED);
+    return s;
+}
+
+void lvstore_release(Lvstore *s) {
+    if (s == NULL || __atomic_sub_fetch(&s->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    
+    for (int i = 0; i < s->count; i++) {
+        lval_clear(&s->items[i]);
+    }
+    free(s->items);
+    free(s);
+}
+
+static Lval *lval_vector(Lvstore *s, int start, int count) {
+    Lval *v = malloc(sizeof(Lval));
+    v->type = LVAL_VECTOR;
+    v->vec.store = s;
+    v->vec.start = start;
+    v->vec.count = count;
+    return v;
+}
+
+// Moves the contents of a heap Lval into the store
+static void store_push(Lvstore *s, Lval *x) {
+    if (s->count == s->cap) {
+        s->cap *= 2;
+        s->items = realloc(s->items, sizeof(Lval) * s->cap);
+    }
+    s->items[s->count++] = *x;
+    free(x);
+}
+
+int lvector_count(Lval *v) {
+    if (v->vec.count >= 0) return v->vec.count;
+    return v->vec.store->count - v->vec.start;
+}
+
+// Borrowed; valid until the store is next changed
+Lval *lvector_item(Lval *v, int i) {
+    return &v->vec.store->items[v->vec.start + i];
+}
+
+unsigned long lvector_hash(Lval *v) {
+    unsigned long h = (unsigned long)lvector_count(v);
+    for (int i = 0; i < lvector_count(v); i++) {
+        h = h * 1099511628211UL ^ lval_hash(lvector_item(v, i));
+    }
+    return h;
+}
+
+int lvector_eq(Lval *x, Lval *y) {
+    int n = lvector_count(x);
+    if (n != lvector_count(y)) return 0;
+    for (int i = 0; i < n; i++) {
+        if (!lval_eq(lvector_item(x, i), lvector_item(y, i))) return 0;
+    }
+    return 1;
+}
+
+void lvector_print(Lval *v, char *out, int size) {
+    int n = snprintf(out, size, "[");
+    for (int i = 0; i < lvector_count(v) && n < size; i++) {
+        char *item = lval_to_string(lvector_item(v, i));
+        n += snprintf(out + n, size - n, i ? " %s" : "%s", item);
+        free(item);
+    }
+    if (n < size) snprintf(out + n, size - n, "]");
+}
+
+int vector_handles(char *name, Lval *a) {
+    if (strcmp(name, "vector") == 0 || strcmp(name, "make-vector") == 0 ||
+        strcmp(name, "nth") == 0 || strcmp(name, "len") == 0 || strcmp(name, "slice") == 0 ||
+        strcmp(name, "vector-set!") == 0 || strcmp(name, "vector-push!") == 0) {
+        return 1;
+    }
+    if (strcmp(name, "head") == 0 || strcmp(name, "tail") == 0) {
+        return a->sexpr.count == 1 && a->sexpr.cell[0]->type == LVAL_VECTOR;
+    }
+    return 0;
+}
+
+static Lval *vector_err(Lval *a, char *name, char *what) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Function '%s' passed %s!", name, what);
+    lval_free(a);
+    return lval_err(msg);
+}
+
+// Reads argument i as an index in [0, limit]
+static int index_arg(Lval *a, int i, int limit, long *out) {
+    Lval *x = a->sexpr.cell[i];
+    if (x->type != LVAL_NUM || x->num < 0 || x->num > limit) return 0;
+    *out = x->num;
+    return 1;
+}
+
+static int arg_count(char *name) {
+    if (strcmp(name, "slice") == 0 || strcmp(name, "vector-set!") == 0) return 3;
+    if (strcmp(name, "nth") == 0 || strcmp(name, "vector-push!") == 0 ||
+        strcmp(name, "make-vector") == 0) return 2;
+    return 1;
+}
+
+Lval *builtin_vector(Lval *a, char *name) {
+    if (strcmp(name, "vector") == 0) {
+        Lvstore *s = lvstore_new(a->sexpr.count);
+        for (int i = 0; i < a->sexpr.count; i++) {
+            store_push(s, a->sexpr.cell[i]);
+        }
+        a->sexpr.count = 0;
+        lval_free(a);
+        return lval_vector(s, 0, -1);
+    }
+    
+    if (a->sexpr.count != arg_count(name)) return vector_err(a, name, "incorrect number of arguments");
+    
+    if (strcmp(name, "make-vector") == 0) {
+        long n;
+        if (!index_arg(a, 0, 1 << 30, &n)) return vector_err(a, name, "incorrect type");
+        Lvstore *s = lvstore_new((int)n);
+        for (long i = 0; i < n; i++) {
+            store_push(s, lval_copy(a->sexpr.cell[1]));
+        }
+        lval_free(a);
+        return lval_vector(s, 0, -1);
+    }
+    
+    // The rest read lists as well as vectors; both index in O(1)
+    Lval *x = a->sexpr.cell[0];
+    int is_vec = x->type == LVAL_VECTOR;
+    if (!is_vec && (x->type != LVAL_SEXPR || strcmp(name, "vector-set!") == 0 ||
+                    strcmp(name, "vector-push!") == 0)) {
+        return vector_err(a, name, "incorrect type");
+    }
+    int n = is_vec ? lvector_count(x) : x->sexpr.count;
+    
+    if (strcmp(name, "len") == 0) {
+        lval_free(a);
+        return lval_num(n);
+    }
+    
+    if (strcmp(name, "head") == 0 || strcmp(name, "tail") == 0) {
+        if (n == 0) return vector_err(a, name, "empty vector");
+        if (strcmp(name, "head") == 0) {
+            Lval *v = lval_copy(lvector_item(x, 0));
+            lval_free(a);
+            return v;
+        }
+        Lval *v = lval_vector(lvstore_retain(x->vec.store), x->vec.start + 1, n - 1);
+        lval_free(a);
+        return v;
+    }
+    
+    if (strcmp(name, "nth") == 0) {
+        long i;
+        if (n == 0 || !index_arg(a, 1, n - 1, &i)) return vector_err(a, name, "an index out of range");
+        Lval *v = lval_copy(is_vec ? lvector_item(x, (int)i) : x->sexpr.cell[i]);
+        lval_free(a);
+        return v;
+    }
+    
+    if (strcmp(name, "slice") == 0) {
+        long start, end;
+        if (!index_arg(a, 1, n, &start) || !index_arg(a, 2, n, &end) || end < start) {
+            return vector_err(a, name, "a range out of bounds");
+        }
+        if (is_vec) {
+            Lval *v = lval_vector(lvstore_retain(x->vec.store), x->vec.start + (int)start, (int)(end - start));
+            lval_free(a);
+            return v;
+        }
+        Lval *v = lval_sexpr();
+        for (long i = start; i < end; i++) {
+            lval_add(v, lval_copy(x->sexpr.cell[i]));
+        }
+        lval_free(a);
+        return v;
+    }
+    
+    // A store holding a view of itself could never be printed or freed
+    Lval *item = a->sexpr.cell[a->sexpr.count - 1];
+    if (item->type == LVAL_VECTOR && item->vec.store == x->vec.store) {
+        return vector_err(a, name, "the vector itself");
+    }
+    
+    if (strcmp(name, "vector-set!") == 0) {
+        long i;
+        if (n == 0 || !index_arg(a, 1, n - 1, &i)) return vector_err(a, name, "an index out of range");
+        Lval *slot = lvector_item(x, (int)i);
+        lval_clear(slot);
+        item = lval_pop(a, 2);
+        *slot = *item;
+        free(item);
+        return lval_take(a, 0);
+    }
+    
+    // vector-push!; a slice is a fixed window, so only whole vectors grow
+    if (x->vec.count >= 0) return vector_err(a, name, "a slice");
+    store_push(x->vec.store, lval_pop(a, 1));
+    return lval_take(a, 0);
+}
@@ -0,0 +1,17 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include "lval.h"
+
+Lvstore *lvstore_retain(Lvstore *s);
+void lvstore_release(Lvstore *s);
+int lvector_count(Lval *v);
+Lval *lvector_item(Lval *v, int i);
+unsigned long lvector_hash(Lval *v);
+int lvector_eq(Lval *x, Lval *y);
+void lvector_print(Lval *v, char *out, int size);
+
+int vector_handles(char *name, Lval *a);
+Lval *builtin_vector(Lval *a, char *name);
+
+#endif
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+
+extern int tests_run;
+
+static int eval_type(Lenv *e, const char *input) {
+    Lval *v = eval_string(e, input);
+    int type = v->type;
+    lval_free(v);
+    return type;
+}
+
+// Test overflow promotes to a bignum and results that fit demote back
+static char *test_bignum_promotion() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    mu_assert("Sum past LONG_MAX should promote",
+              eval_prints(e, "(+ 9223372036854775807 1)", "9223372036854775808"));
+    mu_assert("Product past LONG_MAX should promote",
+              eval_prints(e, "(* 9223372036854775807 -3)", "-27670116110564327421"));
+    mu_assert("Negating LONG_MIN should promote",
+              eval_prints(e, "(- -9223372036854775808)", "9223372036854775808"));
+    mu_assert("LONG_MIN / -1 should promote",
+              eval_prints(e, "(/ -9223372036854775808 -1)", "9223372036854775808"));
+    mu_assert("LONG_MIN % -1 should be 0", eval_prints(e, "(% -9223372036854775808 -1)", "0"));
+    mu_assert("Promoted value should be a bignum",
+              eval_type(e, "(+ 9223372036854775807 1)") == LVAL_BIGNUM);
+    mu_assert("Result that fits should demote",
+              eval_type(e, "(- (+ 9223372036854775807 1) 1)") == LVAL_NUM);
+    mu_assert("Long literal should read exactly",
+              eval_prints(e, "-123456789012345678901234567890", "-123456789012345678901234567890"));
+    mu_assert("LONG_MIN literal should stay a fixnum", eval_type(e, "-9223372036854775808") == LVAL_NUM);
+    mu_assert("Bignums should compare with fixnums",
+              eval_prints(e, "(< -100000000000000000000 -5 100000000000000000000)", "1"));
+    mu_assert("Equal bignums should be =",
+              eval_prints(e, "(= 100000000000000000000 (* 10000000000 10000000000))", "1"));
+    mu_assert("Bignum should divide by zero as an error",
+              eval_type(e, "(/ 100000000000000000000 0)") == LVAL_ERR);
+    mu_assert("Bignums should work as map keys",
+              eval_prints(e, "(get (hash-map 100000000000000000000 'a) (* 10000000000 10000000000))", "a"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test large products and quotients stay exact
+static char *test_bignum_large() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *r = eval_string(e, "(def fact (\\ (n) (if (= n 0) 1 (* n (fact (- n 1))))))");
+    lval_free(r);
+    mu_assert("30! should be exact", eval_prints(e, "(fact 30)", "265252859812191058636308480000000"));
+    mu_assert("Quotient of factorials should be exact", eval_prints(e, "(/ (fact 600) (fact 598))", "359400"));
+    mu_assert("Factorial should be divisible by smaller one", eval_prints(e, "(% (fact 700) (fact 350))", "0"));
+    
+    // Karatsuba-sized square, checked against long division
+    r = eval_string(e, "(def n (+ (fact 500) 12345))");
+    lval_free(r);
+    r = eval_string(e, "(def d (- (fact 300) 1))");
+    lval_free(r);
+    mu_assert("Division should satisfy n = qd + r",
+              eval_prints(e, "(= (+ (* (/ n d) d) (% n d)) n)", "1"));
+    mu_assert("Square over itself should be itself", eval_prints(e, "(= (/ (* n n) n) n)", "1"));
+    mu_assert("Negative quotient should truncate", eval_prints(e, "(= (/ (- 0 n) n) -1)", "1"));
+    
+    // n squared has over two thousand digits, far past a fixed print buffer
+    r = eval_string(e, "(* n n)");
+    char *digits = lval_to_string(r);
+    lval_free(r);
+    char expected[4096];
+    snprintf(expected, sizeof(expected), "(7 %s 8)", digits);
+    mu_assert("Square should be a huge bignum", strlen(digits) > 2000);
+    mu_assert("List holding a huge bignum should print in full", eval_prints(e, "(list 7 (* n n) 8)", expected));
+    free(digits);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test declared fixnum arithmetic spills to bignums on overflow
+static char *test_bignum_fixnum_spill() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *r = eval_string(e, "(def sq (\\ (x y) (declare (fixnum x y)) (+ (* x x) (* y y))))");
+    lval_free(r);
+    mu_assert("Unboxed path should compute small results", eval_prints(e, "(sq 3 4)", "25"));
+    mu_assert("Unboxed overflow should promote",
+              eval_prints(e, "(sq 4000000000 4000000000)", "32000000000000000000"));
+    
+    r = eval_string(e, "(def neg (\\ (x) (declare (fixnum x)) (- x)))");
+    lval_free(r);
+    mu_assert("Unboxed negation of LONG_MIN should promote",
+              eval_prints(e, "(neg -9223372036854775808)", "9223372036854775808"));
+    
+    r = eval_string(e, "(def big (\\ (x) (declare (fixnum x)) (< x (* x x x x x) 5)))");
+    lval_free(r);
+    mu_assert("Comparison past an overflow should keep earlier results", eval_prints(e, "(big 100000)", "0"));
+    mu_assert("Comparison with a promoted operand should hold", eval_prints(e, "(big 2)", "1"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all bignum tests
+char *bignum_tests() {
+    mu_run_test(test_bignum_promotion);
+    mu_run_test(test_bignum_large);
+    mu_run_test(test_bignum_fixnum_spill);
+    
+    return 0;
+}
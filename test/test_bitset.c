@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "typed.h"
+
+extern int tests_run;
+
+// Test building, testing and updating bitsets
+static char *test_bitset_members() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *r = eval_string(e, "(def b (bitset 200 1 64 5 1))");
+    lval_free(r);
+    
+    mu_assert("Bitset should print members in order", eval_prints(e, "b", "#bits(1 5 64 200)"));
+    mu_assert("Bitset should take a list", eval_prints(e, "(bitset (list 3 0))", "#bits(0 3)"));
+    mu_assert("Empty bitset should print empty", eval_prints(e, "(bitset ())", "#bits()"));
+    mu_assert("Negative members should be an error",
+              eval_prints(e, "(bitset -1)", "Error: Function 'bitset' passed a value that is not a small non-negative fixnum!"));
+    mu_assert("bitset-test should find a member", eval_prints(e, "(bitset-test b 64)", "1"));
+    mu_assert("bitset-test should miss a non-member", eval_prints(e, "(bitset-test b 63)", "0"));
+    mu_assert("bitset-test past the end should miss", eval_prints(e, "(bitset-test b 100000000000)", "0"));
+    mu_assert("bitset-set should add a member", eval_prints(e, "(bitset-set b 1000)", "#bits(1 5 64 200 1000)"));
+    mu_assert("bitset-clear should drop a member", eval_prints(e, "(bitset-clear b 200)", "#bits(1 5 64)"));
+    mu_assert("Updates should leave the original alone", eval_prints(e, "b", "#bits(1 5 64 200)"));
+    mu_assert("Updates of a fresh set should chain",
+              eval_prints(e, "(bitset-clear (bitset-set (bitset-set (bitset ()) 1) 130) 1)", "#bits(130)"));
+    mu_assert("Clearing every member should leave a key equal to the empty set",
+              eval_prints(e, "(get (hash-map (bitset ()) 1) (bitset-clear (bitset 300) 300))", "1"));
+    mu_assert("to-list should iterate members", eval_prints(e, "(to-list b)", "(1 5 64 200)"));
+    mu_assert("len should count members", eval_prints(e, "(len b)", "4"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test union, intersect and difference across sets of different lengths
+static char *test_bitset_algebra() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *r = eval_string(e, "(def a (bitset 1 5 64 200))");
+    lval_free(r);
+    r = eval_string(e, "(def b (bitset 5 200 1000))");
+    lval_free(r);
+    
+    mu_assert("union should join sets", eval_prints(e, "(union a b)", "#bits(1 5 64 200 1000)"));
+    mu_assert("intersect should keep common members", eval_prints(e, "(intersect a b)", "#bits(5 200)"));
+    mu_assert("difference should drop the right's members", eval_prints(e, "(difference a b)", "#bits(1 64)"));
+    mu_assert("difference should keep a longer left", eval_prints(e, "(difference b a)", "#bits(1000)"));
+    mu_assert("Disjoint intersect should be empty", eval_prints(e, "(intersect a (bitset 7))", "#bits()"));
+    mu_assert("Set operations should fold", eval_prints(e, "(union a b (bitset 7))", "#bits(1 5 7 64 200 1000)"));
+    mu_assert("popcount should count members", eval_prints(e, "(popcount (union a b))", "5"));
+    mu_assert("Set operations should take only bitsets",
+              eval_prints(e, "(union a 1)", "Error: Function 'union' passed incorrect type!"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test large sets agree at every SIMD level
+static char *test_bitset_large() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    // Multiples of 3 and of 5 below 100000, with words past the SIMD blocks
+    Lval *threes = lval_sexpr();
+    Lval *fives = lval_sexpr();
+    for (long i = 0; i < 100000; i++) {
+        if (i % 3 == 0) lval_add(threes, lval_num(i));
+        if (i % 5 == 0) lval_add(fives, lval_num(i));
+    }
+    char *names[] = {"threes", "fives"};
+    Lval *lists[] = {threes, fives};
+    for (int i = 0; i < 2; i++) {
+        Lval *quoted = lval_sexpr();
+        lval_add(quoted, lval_sym("quote"));
+        lval_add(quoted, lists[i]);
+        Lval *call = lval_sexpr();
+        lval_add(call, lval_sym("bitset"));
+        lval_add(call, quoted);
+        Lval *sym = lval_sym(names[i]);
+        Lval *set = eval(e, call);
+        lenv_put(e, sym, set);
+        lval_free(sym);
+        lval_free(set);
+    }
+    
+    int level = typed_simd_level();
+    for (int l = TYPED_SCALAR; l <= level; l++) {
+        typed_set_simd_level(l);
+        mu_assert("popcount should count every member", eval_prints(e, "(popcount threes)", "33334"));
+        mu_assert("union should count by inclusion-exclusion",
+                  eval_prints(e, "(popcount (union threes fives))", "46667"));
+        mu_assert("intersect should keep multiples of 15", eval_prints(e, "(popcount (intersect threes fives))", "6667"));
+        mu_assert("difference should drop multiples of 15",
+                  eval_prints(e, "(popcount (difference threes fives))", "26667"));
+    }
+    typed_set_simd_level(level);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all bitset tests
+char *bitset_tests() {
+    mu_run_test(test_bitset_members);
+    mu_run_test(test_bitset_algebra);
+    mu_run_test(test_bitset_large);
+    
+    return 0;
+}
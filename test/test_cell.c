@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "cell.h"
+
+extern int tests_run;
+
+static int lists_sym(Lval *v, char *sym) {
+    for (int i = 0; i < v->sexpr.count; i++) {
+        if (v->sexpr.cell[i]->type == LVAL_SYM && strcmp(v->sexpr.cell[i]->sym, sym) == 0) return 1;
+    }
+    return 0;
+}
+
+// Test cells are evaluated lazily and only invalidated dependents rerun
+static char *test_cell_recompute() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def a 1)"));
+    lval_free(eval_string(e, "(def b 2)"));
+    lval_free(eval_string(e, "(def other 7)"));
+    
+    long before = lcells_computed();
+    lval_free(eval_string(e, "(defcell sum (+ a b))"));
+    lval_free(eval_string(e, "(defcell twice (* sum 2))"));
+    lval_free(eval_string(e, "(defcell side (+ other 1))"));
+    mu_assert("Defining cells should not evaluate them", lcells_computed() == before);
+    
+    mu_assert("Cell should read through another cell", eval_num(e, "twice") == 6);
+    mu_assert("Reading should evaluate only the cells it needs", lcells_computed() - before == 2);
+    
+    before = lcells_computed();
+    mu_assert("Cached cell should keep its value", eval_num(e, "twice") == 6);
+    mu_assert("Cached cell should not be evaluated again", lcells_computed() == before);
+    
+    lval_free(eval_string(e, "(def a 5)"));
+    mu_assert("Redefining an input should not evaluate anything", lcells_computed() == before);
+    mu_assert("Dependent should see the new input", eval_num(e, "twice") == 14);
+    mu_assert("Both dependents should be evaluated again", lcells_computed() - before == 2);
+    
+    before = lcells_computed();
+    lval_free(eval_string(e, "(def other 8)"));
+    mu_assert("Unrelated cell should keep its value", eval_num(e, "twice") == 14);
+    mu_assert("Unrelated input should not invalidate the cell", lcells_computed() == before);
+    
+    lval_free(eval_string(e, "(def sum 10)"));
+    mu_assert("Plain def should replace a cell", eval_num(e, "twice") == 20);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test a recomputed cell whose value did not change stops the walk
+static char *test_cell_cutoff() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def x 3)"));
+    lval_free(eval_string(e, "(defcell parity (% x 2))"));
+    lval_free(eval_string(e, "(defcell label (* parity 100))"));
+    mu_assert("Chained cells should compute", eval_num(e, "label") == 100);
+    
+    long before = lcells_computed();
+    lval_free(eval_string(e, "(def x 5)"));
+    mu_assert("Unchanged intermediate should keep the result", eval_num(e, "label") == 100);
+    mu_assert("Only the intermediate should be evaluated again", lcells_computed() - before == 1);
+    
+    Lval *deps = eval_string(e, "(cell-deps 'label)");
+    mu_assert("Deps should be a list", deps->type == LVAL_SEXPR);
+    mu_assert("Deps should include the cell read", lists_sym(deps, "parity"));
+    mu_assert("Deps should not include inputs read indirectly", !lists_sym(deps, "x"));
+    lval_free(deps);
+    
+    Lval *readers = eval_string(e, "(cell-dependents 'x)");
+    mu_assert("Dependents should list the reading cell", readers->sexpr.count == 1 && lists_sym(readers, "parity"));
+    lval_free(readers);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test cycles and unbound reads
+static char *test_cell_errors() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(defcell p (+ q 1))"));
+    lval_free(eval_string(e, "(defcell q (+ p 1))"));
+    Lval *result = eval_string(e, "p");
+    mu_assert("Cycle should return error", result->type == LVAL_ERR);
+    mu_assert("Cycle error should be correct", strstr(result->err, "Cyclic") != NULL);
+    lval_free(result);
+    
+    lval_free(eval_string(e, "(defcell late (+ later 1))"));
+    result = eval_string(e, "late");
+    mu_assert("Unbound input should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    lval_free(eval_string(e, "(def later 41)"));
+    mu_assert("Defining the input should wake the cell", eval_num(e, "late") == 42);
+    
+    result = eval_string(e, "(cell-deps late)");
+    mu_assert("Unquoted name should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test a memoized call inside a cell still records what the callee reads
+static char *test_cell_memo() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    def_lambda(e, "g", "(fn (x) (+ x 1))");
+    def_lambda(e, "h", "(fn (x) (g x))");
+    lval_free(eval_string(e, "(def mh (memoize h))"));
+    lval_free(eval_string(e, "(defcell c1 (mh 1))"));
+    mu_assert("First cell should compute through the memo", eval_num(e, "c1") == 2);
+    lval_free(eval_string(e, "(defcell c2 (mh 1))"));
+    mu_assert("Second cell should get the same value", eval_num(e, "c2") == 2);
+    
+    Lval *deps = eval_string(e, "(cell-deps 'c2)");
+    mu_assert("Cell reading a cached call should depend on the callee", lists_sym(deps, "g"));
+    lval_free(deps);
+    
+    def_lambda(e, "g", "(fn (x) (+ x 100))");
+    mu_assert("Memoized call should see the new callee", eval_num(e, "(mh 1)") == 101);
+    mu_assert("First cell should see the new callee", eval_num(e, "c1") == 101);
+    mu_assert("Second cell should see the new callee", eval_num(e, "c2") == 101);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all cell tests
+char *cell_tests() {
+    mu_run_test(test_cell_recompute);
+    mu_run_test(test_cell_cutoff);
+    mu_run_test(test_cell_errors);
+    mu_run_test(test_cell_memo);
+    
+    return 0;
+}
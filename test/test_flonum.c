@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "parser.h"
+
+extern int tests_run;
+
+// Test float literals read and print back the same
+static char *test_float_literals() {
+    AstNode *node = parse_string("-2.5e3");
+    mu_assert("Float literal should parse as a float", node->type == AST_FLOAT);
+    mu_assert("Float literal should have its value", node->fnum == -2500.0);
+    ast_free(node);
+    
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    mu_assert("Float should print shortest form", eval_prints(e, "0.1", "0.1"));
+    mu_assert("Whole float should keep its point", eval_prints(e, "100.0", "100.0"));
+    mu_assert("Small float should print an exponent", eval_prints(e, "1e-7", "1e-07"));
+    mu_assert("Floats in a list should print", eval_prints(e, "(list 1.5 2 3e2)", "(1.5 2 300.0)"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test mixed arithmetic promotes to floats and comparisons mix kinds
+static char *test_float_arithmetic() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    mu_assert("Fixnum plus float should be a float", eval_prints(e, "(+ 1 2.5)", "3.5"));
+    mu_assert("Float product should stay a float", eval_prints(e, "(* 1.5 2)", "3.0"));
+    mu_assert("Float division should not truncate", eval_prints(e, "(/ 1 4.0)", "0.25"));
+    mu_assert("Fixnum division should still truncate", eval_prints(e, "(/ 7 2)", "3"));
+    mu_assert("Float remainder should take the dividend's sign", eval_prints(e, "(% -7.5 2)", "-1.5"));
+    mu_assert("Unary minus should negate a float", eval_prints(e, "(- 2.5)", "-2.5"));
+    mu_assert("Bignum plus float should be a float", eval_prints(e, "(+ 100000000000000000000 0.5)", "1e+20"));
+    mu_assert("Float by float zero should be infinite", eval_prints(e, "(/ 1.0 0.0)", "inf"));
+    mu_assert("Float by exact zero should be an error", eval_prints(e, "(/ 1.0 0)", "Error: Division by zero!"));
+    mu_assert("Mixed comparison should compare values", eval_prints(e, "(< 1 1.5 2)", "1"));
+    mu_assert("Equal values of either kind should be =", eval_prints(e, "(= 1 1.0)", "1"));
+    mu_assert("NaN should compare false", eval_prints(e, "(< (sqrt -1) 1)", "0"));
+    mu_assert("Sort should order mixed numbers",
+              eval_prints(e, "(sort (list 3 1.5 -2 100000000000000000000))", "(-2 1.5 3 100000000000000000000)"));
+    
+    Lval *r = eval_string(e, "(def f (\\ (x) (declare (fixnum x)) (+ x 1.5 (* x 2))))");
+    lval_free(r);
+    mu_assert("Declared fixnum arithmetic should take float operands", eval_prints(e, "(f 2)", "7.5"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test the math builtins
+static char *test_float_math() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    mu_assert("sqrt should take fixnums", eval_prints(e, "(sqrt 16)", "4.0"));
+    mu_assert("exp should give e", eval_prints(e, "(exp 1)", "2.718281828459045"));
+    mu_assert("log should invert exp", eval_prints(e, "(log (exp 2.0))", "2.0"));
+    mu_assert("floor should round down to an integer", eval_prints(e, "(floor -2.5)", "-3"));
+    mu_assert("floor should leave integers alone", eval_prints(e, "(floor 7)", "7"));
+    mu_assert("floor of a huge float should be a bignum",
+              eval_prints(e, "(floor 1e20)", "100000000000000000000"));
+    mu_assert("floor of infinity should be an error",
+              eval_prints(e, "(floor (/ 1.0 0.0))", "Error: Function 'floor' passed a value that is not finite!"));
+    mu_assert("Math on a symbol should be an error",
+              eval_prints(e, "(sqrt 'x)", "Error: Function 'sqrt' passed incorrect type!"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test floats and bignums work wherever numbers are taken
+static char *test_float_tower() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    mu_assert("Sort should put NaNs after every other number",
+              eval_prints(e, "(sort (list 3 (sqrt -1) 1 2.5 (sqrt -1) -1))", "(-1 1 2.5 3 nan nan)"));
+    
+    lval_free(eval_string(e, "(def m (sorted-map 2 'b 1.5 'a 100000000000000000000 'big (sqrt -1) 'nan 'x 'sym))"));
+    mu_assert("Sorted map should order every kind of number",
+              eval_prints(e, "(keys m)", "(1.5 2 100000000000000000000 nan x)"));
+    mu_assert("Sorted map should find a float key", eval_prints(e, "(get m 1.5)", "a"));
+    mu_assert("Sorted map should find a bignum key", eval_prints(e, "(get m 100000000000000000000)", "big"));
+    mu_assert("Sorted map should find a NaN key", eval_prints(e, "(get m (sqrt -1))", "nan"));
+    mu_assert("Equal numbers should be the same key", eval_prints(e, "(len (put m 2.0 'two))", "5"));
+    mu_assert("Subrange should take mixed bounds",
+              eval_prints(e, "(subrange m 1 100000000000000000001)", "((1.5 a) (2 b) (100000000000000000000 big))"));
+    
+    mu_assert("Float literal should match", eval_prints(e, "(match 1.5 (1 'one) (1.5 'half) (_ 'no))", "half"));
+    mu_assert("Bignum literal should match",
+              eval_prints(e, "(match 100000000000000000000 (100000000000000000000 'big) (_ 'no))", "big"));
+    mu_assert("Literals should match as by =", eval_prints(e, "(match 2.0 (2 'two) (_ 'no))", "two"));
+    
+    lval_free(eval_string(e, "(defgeneric kind)"));
+    lval_free(eval_string(e, "(defmethod kind ((x num)) 'num)"));
+    mu_assert("num method should take a float", eval_prints(e, "(kind 1.5)", "num"));
+    lval_free(eval_string(e, "(defmethod kind ((x float)) 'float)"));
+    mu_assert("float method should be more specific than num", eval_prints(e, "(kind 1.5)", "float"));
+    mu_assert("num method should still take integers", eval_prints(e, "(kind 100000000000000000000)", "num"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all float tests
+char *flonum_tests() {
+    mu_run_test(test_float_literals);
+    mu_run_test(test_float_arithmetic);
+    mu_run_test(test_float_math);
+    mu_run_test(test_float_tower);
+    
+    return 0;
+}
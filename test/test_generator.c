@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "pool.h"
+
+extern int tests_run;
+
+// Test a recursive lambda yields items on demand
+static char *test_generator_yield() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    // (list a b) evaluates a before b, so it sequences the yield first
+    def_lambda(e, "countdown", "(fn (n) (if (= n 0) 0 (list (yield n) (countdown (- n 1)))))");
+    def_lambda(e, "nat", "(fn (n) (list (yield n) (nat (+ n 1))))");
+    
+    Lval *result = eval_string(e, "(take 10 (generator countdown 3))");
+    mu_assert("Generator should stop when its function returns", list_is(result, (long[]){3, 2, 1}, 3));
+    lval_free(result);
+    
+    result = eval_string(e, "(take 4 (generator nat 7))");
+    mu_assert("Unbounded generator should only run as far as needed", list_is(result, (long[]){7, 8, 9, 10}, 4));
+    lval_free(result);
+    
+    result = eval_string(e, "(fold + 0 (lazy-map - (generator countdown 100)))");
+    mu_assert("Generator should feed sequence builtins", result->type == LVAL_NUM && result->num == -5050);
+    lval_free(result);
+    
+    // The sequence is memoized, so reading it twice replays the same items
+    lval_free(eval_string(e, "(def g (generator countdown 2))"));
+    lval_free(eval_string(e, "(take 1 g)"));
+    result = eval_string(e, "(take 5 g)");
+    mu_assert("Generator sequence should be replayable", list_is(result, (long[]){2, 1}, 2));
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test generators nest and yield reports misuse
+static char *test_generator_nested() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_lambda(e, "countdown", "(fn (n) (if (= n 0) 0 (list (yield n) (countdown (- n 1)))))");
+    def_lambda(e, "doubled", "(fn (n) (fold (fn (acc x) (yield (* 2 x))) 0 (generator countdown n)))");
+    
+    Lval *result = eval_string(e, "(take 5 (generator doubled 3))");
+    mu_assert("Generator should consume another generator", list_is(result, (long[]){6, 4, 2}, 3));
+    lval_free(result);
+    
+    result = eval_string(e, "(yield 1)");
+    mu_assert("yield outside a generator should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    def_lambda(e, "broken", "(fn (n) (list (yield n) (head ())))");
+    result = eval_string(e, "(take 5 (generator broken 1))");
+    mu_assert("Error in the generator should reach the consumer", result->type == LVAL_ERR);
+    mu_assert("Generator error should be the function's", strstr(result->err, "empty list") != NULL);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Generator bodies resume on whichever thread forces them, so arguments
+// reading a generator are never forked onto the pool
+static char *test_generator_parallel() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    lval_free(eval_string(e, "(defgeneric twice)"));
+    lval_free(eval_string(e, "(defmethod twice ((n num)) (* 2 n))"));
+    def_lambda(e, "gen", "(fn (n) (list (yield (twice n)) (gen (+ n 1))))");
+    lval_free(eval_string(e, "(def a (generator gen 1))"));
+    lval_free(eval_string(e, "(def b (generator gen 10))"));
+    lval_free(eval_string(e, "(def r (range 0 100))"));
+    eval_set_parallel(4, 1);
+    
+    long before = pool_tasks_run();
+    mu_assert("Generators should resume in order",
+              eval_prints(e, "(list (take 3 a) (take 3 b))", "((2 4 6) (20 22 24))"));
+    mu_assert("Reading generators should stay on the evaluating thread", pool_tasks_run() == before);
+    
+    mu_assert("Ranges should read the same on the pool",
+              eval_prints(e, "(list (take 3 r) (take 3 r))", "((0 1 2) (0 1 2))"));
+    mu_assert("Reading a range should still fork", pool_tasks_run() > before);
+    
+    eval_set_parallel(0, 256);
+    lenv_free(e);
+    return 0;
+}
+
+// Dropping a suspended generator unwinds it, freeing what its frames hold
+static char *test_generator_drop() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_lambda(e, "nat", "(fn (n) (list (yield n) (nat (+ n 1))))");
+    def_lambda(e, "doubled", "(fn (n) (fold (fn (acc x) (yield (* 2 x))) 0 (generator nat n)))");
+    mu_assert("Partly read generator should give its first items",
+              eval_prints(e, "(take 3 (generator nat 0))", "(0 1 2)"));
+    
+    long before = heap_in_use();
+    for (int i = 0; i < 2000; i++) {
+        lval_free(eval_string(e, "(take 3 (generator nat 0))"));
+    }
+    mu_assert("Dropping a suspended generator should not leak", heap_in_use() - before < 16384);
+    
+    before = heap_in_use();
+    for (int i = 0; i < 2000; i++) {
+        lval_free(eval_string(e, "(take 3 (generator doubled 1))"));
+    }
+    mu_assert("Dropping nested suspended generators should not leak", heap_in_use() - before < 16384);
+    
+    // The generator still works after one of its kind was dropped
+    mu_assert("Generator should run again after a drop",
+              eval_prints(e, "(take 3 (generator doubled 1))", "(2 4 6)"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all generator tests
+char *generator_tests() {
+    mu_run_test(test_generator_yield);
+    mu_run_test(test_generator_nested);
+    mu_run_test(test_generator_parallel);
+    mu_run_test(test_generator_drop);
+    
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "generic.h"
+
+extern int tests_run;
+
+// Test methods are selected by the types of all arguments
+static char *test_generic_dispatch() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *result = eval_string(e, "(defgeneric combine)");
+    mu_assert("defgeneric should return a generic", result->type == LVAL_GENERIC);
+    lval_free(result);
+    
+    lval_free(eval_string(e, "(defmethod combine ((a num) (b num)) (+ a b))"));
+    lval_free(eval_string(e, "(defmethod combine ((a list) (b list)) (join a b))"));
+    lval_free(eval_string(e, "(defmethod combine ((a num) b) 1)"));
+    lval_free(eval_string(e, "(defmethod combine (a b) 2)"));
+    lval_free(eval_string(e, "(defmethod combine ((x list)) (head x))"));
+    
+    mu_assert("Numbers should use the num method", eval_num(e, "(combine 3 4)") == 7);
+    result = eval_string(e, "(combine (list 1) (list 2 3))");
+    mu_assert("Lists should use the list method", result->type == LVAL_SEXPR && result->sexpr.count == 3);
+    lval_free(result);
+    mu_assert("Typed first parameter should beat an untyped one", eval_num(e, "(combine 3 (list 1))") == 1);
+    mu_assert("Untyped method should catch the rest", eval_num(e, "(combine (list 1) 3)") == 2);
+    mu_assert("Arity should take part in dispatch", eval_num(e, "(combine (list 9 8))") == 9);
+    
+    result = eval_string(e, "(combine 1 2 3)");
+    mu_assert("Unmatched call should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    result = eval_string(e, "(defmethod combine ((a text)) a)");
+    mu_assert("Unknown type should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    result = eval_string(e, "(defmethod head ((a num)) a)");
+    mu_assert("Method on a non-generic should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test selections are cached per type tuple and dropped by defmethod
+static char *test_generic_cache() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(defgeneric size)"));
+    lval_free(eval_string(e, "(defmethod size ((x num)) 1)"));
+    lval_free(eval_string(e, "(defmethod size (x) 0)"));
+    
+    for (int i = 0; i < 3; i++) {
+        mu_assert("Cached dispatch should return the method's result", eval_num(e, "(size 5)") == 1);
+        mu_assert("Other type should use the fallback", eval_num(e, "(size (list 1 2))") == 0);
+    }
+    
+    Lval *sym = lval_sym("size");
+    Lval *g = lenv_get(e, sym);
+    mu_assert("One cache entry per type tuple", lgeneric_cache_size(g->generic) == 2);
+    
+    lval_free(eval_string(e, "(defmethod size ((x list)) 2)"));
+    mu_assert("Adding a method should empty the cache", lgeneric_cache_size(g->generic) == 0);
+    mu_assert("New method should be selected", eval_num(e, "(size (list 1 2))") == 2);
+    
+    lval_free(eval_string(e, "(defmethod size ((x num)) 10)"));
+    mu_assert("Same types should replace the method", eval_num(e, "(size 5)") == 10);
+    
+    lval_free(eval_string(e, "(defgeneric size)"));
+    mu_assert("defgeneric should keep existing methods", eval_num(e, "(size 5)") == 10);
+    
+    lval_free(g);
+    lval_free(sym);
+    lenv_free(e);
+    return 0;
+}
+
+// Test generics work as ordinary functions
+static char *test_generic_first_class() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(defgeneric twice)"));
+    lval_free(eval_string(e, "(defmethod twice ((x num)) (* x 2))"));
+    lval_free(eval_string(e, "(defmethod twice ((x list)) (join x x))"));
+    
+    mu_assert("Generic should work as a map function", eval_num(e, "(fold + 0 (map twice (list 1 2 3)))") == 12);
+    mu_assert("Method should recurse through the generic",
+              eval_num(e, "(head (tail (twice (list (twice 4)))))") == 8);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all generic tests
+char *generic_tests() {
+    mu_run_test(test_generic_dispatch);
+    mu_run_test(test_generic_cache);
+    mu_run_test(test_generic_first_class);
+    
+    return 0;
+}
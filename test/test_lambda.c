@@ -6,6 +6,7 @@
 #include "eval.h"
 #include "env.h"
 #include "parser.h"
+#include "test_util.h"
 
 extern int tests_run;
 
@@ -211,6 +212,282 @@ static char *test_lambda_errors() {
     return 0;
 }
 
+// Test escape analysis marks only closure-creating bodies as escaping
+static char *test_lambda_escape_analysis() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    // (\ {x} {+ x 1}) cannot capture its frame
+    Lval *plain = lval_sexpr();
+    lval_add(plain, lval_sym("\\"));
+    lval_add(plain, lval_sexpr());
+    lval_add(plain->sexpr.cell[1], lval_sym("x"));
+    lval_add(plain, lval_sexpr());
+    lval_add(plain->sexpr.cell[2], lval_sym("+"));
+    lval_add(plain->sexpr.cell[2], lval_sym("x"));
+    lval_add(plain->sexpr.cell[2], lval_num(1));
+    
+    Lval *result = eval(e, plain);
+    mu_assert("Plain lambda should not escape", result->type == LVAL_LAMBDA && !result->lambda.closure->escapes);
+    lval_free(result);
+    
+    // (\ {x} {\ {y} {+ x y}}) returns a closure over its frame
+    Lval *curried = lval_sexpr();
+    lval_add(curried, lval_sym("\\"));
+    lval_add(curried, lval_sexpr());
+    lval_add(curried->sexpr.cell[1], lval_sym("x"));
+    lval_add(curried, lval_sexpr());
+    lval_add(curried->sexpr.cell[2], lval_sym("\\"));
+    lval_add(curried->sexpr.cell[2], lval_sexpr());
+    lval_add(curried->sexpr.cell[2]->sexpr.cell[1], lval_sym("y"));
+    lval_add(curried->sexpr.cell[2], lval_sexpr());
+    lval_add(curried->sexpr.cell[2]->sexpr.cell[2], lval_sym("+"));
+    lval_add(curried->sexpr.cell[2]->sexpr.cell[2], lval_sym("x"));
+    lval_add(curried->sexpr.cell[2]->sexpr.cell[2], lval_sym("y"));
+    
+    result = eval(e, curried);
+    mu_assert("Closure-creating lambda should escape", result->type == LVAL_LAMBDA && result->lambda.closure->escapes);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test recursion through stack-allocated frames and closures over heap frames
+static char *test_lambda_frames() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    // (def fact (\ {n} {if (= n 0) 1 (* n (fact (- n 1)))}))
+    Lval *body = lval_sexpr();
+    lval_add(body, lval_sym("if"));
+    lval_add(body, lval_sexpr());
+    lval_add(body->sexpr.cell[1], lval_sym("="));
+    lval_add(body->sexpr.cell[1], lval_sym("n"));
+    lval_add(body->sexpr.cell[1], lval_num(0));
+    lval_add(body, lval_num(1));
+    lval_add(body, lval_sexpr());
+    lval_add(body->sexpr.cell[3], lval_sym("*"));
+    lval_add(body->sexpr.cell[3], lval_sym("n"));
+    lval_add(body->sexpr.cell[3], lval_sexpr());
+    lval_add(body->sexpr.cell[3]->sexpr.cell[2], lval_sym("fact"));
+    lval_add(body->sexpr.cell[3]->sexpr.cell[2], lval_sexpr());
+    lval_add(body->sexpr.cell[3]->sexpr.cell[2]->sexpr.cell[1], lval_sym("-"));
+    lval_add(body->sexpr.cell[3]->sexpr.cell[2]->sexpr.cell[1], lval_sym("n"));
+    lval_add(body->sexpr.cell[3]->sexpr.cell[2]->sexpr.cell[1], lval_num(1));
+    
+    Lval *def_expr = lval_sexpr();
+    lval_add(def_expr, lval_sym("def"));
+    lval_add(def_expr, lval_sym("fact"));
+    lval_add(def_expr, lval_sexpr());
+    lval_add(def_expr->sexpr.cell[2], lval_sym("\\"));
+    lval_add(def_expr->sexpr.cell[2], lval_sexpr());
+    lval_add(def_expr->sexpr.cell[2]->sexpr.cell[1], lval_sym("n"));
+    lval_add(def_expr->sexpr.cell[2], body);
+    lval_free(eval(e, def_expr));
+    
+    Lval *call = lval_sexpr();
+    lval_add(call, lval_sym("fact"));
+    lval_add(call, lval_num(10));
+    Lval *result = eval(e, call);
+    mu_assert("Recursive call on stack frames should return number", result->type == LVAL_NUM);
+    mu_assert("fact 10 should be 3628800", result->num == 3628800);
+    lval_free(result);
+    
+    // (((\ {x} {\ {y} {+ x y}}) 3) 4): the inner closure outlives the call
+    Lval *outer = lval_sexpr();
+    lval_add(outer, lval_sym("\\"));
+    lval_add(outer, lval_sexpr());
+    lval_add(outer->sexpr.cell[1], lval_sym("x"));
+    lval_add(outer, lval_sexpr());
+    lval_add(outer->sexpr.cell[2], lval_sym("\\"));
+    lval_add(outer->sexpr.cell[2], lval_sexpr());
+    lval_add(outer->sexpr.cell[2]->sexpr.cell[1], lval_sym("y"));
+    lval_add(outer->sexpr.cell[2], lval_sexpr());
+    lval_add(outer->sexpr.cell[2]->sexpr.cell[2], lval_sym("+"));
+    lval_add(outer->sexpr.cell[2]->sexpr.cell[2], lval_sym("x"));
+    lval_add(outer->sexpr.cell[2]->sexpr.cell[2], lval_sym("y"));
+    Lval *outer_copy = lval_copy(outer);
+    
+    Lval *make_adder = lval_sexpr();
+    lval_add(make_adder, outer);
+    lval_add(make_adder, lval_num(3));
+    
+    Lval *expr = lval_sexpr();
+    lval_add(expr, make_adder);
+    lval_add(expr, lval_num(4));
+    result = eval(e, expr);
+    mu_assert("Closure over returned frame should return number", result->type == LVAL_NUM);
+    mu_assert("Closure over returned frame should be 7", result->num == 7);
+    lval_free(result);
+    
+    // ((\ {x} {\ {y} {+ x y}}) 3): once the call returns, the closure holds
+    // the only reference to its frame, which goes when the closure does
+    make_adder = lval_sexpr();
+    lval_add(make_adder, outer_copy);
+    lval_add(make_adder, lval_num(3));
+    result = eval(e, make_adder);
+    mu_assert("Closure should be returned from the call", result->type == LVAL_LAMBDA);
+    mu_assert("Closure should hold the only reference to its frame", result->lambda.closure->env->refs == 1);
+    mu_assert("Closure's frame should keep the defining env", result->lambda.closure->env->parent == e);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test fixnum declarations and safety levels
+static char *test_lambda_declare() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    // (def sumsq (\ {x y} (declare (fixnum x y)) {+ (* x x) (* y y)}))
+    Lval *def_expr = lval_sexpr();
+    lval_add(def_expr, lval_sym("def"));
+    lval_add(def_expr, lval_sym("sumsq"));
+    Lval *lambda = lval_sexpr();
+    lval_add(lambda, lval_sym("\\"));
+    lval_add(lambda, lval_sexpr());
+    lval_add(lambda->sexpr.cell[1], lval_sym("x"));
+    lval_add(lambda->sexpr.cell[1], lval_sym("y"));
+    lval_add(lambda, lval_sexpr());
+    lval_add(lambda->sexpr.cell[2], lval_sym("declare"));
+    lval_add(lambda->sexpr.cell[2], lval_sexpr());
+    lval_add(lambda->sexpr.cell[2]->sexpr.cell[1], lval_sym("fixnum"));
+    lval_add(lambda->sexpr.cell[2]->sexpr.cell[1], lval_sym("x"));
+    lval_add(lambda->sexpr.cell[2]->sexpr.cell[1], lval_sym("y"));
+    lval_add(lambda, lval_sexpr());
+    lval_add(lambda->sexpr.cell[3], lval_sym("+"));
+    lval_add(lambda->sexpr.cell[3], lval_sexpr());
+    lval_add(lambda->sexpr.cell[3]->sexpr.cell[1], lval_sym("*"));
+    lval_add(lambda->sexpr.cell[3]->sexpr.cell[1], lval_sym("x"));
+    lval_add(lambda->sexpr.cell[3]->sexpr.cell[1], lval_sym("x"));
+    lval_add(lambda->sexpr.cell[3], lval_sexpr());
+    lval_add(lambda->sexpr.cell[3]->sexpr.cell[2], lval_sym("*"));
+    lval_add(lambda->sexpr.cell[3]->sexpr.cell[2], lval_sym("y"));
+    lval_add(lambda->sexpr.cell[3]->sexpr.cell[2], lval_sym("y"));
+    lval_add(def_expr, lambda);
+    
+    Lval *result = eval(e, def_expr);
+    mu_assert("Declared lambda should be created", result->type == LVAL_LAMBDA);
+    mu_assert("Declared lambda should record fixnums", result->lambda.closure->fixnums->sexpr.count == 2);
+    mu_assert("Declared lambda should default to checked", result->lambda.closure->safety == 1);
+    lval_free(result);
+    
+    // (sumsq 3 4) should return 25
+    Lval *call = lval_sexpr();
+    lval_add(call, lval_sym("sumsq"));
+    lval_add(call, lval_num(3));
+    lval_add(call, lval_num(4));
+    result = eval(e, call);
+    mu_assert("Declared lambda should return number", result->type == LVAL_NUM);
+    mu_assert("Declared lambda result should be 25", result->num == 25);
+    lval_free(result);
+    
+    // (sumsq 3 (list 4)) is rejected once at entry
+    call = lval_sexpr();
+    lval_add(call, lval_sym("sumsq"));
+    lval_add(call, lval_num(3));
+    lval_add(call, lval_sexpr());
+    lval_add(call->sexpr.cell[2], lval_sym("list"));
+    lval_add(call->sexpr.cell[2], lval_num(4));
+    result = eval(e, call);
+    mu_assert("Checked declaration should reject non-number", result->type == LVAL_ERR);
+    mu_assert("Checked declaration error should be correct", strstr(result->err, "declared fixnum") != NULL);
+    lval_free(result);
+    
+    // (\ {x} (declare (fixnum x) (safety 0)) {/ x 0}) still reports division by zero
+    Lval *expr = lval_sexpr();
+    lval_add(expr, lval_sexpr());
+    lval_add(expr->sexpr.cell[0], lval_sym("\\"));
+    lval_add(expr->sexpr.cell[0], lval_sexpr());
+    lval_add(expr->sexpr.cell[0]->sexpr.cell[1], lval_sym("x"));
+    lval_add(expr->sexpr.cell[0], lval_sexpr());
+    lval_add(expr->sexpr.cell[0]->sexpr.cell[2], lval_sym("declare"));
+    lval_add(expr->sexpr.cell[0]->sexpr.cell[2], lval_sexpr());
+    lval_add(expr->sexpr.cell[0]->sexpr.cell[2]->sexpr.cell[1], lval_sym("fixnum"));
+    lval_add(expr->sexpr.cell[0]->sexpr.cell[2]->sexpr.cell[1], lval_sym("x"));
+    lval_add(expr->sexpr.cell[0]->sexpr.cell[2], lval_sexpr());
+    lval_add(expr->sexpr.cell[0]->sexpr.cell[2]->sexpr.cell[2], lval_sym("safety"));
+    lval_add(expr->sexpr.cell[0]->sexpr.cell[2]->sexpr.cell[2], lval_num(0));
+    lval_add(expr->sexpr.cell[0], lval_sexpr());
+    lval_add(expr->sexpr.cell[0]->sexpr.cell[3], lval_sym("/"));
+    lval_add(expr->sexpr.cell[0]->sexpr.cell[3], lval_sym("x"));
+    lval_add(expr->sexpr.cell[0]->sexpr.cell[3], lval_num(0));
+    lval_add(expr, lval_num(7));
+    result = eval(e, expr);
+    mu_assert("Safety 0 lambda should still catch division by zero", result->type == LVAL_ERR);
+    mu_assert("Safety 0 error should be division by zero", strstr(result->err, "Division by zero") != NULL);
+    lval_free(result);
+    
+    // (\ {x} (declare (fixnum z)) {x}) declares a non-formal
+    Lval *bad = lval_sexpr();
+    lval_add(bad, lval_sym("\\"));
+    lval_add(bad, lval_sexpr());
+    lval_add(bad->sexpr.cell[1], lval_sym("x"));
+    lval_add(bad, lval_sexpr());
+    lval_add(bad->sexpr.cell[2], lval_sym("declare"));
+    lval_add(bad->sexpr.cell[2], lval_sexpr());
+    lval_add(bad->sexpr.cell[2]->sexpr.cell[1], lval_sym("fixnum"));
+    lval_add(bad->sexpr.cell[2]->sexpr.cell[1], lval_sym("z"));
+    lval_add(bad, lval_sexpr());
+    lval_add(bad->sexpr.cell[3], lval_sym("x"));
+    result = eval(e, bad);
+    mu_assert("Declaring a non-formal should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Lambda metadata lives out of line, so copies share it and values stay small
+static char *test_lambda_layout() {
+    mu_assert("Lval should stay four words", sizeof(Lval) == 4 * sizeof(void *));
+    
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    // (\ {x} {x})
+    Lval *lambda = lval_sexpr();
+    lval_add(lambda, lval_sym("\\"));
+    lval_add(lambda, lval_sexpr());
+    lval_add(lambda->sexpr.cell[1], lval_sym("x"));
+    lval_add(lambda, lval_sexpr());
+    lval_add(lambda->sexpr.cell[2], lval_sym("x"));
+    
+    Lval *f = eval(e, lambda);
+    Lval *g = lval_copy(f);
+    mu_assert("Copies should share one closure record", f->lambda.closure == g->lambda.closure);
+    mu_assert("Shared closure record should count both copies", f->lambda.closure->refs == 2);
+    
+    lval_closure_own(g)->safety = 0;
+    mu_assert("Owning should split the record", f->lambda.closure != g->lambda.closure);
+    mu_assert("Changing one copy should leave the other alone", f->lambda.closure->safety == 1);
+    mu_assert("Split records should keep the environment", g->lambda.closure->env == f->lambda.closure->env);
+    
+    lval_free(f);
+    lval_free(g);
+    lenv_free(e);
+    return 0;
+}
+
+// A body that is just a symbol is looked up without leaking the symbol
+static char *test_lambda_symbol_body() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_lambda(e, "id", "(fn (x) x)");
+    mu_assert("Identity should return its argument", eval_num(e, "(id 5)") == 5);
+    
+    long before = heap_in_use();
+    for (int i = 0; i < 10000; i++) {
+        lval_free(eval_string(e, "(id 5)"));
+    }
+    mu_assert("Calling a symbol-bodied lambda should not leak", heap_in_use() - before < 16384);
+    
+    lenv_free(e);
+    return 0;
+}
+
 // Run all lambda tests
 char *lambda_tests() {
     mu_run_test(test_lambda_creation);
@@ -219,6 +496,11 @@ char *lambda_tests() {
     mu_run_test(test_lambda_closure);
     mu_run_test(test_lambda_recursion);
     mu_run_test(test_lambda_errors);
+    mu_run_test(test_lambda_escape_analysis);
+    mu_run_test(test_lambda_frames);
+    mu_run_test(test_lambda_declare);
+    mu_run_test(test_lambda_layout);
+    mu_run_test(test_lambda_symbol_body);
     
     return 0;
 }
\ No newline at end of file
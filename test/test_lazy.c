@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+
+extern int tests_run;
+
+// Test promises evaluate once and keep their value
+static char *test_lazy_promise() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    lval_free(eval_string(e, "(def n 1)"));
+    lval_free(eval_string(e, "(def p (delay (+ n 1)))"));
+    
+    Lval *result = eval_string(e, "p");
+    mu_assert("delay should return a promise", result->type == LVAL_PROMISE);
+    lval_free(result);
+    
+    result = eval_string(e, "(force p)");
+    mu_assert("force should evaluate the promise", result->type == LVAL_NUM && result->num == 2);
+    lval_free(result);
+    
+    lval_free(eval_string(e, "(def n 10)"));
+    result = eval_string(e, "(force p)");
+    mu_assert("force should keep the first value", result->type == LVAL_NUM && result->num == 2);
+    lval_free(result);
+    
+    result = eval_string(e, "(force 5)");
+    mu_assert("force of a plain value should return it", result->type == LVAL_NUM && result->num == 5);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test ranges and lazy stages only produce the items consumed
+static char *test_lazy_ranges() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_lambda(e, "odd", "(fn (x) (% x 2))");
+    
+    Lval *result = eval_string(e, "(take 4 (lazy-filter odd (range-from 0)))");
+    mu_assert("Unbounded range should be filtered lazily", list_is(result, (long[]){1, 3, 5, 7}, 4));
+    lval_free(result);
+    
+    result = eval_string(e, "(take 5 (range 10 0 -3))");
+    mu_assert("Bounded range should stop at its end", list_is(result, (long[]){10, 7, 4, 1}, 4));
+    lval_free(result);
+    
+    result = eval_string(e, "(head (tail (tail (lazy-map - (range 5)))))");
+    mu_assert("head and tail should work on sequences", result->type == LVAL_NUM && result->num == -2);
+    lval_free(result);
+    
+    // A million items are never held at once
+    result = eval_string(e, "(fold + 0 (range 1000000))");
+    mu_assert("fold over a huge range should stream", result->type == LVAL_NUM && result->num == 499999500000L);
+    lval_free(result);
+    
+    result = eval_string(e, "(head (range 0))");
+    mu_assert("head of an empty range should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test recursive lazy-seq definitions
+static char *test_lazy_seq() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_lambda(e, "nat", "(fn (n) (lazy-seq (cons n (nat (+ n 1)))))");
+    
+    Lval *result = eval_string(e, "(take 3 (nat 5))");
+    mu_assert("Recursive lazy-seq should produce items on demand", list_is(result, (long[]){5, 6, 7}, 3));
+    lval_free(result);
+    
+    result = eval_string(e, "(fold + 0 (take 100000 (nat 1)))");
+    mu_assert("Long recursive sequence should be folded", result->type == LVAL_NUM && result->num == 5000050000L);
+    lval_free(result);
+    
+    result = eval_string(e, "(take 5 (lazy-seq (list 1 2)))");
+    mu_assert("lazy-seq of a list should yield its items", list_is(result, (long[]){1, 2}, 2));
+    lval_free(result);
+    
+    result = eval_string(e, "(take 2 (lazy-seq 5))");
+    mu_assert("lazy-seq of a number should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all lazy tests
+char *lazy_tests() {
+    mu_run_test(test_lazy_promise);
+    mu_run_test(test_lazy_ranges);
+    mu_run_test(test_lazy_seq);
+    
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+
+extern int tests_run;
+
+// Test lookups, updates and removal
+static char *test_map_basics() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def m (hash-map 'a 1 'b 2 (list 1 2) 3))"));
+    mu_assert("get should find a symbol key", eval_num(e, "(get m 'b)") == 2);
+    mu_assert("get should compare list keys structurally", eval_num(e, "(get m (list 1 2))") == 3);
+    mu_assert("len should count entries", eval_num(e, "(len m)") == 3);
+    mu_assert("contains? should see a key", eval_num(e, "(contains? m 'a)") == 1);
+    mu_assert("contains? should miss an absent key", eval_num(e, "(contains? m 'z)") == 0);
+    mu_assert("get should return the default for an absent key", eval_num(e, "(get m 'z 7)") == 7);
+    mu_assert("assoc should replace a value", eval_num(e, "(get (assoc m 'a 10) 'a)") == 10);
+    mu_assert("assoc of an existing key should keep the count", eval_num(e, "(len (assoc m 'a 10))") == 3);
+    mu_assert("dissoc should remove a key", eval_num(e, "(contains? (dissoc m 'a) 'a)") == 0);
+    mu_assert("Map should print its entries", eval_prints(e, "(hash-map 'k 5)", "{k 5}"));
+    mu_assert("keys should list every key", eval_num(e, "(len (keys m))") == 3);
+    mu_assert("vals should follow the order of keys",
+              eval_num(e, "(get m (head (keys m)))") == eval_num(e, "(head (vals m))"));
+    
+    Lval *result = eval_string(e, "(get m 'z)");
+    mu_assert("Missing key should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(hash-map 'a)");
+    mu_assert("Odd number of arguments should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(get (list 1) 1)");
+    mu_assert("get on a list should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test updates leave earlier versions alone and equality ignores history
+static char *test_map_persistence() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def m (hash-map 'a 1))"));
+    lval_free(eval_string(e, "(def n (assoc m 'b 2))"));
+    mu_assert("Old version should not see the new key", eval_num(e, "(contains? m 'b)") == 0);
+    mu_assert("New version should see both keys", eval_num(e, "(len n)") == 2);
+    
+    Lval *a = eval_string(e, "(dissoc (assoc n 'c 3) 'c 'b)");
+    Lval *b = eval_string(e, "m");
+    mu_assert("Maps with equal entries should be equal", lval_eq(a, b));
+    mu_assert("Equal maps should hash equally", lval_hash(a) == lval_hash(b));
+    lval_free(a);
+    lval_free(b);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test a map large enough to need several trie levels
+static char *test_map_large() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def m (hash-map 0 0))"));
+    for (int i = 1; i < 2000; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "(def m (assoc m %d %d))", i, i * i);
+        lval_free(eval_string(e, buf));
+    }
+    mu_assert("Every key should be counted", eval_num(e, "(len m)") == 2000);
+    mu_assert("Deep keys should be found", eval_num(e, "(get m 1999)") == 1999 * 1999);
+    
+    for (int i = 0; i < 2000; i += 2) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "(def m (dissoc m %d))", i);
+        lval_free(eval_string(e, buf));
+    }
+    mu_assert("Removed keys should be gone", eval_num(e, "(contains? m 1000)") == 0);
+    mu_assert("Other keys should remain", eval_num(e, "(get m 1001)") == 1001 * 1001);
+    mu_assert("Count should follow removals", eval_num(e, "(len m)") == 1000);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all map tests
+char *map_tests() {
+    mu_run_test(test_map_basics);
+    mu_run_test(test_map_persistence);
+    mu_run_test(test_map_large);
+    
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+
+extern int tests_run;
+
+// Test literal, wildcard and binding patterns
+static char *test_match_atoms() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *result = eval_string(e, "(match 2 (1 10) (2 20) (_ 30))");
+    mu_assert("Literal clause should match", result->type == LVAL_NUM && result->num == 20);
+    lval_free(result);
+    
+    result = eval_string(e, "(match 7 (1 10) (_ 30))");
+    mu_assert("Wildcard clause should match", result->type == LVAL_NUM && result->num == 30);
+    lval_free(result);
+    
+    result = eval_string(e, "(match (+ 1 2) (x (* x x)))");
+    mu_assert("Binding clause should bind the value", result->type == LVAL_NUM && result->num == 9);
+    lval_free(result);
+    
+    result = eval_string(e, "(match 5 (1 10) (2 20))");
+    mu_assert("Unmatched value should return error", result->type == LVAL_ERR);
+    mu_assert("Unmatched error should be correct", strstr(result->err, "No match") != NULL);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test list patterns destructure by position
+static char *test_match_lists() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *result = eval_string(e, "(match (list 1 2 3) ((a b) 0) ((a b c) (+ a b c)))");
+    mu_assert("List pattern should check length", result->type == LVAL_NUM && result->num == 6);
+    lval_free(result);
+    
+    result = eval_string(e, "(match (list 1 (list 2 3) 4) ((a (b c) _) (list c b a)))");
+    mu_assert("Nested pattern should return list", result->type == LVAL_SEXPR && result->sexpr.count == 3);
+    mu_assert("Nested pattern should bind by position",
+              result->sexpr.cell[0]->num == 3 && result->sexpr.cell[1]->num == 2 && result->sexpr.cell[2]->num == 1);
+    lval_free(result);
+    
+    result = eval_string(e, "(match (list 1 2 3 4) ((x & rest) rest))");
+    mu_assert("Rest pattern should bind the remaining items", result->type == LVAL_SEXPR && result->sexpr.count == 3);
+    mu_assert("Rest pattern should keep order", result->sexpr.cell[0]->num == 2 && result->sexpr.cell[2]->num == 4);
+    lval_free(result);
+    
+    result = eval_string(e, "(match () ((x & rest) 1) (() 0))");
+    mu_assert("Empty list should skip rest pattern needing one item", result->type == LVAL_NUM && result->num == 0);
+    lval_free(result);
+    
+    result = eval_string(e, "(match (list 0 5) ((1 x) x) ((0 x) (- x)) (_ 99))");
+    mu_assert("Literals inside lists should select the clause", result->type == LVAL_NUM && result->num == -5);
+    lval_free(result);
+    
+    result = eval_string(e, "(match 3 ((a b) a) (n n))");
+    mu_assert("List pattern should not match a number", result->type == LVAL_NUM && result->num == 3);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test compiled trees are reused and malformed clauses are rejected
+static char *test_match_errors() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    for (int i = 0; i < 3; i++) {
+        Lval *result = eval_string(e, "(match (list 4 5) ((a b) (* a b)))");
+        mu_assert("Repeated match should give the same result", result->type == LVAL_NUM && result->num == 20);
+        lval_free(result);
+    }
+    
+    Lval *result = eval_string(e, "(match 1 (1))");
+    mu_assert("Clause without body should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    result = eval_string(e, "(match (list 1 2) ((& a b) a))");
+    mu_assert("Misplaced rest should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    result = eval_string(e, "(match (list 1 2) ((x x) x))");
+    mu_assert("Repeated pattern variable should return error", result->type == LVAL_ERR);
+    mu_assert("Repeated variable error should name it", strstr(result->err, "'x' more than once") != NULL);
+    lval_free(result);
+    
+    result = eval_string(e, "(match (list 1 (list 2)) ((x & x) x))");
+    mu_assert("Rest reusing a variable should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    result = eval_string(e, "(match (head ()) (_ 1))");
+    mu_assert("Scrutinee error should propagate", result->type == LVAL_ERR);
+    mu_assert("Scrutinee error should be head's", strstr(result->err, "empty list") != NULL);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test quoted patterns compare with the value instead of destructuring it
+static char *test_match_quoted() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    mu_assert("Quoted symbol should match itself", eval_num(e, "(match 'a ('a 1) (_ 0))") == 1);
+    mu_assert("Quoted symbol should not match another", eval_num(e, "(match 'b ('a 1) (_ 0))") == 0);
+    mu_assert("Quoted symbol should not bind quote", eval_num(e, "(match (list 'quote 7) ('a 1) ((q x) x))") == 7);
+    mu_assert("Quoted list should compare whole",
+              eval_num(e, "(match (list 1 2) ('(1 3) 1) ('(1 2) 2) ((a b) 3))") == 2);
+    mu_assert("Quoted list should leave other shapes to later clauses",
+              eval_num(e, "(match (list 1 4) ('(1 2) 2) ((a b) b))") == 4);
+    mu_assert("Quoted items should select inside lists",
+              eval_num(e, "(match (list 'add 2 3) (('sub x y) (- x y)) (('add x y) (+ x y)))") == 5);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test each match form keeps its tree, and forms built at run time work
+static char *test_match_sites() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_lambda(e, "classify", "(fn (v) (match v (0 'zero) ((a b) 'pair) (_ 'other)))");
+    
+    mu_assert("Copies of a body should share its tree", eval_prints(e, "(classify 0)", "zero"));
+    mu_assert("Shared tree should pick by value", eval_prints(e, "(classify (list 1 2))", "pair"));
+    mu_assert("Shared tree should fall through", eval_prints(e, "(classify 5)", "other"));
+    
+    lval_free(eval_string(e, "(def pick (macro (p) `(match 2 (,p 'hit) (_ 'miss))))"));
+    mu_assert("Template filled one way should match", eval_prints(e, "(pick 2)", "hit"));
+    mu_assert("Template filled another way should not reuse that tree", eval_prints(e, "(pick 3)", "miss"));
+    
+    lval_free(eval_string(e, "(def twice (macro (v) (match v (n (* n 2)))))"));
+    mu_assert("Match built by expansion should compile when run", eval_num(e, "(twice 4)") == 8);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all match tests
+char *match_tests() {
+    mu_run_test(test_match_atoms);
+    mu_run_test(test_match_lists);
+    mu_run_test(test_match_errors);
+    mu_run_test(test_match_quoted);
+    mu_run_test(test_match_sites);
+    
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "pool.h"
+#include "typed.h"
+
+extern int tests_run;
+
+// Test building matrices and reading them back
+static char *test_matrix_build() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *r = eval_string(e, "(def a (matrix (list 1 2 3) (list 4 5.5 6)))");
+    lval_free(r);
+    
+    mu_assert("Matrix should print by rows", eval_prints(e, "a", "#mat((1.0 2.0 3.0) (4.0 5.5 6.0))"));
+    mu_assert("Matrix should take one list of rows",
+              eval_prints(e, "(matrix (list (list 1 2) (list 3 4)))", "#mat((1.0 2.0) (3.0 4.0))"));
+    mu_assert("Matrix should take f64vector rows",
+              eval_prints(e, "(matrix (f64vector 1 2) (list 3 4))", "#mat((1.0 2.0) (3.0 4.0))"));
+    mu_assert("make-matrix should fill", eval_prints(e, "(make-matrix 2 1 7)", "#mat((7.0) (7.0))"));
+    mu_assert("Ragged rows should be an error",
+              eval_prints(e, "(matrix (list 1 2) (list 3))", "Error: Function 'matrix' passed rows of different lengths!"));
+    mu_assert("shape should give rows and columns", eval_prints(e, "(shape a)", "(2 3)"));
+    mu_assert("len should count rows", eval_prints(e, "(len a)", "2"));
+    mu_assert("to-list should give lists of rows", eval_prints(e, "(to-list a)", "((1.0 2.0 3.0) (4.0 5.5 6.0))"));
+    mu_assert("mref should read an element", eval_prints(e, "(mref a 1 1)", "5.5"));
+    mu_assert("mref out of range should be an error",
+              eval_prints(e, "(mref a 2 0)", "Error: Function 'mref' passed an index out of range!"));
+    mu_assert("row should slice out a row", eval_prints(e, "(row a 1)", "#f64(4.0 5.5 6.0)"));
+    mu_assert("col should slice out a column", eval_prints(e, "(col a 2)", "#f64(3.0 6.0)"));
+    mu_assert("submatrix should copy a block", eval_prints(e, "(submatrix a 0 2 1 3)", "#mat((2.0 3.0) (5.5 6.0))"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test transpose, elementwise arithmetic and small products
+static char *test_matrix_ops() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *r = eval_string(e, "(def a (matrix (list 1 2 3) (list 4 5 6)))");
+    lval_free(r);
+    
+    mu_assert("transpose should swap rows and columns",
+              eval_prints(e, "(transpose a)", "#mat((1.0 4.0) (2.0 5.0) (3.0 6.0))"));
+    mu_assert("vadd should broadcast a number", eval_prints(e, "(vadd a 1)", "#mat((2.0 3.0 4.0) (5.0 6.0 7.0))"));
+    mu_assert("vmul should multiply elementwise", eval_prints(e, "(vmul a a)", "#mat((1.0 4.0 9.0) (16.0 25.0 36.0))"));
+    mu_assert("Elementwise shapes should match",
+              eval_prints(e, "(vadd a (transpose a))", "Error: Function 'vadd' passed matrices of different shapes!"));
+    mu_assert("matmul should multiply matrices",
+              eval_prints(e, "(matmul a (transpose a))", "#mat((14.0 32.0) (32.0 77.0))"));
+    mu_assert("Matrix times vector should be a vector", eval_prints(e, "(matmul a (f64vector 1 0 -1))", "#f64(-2.0 -2.0)"));
+    mu_assert("Vector times matrix should be a vector", eval_prints(e, "(matmul (f64vector 1 1) a)", "#f64(5.0 7.0 9.0)"));
+    mu_assert("Inner dimensions should match",
+              eval_prints(e, "(matmul a a)", "Error: Function 'matmul' passed matrices of mismatched shapes!"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Binds name to a rows x cols matrix of pseudo-random fractions
+static void def_random(Lenv *e, char *name, int rows, int cols, unsigned long seed) {
+    Lval *call = lval_sexpr();
+    lval_add(call, lval_sym("matrix"));
+    for (int i = 0; i < rows; i++) {
+        Lval *row = lval_sexpr();
+        lval_add(row, lval_sym("list"));
+        for (int j = 0; j < cols; j++) {
+            seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+            lval_add(row, lval_float((double)((long)(seed >> 33) % 20001 - 10000) / 37.0));
+        }
+        lval_add(call, row);
+    }
+    
+    Lval *sym = lval_sym(name);
+    Lval *m = eval(e, call);
+    lenv_put(e, sym, m);
+    lval_free(sym);
+    lval_free(m);
+}
+
+// Test a blocked product agrees with the naive one at every SIMD level
+// and on the pool
+static char *test_matrix_large() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_random(e, "a", 150, 130, 1);
+    def_random(e, "b", 130, 140, 2);
+    
+    Lval *row = eval_string(e, "(row a 17)");
+    Lval *col = eval_string(e, "(col b 101)");
+    int n;
+    double *x = typed_f64_data(row, &n);
+    double *y = typed_f64_data(col, &n);
+    double naive = 0;
+    for (int k = 0; k < n; k++) {
+        naive += x[k] * y[k];
+    }
+    lval_free(row);
+    lval_free(col);
+    
+    int level = typed_simd_level();
+    Lval *first = NULL;
+    for (int l = TYPED_SCALAR; l <= level; l++) {
+        typed_set_simd_level(l);
+        Lval *c = eval_string(e, "(matmul a b)");
+        mu_assert("Product should be a matrix", c->type == LVAL_MATRIX);
+        if (first == NULL) {
+            first = c;
+            continue;
+        }
+        int same = lval_eq(c, first);
+        lval_free(c);
+        mu_assert("Every SIMD level should give the same product", same);
+    }
+    
+    eval_set_parallel(4, 256);
+    long before = pool_tasks_run();
+    Lval *c = eval_string(e, "(matmul a b)");
+    mu_assert("Large products should use the pool", pool_tasks_run() > before);
+    mu_assert("Pooled product should match", lval_eq(c, first));
+    lval_free(c);
+    eval_set_parallel(0, 256);
+    
+    Lval *sym = lval_sym("c");
+    lenv_put(e, sym, first);
+    lval_free(sym);
+    lval_free(first);
+    Lval *v = eval_string(e, "(mref c 17 101)");
+    mu_assert("Product should match the naive sum", v->type == LVAL_FLOAT && v->fnum == naive);
+    lval_free(v);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all matrix tests
+char *matrix_tests() {
+    mu_run_test(test_matrix_build);
+    mu_run_test(test_matrix_ops);
+    mu_run_test(test_matrix_large);
+    
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "memo.h"
+
+extern int tests_run;
+
+// Builds (\ {n} {if (< n 2) n (+ (name (- n 1)) (name (- n 2)))})
+static Lval *fib_lambda(char *name) {
+    Lval *lambda = lval_sexpr();
+    lval_add(lambda, lval_sym("\\"));
+    lval_add(lambda, lval_sexpr());
+    lval_add(lambda->sexpr.cell[1], lval_sym("n"));
+    
+    Lval *body = lval_sexpr();
+    lval_add(body, lval_sym("if"));
+    lval_add(body, lval_sexpr());
+    lval_add(body->sexpr.cell[1], lval_sym("<"));
+    lval_add(body->sexpr.cell[1], lval_sym("n"));
+    lval_add(body->sexpr.cell[1], lval_num(2));
+    lval_add(body, lval_sym("n"));
+    
+    Lval *sum = lval_sexpr();
+    lval_add(sum, lval_sym("+"));
+    for (int i = 1; i <= 2; i++) {
+        Lval *call = lval_sexpr();
+        lval_add(call, lval_sym(name));
+        lval_add(call, lval_sexpr());
+        lval_add(call->sexpr.cell[1], lval_sym("-"));
+        lval_add(call->sexpr.cell[1], lval_sym("n"));
+        lval_add(call->sexpr.cell[1], lval_num(i));
+        lval_add(sum, call);
+    }
+    lval_add(body, sum);
+    lval_add(lambda, body);
+    return lambda;
+}
+
+// Test structural hashing and equality
+static char *test_memo_hash_eq() {
+    Lval *a = lval_sexpr();
+    lval_add(a, lval_num(1));
+    lval_add(a, lval_sym("x"));
+    Lval *b = lval_copy(a);
+    
+    mu_assert("Equal values should compare equal", lval_eq(a, b));
+    mu_assert("Equal values should hash equally", lval_hash(a) == lval_hash(b));
+    
+    lval_add(b, lval_num(2));
+    mu_assert("Different values should not compare equal", !lval_eq(a, b));
+    
+    lval_free(a);
+    lval_free(b);
+    return 0;
+}
+
+// Test the cache evicts the least recently used entry
+static char *test_memo_lru() {
+    Lmemo *m = lmemo_new(2);
+    Lval *k1 = lval_num(1);
+    Lval *k2 = lval_num(2);
+    Lval *k3 = lval_num(3);
+    
+    lmemo_put(m, k1, k1);
+    lmemo_put(m, k2, k2);
+    
+    // Touch k1 so k2 becomes the oldest
+    Lval *hit = lmemo_get(m, k1);
+    mu_assert("Cached entry should be found", hit != NULL && hit->num == 1);
+    lval_free(hit);
+    
+    lmemo_put(m, k3, k3);
+    mu_assert("Cache should stay bounded", lmemo_count(m) == 2);
+    
+    hit = lmemo_get(m, k2);
+    mu_assert("Least recently used entry should be evicted", hit == NULL);
+    hit = lmemo_get(m, k1);
+    mu_assert("Recently used entry should survive", hit != NULL);
+    lval_free(hit);
+    
+    lval_free(k1);
+    lval_free(k2);
+    lval_free(k3);
+    lmemo_release(m);
+    return 0;
+}
+
+// Test purity analysis
+static char *test_memo_purity() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    // (def fib (\ ...)) recursing through its own name is pure
+    Lval *def_expr = lval_sexpr();
+    lval_add(def_expr, lval_sym("def"));
+    lval_add(def_expr, lval_sym("fib"));
+    lval_add(def_expr, fib_lambda("fib"));
+    Lval *result = eval(e, def_expr);
+    mu_assert("Self-recursive arithmetic lambda should be pure", result->type == LVAL_LAMBDA && result->lambda.closure->pure);
+    lval_free(result);
+    
+    // (\ {f x} {f x}) calls an argument, so it is impure
+    Lval *apply = lval_sexpr();
+    lval_add(apply, lval_sym("\\"));
+    lval_add(apply, lval_sexpr());
+    lval_add(apply->sexpr.cell[1], lval_sym("f"));
+    lval_add(apply->sexpr.cell[1], lval_sym("x"));
+    lval_add(apply, lval_sexpr());
+    lval_add(apply->sexpr.cell[2], lval_sym("f"));
+    lval_add(apply->sexpr.cell[2], lval_sym("x"));
+    result = eval(e, apply);
+    mu_assert("Lambda calling an argument should be impure", result->type == LVAL_LAMBDA && !result->lambda.closure->pure);
+    
+    // (memoize apply) is rejected
+    Lval *call = lval_sexpr();
+    lval_add(call, lval_sym("memoize"));
+    lval_add(call, result);
+    result = eval(e, call);
+    mu_assert("Memoizing an impure lambda should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test def-memo makes naive recursion linear
+static char *test_memo_def_memo() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *def_expr = lval_sexpr();
+    lval_add(def_expr, lval_sym("def-memo"));
+    lval_add(def_expr, lval_sym("fib"));
+    lval_add(def_expr, fib_lambda("fib"));
+    Lval *result = eval(e, def_expr);
+    mu_assert("def-memo should return lambda", result->type == LVAL_LAMBDA);
+    mu_assert("def-memo should attach a cache", result->lambda.closure->memo != NULL);
+    lval_free(result);
+    
+    // (fib 60) would take hours without the cache
+    Lval *call = lval_sexpr();
+    lval_add(call, lval_sym("fib"));
+    lval_add(call, lval_num(60));
+    result = eval(e, call);
+    mu_assert("Memoized fib should return number", result->type == LVAL_NUM);
+    mu_assert("fib 60 should be 1548008755920", result->num == 1548008755920L);
+    lval_free(result);
+    
+    Lval *fib = lval_sym("fib");
+    Lval *f = lenv_get(e, fib);
+    mu_assert("Every subcall should be cached", lmemo_count(f->lambda.closure->memo) == 61);
+    lval_free(f);
+    lval_free(fib);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test purity follows callees that are redefined after a caller was judged
+static char *test_memo_redefined_callee() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    lval_free(eval_string(e, "(def t (transient ()))"));
+    def_lambda(e, "g", "(fn (x) (+ x 1))");
+    def_lambda(e, "h", "(fn (x) (g x))");
+    lval_free(eval_string(e, "(def mh (memoize h))"));
+    mu_assert("Memoized caller should use g", eval_num(e, "(mh 1)") == 2);
+    
+    def_lambda(e, "g", "(fn (x) (+ x 100))");
+    mu_assert("Redefining a pure callee should drop stale results", eval_num(e, "(mh 1)") == 101);
+    
+    def_lambda(e, "g", "(fn (x) (push! t x))");
+    lval_free(eval_string(e, "(mh 1)"));
+    lval_free(eval_string(e, "(mh 1)"));
+    mu_assert("Impure callee should run on every call", eval_prints(e, "t", "<transient list 2>"));
+    
+    Lval *result = eval_string(e, "(memoize h)");
+    mu_assert("Caller of an impure callee should not memoize", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    // Mutual recursion is judged as a whole
+    def_lambda(e, "ev", "(fn (n) (if (= n 0) 1 (od (- n 1))))");
+    def_lambda(e, "od", "(fn (n) (if (= n 0) 0 (ev (- n 1))))");
+    result = eval_string(e, "ev");
+    mu_assert("Mutually recursive arithmetic should be pure", lval_is_pure_fun(result));
+    lval_free(result);
+    
+    def_lambda(e, "od", "(fn (n) (if (= n 0) (push! t n) (ev (- n 1))))");
+    result = eval_string(e, "ev");
+    mu_assert("Cycle through an impure lambda should be impure", !lval_is_pure_fun(result));
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all memo tests
+char *memo_tests() {
+    mu_run_test(test_memo_hash_eq);
+    mu_run_test(test_memo_lru);
+    mu_run_test(test_memo_purity);
+    mu_run_test(test_memo_def_memo);
+    mu_run_test(test_memo_redefined_callee);
+    
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "pool.h"
+
+extern int tests_run;
+
+// Defines (def sumto (\ {n} {if (= n 0) 0 (+ n (sumto (- n 1)))}))
+static void def_sumto(Lenv *e) {
+    Lval *body = lval_sexpr();
+    lval_add(body, lval_sym("if"));
+    lval_add(body, lval_sexpr());
+    lval_add(body->sexpr.cell[1], lval_sym("="));
+    lval_add(body->sexpr.cell[1], lval_sym("n"));
+    lval_add(body->sexpr.cell[1], lval_num(0));
+    lval_add(body, lval_num(0));
+    lval_add(body, lval_sexpr());
+    lval_add(body->sexpr.cell[3], lval_sym("+"));
+    lval_add(body->sexpr.cell[3], lval_sym("n"));
+    lval_add(body->sexpr.cell[3], lval_sexpr());
+    lval_add(body->sexpr.cell[3]->sexpr.cell[2], lval_sym("sumto"));
+    lval_add(body->sexpr.cell[3]->sexpr.cell[2], lval_sexpr());
+    lval_add(body->sexpr.cell[3]->sexpr.cell[2]->sexpr.cell[1], lval_sym("-"));
+    lval_add(body->sexpr.cell[3]->sexpr.cell[2]->sexpr.cell[1], lval_sym("n"));
+    lval_add(body->sexpr.cell[3]->sexpr.cell[2]->sexpr.cell[1], lval_num(1));
+    
+    Lval *def_expr = lval_sexpr();
+    lval_add(def_expr, lval_sym("def"));
+    lval_add(def_expr, lval_sym("sumto"));
+    lval_add(def_expr, lval_sexpr());
+    lval_add(def_expr->sexpr.cell[2], lval_sym("\\"));
+    lval_add(def_expr->sexpr.cell[2], lval_sexpr());
+    lval_add(def_expr->sexpr.cell[2]->sexpr.cell[1], lval_sym("n"));
+    lval_add(def_expr->sexpr.cell[2], body);
+    lval_free(eval(e, def_expr));
+}
+
+static Lval *sumto_call(long n) {
+    Lval *call = lval_sexpr();
+    lval_add(call, lval_sym("sumto"));
+    lval_add(call, lval_num(n));
+    return call;
+}
+
+// Test pure arguments are forked and results keep their positions
+static char *test_parallel_ordering() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_sumto(e);
+    eval_set_parallel(4, 1);
+    
+    long before = pool_tasks_run();
+    
+    // (list (sumto 200) (sumto 300) (sumto 400))
+    Lval *expr = lval_sexpr();
+    lval_add(expr, lval_sym("list"));
+    lval_add(expr, sumto_call(200));
+    lval_add(expr, sumto_call(300));
+    lval_add(expr, sumto_call(400));
+    
+    Lval *result = eval(e, expr);
+    mu_assert("Parallel call should return list", result->type == LVAL_SEXPR);
+    mu_assert("Parallel call should keep every argument", result->sexpr.count == 3);
+    mu_assert("First result should be 20100", result->sexpr.cell[0]->num == 20100);
+    mu_assert("Second result should be 45150", result->sexpr.cell[1]->num == 45150);
+    mu_assert("Third result should be 80200", result->sexpr.cell[2]->num == 80200);
+    mu_assert("All but one heavy argument should run on the pool", pool_tasks_run() - before == 2);
+    lval_free(result);
+    
+    eval_set_parallel(0, 256);
+    lenv_free(e);
+    return 0;
+}
+
+// Test the first error by position wins, as in the sequential path
+static char *test_parallel_errors() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_sumto(e);
+    eval_set_parallel(4, 1);
+    
+    // (list (sumto 10) (/ (sumto 5) 0) (head (list)))
+    Lval *expr = lval_sexpr();
+    lval_add(expr, lval_sym("list"));
+    lval_add(expr, sumto_call(10));
+    lval_add(expr, lval_sexpr());
+    lval_add(expr->sexpr.cell[2], lval_sym("/"));
+    lval_add(expr->sexpr.cell[2], sumto_call(5));
+    lval_add(expr->sexpr.cell[2], lval_num(0));
+    lval_add(expr, lval_sexpr());
+    lval_add(expr->sexpr.cell[3], lval_sym("head"));
+    lval_add(expr->sexpr.cell[3], lval_sexpr());
+    lval_add(expr->sexpr.cell[3]->sexpr.cell[1], lval_sym("list"));
+    
+    Lval *result = eval(e, expr);
+    mu_assert("Parallel call should return error", result->type == LVAL_ERR);
+    mu_assert("First error by position should win", strstr(result->err, "Division by zero") != NULL);
+    lval_free(result);
+    
+    eval_set_parallel(0, 256);
+    lenv_free(e);
+    return 0;
+}
+
+// Test impure arguments keep the whole call sequential
+static char *test_parallel_impure() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_sumto(e);
+    eval_set_parallel(4, 1);
+    
+    long before = pool_tasks_run();
+    
+    // (list (sumto 20) (def y 1) (sumto 30))
+    Lval *expr = lval_sexpr();
+    lval_add(expr, lval_sym("list"));
+    lval_add(expr, sumto_call(20));
+    lval_add(expr, lval_sexpr());
+    lval_add(expr->sexpr.cell[2], lval_sym("def"));
+    lval_add(expr->sexpr.cell[2], lval_sym("y"));
+    lval_add(expr->sexpr.cell[2], lval_num(1));
+    lval_add(expr, sumto_call(30));
+    
+    Lval *result = eval(e, expr);
+    mu_assert("Impure call should return list", result->type == LVAL_SEXPR && result->sexpr.count == 3);
+    mu_assert("Impure call should not use the pool", pool_tasks_run() == before);
+    lval_free(result);
+    
+    eval_set_parallel(0, 256);
+    lenv_free(e);
+    return 0;
+}
+
+// Test the default threshold forks calls into recursive lambdas but not
+// cheap ones
+static char *test_parallel_default_threshold() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_sumto(e);
+    def_lambda(e, "sq", "(fn (x) (* x x))");
+    def_lambda(e, "sumsq", "(fn (x y) (+ (sq x) (sq y)))");
+    eval_set_parallel(4, 256);
+    
+    long before = pool_tasks_run();
+    mu_assert("Recursive calls should keep their results",
+              eval_prints(e, "(list (sumto 100) (sumto 200))", "(5050 20100)"));
+    mu_assert("Recursive calls should cross the default threshold", pool_tasks_run() - before == 1);
+    
+    before = pool_tasks_run();
+    mu_assert("Cheap calls should keep their results",
+              eval_prints(e, "(list (sumsq 1 2) (sumsq 3 4) (+ 1 2))", "(5 25 3)"));
+    mu_assert("Calls into lambdas that only call builtins should stay sequential",
+              pool_tasks_run() == before);
+    
+    eval_set_parallel(0, 256);
+    lenv_free(e);
+    return 0;
+}
+
+// Run all parallel tests
+char *parallel_tests() {
+    mu_run_test(test_parallel_ordering);
+    mu_run_test(test_parallel_errors);
+    mu_run_test(test_parallel_impure);
+    mu_run_test(test_parallel_default_threshold);
+    
+    return 0;
+}
@@ -33,9 +33,34 @@ char *test_parse_invalid() {
     return NULL;
 }
 
+char *test_parse_quote() {
+    AstNode *node = parse_string("(f 'x `(a ,b ,@c))");
+    mu_assert("Error: should parse quoted forms", node != NULL && node->type == AST_SEXPR);
+    mu_assert("Error: should keep three elements", node->sexpr.count == 3);
+    
+    AstNode *quoted = node->sexpr.children[1];
+    mu_assert("Error: 'x should read as a two element list", quoted->type == AST_SEXPR && quoted->sexpr.count == 2);
+    mu_assert("Error: 'x should start with quote", strcmp(quoted->sexpr.children[0]->symbol, "quote") == 0);
+    
+    AstNode *template = node->sexpr.children[2];
+    mu_assert("Error: backquote should read as quasiquote", strcmp(template->sexpr.children[0]->symbol, "quasiquote") == 0);
+    AstNode *body = template->sexpr.children[1];
+    mu_assert("Error: comma should read as unquote", strcmp(body->sexpr.children[1]->sexpr.children[0]->symbol, "unquote") == 0);
+    mu_assert("Error: comma-at should read as unquote-splicing",
+              strcmp(body->sexpr.children[2]->sexpr.children[0]->symbol, "unquote-splicing") == 0);
+    ast_free(node);
+    
+    node = parse_string("(a ')");
+    mu_assert("Error: dangling quote should return error node", node != NULL && node->type == AST_ERROR);
+    ast_free(node);
+    
+    return NULL;
+}
+
 char *parser_tests() {
     mu_run_test(test_parse_number);
     mu_run_test(test_parse_symbol);
     mu_run_test(test_parse_invalid);
+    mu_run_test(test_parse_quote);
     return NULL;
 }
\ No newline at end of file
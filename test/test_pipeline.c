@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+
+extern int tests_run;
+
+// Reads "(fn ...)" and evaluates it as the lambda "(\ ...)"
+static Lval *eval_lambda(Lenv *e, const char *input) {
+    Lval *lambda = read_string(input);
+    lval_free(lambda->sexpr.cell[0]);
+    lambda->sexpr.cell[0] = lval_sym("\\");
+    return eval(e, lambda);
+}
+
+// Test each stage on its own
+static char *test_pipeline_stages() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_lambda(e, "odd", "(fn (x) (% x 2))");
+    lval_free(eval_string(e, "(def xs '(1 2 3 4 5))"));
+    
+    Lval *result = eval_string(e, "(map - xs)");
+    mu_assert("map should apply to every item", list_is(result, (long[]){-1, -2, -3, -4, -5}, 5));
+    lval_free(result);
+    
+    result = eval_string(e, "(filter odd xs)");
+    mu_assert("filter should keep truthy items", list_is(result, (long[]){1, 3, 5}, 3));
+    lval_free(result);
+    
+    result = eval_string(e, "(fold - 100 xs)");
+    mu_assert("fold should accumulate from the left", result->type == LVAL_NUM && result->num == 85);
+    lval_free(result);
+    
+    result = eval_string(e, "(take 2 xs)");
+    mu_assert("take should keep a prefix", list_is(result, (long[]){1, 2}, 2));
+    lval_free(result);
+    
+    result = eval_string(e, "(map 5 xs)");
+    mu_assert("map of a non-function should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test a fused pipeline gives the same result as separate stages
+static char *test_pipeline_fused() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    def_lambda(e, "odd", "(fn (x) (% x 2))");
+    def_lambda(e, "sq", "(fn (x) (* x x))");
+    lval_free(eval_string(e, "(def xs '(1 2 3 4 5 6 7))"));
+    
+    Lval *fused = eval_string(e, "(fold + 0 (map sq (filter odd xs)))");
+    
+    lval_free(eval_string(e, "(def ys (filter odd xs))"));
+    lval_free(eval_string(e, "(def zs (map sq ys))"));
+    Lval *staged = eval_string(e, "(fold + 0 zs)");
+    
+    mu_assert("Fused pipeline should return number", fused->type == LVAL_NUM && fused->num == 84);
+    mu_assert("Fused pipeline should match separate stages", lval_eq(fused, staged));
+    lval_free(fused);
+    lval_free(staged);
+    
+    Lval *result = eval_string(e, "(take 2 (map sq (filter odd xs)))");
+    mu_assert("take should cut a fused pipeline", list_is(result, (long[]){1, 9}, 2));
+    lval_free(result);
+    
+    // A lambda calling map with a pure function stays pure
+    Lval *f = eval_lambda(e, "(fn (l) (fold + 0 (map sq l)))");
+    mu_assert("map of a pure function should be pure", f->type == LVAL_LAMBDA && f->lambda.closure->pure);
+    lval_free(f);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test errors come from the earliest failing stage, as when run separately
+static char *test_pipeline_errors() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    // The outer head fails on 2 before the inner head reaches ()
+    Lval *result = eval_string(e, "(map head (map head '(((1)) (2) ())))");
+    mu_assert("Pipeline should return error", result->type == LVAL_ERR);
+    mu_assert("Earliest stage's error should win", strstr(result->err, "empty list") != NULL);
+    lval_free(result);
+    
+    result = eval_string(e, "(map 5 (filter + '(1 2)))");
+    mu_assert("Bad stage function should return error", result->type == LVAL_ERR);
+    mu_assert("Bad stage error should name the stage", strstr(result->err, "'map'") != NULL);
+    lval_free(result);
+    
+    result = eval_string(e, "(map - (map - 5))");
+    mu_assert("Non-list source should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all pipeline tests
+char *pipeline_tests() {
+    mu_run_test(test_pipeline_stages);
+    mu_run_test(test_pipeline_fused);
+    mu_run_test(test_pipeline_errors);
+    
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+
+extern int tests_run;
+
+// Test the list functions work on persistent vectors
+static char *test_pvec_basics() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def p (pvec 1 2 3))"));
+    mu_assert("Persistent vector should print with a hash", eval_prints(e, "p", "#[1 2 3]"));
+    mu_assert("cons should prepend", eval_prints(e, "(cons 0 p)", "#[0 1 2 3]"));
+    mu_assert("tail should drop the first item", eval_prints(e, "(tail p)", "#[2 3]"));
+    mu_assert("head should read the first item", eval_num(e, "(head p)") == 1);
+    mu_assert("join should concatenate", eval_prints(e, "(join p (list 4) p)", "#[1 2 3 4 1 2 3]"));
+    mu_assert("slice should cut a range", eval_prints(e, "(slice p 1 3)", "#[2 3]"));
+    mu_assert("nth should index", eval_num(e, "(nth p 2)") == 3);
+    mu_assert("len should count", eval_num(e, "(len (tail (tail (tail p))))") == 0);
+    mu_assert("to-list should convert back", eval_prints(e, "(to-list p)", "(1 2 3)"));
+    mu_assert("to-pvec should convert a vector", eval_prints(e, "(to-pvec (vector 5 6))", "#[5 6]"));
+    
+    Lval *result = eval_string(e, "(head (slice p 0 0))");
+    mu_assert("head of an empty vector should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(nth p 3)");
+    mu_assert("Index past the end should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(join p 1)");
+    mu_assert("Joining a number should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test new versions leave the old ones untouched
+static char *test_pvec_persistence() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def p (to-pvec (list 1 2 3 4 5 6 7 8 9 10)))"));
+    lval_free(eval_string(e, "(def q (cons 0 (tail p)))"));
+    mu_assert("New version should see its change", eval_num(e, "(head q)") == 0);
+    mu_assert("Old version should keep its items", eval_num(e, "(head p)") == 1);
+    mu_assert("Versions should share their other items", eval_num(e, "(nth q 9)") == 10);
+    
+    Lval *a = eval_string(e, "(join (pvec 1 2) (pvec 3))");
+    Lval *b = eval_string(e, "(tail (pvec 0 1 2 3))");
+    mu_assert("Equal contents should compare equal", lval_eq(a, b));
+    mu_assert("Equal contents should hash equally", lval_hash(a) == lval_hash(b));
+    lval_free(a);
+    lval_free(b);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test long vectors built by repeated cons and join keep their order
+static char *test_pvec_large() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def p (to-pvec ()))"));
+    for (int i = 999; i >= 0; i--) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "(def p (cons %d p))", i);
+        lval_free(eval_string(e, buf));
+    }
+    mu_assert("cons should build the whole vector", eval_num(e, "(len p)") == 1000);
+    mu_assert("cons should keep the order", eval_num(e, "(nth p 617)") == 617);
+    
+    lval_free(eval_string(e, "(def q (join p p p))"));
+    mu_assert("join should add lengths", eval_num(e, "(len q)") == 3000);
+    mu_assert("join should keep the order", eval_num(e, "(nth q 2999)") == 999);
+    mu_assert("slice should index into the middle", eval_num(e, "(head (slice q 1500 2500))") == 500);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all persistent vector tests
+char *pvec_tests() {
+    mu_run_test(test_pvec_basics);
+    mu_run_test(test_pvec_persistence);
+    mu_run_test(test_pvec_large);
+    
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+
+extern int tests_run;
+
+// Test quote returns its datum unevaluated
+static char *test_quote_datum() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *result = eval_string(e, "'(+ 1 2)");
+    mu_assert("Quoted list should not be evaluated", result->type == LVAL_SEXPR && result->sexpr.count == 3);
+    mu_assert("Quoted list should keep its symbols", result->sexpr.cell[0]->type == LVAL_SYM);
+    lval_free(result);
+    
+    result = eval_string(e, "'undefined");
+    mu_assert("Quoted symbol should not be looked up", result->type == LVAL_SYM);
+    mu_assert("Quoted symbol should keep its name", strcmp(result->sym, "undefined") == 0);
+    lval_free(result);
+    
+    result = eval_string(e, "(head '(7 8))");
+    mu_assert("Quoted list should be usable as data", result->type == LVAL_NUM && result->num == 7);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test unquote and splicing fill a quasiquote template
+static char *test_quasiquote_fill() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    lval_free(eval_string(e, "(def x 5)"));
+    
+    Lval *result = eval_string(e, "`(a ,x ,@(list 1 2) (b ,(* x 2)) c)");
+    mu_assert("Template should return list", result->type == LVAL_SEXPR);
+    mu_assert("Splice should add its items in place", result->sexpr.count == 6);
+    mu_assert("Unquote should insert the value", result->sexpr.cell[1]->num == 5);
+    mu_assert("Splice should keep order", result->sexpr.cell[2]->num == 1 && result->sexpr.cell[3]->num == 2);
+    mu_assert("Nested unquote should be filled", result->sexpr.cell[4]->sexpr.cell[1]->num == 10);
+    mu_assert("Constant parts should be kept", strcmp(result->sexpr.cell[5]->sym, "c") == 0);
+    lval_free(result);
+    
+    result = eval_string(e, "`(,@() z)");
+    mu_assert("Empty splice should add nothing", result->type == LVAL_SEXPR && result->sexpr.count == 1);
+    lval_free(result);
+    
+    result = eval_string(e, "`(,@x)");
+    mu_assert("Splicing a number should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    result = eval_string(e, "`,@x");
+    mu_assert("Splicing outside a list should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test macros written as templates and template purity
+static char *test_quasiquote_macro() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    lval_free(eval_string(e, "(def unless (macro (c a b) `(if ,c ,b ,a)))"));
+    
+    Lval *result = eval_string(e, "(unless (= 1 2) 10 20)");
+    mu_assert("Template macro should expand and evaluate", result->type == LVAL_NUM && result->num == 10);
+    lval_free(result);
+    
+    result = eval_string(e, "(unless (= 1 1) (head ()) 10)");
+    mu_assert("Template macro should only evaluate the chosen branch", result->type == LVAL_NUM && result->num == 10);
+    lval_free(result);
+    
+    // (\ (n) `(,n ,(* n n))) builds data from pure parts only
+    Lval *lambda = read_string("(fn (n) `(,n ,(* n n)))");
+    lval_free(lambda->sexpr.cell[0]);
+    lambda->sexpr.cell[0] = lval_sym("\\");
+    Lval *f = eval(e, lambda);
+    mu_assert("Lambda building a template should be pure", f->type == LVAL_LAMBDA && f->lambda.closure->pure);
+    
+    Lval *call = lval_sexpr();
+    lval_add(call, f);
+    lval_add(call, lval_num(3));
+    result = eval(e, call);
+    mu_assert("Template lambda should return list", result->type == LVAL_SEXPR && result->sexpr.count == 2);
+    mu_assert("Template lambda should fill both slots", result->sexpr.cell[0]->num == 3 && result->sexpr.cell[1]->num == 9);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test inner templates keep their unquotes until their own level
+static char *test_quasiquote_nested() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    lval_free(eval_string(e, "(def x 5)"));
+    
+    mu_assert("Inner unquote should stay quoted",
+              eval_prints(e, "`(a `(b ,(c ,(+ 1 2))))", "(a (quasiquote (b (unquote (c 3)))))"));
+    mu_assert("Outer level should still be filled",
+              eval_prints(e, "`(,x `(,y ,,x))", "(5 (quasiquote ((unquote y) (unquote 5))))"));
+    mu_assert("Inner splice should stay quoted",
+              eval_prints(e, "`(a `(,@(b ,x)))", "(a (quasiquote ((unquote-splicing (b 5)))))"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all quote tests
+char *quote_tests() {
+    mu_run_test(test_quote_datum);
+    mu_run_test(test_quasiquote_fill);
+    mu_run_test(test_quasiquote_macro);
+    mu_run_test(test_quasiquote_nested);
+    
+    return 0;
+}
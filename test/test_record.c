@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+
+extern int tests_run;
+
+// Test constructors, accessors, predicates and printing
+static char *test_record_basics() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *result = eval_string(e, "(defstruct point x y)");
+    mu_assert("defstruct should return the type", result->type == LVAL_RECFN);
+    lval_free(result);
+    
+    lval_free(eval_string(e, "(def p (make-point 3 (list 1 2)))"));
+    mu_assert("Accessor should read the first field", eval_num(e, "(point-x p)") == 3);
+    mu_assert("Accessor should read a list field", eval_num(e, "(head (tail (point-y p)))") == 2);
+    mu_assert("Type name should construct too", eval_num(e, "(point-y (point 1 9))") == 9);
+    mu_assert("Predicate should accept its records", eval_num(e, "(point? p)") == 1);
+    mu_assert("Predicate should reject other values", eval_num(e, "(point? 3)") == 0);
+    
+    lval_free(eval_string(e, "(defstruct size x y)"));
+    mu_assert("Predicate should reject other structs with the same fields", eval_num(e, "(point? (size 1 2))") == 0);
+    
+    result = eval_string(e, "(size-x p)");
+    mu_assert("Accessor on another struct should return error", result->type == LVAL_ERR);
+    mu_assert("Accessor error should name the accessor", strstr(result->err, "size-x") != NULL);
+    lval_free(result);
+    
+    result = eval_string(e, "(make-point 1)");
+    mu_assert("Constructor arity should be checked", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    result = eval_string(e, "(point 1 (point 2 3))");
+    char *str = lval_to_string(result);
+    mu_assert("Record should print with its type", strcmp(str, "<point 1 <point 2 3>>") == 0);
+    free(str);
+    lval_free(result);
+    
+    result = eval_string(e, "(defstruct bad x x)");
+    mu_assert("Repeated field should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test setters leave shared records alone and records compare by value
+static char *test_record_setters() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(defstruct point x y)"));
+    lval_free(eval_string(e, "(def p (point 1 2))"));
+    lval_free(eval_string(e, "(def q (set-point-x p 10))"));
+    mu_assert("Setter should return the updated record", eval_num(e, "(point-x q)") == 10);
+    mu_assert("Setter should keep the other fields", eval_num(e, "(point-y q)") == 2);
+    mu_assert("Setter should not change a shared record", eval_num(e, "(point-x p)") == 1);
+    mu_assert("Fresh record should be updated directly", eval_num(e, "(point-y (set-point-y (point 1 2) 5))") == 5);
+    
+    Lval *a = eval_string(e, "(point 1 (list 2 3))");
+    Lval *b = eval_string(e, "(point 1 (list 2 3))");
+    mu_assert("Records with equal fields should be equal", lval_eq(a, b));
+    mu_assert("Equal records should hash equally", lval_hash(a) == lval_hash(b));
+    lval_free(b);
+    b = eval_string(e, "(point 1 (list 2 4))");
+    mu_assert("Records with different fields should differ", !lval_eq(a, b));
+    lval_free(a);
+    lval_free(b);
+    
+    // Repeating the definition keeps the type
+    lval_free(eval_string(e, "(defstruct point x y)"));
+    mu_assert("Identical redefinition should keep old records valid", eval_num(e, "(point? p)") == 1);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test generated functions are pure and dispatch on struct types
+static char *test_record_functions() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(defstruct point x y)"));
+    lval_free(eval_string(e, "(defstruct circle r)"));
+    mu_assert("Accessor should map over records",
+              eval_num(e, "(fold + 0 (map point-x (list (point 1 0) (point 2 0) (point 3 0))))") == 6);
+    
+    Lval *result = eval_string(e, "(\\ (p) (+ (point-x p) (point-y p)))");
+    mu_assert("Lambda using accessors should be pure", result->type == LVAL_LAMBDA && result->lambda.closure->pure);
+    lval_free(result);
+    
+    lval_free(eval_string(e, "(defgeneric area)"));
+    lval_free(eval_string(e, "(defmethod area ((s point)) 0)"));
+    lval_free(eval_string(e, "(defmethod area ((s circle)) (* 3 (* (circle-r s) (circle-r s))))"));
+    mu_assert("Generic should dispatch on struct type", eval_num(e, "(area (circle 2))") == 12);
+    mu_assert("Generic should tell structs apart", eval_num(e, "(area (point 5 5))") == 0);
+    
+    result = eval_string(e, "(area 3)");
+    mu_assert("Non-record should not match a struct method", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all record tests
+char *record_tests() {
+    mu_run_test(test_record_basics);
+    mu_run_test(test_record_setters);
+    mu_run_test(test_record_functions);
+    
+    return 0;
+}
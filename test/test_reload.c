@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "memo.h"
+
+extern int tests_run;
+
+#define RELOAD_PATH "/tmp/lispy_test_reload.lisp"
+
+static void write_source(const char *text) {
+    FILE *f = fopen(RELOAD_PATH, "w");
+    fputs(text, f);
+    fclose(f);
+}
+
+static int lists_sym(Lval *v, char *sym) {
+    for (int i = 0; i < v->sexpr.count; i++) {
+        if (strcmp(v->sexpr.cell[i]->sym, sym) == 0) return 1;
+    }
+    return 0;
+}
+
+// Test only changed definitions and those mentioning them are evaluated
+static char *test_reload_changes() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    write_source("(def rate 3)\n"
+                 "(def price (* rate 10))\n"
+                 "(def other (+ 1 2))\n"
+                 "(def scale (\\ (x) (* x rate)))\n");
+    Lval *result = eval_string(e, "(reload '" RELOAD_PATH ")");
+    mu_assert("First reload should list every definition", result->type == LVAL_SEXPR && result->sexpr.count == 4);
+    lval_free(result);
+    mu_assert("Definitions should be bound", eval_num(e, "price") == 30);
+    
+    result = eval_string(e, "(reload '" RELOAD_PATH ")");
+    mu_assert("Unchanged file should evaluate nothing", result->type == LVAL_SEXPR && result->sexpr.count == 0);
+    lval_free(result);
+    
+    write_source("(def rate 4)\n"
+                 "(def price (* rate 10))\n"
+                 "(def other (+ 1 2))\n"
+                 "(def scale (\\ (x) (* x rate)))\n");
+    result = eval_string(e, "(reload '" RELOAD_PATH ")");
+    mu_assert("Changed definition should be evaluated", lists_sym(result, "rate"));
+    mu_assert("Dependents should be evaluated", lists_sym(result, "price") && lists_sym(result, "scale"));
+    mu_assert("Unrelated definition should be kept", !lists_sym(result, "other"));
+    lval_free(result);
+    mu_assert("Dependent should see the new value", eval_num(e, "price") == 40);
+    mu_assert("Lambda should see the new value", eval_num(e, "(scale 2)") == 8);
+    
+    lenv_free(e);
+    remove(RELOAD_PATH);
+    return 0;
+}
+
+// Test memo tables of callers outside the file are cleared
+static char *test_reload_callers() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    write_source("(def step (\\ (x) (+ x 1)))\n");
+    lval_free(eval_string(e, "(reload '" RELOAD_PATH ")"));
+    lval_free(eval_string(e, "(def-memo twice (\\ (x) (step (step x))))"));
+    mu_assert("Memoized caller should use the loaded function", eval_num(e, "(twice 1)") == 3);
+    
+    write_source("(def step (\\ (x) (+ x 10)))\n");
+    lval_free(eval_string(e, "(reload '" RELOAD_PATH ")"));
+    mu_assert("Memoized caller should not answer from a stale cache", eval_num(e, "(twice 1)") == 21);
+    
+    Lval *sym = lval_sym("twice");
+    Lval *f = lenv_get(e, sym);
+    mu_assert("Caller should stay memoized", f->type == LVAL_LAMBDA && f->lambda.closure->memo != NULL);
+    lval_free(f);
+    lval_free(sym);
+    
+    lenv_free(e);
+    remove(RELOAD_PATH);
+    return 0;
+}
+
+// Test unreadable files, parse errors and failing definitions
+static char *test_reload_errors() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *result = eval_string(e, "(reload '/nonexistent/file.lisp)");
+    mu_assert("Missing file should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    write_source("(def a 1)\n(def b (+ a 1)\n");
+    result = eval_string(e, "(reload '" RELOAD_PATH ")");
+    mu_assert("Unclosed form should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    write_source("(def a 1)\n(def b (head ()))\n(def c 3)\n");
+    result = eval_string(e, "(reload '" RELOAD_PATH ")");
+    mu_assert("Failing definition should return its error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    write_source("(def a 1)\n(def b 2)\n(def c 3)\n");
+    result = eval_string(e, "(reload '" RELOAD_PATH ")");
+    mu_assert("Fixed file should retry what was not reached",
+              lists_sym(result, "b") && lists_sym(result, "c") && !lists_sym(result, "a"));
+    lval_free(result);
+    
+    lenv_free(e);
+    remove(RELOAD_PATH);
+    return 0;
+}
+
+// Test files may hold symbols longer than any fixed read buffer
+static char *test_reload_long_symbol() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    char name[401];
+    memset(name, 'x', 400);
+    name[400] = '\0';
+    char source[1024];
+    snprintf(source, sizeof(source), "(def %s 7)\n(def y (+ %s 1))\n", name, name);
+    write_source(source);
+    
+    Lval *result = eval_string(e, "(reload '" RELOAD_PATH ")");
+    mu_assert("Long symbol should reload", result->type == LVAL_SEXPR && lists_sym(result, name));
+    lval_free(result);
+    mu_assert("Long symbol should be bound under its full name", eval_num(e, name) == 7);
+    mu_assert("Long symbol should be read where used", eval_num(e, "y") == 8);
+    
+    lenv_free(e);
+    remove(RELOAD_PATH);
+    return 0;
+}
+
+// Run all reload tests
+char *reload_tests() {
+    mu_run_test(test_reload_changes);
+    mu_run_test(test_reload_callers);
+    mu_run_test(test_reload_errors);
+    mu_run_test(test_reload_long_symbol);
+    
+    return 0;
+}
@@ -14,6 +14,29 @@ char *environment_tests();
 char *conditional_tests();
 char *lambda_tests();
 char *macro_tests();
+char *memo_tests();
+char *parallel_tests();
+char *match_tests();
+char *quote_tests();
+char *values_tests();
+char *pipeline_tests();
+char *lazy_tests();
+char *generator_tests();
+char *cell_tests();
+char *reload_tests();
+char *generic_tests();
+char *record_tests();
+char *vector_tests();
+char *pvec_tests();
+char *map_tests();
+char *transient_tests();
+char *sorted_tests();
+char *sort_tests();
+char *bignum_tests();
+char *flonum_tests();
+char *typed_tests();
+char *matrix_tests();
+char *bitset_tests();
 
 int main() {
     char *result;
@@ -88,6 +111,167 @@ int main() {
         return 1;
     }
     
+    printf("Running Memo tests...\n");
+    result = memo_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Parallel tests...\n");
+    result = parallel_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Match tests...\n");
+    result = match_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Quote tests...\n");
+    result = quote_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Values tests...\n");
+    result = values_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Pipeline tests...\n");
+    result = pipeline_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Lazy tests...\n");
+    result = lazy_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Generator tests...\n");
+    result = generator_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Cell tests...\n");
+    result = cell_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Reload tests...\n");
+    result = reload_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Generic tests...\n");
+    result = generic_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Record tests...\n");
+    result = record_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Vector tests...\n");
+    result = vector_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Persistent vector tests...\n");
+    result = pvec_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Map tests...\n");
+    result = map_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Transient tests...\n");
+    result = transient_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Sorted map tests...\n");
+    result = sorted_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Sort tests...\n");
+    result = sort_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Bignum tests...\n");
+    result = bignum_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Float tests...\n");
+    result = flonum_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Typed array tests...\n");
+    result = typed_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Matrix tests...\n");
+    result = matrix_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
+    printf("Running Bitset tests...\n");
+    result = bitset_tests();
+    if (result != 0) {
+        printf("%s\n", result);
+        return 1;
+    }
+    
     printf("ALL TESTS PASSED\n");
     printf("Tests run: %d\n", tests_run);
     return 0;
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "pool.h"
+
+extern int tests_run;
+
+// Test numbers, symbols and mixed keys sort in order
+static char *test_sort_order() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    mu_assert("Numbers should sort ascending", eval_prints(e, "(sort (list 3 -1 2 -7 0))", "(-7 -1 0 2 3)"));
+    mu_assert("Symbols should sort after numbers", eval_prints(e, "(sort (list 'b 2 'a 1))", "(1 2 a b)"));
+    mu_assert("Large numbers should keep their order",
+              eval_prints(e, "(sort (list 4000000000 -4000000000 1))", "(-4000000000 1 4000000000)"));
+    mu_assert("sort-by should order by key",
+              eval_prints(e, "(sort-by (\\ (x) (- 0 x)) (list 1 3 2))", "(3 2 1)"));
+    mu_assert("sort-by should be stable",
+              eval_prints(e, "(sort-by head (list (list 1 'a) (list 0 'b) (list 1 'c) (list 0 'd)))",
+                          "((0 b) (0 d) (1 a) (1 c))"));
+    mu_assert("Empty list should sort to itself", eval_prints(e, "(sort ())", "()"));
+    
+    Lval *result = eval_string(e, "(sort (list 1 (list 2)))");
+    mu_assert("List element should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(sort-by (\\ (x) (/ 1 x)) (list 1 0))");
+    mu_assert("Key function error should propagate", result->type == LVAL_ERR);
+    mu_assert("Key function error should be its own", strstr(result->err, "Division by zero") != NULL);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Sorts n pseudo-random numbers, with a symbol at the end when mixed,
+// and checks the result is ordered
+static int sort_checks(Lenv *e, int n, int mixed) {
+    Lval *call = lval_sexpr();
+    lval_add(call, lval_sym("sort"));
+    Lval *list = lval_sexpr();
+    lval_add(list, lval_sym("quote"));
+    Lval *xs = lval_sexpr();
+    unsigned long seed = 12345;
+    for (int i = 0; i < n; i++) {
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        lval_add(xs, lval_num((long)(seed >> 33) - (1L << 30)));
+    }
+    if (mixed) lval_add(xs, lval_sym("end"));
+    lval_add(list, xs);
+    lval_add(call, list);
+    
+    Lval *result = eval(e, call);
+    int ok = result->type == LVAL_SEXPR && result->sexpr.count == n + mixed;
+    for (int i = 1; ok && i < n; i++) {
+        ok = result->sexpr.cell[i - 1]->num <= result->sexpr.cell[i]->num;
+    }
+    if (ok && mixed) ok = result->sexpr.cell[n]->type == LVAL_SYM;
+    lval_free(result);
+    return ok;
+}
+
+// Test the radix path and the pooled merge path on large inputs
+static char *test_sort_large() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    mu_assert("Radix sort should order numbers", sort_checks(e, 100000, 0));
+    
+    eval_set_parallel(4, 256);
+    long before = pool_tasks_run();
+    mu_assert("Parallel merge sort should order mixed keys", sort_checks(e, 100000, 1));
+    mu_assert("Parallel merge sort should use the pool", pool_tasks_run() > before);
+    eval_set_parallel(0, 256);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all sort tests
+char *sort_tests() {
+    mu_run_test(test_sort_order);
+    mu_run_test(test_sort_large);
+    
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+
+extern int tests_run;
+
+// Test ordered lookups, ends and ranges
+static char *test_sorted_order() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def m (sorted-map 3 'c 1 'a 2 'b 'z 26 'y 25))"));
+    mu_assert("Keys should be in order, numbers first", eval_prints(e, "(keys m)", "(1 2 3 y z)"));
+    mu_assert("Map should print in order", eval_prints(e, "(sorted-map 2 20 1 10)", "{1 10 2 20}"));
+    mu_assert("first should return the smallest pair", eval_prints(e, "(first m)", "(1 a)"));
+    mu_assert("last should return the largest pair", eval_prints(e, "(last m)", "(z 26)"));
+    mu_assert("subrange should be half open", eval_prints(e, "(subrange m 2 'y)", "((2 b) (3 c))"));
+    mu_assert("get should find a symbol key", eval_num(e, "(get m 'y)") == 25);
+    mu_assert("get should return the default for an absent key", eval_num(e, "(get m 9 0)") == 0);
+    mu_assert("contains? should miss an absent key", eval_num(e, "(contains? m 9)") == 0);
+    mu_assert("put should replace a value", eval_prints(e, "(get (put m 1 'x) 1)", "x"));
+    mu_assert("put should keep the old version", eval_prints(e, "(get m 1)", "a"));
+    mu_assert("len should count entries", eval_num(e, "(len (put m 4 'd))") == 6);
+    
+    Lval *result = eval_string(e, "(put m (list 1) 2)");
+    mu_assert("List key should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(get m 9)");
+    mu_assert("Missing key should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(first (list 1 2))");
+    mu_assert("first of a list should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test a map deep enough to split nodes several times
+static char *test_sorted_large() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def m (sorted-map 0 0))"));
+    for (int i = 1; i < 3000; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "(def m (put m %d %d))", (i * 7919) % 3000, i);
+        lval_free(eval_string(e, buf));
+    }
+    mu_assert("Every key should be counted", eval_num(e, "(len m)") == 3000);
+    mu_assert("first should be the smallest key", eval_num(e, "(head (first m))") == 0);
+    mu_assert("last should be the largest key", eval_num(e, "(head (last m))") == 2999);
+    mu_assert("subrange should count its keys", eval_num(e, "(len (subrange m 1000 1500))") == 500);
+    mu_assert("subrange should start at its lower bound",
+              eval_num(e, "(head (head (subrange m 1000 1500)))") == 1000);
+    
+    Lval *a = eval_string(e, "(sorted-map 1 1 2 2)");
+    Lval *b = eval_string(e, "(put (sorted-map 2 2) 1 1)");
+    mu_assert("Maps with equal entries should be equal", lval_eq(a, b));
+    mu_assert("Equal maps should hash equally", lval_hash(a) == lval_hash(b));
+    lval_free(a);
+    lval_free(b);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all sorted map tests
+char *sorted_tests() {
+    mu_run_test(test_sorted_order);
+    mu_run_test(test_sorted_large);
+    
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+
+extern int tests_run;
+
+// Test a list builder appends in place and freezes into a list
+static char *test_transient_list() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def t (transient (list 1 2)))"));
+    for (int i = 3; i <= 500; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "(push! t %d)", i);
+        lval_free(eval_string(e, buf));
+    }
+    mu_assert("Builder should print its size", eval_prints(e, "t", "<transient list 500>"));
+    
+    Lval *result = eval_string(e, "(persistent! t)");
+    mu_assert("persistent! should return a list", result->type == LVAL_SEXPR && result->sexpr.count == 500);
+    mu_assert("Pushed items should keep their order",
+              result->sexpr.cell[0]->num == 1 && result->sexpr.cell[499]->num == 500);
+    lval_free(result);
+    
+    result = eval_string(e, "(push! t 1)");
+    mu_assert("Using a retired builder should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(persistent! t)");
+    mu_assert("Freezing twice should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    mu_assert("Pushing several items should append them all",
+              eval_prints(e, "(persistent! (push! (transient ()) 1 2 3))", "(1 2 3)"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test a map builder leaves the map it started from unchanged
+static char *test_transient_map() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def m (hash-map 'a 1))"));
+    lval_free(eval_string(e, "(def t (transient m))"));
+    for (int i = 0; i < 300; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "(assoc! t %d %d)", i, i * 2);
+        lval_free(eval_string(e, buf));
+    }
+    lval_free(eval_string(e, "(assoc! t 'a 5)"));
+    lval_free(eval_string(e, "(def n (persistent! t))"));
+    mu_assert("Built map should hold every key", eval_num(e, "(len n)") == 301);
+    mu_assert("Built map should hold the last value", eval_num(e, "(get n 'a)") == 5);
+    mu_assert("Built map should find deep keys", eval_num(e, "(get n 299)") == 598);
+    mu_assert("Original map should be unchanged", eval_num(e, "(len m)") == 1 && eval_num(e, "(get m 'a)") == 1);
+    
+    Lval *result = eval_string(e, "(push! (transient m) 1)");
+    mu_assert("push! on a map builder should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(assoc! (transient m) 1)");
+    mu_assert("assoc! without a value should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(transient 5)");
+    mu_assert("transient of a number should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all transient tests
+char *transient_tests() {
+    mu_run_test(test_transient_list);
+    mu_run_test(test_transient_map);
+    
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "typed.h"
+
+extern int tests_run;
+
+// Test building typed arrays and reading them back
+static char *test_typed_construction() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    mu_assert("f64vector should widen fixnums", eval_prints(e, "(f64vector 1 2.5 3)", "#f64(1.0 2.5 3.0)"));
+    mu_assert("i64vector should take a list", eval_prints(e, "(i64vector (list 1 -2 3))", "#i64(1 -2 3)"));
+    mu_assert("i64vector should refuse floats",
+              eval_prints(e, "(i64vector 1 2.5)", "Error: Function 'i64vector' passed a value that is not a fixnum!"));
+    mu_assert("nth should read an element", eval_prints(e, "(nth (f64vector 1 2.5) 1)", "2.5"));
+    mu_assert("len should count elements", eval_prints(e, "(len (i64vector (take 300 (range 0 300))))", "300"));
+    mu_assert("to-list should box elements", eval_prints(e, "(to-list (i64vector 4 5))", "(4 5)"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test the bulk builtins give the same answers at every SIMD level
+static char *test_typed_kernels() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    int level = typed_simd_level();
+    
+    Lval *r = eval_string(e, "(def x (vmul (f64vector (take 1001 (range 0 1001))) (/ 1 7.0)))");
+    lval_free(r);
+    r = eval_string(e, "(def n (i64vector (take 1001 (range -500 501))))");
+    lval_free(r);
+    
+    char *expected[6] = {0};
+    char *exprs[6] = {"(vsum x)", "(vdot x x)", "(vsum (vmul (vadd x 1) 2))",
+                      "(list (vmin x) (vmax x))", "(vdot n (vadd n 3))", "(list (vmin n) (vmax n) (vsum n))"};
+    for (int l = TYPED_SCALAR; l <= level; l++) {
+        typed_set_simd_level(l);
+        for (int i = 0; i < 6; i++) {
+            Lval *v = eval_string(e, exprs[i]);
+            char *str = lval_to_string(v);
+            lval_free(v);
+            if (expected[i] == NULL) {
+                expected[i] = str;
+                continue;
+            }
+            int same = strcmp(str, expected[i]) == 0;
+            free(str);
+            mu_assert("Every SIMD level should give the same result", same);
+        }
+    }
+    typed_set_simd_level(level);
+    for (int i = 0; i < 6; i++) {
+        free(expected[i]);
+    }
+    
+    mu_assert("Exact i64 sums should match", eval_prints(e, "(vsum n)", "0"));
+    mu_assert("vadd should add elementwise", eval_prints(e, "(vadd (i64vector 1 2) (i64vector 10 20))", "#i64(11 22)"));
+    mu_assert("vmul should broadcast a number", eval_prints(e, "(vmul (f64vector 1 2) 0.5)", "#f64(0.5 1.0)"));
+    mu_assert("Broadcasting a float into an i64 array should be an error",
+              eval_prints(e, "(vmul (i64vector 1 2) 0.5)", "Error: Function 'vmul' passed incorrect type!"));
+    mu_assert("Mismatched lengths should be an error",
+              eval_prints(e, "(vadd (i64vector 1 2) (i64vector 1))",
+                          "Error: Function 'vadd' passed vectors of different kinds or lengths!"));
+    mu_assert("i64 overflow should be an error",
+              eval_prints(e, "(vadd (i64vector 9223372036854775807) 1)",
+                          "Error: Function 'vadd' passed values whose result overflows an i64!"));
+    mu_assert("Overflowing i64 sums should promote to bignums",
+              eval_prints(e, "(vsum (i64vector 9223372036854775807 9223372036854775807))",
+                          "18446744073709551614"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test vmap fuses arithmetic bodies and calls anything else
+static char *test_typed_vmap() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *r = eval_string(e, "(def k 3)");
+    lval_free(r);
+    
+    mu_assert("Fused vmap should evaluate arithmetic",
+              eval_prints(e, "(vmap (\\ (x) (+ (* x x) 1)) (f64vector 1 2.5 3))", "#f64(2.0 7.25 10.0)"));
+    mu_assert("Fused vmap should see captured constants",
+              eval_prints(e, "(vmap (\\ (x) (- x k)) (i64vector 1 5))", "#i64(-2 2)"));
+    mu_assert("Other bodies should be called per element",
+              eval_prints(e, "(vmap (\\ (x) (if (> x 2) x 0)) (i64vector 1 5))", "#i64(0 5)"));
+    mu_assert("Fixnum results should convert into an f64 array",
+              eval_prints(e, "(vmap (\\ (x) (if (> x 2) 1 0)) (f64vector 1 5))", "#f64(0.0 1.0)"));
+    mu_assert("Overflow should fall back to calls that report the bignum",
+              eval_prints(e, "(vmap (\\ (x) (* x x)) (i64vector 4294967296))",
+                          "Error: Function 'vmap' passed a function that returned a non-fixnum!"));
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test lists of large arrays print past the size of one array's output
+static char *test_typed_print_nested() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *r = eval_string(e, "(list (i64vector (take 300 (range 0 300))) (i64vector (take 300 (range 0 300))) 7)");
+    char *str = lval_to_string(r);
+    char *second = strstr(str + 2, "#i64(");
+    mu_assert("List should hold both arrays", strncmp(str, "(#i64(0 1 2", 11) == 0 && second != NULL);
+    mu_assert("Second array should follow the first's output", strstr(second + 1, "#i64(") == NULL && second - str > 1000);
+    mu_assert("List should end with its last item", strcmp(str + strlen(str) - 3, " 7)") == 0);
+    free(str);
+    lval_free(r);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all typed array tests
+char *typed_tests() {
+    mu_run_test(test_typed_construction);
+    mu_run_test(test_typed_kernels);
+    mu_run_test(test_typed_vmap);
+    mu_run_test(test_typed_print_nested);
+    
+    return 0;
+}
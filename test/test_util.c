@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "test_util.h"
+#include "eval.h"
+#include "parser.h"
+#include "repl.h"
+
+Lval *read_string(const char *input) {
+    AstNode *node = parse_string(input);
+    Lval *v = ast_to_lval(node);
+    ast_free(node);
+    return v;
+}
+
+Lval *eval_string(Lenv *e, const char *input) {
+    return eval(e, read_string(input));
+}
+
+// Whether input evaluates to a value printing as expected
+int eval_prints(Lenv *e, const char *input, const char *expected) {
+    Lval *v = eval_string(e, input);
+    char *str = lval_to_string(v);
+    int same = strcmp(str, expected) == 0;
+    free(str);
+    lval_free(v);
+    return same;
+}
+
+// The number input evaluates to, or -1 for anything else
+long eval_num(Lenv *e, const char *input) {
+    Lval *v = eval_string(e, input);
+    long n = v->type == LVAL_NUM ? v->num : -1;
+    lval_free(v);
+    return n;
+}
+
+// The reader cannot read the lambda symbol, so tests spell it "fn"
+static void fn_to_lambda(Lval *x) {
+    if (x->type == LVAL_SYM && strcmp(x->sym, "fn") == 0) {
+        x->sym[0] = '\\';
+        x->sym[1] = '\0';
+    }
+    if (x->type == LVAL_SEXPR) {
+        for (int i = 0; i < x->sexpr.count; i++) fn_to_lambda(x->sexpr.cell[i]);
+    }
+}
+
+// Defines name as the lambda read from "(fn formals body)"
+void def_lambda(Lenv *e, char *name, const char *input) {
+    Lval *lambda = read_string(input);
+    fn_to_lambda(lambda);
+    
+    Lval *def_expr = lval_sexpr();
+    lval_add(def_expr, lval_sym("def"));
+    lval_add(def_expr, lval_sym(name));
+    lval_add(def_expr, lambda);
+    lval_free(eval(e, def_expr));
+}
+
+// Whether v is a list of exactly the given numbers
+int list_is(Lval *v, long *items, int count) {
+    if (v->type != LVAL_SEXPR || v->sexpr.count != count) return 0;
+    for (int i = 0; i < count; i++) {
+        if (v->sexpr.cell[i]->type != LVAL_NUM || v->sexpr.cell[i]->num != items[i]) return 0;
+    }
+    return 1;
+}
+
+// Bytes currently allocated on the heap, for checking a loop does not leak.
+// Sanitizer allocators report nothing here, which leaves those checks moot.
+long heap_in_use(void) {
+    return (long)mallinfo2().uordblks;
+}
@@ -0,0 +1,16 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include "lval.h"
+#include "env.h"
+
+// Helpers shared by the test files for running source text
+Lval *read_string(const char *input);
+Lval *eval_string(Lenv *e, const char *input);
+int eval_prints(Lenv *e, const char *input, const char *expected);
+long eval_num(Lenv *e, const char *input);
+void def_lambda(Lenv *e, char *name, const char *input);
+int list_is(Lval *v, long *items, int count);
+long heap_in_use(void);
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+#include "values.h"
+
+extern int tests_run;
+
+// Reads "(fn ...)" and evaluates it as the lambda "(\ ...)"
+static Lval *eval_lambda(Lenv *e, const char *input) {
+    Lval *lambda = read_string(input);
+    lval_free(lambda->sexpr.cell[0]);
+    lambda->sexpr.cell[0] = lval_sym("\\");
+    return eval(e, lambda);
+}
+
+// Test a single-value context takes the first value
+static char *test_values_single() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *result = eval_string(e, "(values 1 2)");
+    mu_assert("values should return its first value", result->type == LVAL_NUM && result->num == 1);
+    lval_free(result);
+    
+    result = eval_string(e, "(+ (values 1 2) 10)");
+    mu_assert("Argument position should use the first value", result->type == LVAL_NUM && result->num == 11);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test let-values binds every value in order
+static char *test_values_let() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *result = eval_string(e, "(let-values ((q r) (values (/ 17 5) (% 17 5))) (list r q))");
+    mu_assert("let-values should return list", result->type == LVAL_SEXPR && result->sexpr.count == 2);
+    mu_assert("let-values should bind by position", result->sexpr.cell[0]->num == 2 && result->sexpr.cell[1]->num == 3);
+    lval_free(result);
+    
+    result = eval_string(e, "(let-values ((a b c) (if 1 (values 1 2 3) 0)) (+ a b c))");
+    mu_assert("Values should pass through if", result->type == LVAL_NUM && result->num == 6);
+    lval_free(result);
+    
+    result = eval_string(e, "(let-values ((a) 5) a)");
+    mu_assert("A plain value should count as one value", result->type == LVAL_NUM && result->num == 5);
+    lval_free(result);
+    
+    result = eval_string(e, "(let-values ((a b) 5) a)");
+    mu_assert("Too few values should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    // The inner call's extra value was consumed by list
+    result = eval_string(e, "(let-values ((a b) (list (values 1 2))) a)");
+    mu_assert("Consumed values should not leak into let-values", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    result = eval_string(e, "(let-values ((a b) (match (values 1 2) (_ 5))) a)");
+    mu_assert("A value made after the first was freed should count as one", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    // New values may reuse the freed first value's address
+    result = eval_string(e, "(values 1 2)");
+    mu_assert("values should park its extra value", values_count(result) == 2);
+    lval_free(result);
+    Lval *fresh[64];
+    int counted = 1;
+    for (int i = 0; i < 64; i++) {
+        fresh[i] = lval_num(i);
+        if (values_count(fresh[i]) != 1) counted = 0;
+    }
+    for (int i = 0; i < 64; i++) lval_free(fresh[i]);
+    mu_assert("Freeing the first value should drop the rest", counted);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test values returned through a lambda call
+static char *test_values_lambda() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    Lval *minmax = eval_lambda(e, "(fn (a b) (if (< a b) (values a b) (values b a)))");
+    mu_assert("values should be a pure builtin", minmax->type == LVAL_LAMBDA && minmax->lambda.closure->pure);
+    
+    Lval *call = lval_sexpr();
+    lval_add(call, lval_sym("let-values"));
+    lval_add(call, lval_sexpr());
+    lval_add(call->sexpr.cell[1], read_string("(lo hi)"));
+    lval_add(call->sexpr.cell[1], lval_sexpr());
+    lval_add(call->sexpr.cell[1]->sexpr.cell[1], minmax);
+    lval_add(call->sexpr.cell[1]->sexpr.cell[1], lval_num(9));
+    lval_add(call->sexpr.cell[1]->sexpr.cell[1], lval_num(4));
+    lval_add(call, read_string("(- hi lo)"));
+    
+    Lval *result = eval(e, call);
+    mu_assert("Lambda should return both values", result->type == LVAL_NUM && result->num == 5);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all values tests
+char *values_tests() {
+    mu_run_test(test_values_single);
+    mu_run_test(test_values_let);
+    mu_run_test(test_values_lambda);
+    
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "lval.h"
+#include "eval.h"
+#include "env.h"
+
+extern int tests_run;
+
+// Test indexing, length and bounds on vectors and lists
+static char *test_vector_indexing() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def v (vector 10 20 30 40))"));
+    mu_assert("nth should index a vector", eval_num(e, "(nth v 2)") == 30);
+    mu_assert("len should count a vector", eval_num(e, "(len v)") == 4);
+    mu_assert("nth should index a list", eval_num(e, "(nth (list 5 6 7) 1)") == 6);
+    mu_assert("len should count a list", eval_num(e, "(len (list 5 6 7))") == 3);
+    mu_assert("head should read a vector", eval_num(e, "(head v)") == 10);
+    mu_assert("Vector should print in brackets", eval_prints(e, "v", "[10 20 30 40]"));
+    
+    Lval *result = eval_string(e, "(nth v 4)");
+    mu_assert("Index past the end should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(nth v -1)");
+    mu_assert("Negative index should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(len 3)");
+    mu_assert("len of a number should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test slices and tails are views sharing the parent's storage
+static char *test_vector_views() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def v (vector 1 2 3 4 5))"));
+    lval_free(eval_string(e, "(def s (slice v 1 4))"));
+    mu_assert("Slice should have its own length", eval_num(e, "(len s)") == 3);
+    mu_assert("Slice should index from its start", eval_num(e, "(nth s 0)") == 2);
+    mu_assert("Tail should be a shorter view", eval_prints(e, "(tail (tail v))", "[3 4 5]"));
+    mu_assert("Slice of a slice should compose", eval_prints(e, "(slice s 1 3)", "[3 4]"));
+    mu_assert("Slice of a list should copy", eval_prints(e, "(slice (list 1 2 3) 0 2)", "(1 2)"));
+    
+    lval_free(eval_string(e, "(vector-set! s 0 20)"));
+    mu_assert("Write through a slice should reach the parent", eval_num(e, "(nth v 1)") == 20);
+    lval_free(eval_string(e, "(vector-set! v 3 40)"));
+    mu_assert("Write to the parent should reach the slice", eval_num(e, "(nth s 2)") == 40);
+    
+    Lval *result = eval_string(e, "(slice v 3 2)");
+    mu_assert("Reversed range should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(vector-push! s 9)");
+    mu_assert("Pushing onto a slice should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    result = eval_string(e, "(vector-set! v 0 v)");
+    mu_assert("Storing a vector in itself should return error", result->type == LVAL_ERR);
+    lval_free(result);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Test pushes grow the vector in place
+static char *test_vector_push() {
+    Lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    
+    lval_free(eval_string(e, "(def v (make-vector 0 0))"));
+    for (int i = 0; i < 1000; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "(vector-push! v %d)", i);
+        lval_free(eval_string(e, buf));
+    }
+    mu_assert("Pushes should be seen through the binding", eval_num(e, "(len v)") == 1000);
+    mu_assert("Pushed items should keep their order", eval_num(e, "(nth v 999)") == 999);
+    mu_assert("make-vector should fill", eval_prints(e, "(make-vector 3 (list 1))", "[(1) (1) (1)]"));
+    
+    Lval *a = eval_string(e, "(vector 1 (list 2))");
+    Lval *b = eval_string(e, "(slice (vector 0 1 (list 2)) 1 3)");
+    mu_assert("Vectors with equal items should be equal", lval_eq(a, b));
+    mu_assert("Equal vectors should hash equally", lval_hash(a) == lval_hash(b));
+    lval_free(a);
+    lval_free(b);
+    
+    lenv_free(e);
+    return 0;
+}
+
+// Run all vector tests
+char *vector_tests() {
+    mu_run_test(test_vector_indexing);
+    mu_run_test(test_vector_views);
+    mu_run_test(test_vector_push);
+    
+    return 0;
+}